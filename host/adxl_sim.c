@@ -0,0 +1,330 @@
+/**
+ * @file adxl_sim.c
+ * @brief ADXL345 model behind the SPI functions for the host build
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Takes the place of spi.c. Each call is one SPI transaction with the
+ * part, decoded to register reads and writes on the model:
+ *   - data registers hold the last sample, taken at the BW_RATE output
+ *     rate, in the range and resolution set in DATA_FORMAT
+ *   - the FIFO collects those samples in FIFO, stream and trigger modes,
+ *     and reading the data registers pops the oldest
+ *   - shocks over THRESH_TAP on an axis in TAP_AXES latch a single tap,
+ *     cleared by reading INT_SOURCE
+ *   - INT_ENABLE, INT_MAP and the INT_INVERT bit drive the two lines
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "adxl345.h"
+#include "sim.h"
+#include "spi.h"
+
+#define ADXL_SIM_DEVID (0xE5)
+#define ADXL_SIM_FIFO_LEN (32)
+#define ADXL_SIM_TAP_MG (62.5f) /* THRESH_TAP scale */
+#define ADXL_SIM_DUR_US (625) /* DUR scale */
+
+#define ADXL_POWER_CTL_MEASURE (1 << 3)
+#define ADXL_DATA_FORMAT_INT_INVERT (1 << 5)
+#define ADXL_DATA_FORMAT_FULL_RES (1 << 3)
+#define ADXL_DATA_FORMAT_RANGE_MASK (0x03)
+#define ADXL_FIFO_CTL_MODE_OFS (6)
+#define ADXL_FIFO_CTL_SAMPLES_MASK (0x1F)
+#define ADXL_FIFO_MODE_BYPASS (0)
+#define ADXL_FIFO_MODE_FIFO (1)
+#define ADXL_TAP_AXES_Z (1 << 0)
+
+/* interrupts that stay set until INT_SOURCE is read */
+#define ADXL_SIM_LATCHED (ADXL_INT_SINGLE_TAP | ADXL_INT_DOUBLE_TAP | ADXL_INT_ACTIVITY | \
+                          ADXL_INT_INACTIVITY | ADXL_INT_FREE_FALL)
+
+typedef struct
+{
+  int16_t axis[3];
+} sample_t;
+
+static pthread_mutex_t adxl_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t regs[ADXL_FIFO_STATUS + 1];
+static float accel[3]; /* steady, in g */
+static float shock_g;
+static uint32_t shock_left_us;
+static uint32_t sample_us; /* since the last sample */
+static sample_t latest;
+static sample_t fifo[ADXL_SIM_FIFO_LEN];
+static uint8_t fifo_head;
+static uint8_t fifo_count;
+static uint8_t int_source; /* latched, data ready and overrun */
+
+/* acceleration in counts for the current DATA_FORMAT */
+static int16_t adxl_sim_counts(float g)
+{
+  uint8_t range = regs[ADXL_DATA_FORMAT] & ADXL_DATA_FORMAT_RANGE_MASK;
+  int32_t limit = 512, counts;
+
+  /* 10 bits over the range, or 4 mg per count with FULL_RES */
+  if(regs[ADXL_DATA_FORMAT] & ADXL_DATA_FORMAT_FULL_RES)
+  {
+    counts = (int32_t)(g * 256.0f);
+    limit <<= range;
+  }
+  else
+  {
+    counts = (int32_t)(g * (256 >> range));
+  }
+
+  if(counts >= limit) counts = limit - 1;
+  if(counts < -limit) counts = -limit;
+
+  return counts;
+}
+
+static void adxl_sim_sample()
+{
+  uint8_t i;
+  sample_t * slot;
+
+  for(i = 0; i < 3; i++) latest.axis[i] = adxl_sim_counts(accel[i] + ((i == 2) ? shock_g : 0.0f));
+  int_source |= ADXL_INT_DATA_READY;
+
+  if((regs[ADXL_FIFO_CTL] >> ADXL_FIFO_CTL_MODE_OFS) == ADXL_FIFO_MODE_BYPASS) return;
+
+  if(fifo_count == ADXL_SIM_FIFO_LEN)
+  {
+    int_source |= ADXL_INT_OVERRUN;
+
+    /* FIFO mode stops when full, stream and trigger drop the oldest */
+    if((regs[ADXL_FIFO_CTL] >> ADXL_FIFO_CTL_MODE_OFS) == ADXL_FIFO_MODE_FIFO) return;
+    fifo_head = (fifo_head + 1) % ADXL_SIM_FIFO_LEN;
+    fifo_count--;
+  }
+
+  slot = &fifo[(fifo_head + fifo_count) % ADXL_SIM_FIFO_LEN];
+  *slot = latest;
+  fifo_count++;
+}
+
+static uint8_t adxl_sim_int_source()
+{
+  uint8_t source = int_source;
+
+  if((regs[ADXL_FIFO_CTL] >> ADXL_FIFO_CTL_MODE_OFS) != ADXL_FIFO_MODE_BYPASS &&
+     fifo_count >= (regs[ADXL_FIFO_CTL] & ADXL_FIFO_CTL_SAMPLES_MASK))
+  {
+    source |= ADXL_INT_WATERMARK;
+  }
+
+  return source;
+}
+
+/* the data registers show the oldest FIFO entry, or the last sample */
+static uint8_t adxl_sim_read_reg(uint8_t addr)
+{
+  const sample_t * sample = fifo_count ? &fifo[fifo_head] : &latest;
+
+  if(addr >= ADXL_DATAX0 && addr <= ADXL_DATAZ1)
+  {
+    uint16_t value = sample->axis[(addr - ADXL_DATAX0) / 2];
+    return (addr & 1) ? (value >> 8) : value;
+  }
+
+  switch(addr)
+  {
+    case ADXL_INT_SOURCE:
+      return adxl_sim_int_source();
+    case ADXL_FIFO_STATUS:
+      return fifo_count;
+    default:
+      return (addr <= ADXL_FIFO_STATUS) ? regs[addr] : 0;
+  }
+}
+
+/* side effects of a read from first to last */
+static void adxl_sim_after_read(uint8_t first, uint8_t last)
+{
+  if(first <= ADXL_INT_SOURCE && last >= ADXL_INT_SOURCE)
+  {
+    int_source &= ~ADXL_SIM_LATCHED;
+    regs[ADXL_ACT_TAP_STATUS] = 0;
+  }
+
+  if(first <= ADXL_DATAZ1 && last >= ADXL_DATAX0)
+  {
+    int_source &= ~ADXL_INT_DATA_READY;
+    if(fifo_count)
+    {
+      fifo_head = (fifo_head + 1) % ADXL_SIM_FIFO_LEN;
+      fifo_count--;
+      int_source &= ~ADXL_INT_OVERRUN;
+    }
+  }
+}
+
+void adxl_sim_init()
+{
+  pthread_mutex_lock(&adxl_lock);
+
+  memset(regs, 0, sizeof(regs));
+  regs[ADXL_DEVID] = ADXL_SIM_DEVID;
+  regs[ADXL_BW_RATE] = 0x0A; /* 100 Hz */
+
+  accel[0] = 0.0f;
+  accel[1] = 0.0f;
+  accel[2] = -1.0f;
+  shock_g = 0.0f;
+  shock_left_us = 0;
+  sample_us = 0;
+  memset(&latest, 0, sizeof(latest));
+  fifo_head = 0;
+  fifo_count = 0;
+  int_source = 0;
+
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+void adxl_sim_tick(uint32_t us)
+{
+  uint8_t rate;
+  uint32_t period_us;
+
+  pthread_mutex_lock(&adxl_lock);
+
+  if(regs[ADXL_POWER_CTL] & ADXL_POWER_CTL_MEASURE)
+  {
+    /* 3200 Hz at rate code 15, halving with each code below */
+    rate = regs[ADXL_BW_RATE] & 0x0F;
+    period_us = (uint32_t)((1000000ull << (15 - rate)) / 3200);
+
+    for(sample_us += us; sample_us >= period_us; sample_us -= period_us) adxl_sim_sample();
+  }
+
+  if(shock_left_us)
+  {
+    shock_left_us = (shock_left_us > us) ? shock_left_us - us : 0;
+    if(!shock_left_us) shock_g = 0.0f;
+  }
+
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+void adxl_sim_set_accel(float x, float y, float z)
+{
+  pthread_mutex_lock(&adxl_lock);
+  accel[0] = x;
+  accel[1] = y;
+  accel[2] = z;
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+void adxl_sim_shock(float g, uint32_t ms)
+{
+  float mag = (g < 0) ? -g : g;
+
+  pthread_mutex_lock(&adxl_lock);
+
+  shock_g = g;
+  shock_left_us = ms * 1000;
+
+  if(regs[ADXL_POWER_CTL] & ADXL_POWER_CTL_MEASURE)
+  {
+    /* the peak lands in a sample */
+    adxl_sim_sample();
+
+    /* a tap is over the threshold and back within DUR */
+    if(regs[ADXL_THRESH_TAP] && regs[ADXL_DUR] && (regs[ADXL_TAP_AXES] & ADXL_TAP_AXES_Z) &&
+       mag * 1000.0f > regs[ADXL_THRESH_TAP] * ADXL_SIM_TAP_MG &&
+       ms * 1000 < (uint32_t)regs[ADXL_DUR] * ADXL_SIM_DUR_US)
+    {
+      int_source |= ADXL_INT_SINGLE_TAP;
+      regs[ADXL_ACT_TAP_STATUS] = ADXL_TAP_AXES_Z;
+    }
+  }
+
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+uint8_t adxl_sim_int_pins()
+{
+  uint8_t active, pins = 0;
+
+  pthread_mutex_lock(&adxl_lock);
+
+  active = adxl_sim_int_source() & regs[ADXL_INT_ENABLE];
+  if(active & ~regs[ADXL_INT_MAP]) pins |= SIM_ADXL_INT1;
+  if(active & regs[ADXL_INT_MAP]) pins |= SIM_ADXL_INT2;
+  if(regs[ADXL_DATA_FORMAT] & ADXL_DATA_FORMAT_INT_INVERT) pins ^= SIM_ADXL_INT1 | SIM_ADXL_INT2;
+
+  pthread_mutex_unlock(&adxl_lock);
+
+  return pins;
+}
+
+
+/* spi.h */
+
+void spi_init()
+{
+}
+
+void spi_write(uint8_t addr, uint8_t data)
+{
+  addr &= 0x3F;
+
+  pthread_mutex_lock(&adxl_lock);
+
+  switch(addr)
+  {
+    case ADXL_DEVID:
+    case ADXL_ACT_TAP_STATUS:
+    case ADXL_INT_SOURCE:
+    case ADXL_FIFO_STATUS:
+      /* read only */
+      break;
+    case ADXL_FIFO_CTL:
+      /* going through bypass empties the FIFO */
+      if((data >> ADXL_FIFO_CTL_MODE_OFS) == ADXL_FIFO_MODE_BYPASS) fifo_count = 0;
+      regs[addr] = data;
+      break;
+    default:
+      if(addr < ADXL_DATAX0 || addr > ADXL_DATAZ1) regs[addr] = data;
+      break;
+  }
+
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+uint8_t spi_read(uint8_t addr)
+{
+  uint8_t data;
+  spi_read_burst(addr & 0x3F, &data, 1);
+
+  return data;
+}
+
+void spi_read_burst(uint8_t addr, uint8_t * ptr_data, uint8_t len)
+{
+  uint8_t i;
+
+  addr &= 0x3F;
+  if(!len) return;
+
+  pthread_mutex_lock(&adxl_lock);
+
+  for(i = 0; i < len; i++) ptr_data[i] = adxl_sim_read_reg(addr + i);
+  adxl_sim_after_read(addr, addr + len - 1);
+
+  pthread_mutex_unlock(&adxl_lock);
+}
+
+uint16_t spi_read_double(uint8_t addr)
+{
+  uint8_t data[2];
+  spi_read_burst(addr, data, 2);
+
+  return (data[1] << 8) | data[0];
+}
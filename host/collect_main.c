@@ -0,0 +1,730 @@
+/**
+ * @file collect_main.c
+ * @brief Dumps every parcel on a dock at once, using collector.c
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Each port is asked for its status, optionally switched to protocol v3,
+ * and dumped a number of times. With -b the status request and the
+ * first dump go in one PKT_CMD_BATCH, after the switch to v3 if there is
+ * one, saving a round trip per parcel. With -k every dump comes sealed:
+ * ports are offered the device key, which only boards not yet tracking
+ * take, and open an encrypted session before their first dump. Frames are decoded by the collector's
+ * workers; this thread only runs coll_run() and sends the commands the
+ * workers have queued up, or sends again when a port has gone quiet.
+ *
+ * Ports are serial devices or ptys, such as host/pps_host instances
+ * (see scripts/fleet_sim.py for starting many). -s instead makes that
+ * many socket pairs answered by a responder thread here, which sends a
+ * fixed log as fast as the collector takes it, to measure the collector
+ * on its own.
+ *
+ * usage: pps_collect [-w workers] [-3] [-b] [-p] [-k key] [-r rounds] [-t timeout_ms] [-v] port...
+ *        pps_collect [-w workers] [-3] [-b] [-k key] [-r rounds] [-e events] -s ports
+ *
+ * The key is SESSION_KEY_LEN bytes in hex. -k switches to v3 as well, the
+ * board only takes a key over a link with a CRC32 trailer.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aes.h"
+#include "codec.h"
+#include "collector.h"
+#include "packets.h"
+#include "seal.h"
+
+#define COLLECT_MAX_ROUNDS (64)
+#define COLLECT_SWITCH_US (50000) /* the board changes framing after its version answer is out */
+#define COLLECT_ACCESS_CODE (0x8A) /* carrier */
+#define COLLECT_PACKAGE_ID (0xC0DE) /* synthetic ports */
+#define DUMP_PER_PKT ((PKT_MAX_PAYLOAD - sizeof(res_dump_t)) / CODEC_EVENT_LEN)
+#define SYNTH_DUMP_FRAMES ((PACK_MAX_EVENTS + DUMP_PER_PKT - 1) / DUMP_PER_PKT)
+#define SYNTH_WIRE_MAX (COLL_WIRE_MAX * BATCH_MAX_CMDS * SYNTH_DUMP_FRAMES) /* a batch of full dumps */
+
+/*
+ * @brief Where a port is in its session
+ */
+typedef enum
+{
+  COLLECT_STATUS,
+  COLLECT_VERSION,
+  COLLECT_KEY,
+  COLLECT_SESSION,
+  COLLECT_DUMP,
+  COLLECT_DONE,
+  COLLECT_FAILED
+} collect_state_e;
+
+/*
+ * @brief Per port session, shared by the worker and the main thread
+ */
+typedef struct
+{
+  pthread_mutex_t lock;
+  uint8_t state; /* collect_state_e */
+  uint8_t pending; /* send is due at due_us */
+  uint8_t send;
+  uint8_t dirty; /* a frame of this dump was lost */
+  uint8_t last_left; /* frames_left of the last dump frame */
+  uint8_t nonce[SESSION_NONCE_LEN]; /* ours, for the last session asked for */
+  uint64_t due_us;
+  uint64_t sent_us; /* last command, for the timeout */
+  uint64_t start_us; /* first request of this dump */
+  uint32_t round_events;
+  uint32_t events; /* from whole dumps */
+  uint32_t rounds;
+  uint32_t retries;
+  uint32_t naks;
+  uint32_t latency_us[COLLECT_MAX_ROUNDS];
+} collect_port_t;
+
+static coll_engine_t engine;
+static collect_port_t ports[COLL_MAX_PORTS];
+static uint32_t num_ports, rounds = 1, timeout_ms = 2000;
+static uint8_t use_v3, use_batch, use_seal, packed, verbose;
+static uint8_t steps[COLLECT_DONE + 1]; /* the states a port goes through, in order */
+static uint8_t device_key[SESSION_KEY_LEN];
+static aes_ctx_t device_aes;
+
+static int synth_fds[COLL_MAX_PORTS];
+static uint32_t synth_events = 128;
+
+static uint64_t collect_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/* session, on the workers */
+
+/* the state after this one */
+static uint8_t collect_after(uint8_t state)
+{
+  uint32_t i;
+
+  for(i = 0; steps[i] != state; i++);
+
+  return steps[i + 1];
+}
+
+/* the command that moves a port on from this state */
+static uint8_t collect_cmd(uint8_t state)
+{
+  static const uint8_t cmds[] = { PKT_CMD_STATUS, PKT_CMD_VERSION, PKT_CMD_KEY, PKT_CMD_SESSION, PKT_CMD_DUMP };
+
+  return cmds[state];
+}
+
+static void collect_next(collect_port_t * p, uint8_t cmd, uint64_t delay_us)
+{
+  p->pending = 1;
+  p->send = cmd;
+  p->due_us = collect_now_us() + delay_us;
+}
+
+static void collect_dump_frame(collect_port_t * p, const coll_msg_t * msg)
+{
+  /* a gap in the count means a frame went missing */
+  if(p->round_events && msg->res.dump.frames_left != p->last_left - 1) p->dirty = 1;
+  p->last_left = msg->res.dump.frames_left;
+  p->round_events += msg->num_events;
+  if(msg->res.dump.frames_left) return;
+
+  if(p->dirty)
+  {
+    p->retries++;
+    collect_next(p, PKT_CMD_DUMP, 0);
+    return;
+  }
+
+  p->latency_us[p->rounds++] = collect_now_us() - p->start_us;
+  p->events += p->round_events;
+  if(p->rounds == rounds)
+  {
+    p->state = COLLECT_DONE;
+    return;
+  }
+  p->start_us = 0;
+  collect_next(p, PKT_CMD_DUMP, 0);
+}
+
+static void collect_msg(coll_engine_t * eng, uint32_t port, void * ctx, const coll_msg_t * msg)
+{
+  collect_port_t * p = (collect_port_t *)ctx;
+  seal_t seal;
+
+  pthread_mutex_lock(&p->lock);
+
+  if(msg->status != COLL_FRAME_OK)
+  {
+    if(p->state == COLLECT_DUMP) p->dirty = 1;
+  }
+  else if(msg->pkt_type == PKT_RES_NAK && p->state == COLLECT_KEY)
+  {
+    /* tracking, it keeps the key it was given at the depot */
+    p->state = COLLECT_SESSION;
+    collect_next(p, PKT_CMD_SESSION, 0);
+  }
+  else if(msg->pkt_type == PKT_RES_NAK)
+  {
+    p->naks++;
+    collect_next(p, collect_cmd(p->state), 0);
+  }
+  else if(p->state == COLLECT_STATUS && msg->pkt_type == PKT_RES_STATUS)
+  {
+    /* with -b the first dump came in the same batch and follows */
+    p->state = collect_after(COLLECT_STATUS);
+    if(!use_batch) collect_next(p, collect_cmd(p->state), 0);
+  }
+  else if(p->state == COLLECT_VERSION && msg->pkt_type == PKT_RES_VERSION)
+  {
+    coll_set_version(eng, port, msg->res.version.version);
+    p->state = collect_after(COLLECT_VERSION);
+    collect_next(p, collect_cmd(p->state), COLLECT_SWITCH_US);
+  }
+  else if(p->state == COLLECT_KEY && msg->pkt_type == PKT_RES_ACK)
+  {
+    p->state = COLLECT_SESSION;
+    collect_next(p, PKT_CMD_SESSION, 0);
+  }
+  else if(p->state == COLLECT_SESSION && msg->pkt_type == PKT_RES_SESSION)
+  {
+    seal_derive(&seal, &device_aes, p->nonce, msg->res.session.nonce);
+    coll_set_session(eng, port, &seal);
+    p->state = collect_after(COLLECT_SESSION);
+    collect_next(p, collect_cmd(p->state), 0);
+  }
+  else if(p->state == COLLECT_DUMP && (msg->pkt_type == PKT_RES_DUMP || msg->pkt_type == PKT_RES_DUMP_PACKED) &&
+          msg->sealed == use_seal)
+  {
+    collect_dump_frame(p, msg);
+  }
+
+  /* anything arriving keeps the port from timing out */
+  p->sent_us = collect_now_us();
+
+  pthread_mutex_unlock(&p->lock);
+}
+
+
+/* commands, on the main thread */
+
+/* marks a command sent, with the port locked */
+static void collect_sending(collect_port_t * p, uint8_t cmd)
+{
+  /* a fresh nonce each time, even when asking again */
+  if(cmd == PKT_CMD_SESSION && getrandom(p->nonce, SESSION_NONCE_LEN, 0) != SESSION_NONCE_LEN)
+  {
+    p->state = COLLECT_FAILED;
+  }
+  if(cmd == PKT_CMD_DUMP || (cmd == PKT_CMD_STATUS && use_batch))
+  {
+    p->round_events = 0;
+    p->dirty = 0;
+    if(!p->start_us) p->start_us = collect_now_us();
+  }
+  p->sent_us = collect_now_us();
+}
+
+static void collect_send(uint32_t port, uint8_t cmd)
+{
+  cmd_version_t version = { PROTO_VERSION_COBS };
+  cmd_dump_t dump = { COLLECT_ACCESS_CODE, packed ? DUMP_ENC_PACKED : DUMP_ENC_RAW };
+  cmd_key_t key;
+  cmd_session_t session = { COLLECT_ACCESS_CODE };
+  const void * msg = NULL;
+  uint8_t cmds[PKT_MAX_PAYLOAD];
+  cmd_batch_t batch = { 0, 0, cmds };
+  uint32_t len = 0;
+
+  switch(cmd)
+  {
+    case PKT_CMD_VERSION:
+      msg = &version;
+      break;
+    case PKT_CMD_DUMP:
+      msg = &dump;
+      break;
+    case PKT_CMD_KEY:
+      memcpy(key.key, device_key, SESSION_KEY_LEN);
+      msg = &key;
+      break;
+    case PKT_CMD_SESSION:
+      pthread_mutex_lock(&ports[port].lock);
+      memcpy(session.nonce, ports[port].nonce, SESSION_NONCE_LEN);
+      pthread_mutex_unlock(&ports[port].lock);
+      msg = &session;
+      break;
+    default:
+      break;
+  }
+
+  if(cmd == PKT_CMD_STATUS && use_batch)
+  {
+    /* status and the first dump in one round trip */
+    codec_batch_add(PKT_CMD_STATUS, NULL, cmds, sizeof(cmds), &len);
+    codec_batch_add(PKT_CMD_DUMP, &dump, cmds, sizeof(cmds), &len);
+    batch.num_cmds = 2;
+    batch.len = len;
+    cmd = PKT_CMD_BATCH;
+    msg = &batch;
+  }
+
+  if(coll_send(&engine, port, cmd, msg) != COLL_SUCCESS)
+  {
+    pthread_mutex_lock(&ports[port].lock);
+    ports[port].state = COLLECT_FAILED;
+    pthread_mutex_unlock(&ports[port].lock);
+  }
+}
+
+/* sends what is due, returns the number of ports still going */
+static uint32_t collect_poll()
+{
+  uint64_t now = collect_now_us();
+  uint32_t i, active = 0;
+  collect_port_t * p;
+  uint8_t cmd, go, reset;
+
+  for(i = 0; i < num_ports; i++)
+  {
+    p = &ports[i];
+    cmd = 0;
+    go = 0;
+    reset = 0;
+
+    pthread_mutex_lock(&p->lock);
+    if(p->state < COLLECT_DONE)
+    {
+      active++;
+      if(p->pending && now >= p->due_us)
+      {
+        cmd = p->send;
+        go = 1;
+        p->pending = 0;
+      }
+      else if(!p->pending && now > p->sent_us + timeout_ms * 1000ull)
+      {
+        /* gone quiet, start the step again */
+        p->retries++;
+        reset = 1;
+        go = 1;
+        cmd = collect_cmd(p->state);
+      }
+      if(go) collect_sending(p, cmd);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    /* unlocked, a full worker queue waits on the callback, which takes the lock */
+    if(reset) coll_set_version(&engine, i, engine.ports[i].parser.version);
+    if(go) collect_send(i, cmd);
+  }
+
+  return active;
+}
+
+
+/* synthetic ports */
+
+/*
+ * @brief A synthetic board
+ */
+typedef struct
+{
+  coll_parser_t parser;
+  aes_ctx_t key; /* from PKT_CMD_KEY */
+  uint8_t sealed; /* seal holds the session */
+  seal_t seal;
+} synth_port_t;
+
+/* one response, sealed when a session is open, returns its length on the wire */
+static uint32_t synth_frame(synth_port_t * sp, uint8_t pkt_type, const uint8_t * payload, uint32_t len, uint8_t * wire)
+{
+  static uint8_t sealed[SEAL_BUF_LEN] __attribute__((aligned(4)));
+  sg_seg_t seg = { payload, len };
+
+  if(!sp->sealed || !seal_frame(&sp->seal, pkt_type, &seg, 1, sealed, &len))
+  {
+    return coll_wire(sp->parser.version, pkt_type, payload, len, wire);
+  }
+
+  return coll_wire(sp->parser.version, PKT_RES_SEALED, sealed, len, wire);
+}
+
+/* the answer to one command, returns its length on the wire */
+static uint32_t synth_answer(synth_port_t * sp, uint8_t pkt_type, const uint8_t * in, uint8_t in_len,
+                             const uint8_t * events, uint8_t in_batch, uint8_t * wire)
+{
+  coll_parser_t * parser = &sp->parser;
+  uint8_t payload[PKT_MAX_PAYLOAD], version, type, n_in, ack = 0;
+  uint32_t used, len = 0, n, left, frames, i, pos = 0;
+  res_status_t status = { COLLECT_PACKAGE_ID, STATUS_TRACKING, 0, 0, 0, 0 };
+  res_session_t session;
+  res_dump_t hdr;
+  cmd_batch_t batch;
+  const uint8_t * sub;
+
+  switch(pkt_type)
+  {
+    case PKT_CMD_STATUS:
+      codec_encode(PKT_RES_STATUS, &status, payload, sizeof(payload), &n);
+      len = coll_wire(parser->version, PKT_RES_STATUS, payload, n, wire);
+      break;
+    case PKT_CMD_VERSION:
+      if(in_batch || !in_len) break;
+
+      /* answered in the old framing, then switch */
+      version = in[0];
+      if(version > PROTO_VERSION_MAX) version = PROTO_VERSION_MAX;
+      len = coll_wire(parser->version, PKT_RES_VERSION, &version, 1, wire);
+      parser->version = version;
+      break;
+    case PKT_CMD_DUMP:
+      /* raw dumps only, as send_events() splits them */
+      frames = (synth_events + DUMP_PER_PKT - 1) / DUMP_PER_PKT;
+      if(!frames) frames = 1;
+      hdr.package_id = COLLECT_PACKAGE_ID;
+      for(left = synth_events, i = 0; frames--; i += n)
+      {
+        n = (left > DUMP_PER_PKT) ? DUMP_PER_PKT : left;
+        left -= n;
+        hdr.num_events = n;
+        hdr.frames_left = frames;
+        codec_encode(PKT_RES_DUMP, &hdr, payload, sizeof(payload), &used);
+        memcpy(payload + used, events + i * CODEC_EVENT_LEN, n * CODEC_EVENT_LEN);
+        len += synth_frame(sp, PKT_RES_DUMP, payload, used + n * CODEC_EVENT_LEN, wire + len);
+      }
+      break;
+    case PKT_CMD_KEY:
+      /* taken while tracking, unlike a board */
+      if(in_len != SESSION_KEY_LEN) break;
+      aes_init(&sp->key, in);
+      sp->sealed = 0;
+      ack = 1;
+      break;
+    case PKT_CMD_SESSION:
+      sp->sealed = 0;
+      ack = (in_len == 1);
+      if(ack || in_len != 1 + SESSION_NONCE_LEN || getrandom(session.nonce, SESSION_NONCE_LEN, 0) != SESSION_NONCE_LEN) break;
+
+      seal_derive(&sp->seal, &sp->key, in + 1, session.nonce);
+      codec_encode(PKT_RES_SESSION, &session, payload, sizeof(payload), &n);
+      len = coll_wire(parser->version, PKT_RES_SESSION, payload, n, wire);
+      sp->sealed = 1;
+      break;
+    case PKT_CMD_BATCH:
+      /* back to back, as the board does */
+      if(in_batch || codec_batch_parse(in, in_len, &batch) != CODEC_SUCCESS) break;
+      while(codec_batch_next(&batch, &pos, &type, &sub, &n_in))
+      {
+        len += synth_answer(sp, type, sub, n_in, events, 1, wire + len);
+      }
+      if(!batch.num_cmds) len = coll_wire(parser->version, PKT_RES_ACK, payload, 0, wire);
+      return len;
+    default:
+      break;
+  }
+
+  if(!len) len = coll_wire(parser->version, ack ? PKT_RES_ACK : PKT_RES_NAK, payload, 0, wire);
+
+  return len;
+}
+
+/* answers the commands on one socket, returns 0 once it closes */
+static uint8_t synth_serve(int fd, synth_port_t * sp, const uint8_t * events)
+{
+  coll_parser_t * parser = &sp->parser;
+  static uint8_t wire[SYNTH_WIRE_MAX];
+  uint8_t in[COLL_CHUNK_LEN];
+  uint32_t pos = 0, used, len, sent;
+  ssize_t got = read(fd, in, sizeof(in));
+
+  if(got <= 0) return 0;
+
+  while(pos < (uint32_t)got)
+  {
+    if(coll_parser_feed(parser, in + pos, got - pos, &used) != COLL_FRAME_OK)
+    {
+      pos += used;
+      continue;
+    }
+    pos += used;
+
+    len = synth_answer(sp, parser->frame[0], parser->frame + CODEC_HDR_LEN, parser->frame[1], events, 0, wire);
+    for(sent = 0; sent < len; sent += got)
+    {
+      got = write(fd, wire + sent, len - sent);
+      if(got <= 0) return 0;
+    }
+    got = 0;
+  }
+
+  return 1;
+}
+
+static void * synth_thread(void * arg)
+{
+  static synth_port_t sports[COLL_MAX_PORTS];
+  static uint8_t events[PACK_MAX_EVENTS * CODEC_EVENT_LEN];
+  struct epoll_event evs[64];
+  event_t event;
+  uint32_t i, open = num_ports;
+  int epfd = epoll_create1(0), n;
+
+  /* a plausible log, the same on every port */
+  memset(&event, 0, sizeof(event));
+  event.time.year = 2018;
+  event.time.month = 5;
+  event.time.day = 12;
+  for(i = 0; i < PACK_MAX_EVENTS; i++)
+  {
+    event.event_type = (i % 4 == 3) ? EVENT_FLIP : EVENT_DROP;
+    event.time.hour = i / 60 % 24;
+    event.time.minute = i % 60;
+    event.data = 512 + i * 37 % 4000;
+    codec_encode_event(&event, events + i * CODEC_EVENT_LEN);
+  }
+
+  for(i = 0; i < num_ports; i++)
+  {
+    coll_parser_init(&sports[i].parser, PROTO_VERSION_XOR);
+    evs[0].events = EPOLLIN;
+    evs[0].data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, synth_fds[i], &evs[0]);
+  }
+
+  while(open)
+  {
+    n = epoll_wait(epfd, evs, 64, -1);
+    while(n-- > 0)
+    {
+      i = evs[n].data.u32;
+      if(synth_serve(synth_fds[i], &sports[i], events)) continue;
+      epoll_ctl(epfd, EPOLL_CTL_DEL, synth_fds[i], NULL);
+      open--;
+    }
+  }
+
+  close(epfd);
+  return NULL;
+}
+
+
+/* setup and report */
+
+static int collect_open(const char * path)
+{
+  struct termios tio;
+  int fd = open(path, O_RDWR | O_NOCTTY);
+
+  if(fd < 0) return -1;
+  if(!tcgetattr(fd, &tio))
+  {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B9600);
+    cfsetospeed(&tio, B9600);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  return fd;
+}
+
+static int collect_cmp(const void * a, const void * b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static double collect_pct(const uint32_t * sorted, uint32_t n, uint32_t pct)
+{
+  uint32_t rank = (pct * n + 99) / 100;
+
+  if(!n) return 0;
+  return sorted[rank ? rank - 1 : 0] / 1000.0;
+}
+
+static void collect_report(double elapsed)
+{
+  static uint32_t all[COLL_MAX_PORTS * COLLECT_MAX_ROUNDS];
+  uint32_t i, n = 0, done = 0, retries = 0, naks = 0, bad = 0, frames = 0;
+  uint64_t events = 0, bytes = 0;
+  struct rusage ru;
+  double cpu;
+  collect_port_t * p;
+
+  if(verbose) printf("%-5s %-10s %7s %7s %7s %6s %8s\n", "port", "state", "events", "dumps", "frames", "bad", "retries");
+  for(i = 0; i < num_ports; i++)
+  {
+    p = &ports[i];
+    memcpy(all + n, p->latency_us, p->rounds * sizeof(uint32_t));
+    n += p->rounds;
+    done += p->state == COLLECT_DONE;
+    retries += p->retries;
+    naks += p->naks;
+    events += p->events;
+    bad += engine.ports[i].bad;
+    frames += engine.ports[i].frames;
+    bytes += engine.ports[i].bytes;
+    if(verbose)
+    {
+      printf("%-5u %-10s %7u %7u %7u %6u %8u\n", i, (p->state == COLLECT_DONE) ? "done" :
+             (p->state == COLLECT_FAILED) ? "failed" : "timed out", p->events, p->rounds,
+             engine.ports[i].frames, engine.ports[i].bad, p->retries);
+    }
+  }
+  qsort(all, n, sizeof(uint32_t), collect_cmp);
+
+  getrusage(RUSAGE_SELF, &ru);
+  cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+
+  if(verbose) printf("\n");
+  printf("%u of %u ports done, %u dumps, %llu events, %u frames (%u bad), %.1f KB in %.3f s\n", done, num_ports, n,
+         (unsigned long long)events, frames, bad, bytes / 1024.0, elapsed);
+  printf("%.0f events/s, %.2f MB/s, %.0f ns CPU per event (%.3f s CPU)\n", events / elapsed,
+         bytes / elapsed / 1e6, events ? cpu * 1e9 / events : 0, cpu);
+  printf("dump latency p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n", collect_pct(all, n, 50),
+         collect_pct(all, n, 90), collect_pct(all, n, 99), collect_pct(all, n, 100));
+  printf("retries %u, NAKs %u\n", retries, naks);
+}
+
+int main(int argc, char ** argv)
+{
+  uint32_t workers = 0, synth = 0, i, port, n = 0;
+  uint64_t start;
+  pthread_t responder;
+  int opt, fds[2], fd;
+
+  while((opt = getopt(argc, argv, "w:3bpk:r:t:s:e:v")) != -1)
+  {
+    switch(opt)
+    {
+      case 'w': workers = atoi(optarg); break;
+      case '3': use_v3 = 1; break;
+      case 'b': use_batch = 1; break;
+      case 'p': packed = 1; break;
+      case 'k':
+        for(i = 0; i < SESSION_KEY_LEN && sscanf(optarg + 2 * i, "%2hhx", &device_key[i]) == 1; i++);
+        if(i < SESSION_KEY_LEN || optarg[2 * i])
+        {
+          fprintf(stderr, "%s: the key is %u bytes in hex\n", argv[0], SESSION_KEY_LEN);
+          return 1;
+        }
+        aes_init(&device_aes, device_key);
+        use_seal = 1;
+        use_v3 = 1;
+        break;
+      case 'r': rounds = atoi(optarg); break;
+      case 't': timeout_ms = atoi(optarg); break;
+      case 's': synth = atoi(optarg); break;
+      case 'e': synth_events = atoi(optarg); break;
+      case 'v': verbose = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-w workers] [-3] [-b] [-p] [-k key] [-r rounds] [-t timeout_ms] [-v] port...\n"
+                        "       %s [-w workers] [-3] [-b] [-k key] [-r rounds] [-e events] -s ports\n", argv[0], argv[0]);
+        return 1;
+    }
+  }
+  num_ports = synth ? synth : (uint32_t)(argc - optind);
+  if(!num_ports || num_ports > COLL_MAX_PORTS || !rounds || rounds > COLLECT_MAX_ROUNDS || synth_events > PACK_MAX_EVENTS)
+  {
+    fprintf(stderr, "%s: 1 to %u ports, 1 to %u rounds, at most %u events\n", argv[0], COLL_MAX_PORTS,
+            COLLECT_MAX_ROUNDS, PACK_MAX_EVENTS);
+    return 1;
+  }
+  if(synth && packed)
+  {
+    fprintf(stderr, "%s: synthetic ports only send raw dumps\n", argv[0]);
+    packed = 0;
+  }
+
+  /* with batches the status goes after the other steps, with the first dump */
+  if(!use_batch) steps[n++] = COLLECT_STATUS;
+  if(use_v3) steps[n++] = COLLECT_VERSION;
+  if(use_seal)
+  {
+    steps[n++] = COLLECT_KEY;
+    steps[n++] = COLLECT_SESSION;
+  }
+  if(use_batch) steps[n++] = COLLECT_STATUS;
+  steps[n] = COLLECT_DUMP;
+
+  /* the responder may still be writing when the collector closes its ends */
+  signal(SIGPIPE, SIG_IGN);
+
+  if(coll_init(&engine, workers, collect_msg) != COLL_SUCCESS)
+  {
+    fprintf(stderr, "%s: could not start the collector: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+
+  for(i = 0; i < num_ports; i++)
+  {
+    if(synth)
+    {
+      if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+      {
+        fprintf(stderr, "%s: socketpair: %s\n", argv[0], strerror(errno));
+        return 1;
+      }
+      fd = fds[0];
+      synth_fds[i] = fds[1];
+    }
+    else if((fd = collect_open(argv[optind + i])) < 0)
+    {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind + i], strerror(errno));
+      return 1;
+    }
+
+    pthread_mutex_init(&ports[i].lock, NULL);
+    if(coll_add_port(&engine, fd, &ports[i], &port) != COLL_SUCCESS)
+    {
+      fprintf(stderr, "%s: could not add %u\n", argv[0], i);
+      return 1;
+    }
+    ports[i].state = steps[0];
+    collect_next(&ports[i], collect_cmd(steps[0]), 0);
+  }
+
+  if(synth && pthread_create(&responder, NULL, synth_thread, NULL))
+  {
+    fprintf(stderr, "%s: could not start the responder\n", argv[0]);
+    return 1;
+  }
+
+  start = collect_now_us();
+  while(collect_poll())
+  {
+    if(coll_run(&engine, 1) != COLL_SUCCESS) break;
+
+    /* a port that never answers gives up eventually */
+    if(collect_now_us() - start > (uint64_t)timeout_ms * 1000 * (rounds + 2) * 10) break;
+  }
+
+  coll_stop(&engine);
+  collect_report((collect_now_us() - start) / 1e6);
+  if(synth) pthread_join(responder, NULL);
+
+  return 0;
+}
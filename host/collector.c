@@ -0,0 +1,480 @@
+/**
+ * @file collector.c
+ * @brief Host side collector for many parcels at once
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "collector.h"
+#include "simd.h"
+#include "unpack.h"
+
+#define COLL_EPOLL_EVENTS (64) /* ready ports taken per coll_run() */
+#define COLL_STOP_PORT (0xFFFFFFFF) /* chunk that ends a worker */
+
+
+/* parser */
+
+void coll_parser_init(coll_parser_t * parser, uint8_t version)
+{
+  parser->version = version;
+  parser->discard = 0;
+  parser->done = 0;
+  parser->len = 0;
+  codec_cobs_init(&parser->cobs);
+}
+
+/* checks a whole frame in the buffer */
+static coll_frame_e coll_parser_check(const coll_parser_t * parser)
+{
+  return simd_frame_ok(parser->version, parser->frame, parser->len) ? COLL_FRAME_OK : COLL_FRAME_BAD;
+}
+
+coll_frame_e coll_parser_feed(coll_parser_t * parser, const uint8_t * data, uint32_t len, uint32_t * used)
+{
+  coll_frame_e result = COLL_FRAME_NONE;
+  uint32_t i = 0, trailer;
+  uint8_t in, out;
+
+  if(parser->done) coll_parser_init(parser, parser->version);
+
+  if(parser->version >= PROTO_VERSION_COBS)
+  {
+    while(i < len)
+    {
+      in = data[i++];
+      if(in != CODEC_COBS_DELIM)
+      {
+        if(parser->discard || !codec_cobs_byte(&parser->cobs, in, &out)) continue;
+        if(parser->len == sizeof(parser->frame)) parser->discard = 1;
+        else parser->frame[parser->len++] = out;
+        continue;
+      }
+
+      /* nothing between two delimiters */
+      if(!parser->len && !parser->discard)
+      {
+        codec_cobs_init(&parser->cobs);
+        continue;
+      }
+
+      result = (!parser->discard && codec_cobs_done(&parser->cobs)) ? coll_parser_check(parser) : COLL_FRAME_BAD;
+      break;
+    }
+  }
+  else
+  {
+    /* v1 and v2 run to the length byte, a bad one is only found by the trailer */
+    trailer = codec_trailer_len(parser->version);
+    while(i < len)
+    {
+      parser->frame[parser->len++] = data[i++];
+      if(parser->len > CODEC_HDR_LEN && parser->len == CODEC_HDR_LEN + parser->frame[1] + trailer)
+      {
+        result = coll_parser_check(parser);
+        break;
+      }
+    }
+  }
+
+  *used = i;
+  if(result != COLL_FRAME_NONE) parser->done = 1;
+
+  return result;
+}
+
+codec_e coll_decode(const coll_parser_t * parser, const seal_t * seal, coll_msg_t * msg)
+{
+  const uint8_t * payload = parser->frame + CODEC_HDR_LEN;
+  uint32_t len = parser->frame[1], i;
+  codec_e status;
+
+  msg->status = COLL_FRAME_OK;
+  msg->pkt_type = parser->frame[0];
+  msg->sealed = 0;
+
+  /* the response inside is decoded as if it came on its own */
+  if(msg->pkt_type == PKT_RES_SEALED && seal)
+  {
+    if(!seal_open(seal, payload, len, &msg->pkt_type, msg->plain, &len)) return CODEC_SHORT;
+    payload = msg->plain;
+    msg->sealed = 1;
+  }
+  msg->pkt_len = len;
+  msg->num_events = 0;
+  msg->payload = payload;
+  memset(&msg->res, 0, sizeof(msg->res));
+
+  status = codec_decode(msg->pkt_type, payload, len, &msg->res);
+  if(status != CODEC_SUCCESS) return status;
+
+  switch(msg->pkt_type)
+  {
+    case PKT_RES_DUMP:
+      if(sizeof(res_dump_t) + msg->res.dump.num_events * CODEC_EVENT_LEN > len) return CODEC_SHORT;
+      for(i = 0; i < msg->res.dump.num_events; i++)
+      {
+        codec_decode_event(payload + sizeof(res_dump_t) + i * CODEC_EVENT_LEN, &msg->events[i]);
+      }
+      break;
+    case PKT_RES_DUMP_PACKED:
+      if(!unpack_events(payload + sizeof(res_dump_t), len - sizeof(res_dump_t), msg->res.dump.num_events,
+                        msg->events))
+      {
+        return CODEC_SHORT;
+      }
+      break;
+    default:
+      return CODEC_SUCCESS;
+  }
+
+  msg->num_events = msg->res.dump.num_events;
+
+  return CODEC_SUCCESS;
+}
+
+
+/* decoding */
+
+/* frames every byte of a chunk and hands each frame to the callback */
+static void coll_process(coll_engine_t * eng, coll_msg_t * msg, const coll_chunk_t * chunk)
+{
+  coll_port_t * port = &eng->ports[chunk->port];
+  uint32_t pos = 0, used;
+  coll_frame_e result;
+
+  if(chunk->version)
+  {
+    coll_parser_init(&port->parser, chunk->version);
+    return;
+  }
+
+  port->bytes += chunk->len;
+  while(pos < chunk->len)
+  {
+    result = coll_parser_feed(&port->parser, chunk->data + pos, chunk->len - pos, &used);
+    pos += used;
+    if(result == COLL_FRAME_NONE) continue;
+
+    if(result == COLL_FRAME_OK && coll_decode(&port->parser, port->sealed ? &port->seal : NULL, msg) == CODEC_SUCCESS)
+    {
+      port->frames++;
+    }
+    else
+    {
+      port->bad++;
+      msg->status = COLL_FRAME_BAD;
+      msg->num_events = 0;
+    }
+    eng->on_msg(eng, chunk->port, port->ctx, msg);
+  }
+}
+
+static void * coll_worker(void * arg)
+{
+  coll_worker_t * worker = (coll_worker_t *)arg;
+  coll_chunk_t * chunk;
+
+  while(1)
+  {
+    pthread_mutex_lock(&worker->lock);
+    while(worker->head == worker->tail) pthread_cond_wait(&worker->not_empty, &worker->lock);
+    chunk = &worker->queue[worker->head % COLL_QUEUE_LEN];
+    pthread_mutex_unlock(&worker->lock);
+
+    if(chunk->port == COLL_STOP_PORT) break;
+    coll_process(worker->eng, &worker->msg, chunk);
+
+    /* the slot is only free once processed */
+    pthread_mutex_lock(&worker->lock);
+    worker->head++;
+    pthread_cond_signal(&worker->not_full);
+    pthread_mutex_unlock(&worker->lock);
+  }
+
+  return NULL;
+}
+
+/* next free slot in a worker queue, waits while the worker is behind */
+static coll_chunk_t * coll_queue_slot(coll_worker_t * worker)
+{
+  coll_chunk_t * chunk;
+
+  pthread_mutex_lock(&worker->lock);
+  while(worker->tail - worker->head == COLL_QUEUE_LEN) pthread_cond_wait(&worker->not_full, &worker->lock);
+  chunk = &worker->queue[worker->tail % COLL_QUEUE_LEN];
+  pthread_mutex_unlock(&worker->lock);
+
+  return chunk;
+}
+
+static void coll_queue_push(coll_worker_t * worker)
+{
+  pthread_mutex_lock(&worker->lock);
+  worker->tail++;
+  pthread_cond_signal(&worker->not_empty);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+
+/* engine */
+
+coll_e coll_init(coll_engine_t * eng, uint32_t num_workers, coll_msg_cb on_msg)
+{
+  coll_worker_t * worker;
+  uint32_t i;
+
+  if(!eng || !on_msg) return COLL_NULL_PTR;
+  if(num_workers > COLL_MAX_WORKERS) num_workers = COLL_MAX_WORKERS;
+
+  eng->epfd = epoll_create1(0);
+  if(eng->epfd < 0) return COLL_SYS_ERR;
+  eng->on_msg = on_msg;
+  eng->num_ports = 0;
+  eng->num_workers = 0;
+
+  for(i = 0; i < num_workers; i++)
+  {
+    worker = &eng->workers[i];
+    worker->eng = eng;
+    worker->head = 0;
+    worker->tail = 0;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->not_empty, NULL);
+    pthread_cond_init(&worker->not_full, NULL);
+    if(pthread_create(&worker->thread, NULL, coll_worker, worker))
+    {
+      coll_stop(eng);
+      return COLL_SYS_ERR;
+    }
+    eng->num_workers++;
+  }
+
+  return COLL_SUCCESS;
+}
+
+coll_e coll_add_port(coll_engine_t * eng, int fd, void * ctx, uint32_t * port)
+{
+  struct epoll_event ev;
+  coll_port_t * p;
+
+  if(!eng || !port) return COLL_NULL_PTR;
+  if(eng->num_ports == COLL_MAX_PORTS) return COLL_FULL;
+
+  p = &eng->ports[eng->num_ports];
+  p->fd = fd;
+  p->ctx = ctx;
+  p->frames = 0;
+  p->bad = 0;
+  p->bytes = 0;
+  p->sealed = 0;
+  coll_parser_init(&p->parser, PROTO_VERSION_XOR);
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  ev.events = EPOLLIN;
+  ev.data.u32 = eng->num_ports;
+  if(epoll_ctl(eng->epfd, EPOLL_CTL_ADD, fd, &ev)) return COLL_SYS_ERR;
+
+  *port = eng->num_ports++;
+
+  return COLL_SUCCESS;
+}
+
+/* COBS encodes a frame between delimiters */
+static uint32_t coll_cobs_encode(const uint8_t * in, uint32_t len, uint8_t * out)
+{
+  uint32_t i, pos = 2, code = 1;
+
+  out[0] = CODEC_COBS_DELIM;
+  for(i = 0; i < len; i++)
+  {
+    if(in[i] == 0)
+    {
+      out[pos - code] = code;
+      code = 1;
+      pos++;
+      continue;
+    }
+    out[pos++] = in[i];
+    if(++code == 0xFF)
+    {
+      out[pos - code] = code;
+      code = 1;
+      pos++;
+    }
+  }
+  out[pos - code] = code;
+  out[pos++] = CODEC_COBS_DELIM;
+
+  return pos;
+}
+
+uint32_t coll_wire(uint8_t version, uint8_t pkt_type, const uint8_t * payload, uint32_t len, uint8_t * out)
+{
+  uint8_t frame[CODEC_FRAME_MAX];
+
+  if(len > PKT_MAX_PAYLOAD) return 0;
+
+  if(version < PROTO_VERSION_COBS)
+  {
+    memcpy(out + CODEC_HDR_LEN, payload, len);
+    return codec_frame(version, pkt_type, out, len);
+  }
+
+  memcpy(frame + CODEC_HDR_LEN, payload, len);
+  len = codec_frame(version, pkt_type, frame, len);
+
+  return coll_cobs_encode(frame, len, out);
+}
+
+coll_e coll_send(coll_engine_t * eng, uint32_t port, uint8_t pkt_type, const void * msg)
+{
+  uint8_t payload[PKT_MAX_PAYLOAD], wire[COLL_WIRE_MAX];
+  uint32_t len, sent = 0;
+  ssize_t n;
+  coll_port_t * p;
+
+  if(!eng) return COLL_NULL_PTR;
+  if(port >= eng->num_ports || eng->ports[port].fd < 0) return COLL_BAD_PORT;
+  p = &eng->ports[port];
+
+  if(pkt_type == PKT_CMD_BATCH)
+  {
+    /* already encoded, one entry at a time */
+    if(!msg) return COLL_NULL_PTR;
+    len = ((const cmd_batch_t *)msg)->len;
+    memcpy(payload, ((const cmd_batch_t *)msg)->cmds, len);
+  }
+  else if(codec_encode(pkt_type, msg, payload, sizeof(payload), &len) != CODEC_SUCCESS)
+  {
+    return COLL_TOO_LONG;
+  }
+  len = coll_wire(p->parser.version, pkt_type, payload, len, wire);
+
+  /* commands are short, wait out a full output buffer rather than queue */
+  while(sent < len)
+  {
+    n = write(p->fd, wire + sent, len - sent);
+    if(n > 0) sent += n;
+    else if(n < 0 && errno != EAGAIN && errno != EINTR) return COLL_SYS_ERR;
+  }
+
+  return COLL_SUCCESS;
+}
+
+coll_e coll_set_version(coll_engine_t * eng, uint32_t port, uint8_t version)
+{
+  coll_worker_t * worker;
+  coll_chunk_t * chunk;
+
+  if(!eng) return COLL_NULL_PTR;
+  if(port >= eng->num_ports || !version) return COLL_BAD_PORT;
+
+  /* from outside the worker, after the bytes it has not framed yet */
+  worker = eng->num_workers ? &eng->workers[port % eng->num_workers] : NULL;
+  if(worker && !pthread_equal(pthread_self(), worker->thread))
+  {
+    chunk = coll_queue_slot(worker);
+    chunk->port = port;
+    chunk->len = 0;
+    chunk->version = version;
+    coll_queue_push(worker);
+    return COLL_SUCCESS;
+  }
+
+  /* any partial frame was in the old framing */
+  coll_parser_init(&eng->ports[port].parser, version);
+
+  return COLL_SUCCESS;
+}
+
+coll_e coll_set_session(coll_engine_t * eng, uint32_t port, const seal_t * seal)
+{
+  if(!eng) return COLL_NULL_PTR;
+  if(port >= eng->num_ports) return COLL_BAD_PORT;
+
+  eng->ports[port].sealed = seal != NULL;
+  if(seal) eng->ports[port].seal = *seal;
+
+  return COLL_SUCCESS;
+}
+
+coll_e coll_run(coll_engine_t * eng, int timeout_ms)
+{
+  struct epoll_event evs[COLL_EPOLL_EVENTS];
+  coll_worker_t * worker;
+  coll_chunk_t * chunk, local;
+  coll_port_t * p;
+  int n, i;
+  ssize_t len;
+
+  if(!eng) return COLL_NULL_PTR;
+
+  n = epoll_wait(eng->epfd, evs, COLL_EPOLL_EVENTS, timeout_ms);
+  if(n < 0) return (errno == EINTR) ? COLL_SUCCESS : COLL_SYS_ERR;
+
+  for(i = 0; i < n; i++)
+  {
+    p = &eng->ports[evs[i].data.u32];
+
+    /* read straight into the worker's queue */
+    worker = eng->num_workers ? &eng->workers[evs[i].data.u32 % eng->num_workers] : NULL;
+    chunk = worker ? coll_queue_slot(worker) : &local;
+
+    len = read(p->fd, chunk->data, COLL_CHUNK_LEN);
+    if(len > 0)
+    {
+      chunk->port = evs[i].data.u32;
+      chunk->len = len;
+      chunk->version = 0;
+      if(worker) coll_queue_push(worker);
+      else coll_process(eng, &eng->msg, chunk);
+    }
+    else if(len == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+      /* hung up, stop waiting on it */
+      epoll_ctl(eng->epfd, EPOLL_CTL_DEL, p->fd, NULL);
+    }
+  }
+
+  return COLL_SUCCESS;
+}
+
+void coll_stop(coll_engine_t * eng)
+{
+  coll_worker_t * worker;
+  coll_chunk_t * chunk;
+  uint32_t i;
+
+  for(i = 0; i < eng->num_workers; i++)
+  {
+    worker = &eng->workers[i];
+    chunk = coll_queue_slot(worker);
+    chunk->port = COLL_STOP_PORT;
+    coll_queue_push(worker);
+    pthread_join(worker->thread, NULL);
+  }
+  eng->num_workers = 0;
+
+  for(i = 0; i < eng->num_ports; i++)
+  {
+    if(eng->ports[i].fd < 0) continue;
+    close(eng->ports[i].fd);
+    eng->ports[i].fd = -1;
+  }
+  eng->num_ports = 0;
+
+  close(eng->epfd);
+  eng->epfd = -1;
+}
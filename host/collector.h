@@ -0,0 +1,317 @@
+/**
+ * @file collector.h
+ * @brief Host side collector for many parcels at once
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * A gateway talks to a dock full of parcels, each on its own serial port
+ * or pty. One thread runs coll_run(), which waits on every port with
+ * epoll and reads whatever has arrived. The bytes are handed to a pool
+ * of workers, each port always to the same one, which frame them with a
+ * coll_parser_t and decode the responses with the firmware's codec into
+ * a coll_msg_t for the caller's callback. With no workers everything
+ * runs on the epoll thread.
+ *
+ * Nothing is allocated: the engine, its ports and the worker queues are
+ * all in coll_engine_t, which the caller provides. A port's parser is
+ * only touched by its worker; coll_set_version() from another thread
+ * goes through the worker's queue, in order with the bytes already read.
+ * coll_send() writes straight to the port from any thread.
+ *
+ * Once a port has a session, set with coll_set_session(), its sealed
+ * responses are opened and handed out as the response inside.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __COLLECTOR_H__
+#define __COLLECTOR_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "codec.h"
+#include "pack.h"
+#include "packets.h"
+#include "seal.h"
+
+#define COLL_MAX_PORTS (1024) /* ports per engine */
+#define COLL_MAX_WORKERS (16)
+#define COLL_CHUNK_LEN (256) /* most bytes read from a port at once */
+#define COLL_QUEUE_LEN (64) /* chunks waiting for each worker, power of 2 */
+#define COLL_WIRE_MAX (CODEC_WIRE_MAX)
+
+/*
+ * @brief Collector status code
+ */
+typedef enum
+{
+  COLL_SUCCESS,
+  COLL_NULL_PTR,
+  COLL_FULL, /* no room for another port */
+  COLL_BAD_PORT,
+  COLL_TOO_LONG, /* message does not fit a packet */
+  COLL_SYS_ERR /* an epoll, thread or write call failed, see errno */
+} coll_e;
+
+/*
+ * @brief Parser results
+ */
+typedef enum
+{
+  COLL_FRAME_NONE, /* needs more bytes */
+  COLL_FRAME_OK, /* a frame is in the parser */
+  COLL_FRAME_BAD /* a frame failed its checksum or was cut short */
+} coll_frame_e;
+
+/*
+ * @brief Incremental frame parser
+ *
+ * Takes bytes as they arrive, in any split, for any protocol version.
+ * v1 and v2 frames are counted by their length byte, v3 frames run to
+ * the next COBS delimiter.
+ */
+typedef struct
+{
+  uint8_t version; /* PROTO_VERSION_* */
+  uint8_t discard; /* v3, frame too long, skipping to the next delimiter */
+  uint8_t done; /* frame was handed out, start over on the next byte */
+  uint16_t len; /* bytes in frame */
+  cobs_dec_t cobs;
+  uint8_t frame[CODEC_FRAME_MAX]; /* type, pkt_len, payload, trailer */
+} coll_parser_t;
+
+/*
+ * @brief A decoded response
+ */
+typedef struct
+{
+  uint8_t status; /* coll_frame_e, COLL_FRAME_OK or COLL_FRAME_BAD */
+  uint8_t pkt_type; /* pkt_type_e, not valid for a bad frame */
+  uint8_t pkt_len;
+  uint8_t sealed; /* came in a PKT_RES_SEALED, pkt_type is the response inside */
+  uint8_t num_events; /* records in events, for either dump response */
+  const uint8_t * payload; /* the raw payload, valid during the callback */
+  union
+  {
+    res_status_t status;
+    res_dump_t dump;
+    res_stats_t stats;
+    res_summary_t summary;
+    res_version_t version;
+    res_baud_t baud;
+    res_session_t session;
+    res_caps_t caps;
+  } res;
+  event_t events[PACK_MAX_EVENTS];
+  uint8_t plain[PKT_MAX_PAYLOAD]; /* payload of a sealed frame, once opened */
+} coll_msg_t;
+
+struct coll_engine;
+
+/*
+ * @brief Called by a worker with each frame from a port
+ */
+typedef void (*coll_msg_cb)(struct coll_engine * eng, uint32_t port, void * ctx, const coll_msg_t * msg);
+
+/*
+ * @brief One endpoint
+ */
+typedef struct
+{
+  int fd; /* -1 once closed */
+  void * ctx; /* for the callback */
+  coll_parser_t parser;
+  uint8_t sealed; /* seal holds the session */
+  seal_t seal;
+  uint32_t frames; /* good frames */
+  uint32_t bad; /* frames that failed */
+  uint64_t bytes;
+} coll_port_t;
+
+/*
+ * @brief Bytes read from a port, on their way to its worker
+ */
+typedef struct
+{
+  uint32_t port;
+  uint32_t len;
+  uint8_t version; /* not 0 to switch the parser to this version instead */
+  uint8_t data[COLL_CHUNK_LEN];
+} coll_chunk_t;
+
+/*
+ * @brief Decoding thread and its queue
+ */
+typedef struct
+{
+  struct coll_engine * eng;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  uint32_t head; /* next chunk to take */
+  uint32_t tail; /* next free slot */
+  coll_chunk_t queue[COLL_QUEUE_LEN];
+  coll_msg_t msg; /* decoded into for the callback */
+} coll_worker_t;
+
+/*
+ * @brief Collector
+ */
+typedef struct coll_engine
+{
+  int epfd;
+  coll_msg_cb on_msg;
+  uint32_t num_ports;
+  uint32_t num_workers;
+  coll_port_t ports[COLL_MAX_PORTS];
+  coll_worker_t workers[COLL_MAX_WORKERS];
+  coll_msg_t msg; /* for decoding on the epoll thread */
+} coll_engine_t;
+
+/**
+ * @brief Resets a parser
+ *
+ * @param parser Pointer to the parser
+ * @param version Protocol version of the frames to come
+ *
+ * @return none
+ */
+void coll_parser_init(coll_parser_t * parser, uint8_t version);
+
+/**
+ * @brief Feeds bytes to a parser
+ *
+ * Stops after each frame, so call again with the rest of the bytes
+ * until it returns COLL_FRAME_NONE. A frame stays in the parser until
+ * the next call.
+ *
+ * @param parser Pointer to the parser
+ * @param data Pointer to the bytes
+ * @param len The number of bytes
+ * @param used Pointer to the location to store the number of bytes taken
+ *
+ * @return A frame status
+ */
+coll_frame_e coll_parser_feed(coll_parser_t * parser, const uint8_t * data, uint32_t len, uint32_t * used);
+
+/**
+ * @brief Decodes the frame in a parser
+ *
+ * A PKT_RES_SEALED frame is opened with seal, and decoded as the
+ * response inside. With no session it is left sealed.
+ *
+ * @param parser Pointer to the parser holding a COLL_FRAME_OK frame
+ * @param seal Pointer to the port's session, NULL if there is none
+ * @param msg Pointer to the message to fill
+ *
+ * @return A codec status code, CODEC_SHORT for a dump whose events do not decode
+ */
+codec_e coll_decode(const coll_parser_t * parser, const seal_t * seal, coll_msg_t * msg);
+
+/**
+ * @brief Starts a collector
+ *
+ * @param eng Pointer to the engine
+ * @param num_workers Decoding threads, 0 to decode on the coll_run() thread
+ * @param on_msg Called with every frame
+ *
+ * @return A collector status code
+ */
+coll_e coll_init(coll_engine_t * eng, uint32_t num_workers, coll_msg_cb on_msg);
+
+/**
+ * @brief Adds a port
+ *
+ * The fd should be in raw mode. It is made non-blocking and closed by
+ * coll_stop(). Ports start at protocol v1.
+ *
+ * @param eng Pointer to the engine
+ * @param fd The port
+ * @param ctx Passed to the callback
+ * @param port Pointer to the location to store the port number
+ *
+ * @return A collector status code
+ */
+coll_e coll_add_port(coll_engine_t * eng, int fd, void * ctx, uint32_t * port);
+
+/**
+ * @brief Frames a payload for the wire
+ *
+ * @param version The protocol version
+ * @param pkt_type The packet type
+ * @param payload Pointer to the encoded payload
+ * @param len The length of the payload, at most PKT_MAX_PAYLOAD
+ * @param out Pointer to at least COLL_WIRE_MAX bytes
+ *
+ * @return The number of bytes to send
+ */
+uint32_t coll_wire(uint8_t version, uint8_t pkt_type, const uint8_t * payload, uint32_t len, uint8_t * out);
+
+/**
+ * @brief Sends a command to a port
+ *
+ * Encodes and frames the message for the port's protocol version. A
+ * PKT_CMD_BATCH takes a cmd_batch_t whose commands were put together
+ * with codec_batch_add().
+ *
+ * @param eng Pointer to the engine
+ * @param port The port number
+ * @param pkt_type The command
+ * @param msg Pointer to the command struct, may be NULL for empty commands
+ *
+ * @return A collector status code
+ */
+coll_e coll_send(coll_engine_t * eng, uint32_t port, uint8_t pkt_type, const void * msg);
+
+/**
+ * @brief Changes the framing of a port
+ *
+ * Call once the version response has arrived, both ways switch. Also
+ * drops any partial frame, so calling it with the current version puts
+ * a lost v1 parser back at a frame boundary. Call from the callback or
+ * the coll_run() thread.
+ *
+ * @param eng Pointer to the engine
+ * @param port The port number
+ * @param version The protocol version
+ *
+ * @return A collector status code
+ */
+coll_e coll_set_version(coll_engine_t * eng, uint32_t port, uint8_t version);
+
+/**
+ * @brief Sets the session sealed responses from a port are opened with
+ *
+ * Call once the session response has arrived and seal_derive() has
+ * been run on it. Call from the callback, or before the port's first
+ * bytes are read.
+ *
+ * @param eng Pointer to the engine
+ * @param port The port number
+ * @param seal Pointer to the session, copied, NULL to end it
+ *
+ * @return A collector status code
+ */
+coll_e coll_set_session(coll_engine_t * eng, uint32_t port, const seal_t * seal);
+
+/**
+ * @brief Waits for bytes on any port and passes them on
+ *
+ * @param eng Pointer to the engine
+ * @param timeout_ms Longest wait, -1 for no limit
+ *
+ * @return A collector status code
+ */
+coll_e coll_run(coll_engine_t * eng, int timeout_ms);
+
+/**
+ * @brief Stops the workers once their queues are empty and closes the ports
+ *
+ * @param eng Pointer to the engine
+ *
+ * @return none
+ */
+void coll_stop(coll_engine_t * eng);
+
+#endif /* __COLLECTOR_H__ */
@@ -0,0 +1,156 @@
+/**
+ * @file hal_host.c
+ * @brief Registers, CMSIS intrinsics and hal.h for the host build
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Interrupt handlers are called through sim_irq() with irq_lock held,
+ * and __disable_irq() takes the same lock, so they never run during a
+ * critical section or each other, same as on the part. Bytes sent on a
+ * UART are written to sim_uart_fd, or dropped if it is not open. The
+ * Bluetooth link can be made noisy with sim_error_ppm.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "msp.h"
+#include "hal.h"
+#include "helpers.h"
+#include "sim.h"
+#include "uart.h"
+
+/* registers from msp.h */
+DIO_PORT_Interruptable_Type host_ports[6];
+EUSCI_A_Type host_eusci_a[4];
+RTC_C_Type host_rtc_c;
+WDT_A_Type host_wdt_a;
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+
+int sim_uart_fd[2] = { -1, -1 };
+uint32_t sim_tx_dropped[2];
+uint32_t sim_error_ppm;
+uint32_t sim_errors;
+
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint8_t masked; /* PRIMASK of this thread */
+static __thread uint32_t isr_num; /* IPSR, 0 outside a handler */
+static volatile uint8_t irq_pending;
+static volatile uint64_t nvic_enabled;
+
+
+/* CMSIS */
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+  __atomic_or_fetch(&nvic_enabled, (uint64_t)1 << irq, __ATOMIC_SEQ_CST);
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+  __atomic_and_fetch(&nvic_enabled, ~((uint64_t)1 << irq), __ATOMIC_SEQ_CST);
+}
+
+void __disable_irq(void)
+{
+  /* handlers already hold the lock */
+  if(isr_num || masked) return;
+
+  pthread_mutex_lock(&irq_lock);
+  masked = 1;
+}
+
+void __enable_irq(void)
+{
+  if(isr_num || !masked) return;
+
+  masked = 0;
+  pthread_mutex_unlock(&irq_lock);
+
+  /* let a waiting interrupt in before the next critical section */
+  if(irq_pending) sched_yield();
+}
+
+uint32_t __get_PRIMASK(void)
+{
+  return isr_num ? 1 : masked;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+  if(primask) __disable_irq();
+  else __enable_irq();
+}
+
+uint32_t __get_IPSR(void)
+{
+  return isr_num;
+}
+
+
+/* hal.h */
+
+uint8_t hal_uart_tx_ready(uint8_t uart_num)
+{
+  return 1;
+}
+
+void hal_uart_tx(uint8_t uart_num, uint8_t data)
+{
+  if(uart_num == UART_NUM_BT) data = sim_line_noise(data);
+
+  /* a full pty drops the byte, like a link with no one listening */
+  if(write(sim_uart_fd[uart_num], &data, 1) != 1) sim_tx_dropped[uart_num]++;
+}
+
+uint8_t hal_uart_busy(uint8_t uart_num)
+{
+  return 0;
+}
+
+
+/* link */
+
+uint8_t sim_line_noise(uint8_t data)
+{
+  static __thread uint32_t seed;
+
+  if(!sim_error_ppm) return data;
+
+  /* xorshift32, seeded per thread and process */
+  if(!seed) seed = 0x9E3779B9 ^ ((uint32_t)getpid() << 8) ^ (uint32_t)(uintptr_t)&seed;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  if(seed % 1000000 >= sim_error_ppm) return data;
+
+  __atomic_add_fetch(&sim_errors, 1, __ATOMIC_RELAXED);
+  return data ^ (1 << (seed >> 29));
+}
+
+
+/* interrupts */
+
+void sim_irq(IRQn_Type irq, void (*handler)())
+{
+  irq_pending = 1;
+  pthread_mutex_lock(&irq_lock);
+  irq_pending = 0;
+
+  isr_num = 16 + irq;
+  handler();
+  isr_num = 0;
+
+  pthread_mutex_unlock(&irq_lock);
+}
+
+uint8_t sim_irq_enabled(IRQn_Type irq)
+{
+  return (nvic_enabled >> irq) & 1;
+}
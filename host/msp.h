@@ -0,0 +1,188 @@
+/**
+ * @file msp.h
+ * @brief Simulated MSP432P401R registers for the host build
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Stands in for the TI device header when building with HOST_BUILD. Only
+ * the peripherals the firmware touches are here, laid out as plain
+ * memory with the field names, bit masks and offsets of the real
+ * header. sim_main.c moves them along: it sets the flags the firmware
+ * waits on, counts the RTC and the cycle counter, and calls the
+ * interrupt handlers from its own thread.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __HOST_MSP_H__
+#define __HOST_MSP_H__
+
+#include <stdint.h>
+
+#define BIT0 (0x0001)
+#define BIT1 (0x0002)
+#define BIT2 (0x0004)
+#define BIT3 (0x0008)
+#define BIT4 (0x0010)
+#define BIT5 (0x0020)
+#define BIT6 (0x0040)
+#define BIT7 (0x0080)
+
+/* GPIO */
+typedef struct
+{
+  volatile uint8_t IN;
+  volatile uint8_t OUT;
+  volatile uint8_t DIR;
+  volatile uint8_t REN;
+  volatile uint8_t DS;
+  volatile uint8_t SEL0;
+  volatile uint8_t SEL1;
+  volatile uint8_t SELC;
+  volatile uint8_t IES;
+  volatile uint8_t IE;
+  volatile uint8_t IFG;
+  volatile uint16_t IV;
+} DIO_PORT_Interruptable_Type;
+
+extern DIO_PORT_Interruptable_Type host_ports[6];
+#define P1 (&host_ports[0])
+#define P2 (&host_ports[1])
+#define P3 (&host_ports[2])
+#define P4 (&host_ports[3])
+#define P5 (&host_ports[4])
+#define P6 (&host_ports[5])
+
+/* eUSCI_A UART */
+typedef struct
+{
+  volatile uint16_t CTLW0;
+  volatile uint16_t CTLW1;
+  volatile uint16_t BRW;
+  volatile uint16_t MCTLW;
+  volatile uint16_t STATW;
+  volatile uint16_t RXBUF;
+  volatile uint16_t TXBUF;
+  volatile uint16_t ABCTL;
+  volatile uint16_t IRCTL;
+  volatile uint16_t IE;
+  volatile uint16_t IFG;
+  volatile uint16_t IV;
+} EUSCI_A_Type;
+
+extern EUSCI_A_Type host_eusci_a[4];
+#define EUSCI_A0 (&host_eusci_a[0])
+#define EUSCI_A1 (&host_eusci_a[1])
+#define EUSCI_A2 (&host_eusci_a[2])
+#define EUSCI_A3 (&host_eusci_a[3])
+
+#define EUSCI_A_CTLW0_SWRST (0x0001)
+#define EUSCI_A_CTLW0_SSEL__SMCLK (0x0080)
+#define EUSCI_A_MCTLW_OS16 (0x0001)
+#define EUSCI_A_MCTLW_BRF_OFS (4)
+#define EUSCI_A_MCTLW_BRS_OFS (8)
+#define EUSCI_A_STATW_BUSY (0x0001)
+#define EUSCI_A_STATW_RXERR (0x0004)
+#define EUSCI_A_IE_RXIE (0x0001)
+#define EUSCI_A_IE_TXIE (0x0002)
+#define EUSCI_A_IFG_RXIFG (0x0001)
+#define EUSCI_A_IFG_TXIFG (0x0002)
+
+/* RTC_C, calendar mode with binary fields */
+typedef struct
+{
+  volatile uint16_t CTL0;
+  volatile uint16_t CTL13;
+  volatile uint16_t OCAL;
+  volatile uint16_t TCMP;
+  volatile uint16_t PS0CTL;
+  volatile uint16_t PS1CTL;
+  volatile uint16_t PS;
+  volatile uint16_t IV;
+  volatile uint16_t TIM0;
+  volatile uint16_t TIM1;
+  volatile uint16_t DATE;
+  volatile uint16_t YEAR;
+} RTC_C_Type;
+
+extern RTC_C_Type host_rtc_c;
+#define RTC_C (&host_rtc_c)
+
+#define RTC_C_CTL0_KEY_OFS (8)
+#define RTC_C_CTL13_HOLD (0x0040)
+#define RTC_C_TIM0_SEC_OFS (0)
+#define RTC_C_TIM0_SEC_MASK (0x003F)
+#define RTC_C_TIM0_MIN_OFS (8)
+#define RTC_C_TIM0_MIN_MASK (0x3F00)
+#define RTC_C_TIM1_HOUR_OFS (0)
+#define RTC_C_TIM1_HOUR_MASK (0x001F)
+#define RTC_C_TIM1_DOW_OFS (8)
+#define RTC_C_TIM1_DOW_MASK (0x0700)
+#define RTC_C_DATE_DAY_OFS (0)
+#define RTC_C_DATE_DAY_MASK (0x001F)
+#define RTC_C_DATE_MON_OFS (8)
+#define RTC_C_DATE_MON_MASK (0x0F00)
+
+/* watchdog, expires in sim_main.c; CNTCL reads back set until the model sees it */
+typedef struct
+{
+  volatile uint16_t CTL;
+} WDT_A_Type;
+
+extern WDT_A_Type host_wdt_a;
+#define WDT_A (&host_wdt_a)
+
+#define WDT_A_CTL_PW (0x5A00)
+#define WDT_A_CTL_SSEL__ACLK (0x0020)
+#define WDT_A_CTL_HOLD (0x0080)
+#define WDT_A_CTL_CNTCL (0x0008)
+#define WDT_A_CTL_IS_4 (0x0004)
+#define WDT_A_CTL_IS_MASK (0x0007)
+#define WDT_A_CTL_SSEL_MASK (0x0060)
+
+/* core debug and cycle counter */
+typedef struct
+{
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+
+#define DWT_CTRL_CYCCNTENA_Msk (0x00000001)
+#define CoreDebug_DEMCR_TRCENA_Msk (0x01000000)
+
+/* interrupts */
+typedef enum
+{
+  PORT1_IRQn = 35,
+  PORT4_IRQn = 38,
+  EUSCIA0_IRQn = 16,
+  EUSCIA2_IRQn = 18
+} IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+
+/* PRIMASK holds off the interrupt thread, see hal_host.c */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+uint32_t __get_IPSR(void);
+#define __enable_interrupts() __enable_irq()
+
+__attribute__((always_inline)) static inline uint32_t __CLZ(uint32_t value)
+{
+  return value ? __builtin_clz(value) : 32;
+}
+
+#endif /* __HOST_MSP_H__ */
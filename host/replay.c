@@ -0,0 +1,316 @@
+/**
+ * @file replay.c
+ * @brief Replays accelerometer recordings through the detection pipeline
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Feeds each sample through what the board does with it: the tap rule
+ * the ADXL345 applies (detect_tap), the flip count from the main loop
+ * (detect_flip), then coalescing into the event log. The cycle counter
+ * and RTC follow the sample times. Events are matched against labels in
+ * the recording and the pipeline is timed without the file parsing.
+ *
+ * Recordings are text, one record per line:
+ *   # comment
+ *   <time_us> <x> <y> <z>               sample, 256 counts per g
+ *   label <start_us> <end_us> drop|flip  the handling happened in this span
+ *
+ * Samples must be in time order. The board reads z once per main loop
+ * pass, the replay once per sample, so a flip needs DETECT_FLIP_COUNT
+ * samples upside down here. scripts/replay_gen.py writes synthetic
+ * recordings in this format.
+ *
+ * usage: pps_replay [-c coalesce_ms] [-r runs] recording
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msp.h"
+#include "arena.h"
+#include "coalesce.h"
+#include "detect.h"
+#include "event_buf.h"
+#include "helpers.h"
+#include "packets.h"
+#include "rtc.h"
+#include "summary.h"
+#include "trace.h"
+
+#define REPLAY_MAX_SAMPLES (1 << 22) /* 11 hours at 100 Hz */
+#define REPLAY_MAX_LABELS (4096)
+#define REPLAY_MAX_FOUND (4096)
+#define REPLAY_LINE_LEN (128)
+#define REPLAY_EPOCH (1525132800) /* recordings start 2018/05/01, unix time */
+#define REPLAY_EPOCH_2000 (REPLAY_EPOCH - 946684800) /* same, from 2000 like rtc_to_seconds */
+#define REPLAY_SLACK_US (1000000) /* event times are whole seconds */
+#define REPLAY_NUM_TYPES (2)
+
+typedef struct
+{
+  uint64_t time_us;
+  int16_t axis[3];
+} sample_t;
+
+typedef struct
+{
+  uint64_t start_us;
+  uint64_t end_us;
+  uint8_t type;
+  uint8_t matched;
+} label_t;
+
+typedef struct
+{
+  uint64_t time_us;
+  uint8_t type;
+} found_t;
+
+static sample_t samples[REPLAY_MAX_SAMPLES];
+static label_t labels[REPLAY_MAX_LABELS];
+static found_t found[REPLAY_MAX_FOUND];
+static uint32_t num_samples, num_labels, num_found, lost;
+static uint64_t rtc_second = UINT64_MAX;
+static eb_t * buf;
+
+static const char * type_names[REPLAY_NUM_TYPES] = { "drop", "flip" };
+
+/* one line of a recording, returns 0 if it is not a sample or label */
+static uint8_t replay_parse(const char * line)
+{
+  char name[8];
+  unsigned long long t, end;
+  int x, y, z;
+  uint8_t i;
+
+  if(line[0] == '#' || line[0] == '\n') return 1;
+
+  if(sscanf(line, "label %llu %llu %7s", &t, &end, name) == 3)
+  {
+    for(i = 0; i < REPLAY_NUM_TYPES && strcmp(name, type_names[i]); i++);
+    if(i == REPLAY_NUM_TYPES || num_labels == REPLAY_MAX_LABELS) return 0;
+
+    labels[num_labels].start_us = t;
+    labels[num_labels].end_us = end;
+    labels[num_labels].type = i;
+    labels[num_labels].matched = 0;
+    num_labels++;
+    return 1;
+  }
+
+  if(sscanf(line, "%llu %d %d %d", &t, &x, &y, &z) != 4) return 0;
+  if(num_samples == REPLAY_MAX_SAMPLES) return 0;
+  if(num_samples && t < samples[num_samples - 1].time_us) return 0;
+
+  samples[num_samples].time_us = t;
+  samples[num_samples].axis[0] = x;
+  samples[num_samples].axis[1] = y;
+  samples[num_samples].axis[2] = z;
+  num_samples++;
+
+  return 1;
+}
+
+static uint8_t replay_load(const char * path)
+{
+  FILE * f = fopen(path, "r");
+  char line[REPLAY_LINE_LEN];
+  uint32_t n = 0;
+
+  if(!f)
+  {
+    fprintf(stderr, "replay: could not open %s\n", path);
+    return 0;
+  }
+
+  while(fgets(line, sizeof(line), f))
+  {
+    n++;
+    if(!replay_parse(line))
+    {
+      fprintf(stderr, "replay: %s:%u not a sample or label, out of order, or too many\n", path, n);
+      fclose(f);
+      return 0;
+    }
+  }
+
+  fclose(f);
+  return 1;
+}
+
+/* move the cycle counter and RTC to a sample time */
+static void replay_set_time(uint64_t time_us)
+{
+  time_t secs = REPLAY_EPOCH + time_us / 1000000;
+  struct tm tm;
+  rtc_t now;
+
+  DWT->CYCCNT = time_us * (MCLK_HZ / 1000000);
+
+  if(time_us / 1000000 == rtc_second) return;
+  rtc_second = time_us / 1000000;
+
+  gmtime_r(&secs, &tm);
+  now.year = tm.tm_year + 1900;
+  now.month = tm.tm_mon + 1;
+  now.dow = tm.tm_wday;
+  now.day = tm.tm_mday;
+  now.hour = tm.tm_hour;
+  now.minute = tm.tm_min;
+  now.second = tm.tm_sec;
+  rtc_init(now);
+}
+
+/* take the events coalescing has stored */
+static void replay_collect()
+{
+  event_t event;
+  uint32_t secs;
+
+  while(eb_remove_item(buf, &event) == EB_SUCCESS)
+  {
+    if(num_found == REPLAY_MAX_FOUND || event.event_type >= REPLAY_NUM_TYPES)
+    {
+      lost++;
+      continue;
+    }
+
+    secs = rtc_to_seconds(&event.time) - REPLAY_EPOCH_2000;
+    found[num_found].time_us = (uint64_t)secs * 1000000;
+    found[num_found].type = event.event_type;
+    num_found++;
+  }
+}
+
+static void replay_run(uint16_t coalesce_ms)
+{
+  detect_t det;
+  const sample_t * s;
+  uint32_t i, peak;
+
+  num_found = 0;
+  lost = 0;
+  detect_init(&det);
+  coalesce_init(buf, coalesce_ms);
+
+  for(i = 0; i < num_samples; i++)
+  {
+    s = &samples[i];
+    replay_set_time(s->time_us);
+
+    /* PORT4_IRQHandler on a tap, then the main loop */
+    if(detect_tap(&det, s->time_us, s->axis[0], s->axis[1], s->axis[2], &peak))
+    {
+      coalesce_trigger(EVENT_DROP, peak);
+    }
+    if(detect_flip(&det, s->axis[2])) coalesce_trigger(EVENT_FLIP, s->axis[2]);
+    coalesce_poll();
+    replay_collect();
+  }
+
+  /* let the last bursts close */
+  if(num_samples)
+  {
+    replay_set_time(samples[num_samples - 1].time_us + 1000 * (coalesce_ms ? coalesce_ms : COALESCE_DEFAULT_MS) + 1000000);
+    coalesce_poll();
+    replay_collect();
+  }
+}
+
+static void replay_score()
+{
+  uint32_t i, j, hit[REPLAY_NUM_TYPES] = { 0 }, total[REPLAY_NUM_TYPES] = { 0 };
+  uint32_t detected[REPLAY_NUM_TYPES] = { 0 };
+  label_t * l;
+
+  for(i = 0; i < num_labels; i++) total[labels[i].type]++;
+
+  /* each label takes the first event of its type inside its span */
+  for(i = 0; i < num_found; i++)
+  {
+    detected[found[i].type]++;
+    for(j = 0; j < num_labels; j++)
+    {
+      l = &labels[j];
+      if(l->matched || l->type != found[i].type) continue;
+      if(found[i].time_us + REPLAY_SLACK_US < l->start_us || found[i].time_us > l->end_us + REPLAY_SLACK_US) continue;
+
+      l->matched = 1;
+      hit[l->type]++;
+      break;
+    }
+  }
+
+  printf("%-6s %8s %8s %8s %8s %8s\n", "type", "labels", "events", "hit", "missed", "false");
+  for(i = 0; i < REPLAY_NUM_TYPES; i++)
+  {
+    printf("%-6s %8u %8u %8u %8u %8u\n", type_names[i], total[i], detected[i], hit[i],
+           total[i] - hit[i], detected[i] - hit[i]);
+  }
+  if(lost) printf("%u events past the first %u not scored\n", lost, REPLAY_MAX_FOUND);
+}
+
+static double replay_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char ** argv)
+{
+  uint16_t coalesce_ms = 0;
+  uint32_t runs = 5, i;
+  double start, elapsed, best = 0, recorded;
+  int opt;
+
+  while((opt = getopt(argc, argv, "c:r:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'c': coalesce_ms = atoi(optarg); break;
+      case 'r': runs = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-c coalesce_ms] [-r runs] recording\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind != argc - 1 || !runs)
+  {
+    fprintf(stderr, "usage: %s [-c coalesce_ms] [-r runs] recording\n", argv[0]);
+    return 1;
+  }
+
+  if(!replay_load(argv[optind])) return 1;
+
+  arena_init();
+  trace_init();
+  eb_init(&buf);
+  summary_init();
+
+  /* same events every run, keep the fastest */
+  for(i = 0; i < runs; i++)
+  {
+    rtc_second = UINT64_MAX;
+    start = replay_now();
+    replay_run(coalesce_ms);
+    elapsed = replay_now() - start;
+    if(!i || elapsed < best) best = elapsed;
+  }
+
+  recorded = num_samples ? (samples[num_samples - 1].time_us - samples[0].time_us) / 1e6 : 0;
+  printf("%u samples, %.1f s recorded, %u labels\n", num_samples, recorded, num_labels);
+  printf("pipeline %.3f ms, %.0f samples/s, %.1f ns/sample (best of %u)\n\n", best * 1e3,
+         num_samples / best, best * 1e9 / (num_samples ? num_samples : 1), runs);
+  replay_score();
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file sim.h
+ * @brief Simulated hardware shared by the host build files
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * hal_host.c owns the registers in msp.h and the interrupt lock,
+ * adxl_sim.c models the accelerometer behind spi.h, and sim_main.c runs
+ * the board around the firmware: it ticks the model and turns its INT1
+ * and INT2 lines into P4 interrupts.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include "msp.h"
+
+#define SIM_ADXL_INT1 (0x01)
+#define SIM_ADXL_INT2 (0x02)
+
+extern int sim_uart_fd[2]; /* where each UART sends, -1 to drop */
+extern uint32_t sim_tx_dropped[2]; /* bytes the fd would not take */
+extern uint32_t sim_error_ppm; /* Bluetooth bytes in a million with a bit flipped */
+extern uint32_t sim_errors; /* bytes flipped so far */
+
+/**
+ * @brief passes a Bluetooth byte over the simulated link
+ *
+ * Flips one bit in sim_error_ppm of every million bytes, either way
+ *
+ * @param data The byte sent
+ *
+ * @return the byte received
+ */
+uint8_t sim_line_noise(uint8_t data);
+
+/**
+ * @brief calls an interrupt handler
+ *
+ * Waits for any critical section on another thread to end, and runs the
+ * handler as an interrupt: critical sections inside it do nothing and
+ * __get_IPSR() is not zero
+ *
+ * @param irq The interrupt
+ * @param handler The handler
+ *
+ * @return none
+ */
+void sim_irq(IRQn_Type irq, void (*handler)());
+
+/**
+ * @brief checks if an interrupt is enabled in the NVIC
+ *
+ * @param irq The interrupt
+ *
+ * @return 1 if enabled
+ */
+uint8_t sim_irq_enabled(IRQn_Type irq);
+
+/**
+ * @brief resets the accelerometer model
+ *
+ * Lies flat and upright, registers at their power on values
+ *
+ * @return none
+ */
+void adxl_sim_init();
+
+/**
+ * @brief moves the accelerometer model on
+ *
+ * Samples into the FIFO at the BW_RATE output rate and ends shocks
+ *
+ * @param us Microseconds since the last call
+ *
+ * @return none
+ */
+void adxl_sim_tick(uint32_t us);
+
+/**
+ * @brief sets the steady acceleration
+ *
+ * @param x, y, z Acceleration in g, z is -1 when upright
+ *
+ * @return none
+ */
+void adxl_sim_set_accel(float x, float y, float z);
+
+/**
+ * @brief adds a short shock on top of the steady acceleration
+ *
+ * Latches a single tap if it is over THRESH_TAP on an enabled axis
+ *
+ * @param g Peak acceleration in g, along z
+ * @param ms How long the shock lasts
+ *
+ * @return none
+ */
+void adxl_sim_shock(float g, uint32_t ms);
+
+/**
+ * @brief gets the interrupt lines
+ *
+ * @return SIM_ADXL_INT1 and SIM_ADXL_INT2 if asserted
+ */
+uint8_t adxl_sim_int_pins();
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,404 @@
+/**
+ * @file sim_main.c
+ * @brief Simulated board for the host build
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Runs the firmware as a normal process. main() here starts an
+ * interrupt thread and then calls the firmware's main, built as
+ * firmware_main. The interrupt thread stands in for everything that
+ * happens on its own on the part:
+ *   - DWT->CYCCNT counts at MCLK_HZ and the RTC_C calendar once a second
+ *   - the WDT_A counts while not held and, when it expires, the process
+ *     exits with SIM_WDT_EXIT where the part would reset and lose its RAM
+ *   - the ADXL345 model is sampled and its INT1 and INT2 lines raise
+ *     P4.4 and P4.5 on the edge IES selects
+ *   - the Bluetooth UART is a pseudo-terminal; received bytes are handed
+ *     to EUSCIA2_IRQHandler at the current rate, and while TXIE is set
+ *     the handler is called at the same rate to take the next byte of a
+ *     frame. -e flips bits in both directions, see sim_line_noise()
+ *   - the on-board UART is a second pseudo-terminal, for trace_decode.py
+ *   - lines on stdin move the accelerometer, see sim_command()
+ *
+ * Handlers are called through sim_irq(), see hal_host.c.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msp.h"
+#include "flash.h"
+#include "helpers.h"
+#include "packets.h"
+#include "rtc.h"
+#include "sim.h"
+#include "uart.h"
+
+#define SIM_TICK_MS (1)
+#define SIM_DROP_G (20.0f) /* over the 16 g tap threshold main.c sets */
+#define SIM_SHOCK_MS (5)
+#define SIM_CMD_LEN (80)
+#define SIM_ACLK_HZ (32768)
+#define SIM_WDT_EXIT (2)
+
+/* firmware entry and handlers, from main.c */
+void firmware_main(void);
+void PORT4_IRQHandler();
+void EUSCIA2_IRQHandler();
+
+static const uint32_t baud_rates[BAUD_NUM_RATES] = { 9600, 19200, 38400, 57600, 115200 };
+static volatile sig_atomic_t quit_f;
+
+static const char * flash_path;
+static uint8_t wdt_expired;
+static uint8_t gpio_level; /* P4 as last seen */
+static char cmd_line[SIM_CMD_LEN];
+static uint32_t cmd_len;
+
+
+/* interrupt thread */
+
+static uint64_t sim_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t sim_days_in_month(uint16_t year, uint8_t month)
+{
+  static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+  if(month == 2 && (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0)) return 29;
+
+  return days[month - 1];
+}
+
+/* one second on the RTC_C calendar */
+static void sim_rtc_second()
+{
+  rtc_t t;
+
+  if(RTC_C->CTL13 & RTC_C_CTL13_HOLD) return;
+
+  t = rtc_get_time();
+  t.second = (t.second + 1) % 60;
+  if(!t.second) t.minute = (t.minute + 1) % 60;
+  if(!t.second && !t.minute) t.hour = (t.hour + 1) % 24;
+  if(!t.second && !t.minute && !t.hour)
+  {
+    t.dow = (t.dow + 1) % 7;
+
+    /* never set, count the time of day only */
+    if(t.month >= 1 && t.month <= 12 && ++t.day > sim_days_in_month(t.year, t.month))
+    {
+      t.day = 1;
+      if(++t.month > 12)
+      {
+        t.month = 1;
+        t.year++;
+      }
+    }
+  }
+
+  RTC_C->YEAR = t.year;
+  RTC_C->DATE = (t.month << RTC_C_DATE_MON_OFS) | (t.day << RTC_C_DATE_DAY_OFS);
+  RTC_C->TIM1 = (t.dow << RTC_C_TIM1_DOW_OFS) | (t.hour << RTC_C_TIM1_HOUR_OFS);
+  RTC_C->TIM0 = (t.minute << RTC_C_TIM0_MIN_OFS) | (t.second << RTC_C_TIM0_SEC_OFS);
+}
+
+/* accelerometer lines onto P4.4 and P4.5 */
+/* returns 1 once the watchdog expires */
+static uint8_t sim_wdt(uint32_t elapsed)
+{
+  /* clock source cycles for IS 0 to 7 */
+  static const uint8_t is_log2[8] = { 31, 27, 23, 19, 15, 13, 9, 6 };
+  static uint64_t count_us;
+  uint16_t ctl = WDT_A->CTL;
+  uint64_t hz, limit_us;
+
+  /* CNTCL clears itself on the part, take it once */
+  if(ctl & WDT_A_CTL_CNTCL)
+  {
+    if(__atomic_compare_exchange_n(&WDT_A->CTL, &ctl, ctl & ~WDT_A_CTL_CNTCL, 0, __ATOMIC_SEQ_CST,
+                                   __ATOMIC_SEQ_CST)) count_us = 0;
+    return 0;
+  }
+  if(!(ctl & WDT_A_CTL_PW) || (ctl & WDT_A_CTL_HOLD)) return 0;
+
+  /* ACLK, or SMCLK; the VLO and BCLK are not used */
+  hz = ((ctl & WDT_A_CTL_SSEL_MASK) == WDT_A_CTL_SSEL__ACLK) ? SIM_ACLK_HZ : SMCLK_HZ;
+  limit_us = ((uint64_t)1000000 << is_log2[ctl & WDT_A_CTL_IS_MASK]) / hz;
+  count_us += elapsed;
+  if(count_us < limit_us) return 0;
+
+  fprintf(stderr, "sim: watchdog expired after %llu ms without a feed, the part would reset\n",
+          (unsigned long long)(count_us / 1000));
+  return 1;
+}
+
+static void sim_gpio()
+{
+  uint8_t pins = adxl_sim_int_pins();
+  uint8_t level = ((pins & SIM_ADXL_INT1) ? BIT4 : 0) | ((pins & SIM_ADXL_INT2) ? BIT5 : 0);
+  uint8_t rising = level & ~gpio_level, falling = ~level & gpio_level;
+
+  gpio_level = level;
+  P4->IN = (P4->IN & ~(BIT5 | BIT4)) | level;
+  P4->IFG |= ((rising & ~P4->IES) | (falling & P4->IES)) & (BIT5 | BIT4);
+
+  if((P4->IFG & P4->IE) && sim_irq_enabled(PORT4_IRQn)) sim_irq(PORT4_IRQn, PORT4_IRQHandler);
+}
+
+/* hand a received byte to the Bluetooth UART handler */
+static uint8_t sim_uart_rx()
+{
+  uint8_t data;
+
+  /* leave it in the pty until the UART would take it */
+  if(!(EUSCI_A2->IE & EUSCI_A_IE_RXIE) || !sim_irq_enabled(EUSCIA2_IRQn)) return 0;
+  if(read(sim_uart_fd[UART_NUM_BT], &data, 1) != 1) return 0;
+
+  EUSCI_A2->RXBUF = sim_line_noise(data);
+  EUSCI_A2->IFG |= EUSCI_A_IFG_RXIFG;
+  sim_irq(EUSCIA2_IRQn, EUSCIA2_IRQHandler);
+
+  return 1;
+}
+
+/* let the Bluetooth UART handler send a byte */
+static uint8_t sim_uart_tx()
+{
+  if(!(EUSCI_A2->IE & EUSCI_A_IE_TXIE) || !sim_irq_enabled(EUSCIA2_IRQn)) return 0;
+
+  sim_irq(EUSCIA2_IRQn, EUSCIA2_IRQHandler);
+
+  return 1;
+}
+
+static void sim_flash_save()
+{
+  FILE * f;
+
+  if(!flash_path) return;
+
+  f = fopen(flash_path, "wb");
+  if(!f || fwrite(flash_sim_image(FLASH_BANK1_BASE), FLASH_SECTOR_LEN, FLASH_NUM_SECTORS, f) != FLASH_NUM_SECTORS)
+  {
+    fprintf(stderr, "sim: could not save flash to %s\n", flash_path);
+  }
+  if(f) fclose(f);
+}
+
+static void sim_flash_load()
+{
+  FILE * f;
+
+  /* erased, unless there is an image from last time */
+  memset(flash_sim_image(FLASH_BANK1_BASE), 0xFF, FLASH_NUM_SECTORS * FLASH_SECTOR_LEN);
+  if(!flash_path || !(f = fopen(flash_path, "rb"))) return;
+
+  if(fread(flash_sim_image(FLASH_BANK1_BASE), FLASH_SECTOR_LEN, FLASH_NUM_SECTORS, f) != FLASH_NUM_SECTORS)
+  {
+    fprintf(stderr, "sim: %s is short, rest of bank 1 left erased\n", flash_path);
+  }
+  fclose(f);
+}
+
+/*
+ * one line from stdin:
+ *   drop [g]      shock along z, a tap if over THRESH_TAP
+ *   flip          turn upside down
+ *   upright       turn back over
+ *   accel x y z   steady acceleration in g
+ *   quit          save flash and exit
+ */
+static void sim_command(char * line)
+{
+  float x, y, z;
+
+  if(sscanf(line, "drop %f", &z) == 1) adxl_sim_shock(z, SIM_SHOCK_MS);
+  else if(!strncmp(line, "drop", 4)) adxl_sim_shock(SIM_DROP_G, SIM_SHOCK_MS);
+  else if(!strncmp(line, "flip", 4)) adxl_sim_set_accel(0.0f, 0.0f, 1.0f);
+  else if(!strncmp(line, "upright", 7)) adxl_sim_set_accel(0.0f, 0.0f, -1.0f);
+  else if(sscanf(line, "accel %f %f %f", &x, &y, &z) == 3) adxl_sim_set_accel(x, y, z);
+  else if(!strncmp(line, "quit", 4)) quit_f = 1;
+  else if(line[0]) fprintf(stderr, "sim: drop [g] | flip | upright | accel x y z | quit\n");
+}
+
+/* run each whole line read from stdin, returns 0 at the end */
+static uint8_t sim_stdin()
+{
+  ssize_t n = read(STDIN_FILENO, cmd_line + cmd_len, sizeof(cmd_line) - 1 - cmd_len);
+  char * end;
+
+  if(n <= 0) return 0;
+  cmd_len += n;
+  cmd_line[cmd_len] = 0;
+
+  while((end = strchr(cmd_line, '\n')))
+  {
+    *end++ = 0;
+    sim_command(cmd_line);
+    cmd_len -= end - cmd_line;
+    memmove(cmd_line, end, cmd_len + 1);
+  }
+
+  /* too long to be a command */
+  if(cmd_len == sizeof(cmd_line) - 1) cmd_len = 0;
+
+  return 1;
+}
+
+static void * sim_thread(void * arg)
+{
+  struct pollfd fds[2];
+  uint64_t last = sim_now_us(), now, rx_credit = 0, tx_credit = 0, cycles = 0, rtc_us = 0;
+  uint32_t elapsed, byte_us;
+  uint8_t stdin_open = 1;
+
+  fds[0].fd = sim_uart_fd[UART_NUM_BT];
+  fds[0].events = POLLIN;
+  fds[1].fd = STDIN_FILENO;
+  fds[1].events = POLLIN;
+
+  while(!quit_f)
+  {
+    poll(fds, stdin_open ? 2 : 1, SIM_TICK_MS);
+
+    now = sim_now_us();
+    elapsed = now - last;
+    last = now;
+
+    /* clocks */
+    cycles += (uint64_t)elapsed * MCLK_HZ;
+    DWT->CYCCNT += cycles / 1000000;
+    cycles %= 1000000;
+    for(rtc_us += elapsed; rtc_us >= 1000000; rtc_us -= 1000000) sim_rtc_second();
+    if(sim_wdt(elapsed))
+    {
+      wdt_expired = 1;
+      break;
+    }
+
+    adxl_sim_tick(elapsed);
+    sim_gpio();
+
+    /* 10 bits a byte at the current rate, and no backlog while idle */
+    byte_us = 10000000 / baud_rates[uart_get_baud()];
+    rx_credit += elapsed;
+    while(rx_credit >= byte_us && sim_uart_rx()) rx_credit -= byte_us;
+    if(rx_credit > byte_us) rx_credit = byte_us;
+    tx_credit += elapsed;
+    while(tx_credit >= byte_us && sim_uart_tx()) tx_credit -= byte_us;
+    if(tx_credit > byte_us) tx_credit = byte_us;
+
+    if(stdin_open && (fds[1].revents & (POLLIN | POLLHUP))) stdin_open = sim_stdin();
+  }
+
+  if(sim_tx_dropped[UART_NUM_BT]) fprintf(stderr, "sim: %u Bluetooth bytes dropped\n", sim_tx_dropped[UART_NUM_BT]);
+  if(sim_errors) fprintf(stderr, "sim: %u Bluetooth bytes corrupted\n", sim_errors);
+  sim_flash_save();
+  exit(wdt_expired ? SIM_WDT_EXIT : 0);
+
+  return NULL;
+}
+
+
+/* process */
+
+static int sim_open_pty(const char * name, const char * link_path)
+{
+  struct termios tio;
+  int master, slave;
+  const char * path;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master < 0 || grantpt(master) || unlockpt(master) || !(path = ptsname(master))) return -1;
+
+  /* hold the slave open so the pty outlives a client, and make it raw */
+  slave = open(path, O_RDWR | O_NOCTTY);
+  if(slave < 0 || tcgetattr(slave, &tio)) return -1;
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  if(link_path)
+  {
+    unlink(link_path);
+    if(symlink(path, link_path)) fprintf(stderr, "sim: could not link %s\n", link_path);
+  }
+  fprintf(stderr, "sim: %s UART on %s\n", name, link_path ? link_path : path);
+
+  return master;
+}
+
+static void sim_signal(int sig)
+{
+  quit_f = 1;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * bt_link = NULL, * log_link = NULL;
+  pthread_t thread;
+  struct sigaction sa;
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:l:f:e:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'b': bt_link = optarg; break;
+      case 'l': log_link = optarg; break;
+      case 'f': flash_path = optarg; break;
+      case 'e': sim_error_ppm = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-b bt_link] [-l log_link] [-f flash_image] [-e error_ppm]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  sim_uart_fd[UART_NUM_LOG] = sim_open_pty("log", log_link);
+  sim_uart_fd[UART_NUM_BT] = sim_open_pty("Bluetooth", bt_link);
+  if(sim_uart_fd[UART_NUM_LOG] < 0 || sim_uart_fd[UART_NUM_BT] < 0)
+  {
+    fprintf(stderr, "sim: could not open a pty\n");
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sim_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  /* power on state */
+  sim_flash_load();
+  adxl_sim_init();
+  EUSCI_A0->IFG = EUSCI_A_IFG_TXIFG;
+  EUSCI_A2->IFG = EUSCI_A_IFG_TXIFG;
+
+  if(pthread_create(&thread, NULL, sim_thread, NULL))
+  {
+    fprintf(stderr, "sim: could not start the interrupt thread\n");
+    return 1;
+  }
+
+  firmware_main();
+
+  return 0;
+}
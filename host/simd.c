@@ -0,0 +1,428 @@
+/**
+ * @file simd.c
+ * @brief Vectorised frame checks and event decoding for the gateway
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * The vector paths are compiled with target attributes so the rest of
+ * the host build needs no -m flags, and are only called once the CPU
+ * has been checked. Anything shorter than a vector goes through the
+ * scalar code, so every level agrees byte for byte.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <string.h>
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+#include "codec.h"
+#include "crc.h"
+#include "simd.h"
+#include "unpack.h"
+
+#define SIMD_CLMUL_MIN (64) /* shortest block worth folding */
+
+static int simd_cur = -1; /* simd_level_e, -1 until first use */
+static int simd_max = -1;
+
+static const char * const simd_names[SIMD_NUM_LEVELS] = { "scalar", "sse4.1", "avx2" };
+
+
+/* levels */
+
+static void simd_detect()
+{
+  simd_max = SIMD_SCALAR;
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul"))
+  {
+    simd_max = SIMD_SSE41;
+    if(__builtin_cpu_supports("avx2")) simd_max = SIMD_AVX2;
+  }
+#endif
+  simd_cur = simd_max;
+}
+
+simd_level_e simd_level()
+{
+  if(simd_cur < 0) simd_detect();
+
+  return simd_cur;
+}
+
+simd_level_e simd_set_level(simd_level_e level)
+{
+  if(simd_max < 0) simd_detect();
+  simd_cur = (level > simd_max) ? simd_max : level;
+
+  return simd_cur;
+}
+
+const char * simd_level_name(simd_level_e level)
+{
+  return (level < SIMD_NUM_LEVELS) ? simd_names[level] : "?";
+}
+
+
+/* scalar */
+
+static uint8_t simd_xor_scalar(const uint8_t * ptr, uint32_t len)
+{
+  uint8_t checksum = 0;
+  uint32_t i;
+
+  for(i = 0; i < len; i++) checksum ^= ptr[i];
+
+  return checksum;
+}
+
+static void simd_events_scalar(const uint8_t * in, uint32_t num_events, const simd_cols_t * cols, uint32_t row)
+{
+  rtc_t time;
+  uint32_t i;
+
+  for(i = 0; i < num_events; i++, in += CODEC_EVENT_LEN, row++)
+  {
+    time.year = in[4] | (in[5] << 8);
+    time.month = in[6];
+    time.day = in[8];
+    time.hour = in[9];
+    time.minute = in[10];
+    time.second = in[11];
+
+    cols->type[row] = in[0];
+    cols->merged[row] = in[1];
+    cols->span_ms[row] = in[2] | (in[3] << 8);
+    cols->time[row] = unpack_seconds(&time);
+    cols->data[row] = in[12] | (in[13] << 8) | (in[14] << 16) | ((uint32_t)in[15] << 24);
+  }
+}
+
+
+#ifdef SIMD_X86
+
+/* SSE4.1 */
+
+/*
+ * CRC32 folding from Intel's "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction", constants for the reflected 0x04C11DB7.
+ * len is at least 64 and a multiple of 16, crc is the running value.
+ */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t simd_crc32_clmul(uint32_t crc, const uint8_t * ptr, uint32_t len)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)ptr), _mm_cvtsi32_si128(crc));
+  x2 = _mm_loadu_si128((const __m128i *)(ptr + 16));
+  x3 = _mm_loadu_si128((const __m128i *)(ptr + 32));
+  x4 = _mm_loadu_si128((const __m128i *)(ptr + 48));
+  ptr += 64;
+  len -= 64;
+
+  /* four lanes of 128 bits, 64 bytes a step */
+  while(len >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)ptr));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(ptr + 16)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(ptr + 32)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(ptr + 48)));
+    ptr += 64;
+    len -= 64;
+  }
+
+  /* the lanes into one */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+
+  /* what is left, 16 bytes a step */
+  while(len >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x5);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)ptr));
+    ptr += 16;
+    len -= 16;
+  }
+
+  /* 128 bits to 64 */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, low32), k5, 0x00), x2);
+
+  /* Barrett reduction to 32 */
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, low32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_extract_epi32(x1, 1);
+}
+
+__attribute__((target("sse4.1")))
+static uint8_t simd_xor_sse41(const uint8_t * ptr, uint32_t len)
+{
+  __m128i acc = _mm_setzero_si128();
+  uint32_t i;
+
+  for(i = 0; i + 16 <= len; i += 16) acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i *)(ptr + i)));
+  acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+  acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 4));
+  acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 2));
+  acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 1));
+
+  return (uint8_t)_mm_cvtsi128_si32(acc) ^ simd_xor_scalar(ptr + i, len - i);
+}
+
+/* unpack_seconds on four times, from the year word and the day word of each record */
+__attribute__((target("sse4.1")))
+static __m128i simd_seconds_sse41(__m128i w1, __m128i w2)
+{
+  const __m128i byte = _mm_set1_epi32(0xFF);
+  __m128i year = _mm_and_si128(w1, _mm_set1_epi32(0xFFFF));
+  __m128i month = _mm_and_si128(_mm_srli_epi32(w1, 16), byte);
+  __m128i y, m, c, days, secs;
+
+  /* years from March, so the leap day is last */
+  y = _mm_add_epi32(year, _mm_cmplt_epi32(month, _mm_set1_epi32(3)));
+  m = _mm_add_epi32(month, _mm_set1_epi32(9));
+  m = _mm_sub_epi32(m, _mm_mullo_epi32(_mm_srli_epi32(_mm_mullo_epi32(m, _mm_set1_epi32(2731)), 15),
+                                       _mm_set1_epi32(12)));
+
+  /* y / 100 as (y / 4) / 25, exact for any 16 bit year */
+  c = _mm_srli_epi32(_mm_mullo_epi32(_mm_srli_epi32(y, 2), _mm_set1_epi32(5243)), 17);
+  days = _mm_add_epi32(_mm_mullo_epi32(y, _mm_set1_epi32(365)), _mm_srli_epi32(y, 2));
+  days = _mm_add_epi32(_mm_sub_epi32(days, c), _mm_srli_epi32(c, 2));
+  days = _mm_add_epi32(days, _mm_srli_epi32(_mm_mullo_epi32(_mm_add_epi32(_mm_mullo_epi32(m, _mm_set1_epi32(153)),
+                                                                           _mm_set1_epi32(2)),
+                                                            _mm_set1_epi32(52429)), 18));
+  days = _mm_sub_epi32(_mm_add_epi32(days, _mm_and_si128(w2, byte)), _mm_set1_epi32(730426));
+
+  secs = _mm_add_epi32(_mm_mullo_epi32(days, _mm_set1_epi32(24)), _mm_and_si128(_mm_srli_epi32(w2, 8), byte));
+  secs = _mm_add_epi32(_mm_mullo_epi32(secs, _mm_set1_epi32(60)), _mm_and_si128(_mm_srli_epi32(w2, 16), byte));
+  secs = _mm_add_epi32(_mm_mullo_epi32(secs, _mm_set1_epi32(60)), _mm_srli_epi32(w2, 24));
+
+  return _mm_andnot_si128(_mm_cmplt_epi32(year, _mm_set1_epi32(2000)), secs);
+}
+
+__attribute__((target("sse4.1")))
+static uint32_t simd_events_sse41(const uint8_t * in, uint32_t num_events, const simd_cols_t * cols, uint32_t row)
+{
+  const __m128i split = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+  __m128i r0, r1, r2, r3, t0, t1, t2, t3, w0, w1, w2, w3;
+  uint32_t i, word;
+
+  for(i = 0; i + 4 <= num_events; i += 4, in += 4 * CODEC_EVENT_LEN, row += 4)
+  {
+    r0 = _mm_loadu_si128((const __m128i *)in);
+    r1 = _mm_loadu_si128((const __m128i *)(in + 16));
+    r2 = _mm_loadu_si128((const __m128i *)(in + 32));
+    r3 = _mm_loadu_si128((const __m128i *)(in + 48));
+
+    /* records to words: w0 type and reserved, w1 year month dow, w2 day to second, w3 data */
+    t0 = _mm_unpacklo_epi32(r0, r1);
+    t1 = _mm_unpacklo_epi32(r2, r3);
+    t2 = _mm_unpackhi_epi32(r0, r1);
+    t3 = _mm_unpackhi_epi32(r2, r3);
+    w0 = _mm_unpacklo_epi64(t0, t1);
+    w1 = _mm_unpackhi_epi64(t0, t1);
+    w2 = _mm_unpacklo_epi64(t2, t3);
+    w3 = _mm_unpackhi_epi64(t2, t3);
+
+    /* four types, four merge counts, four spans */
+    w0 = _mm_shuffle_epi8(w0, split);
+    word = _mm_cvtsi128_si32(w0);
+    memcpy(cols->type + row, &word, 4);
+    word = _mm_extract_epi32(w0, 1);
+    memcpy(cols->merged + row, &word, 4);
+    _mm_storel_epi64((__m128i *)(cols->span_ms + row), _mm_srli_si128(w0, 8));
+
+    _mm_storeu_si128((__m128i *)(cols->time + row), simd_seconds_sse41(w1, w2));
+    _mm_storeu_si128((__m128i *)(cols->data + row), w3);
+  }
+
+  return i;
+}
+
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static uint8_t simd_xor_avx2(const uint8_t * ptr, uint32_t len)
+{
+  __m256i acc = _mm256_setzero_si256();
+  __m128i half;
+  uint32_t i;
+
+  for(i = 0; i + 32 <= len; i += 32) acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i *)(ptr + i)));
+  half = _mm_xor_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  half = _mm_xor_si128(half, _mm_srli_si128(half, 8));
+  half = _mm_xor_si128(half, _mm_srli_si128(half, 4));
+  half = _mm_xor_si128(half, _mm_srli_si128(half, 2));
+  half = _mm_xor_si128(half, _mm_srli_si128(half, 1));
+
+  return (uint8_t)_mm_cvtsi128_si32(half) ^ simd_xor_scalar(ptr + i, len - i);
+}
+
+/* simd_seconds_sse41 on eight */
+__attribute__((target("avx2")))
+static __m256i simd_seconds_avx2(__m256i w1, __m256i w2)
+{
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  __m256i year = _mm256_and_si256(w1, _mm256_set1_epi32(0xFFFF));
+  __m256i month = _mm256_and_si256(_mm256_srli_epi32(w1, 16), byte);
+  __m256i y, m, c, days, secs;
+
+  y = _mm256_add_epi32(year, _mm256_cmpgt_epi32(_mm256_set1_epi32(3), month));
+  m = _mm256_add_epi32(month, _mm256_set1_epi32(9));
+  m = _mm256_sub_epi32(m, _mm256_mullo_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(m, _mm256_set1_epi32(2731)), 15),
+                                             _mm256_set1_epi32(12)));
+
+  c = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 2), _mm256_set1_epi32(5243)), 17);
+  days = _mm256_add_epi32(_mm256_mullo_epi32(y, _mm256_set1_epi32(365)), _mm256_srli_epi32(y, 2));
+  days = _mm256_add_epi32(_mm256_sub_epi32(days, c), _mm256_srli_epi32(c, 2));
+  days = _mm256_add_epi32(days, _mm256_srli_epi32(
+                                  _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m, _mm256_set1_epi32(153)),
+                                                                      _mm256_set1_epi32(2)),
+                                                     _mm256_set1_epi32(52429)), 18));
+  days = _mm256_sub_epi32(_mm256_add_epi32(days, _mm256_and_si256(w2, byte)), _mm256_set1_epi32(730426));
+
+  secs = _mm256_add_epi32(_mm256_mullo_epi32(days, _mm256_set1_epi32(24)),
+                          _mm256_and_si256(_mm256_srli_epi32(w2, 8), byte));
+  secs = _mm256_add_epi32(_mm256_mullo_epi32(secs, _mm256_set1_epi32(60)),
+                          _mm256_and_si256(_mm256_srli_epi32(w2, 16), byte));
+  secs = _mm256_add_epi32(_mm256_mullo_epi32(secs, _mm256_set1_epi32(60)), _mm256_srli_epi32(w2, 24));
+
+  return _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(2000), year), secs);
+}
+
+__attribute__((target("avx2")))
+static uint32_t simd_events_avx2(const uint8_t * in, uint32_t num_events, const simd_cols_t * cols, uint32_t row)
+{
+  const __m256i split = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+                                         0, 4, 8, 12, 1, 5, 9, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7);
+  __m256i r0, r1, r2, r3, t0, t1, t2, t3, w0, w1, w2, w3;
+  uint32_t i;
+
+  for(i = 0; i + 8 <= num_events; i += 8, in += 8 * CODEC_EVENT_LEN, row += 8)
+  {
+    /* records 0-3 in the low lanes, 4-7 in the high, so the words come out in order */
+    r0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+                                 _mm_loadu_si128((const __m128i *)(in + 64)), 1);
+    r1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + 16))),
+                                 _mm_loadu_si128((const __m128i *)(in + 80)), 1);
+    r2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + 32))),
+                                 _mm_loadu_si128((const __m128i *)(in + 96)), 1);
+    r3 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + 48))),
+                                 _mm_loadu_si128((const __m128i *)(in + 112)), 1);
+
+    t0 = _mm256_unpacklo_epi32(r0, r1);
+    t1 = _mm256_unpacklo_epi32(r2, r3);
+    t2 = _mm256_unpackhi_epi32(r0, r1);
+    t3 = _mm256_unpackhi_epi32(r2, r3);
+    w0 = _mm256_unpacklo_epi64(t0, t1);
+    w1 = _mm256_unpackhi_epi64(t0, t1);
+    w2 = _mm256_unpacklo_epi64(t2, t3);
+    w3 = _mm256_unpackhi_epi64(t2, t3);
+
+    /* eight types, eight merge counts, then eight spans */
+    w0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(w0, split), order);
+    _mm_storel_epi64((__m128i *)(cols->type + row), _mm256_castsi256_si128(w0));
+    _mm_storel_epi64((__m128i *)(cols->merged + row), _mm_srli_si128(_mm256_castsi256_si128(w0), 8));
+    _mm_storeu_si128((__m128i *)(cols->span_ms + row), _mm256_extracti128_si256(w0, 1));
+
+    _mm256_storeu_si256((__m256i *)(cols->time + row), simd_seconds_avx2(w1, w2));
+    _mm256_storeu_si256((__m256i *)(cols->data + row), w3);
+  }
+
+  return i;
+}
+
+#endif /* SIMD_X86 */
+
+
+/* dispatch */
+
+uint32_t simd_crc32(uint32_t crc, const uint8_t * ptr, uint32_t len)
+{
+#ifdef SIMD_X86
+  uint32_t n;
+
+  /* there is no wider carry-less multiply in AVX2, both levels fold 128 bits */
+  if(simd_level() >= SIMD_SSE41 && len >= SIMD_CLMUL_MIN)
+  {
+    n = len & ~15u;
+    crc = simd_crc32_clmul(crc, ptr, n);
+    ptr += n;
+    len -= n;
+  }
+#endif
+
+  return crc32_update(crc, ptr, len);
+}
+
+uint8_t simd_frame_ok(uint8_t version, const uint8_t * frame, uint32_t len)
+{
+  uint32_t trailer = codec_trailer_len(version), crc;
+  uint8_t checksum;
+
+  if(len < CODEC_HDR_LEN + trailer || len != CODEC_HDR_LEN + frame[1] + trailer) return 0;
+
+  if(version >= PROTO_VERSION_CRC32)
+  {
+    len -= trailer;
+    crc = CRC32_FINAL(simd_crc32(CRC32_INIT, frame, len));
+    return crc == (frame[len] | (frame[len + 1] << 8) | (frame[len + 2] << 16) | ((uint32_t)frame[len + 3] << 24));
+  }
+
+  /* the XOR of everything, trailer included, is 0 */
+  switch(simd_level())
+  {
+#ifdef SIMD_X86
+    case SIMD_AVX2: checksum = simd_xor_avx2(frame, len); break;
+    case SIMD_SSE41: checksum = simd_xor_sse41(frame, len); break;
+#endif
+    default: checksum = simd_xor_scalar(frame, len); break;
+  }
+
+  return !checksum;
+}
+
+void simd_events(const uint8_t * in, uint32_t num_events, const simd_cols_t * cols, uint32_t first)
+{
+  uint32_t done = 0;
+
+#ifdef SIMD_X86
+  if(simd_level() >= SIMD_AVX2) done = simd_events_avx2(in, num_events, cols, first);
+  if(simd_level() >= SIMD_SSE41)
+  {
+    done += simd_events_sse41(in + done * CODEC_EVENT_LEN, num_events - done, cols, first + done);
+  }
+#endif
+
+  simd_events_scalar(in + done * CODEC_EVENT_LEN, num_events - done, cols, first + done);
+}
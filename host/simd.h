@@ -0,0 +1,109 @@
+/**
+ * @file simd.h
+ * @brief Vectorised frame checks and event decoding for the gateway
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * A gateway checks every dump frame and turns its 16 byte event records
+ * into something it can store. These do both with SSE4.1 or AVX2 when
+ * the CPU has them and a plain loop when it does not; every level gives
+ * the same answers. The CRC32 is folded with carry-less multiplies
+ * (PCLMULQDQ) 64 bytes at a time, the XOR checksum 16 or 32 bytes at a
+ * time, and events are transposed 4 or 8 at a time into columns, with
+ * the time converted to seconds on the way.
+ *
+ * The best level is picked on first use; simd_set_level() can lower it
+ * to compare them.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <stdint.h>
+#include "packets.h"
+
+/*
+ * @brief Instruction sets, each includes the ones before it
+ */
+typedef enum
+{
+  SIMD_SCALAR,
+  SIMD_SSE41, /* SSE4.1 and PCLMULQDQ */
+  SIMD_AVX2,
+  SIMD_NUM_LEVELS
+} simd_level_e;
+
+/*
+ * @brief Event columns, each with room for every event decoded into it
+ */
+typedef struct
+{
+  uint8_t * type; /* event_type_e */
+  uint8_t * merged; /* reserved[0], triggers merged into the event */
+  uint16_t * span_ms; /* reserved[1] and [2], first trigger to the last */
+  uint32_t * time; /* seconds since 2000, as rtc_to_seconds */
+  uint32_t * data;
+} simd_cols_t;
+
+/**
+ * @brief Gets the level in use
+ *
+ * @return A simd_level_e
+ */
+simd_level_e simd_level();
+
+/**
+ * @brief Changes the level in use
+ *
+ * @param level The level wanted, lowered to what the CPU has
+ *
+ * @return The level now in use
+ */
+simd_level_e simd_set_level(simd_level_e level);
+
+/**
+ * @brief Gets the name of a level
+ *
+ * @param level A simd_level_e
+ *
+ * @return The name
+ */
+const char * simd_level_name(simd_level_e level);
+
+/**
+ * @brief Add a block to a running CRC32, same as crc32_update
+ *
+ * @param crc The running CRC of the preceding bytes
+ * @param ptr Pointer to the block
+ * @param len The length of the block
+ *
+ * @return The updated running CRC
+ */
+uint32_t simd_crc32(uint32_t crc, const uint8_t * ptr, uint32_t len);
+
+/**
+ * @brief Checks the trailer of an unescaped frame
+ *
+ * @param version The protocol version, v3 frames after COBS decoding
+ * @param frame Pointer to the frame, type and pkt_len first
+ * @param len The length of the frame, trailer included
+ *
+ * @return 1 if the length and trailer are right, 0 if not
+ */
+uint8_t simd_frame_ok(uint8_t version, const uint8_t * frame, uint32_t len);
+
+/**
+ * @brief Decodes event records into columns
+ *
+ * @param in Pointer to num_events records of CODEC_EVENT_LEN bytes, as in a raw dump
+ * @param num_events The number of records
+ * @param cols Pointer to the columns
+ * @param first Row of the columns to write the first event to
+ *
+ * @return none
+ */
+void simd_events(const uint8_t * in, uint32_t num_events, const simd_cols_t * cols, uint32_t first);
+
+#endif /* __SIMD_H__ */
@@ -0,0 +1,264 @@
+/**
+ * @file simd_main.c
+ * @brief Frame check and event decode benchmark for simd.c
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Builds a shift's worth of full raw dump frames, back to back as they
+ * come off the wire, with one in every SIMD_BENCH_BAD_EVERY damaged.
+ * Each level the CPU has then checks every frame and decodes every
+ * event into columns, best of a number of runs on one thread. The
+ * codec line is the collector's old path for comparison, the byte loop
+ * CRC and codec_decode_event into event_t records.
+ *
+ * Every level has to find the same bad frames and fill the columns the
+ * same as codec_decode_event and unpack_seconds do, or the run fails.
+ *
+ * usage: pps_simd [-f frames] [-r runs] [-1]
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "crc.h"
+#include "packets.h"
+#include "simd.h"
+#include "unpack.h"
+
+#define SIMD_BENCH_MAX_FRAMES (1 << 16)
+#define SIMD_BENCH_PER_FRAME ((PKT_MAX_PAYLOAD - sizeof(res_dump_t)) / CODEC_EVENT_LEN)
+#define SIMD_BENCH_MAX_EVENTS (SIMD_BENCH_MAX_FRAMES * SIMD_BENCH_PER_FRAME)
+#define SIMD_BENCH_BAD_EVERY (64)
+
+static uint8_t wire[SIMD_BENCH_MAX_FRAMES * CODEC_FRAME_MAX];
+static uint32_t offsets[SIMD_BENCH_MAX_FRAMES + 1];
+static event_t records[SIMD_BENCH_PER_FRAME];
+
+static uint8_t type[SIMD_BENCH_MAX_EVENTS], merged[SIMD_BENCH_MAX_EVENTS];
+static uint16_t span_ms[SIMD_BENCH_MAX_EVENTS];
+static uint32_t secs[SIMD_BENCH_MAX_EVENTS], data[SIMD_BENCH_MAX_EVENTS];
+static const simd_cols_t cols = { type, merged, span_ms, secs, data };
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t bench_rand()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+
+  return rng;
+}
+
+static uint64_t bench_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* back to back frames of full dumps, returns the number damaged */
+static uint32_t bench_frames(uint8_t version, uint32_t num_frames)
+{
+  uint8_t frame[CODEC_FRAME_MAX];
+  res_dump_t hdr;
+  event_t event;
+  uint32_t f, i, used, len, bad = 0, pos = 0;
+
+  memset(&event, 0, sizeof(event));
+  for(f = 0; f < num_frames; f++)
+  {
+    hdr.package_id = 1 + bench_rand() % 4096;
+    hdr.num_events = SIMD_BENCH_PER_FRAME;
+    hdr.frames_left = num_frames - 1 - f;
+    codec_encode(PKT_RES_DUMP, &hdr, frame + CODEC_HDR_LEN, PKT_MAX_PAYLOAD, &used);
+
+    for(i = 0; i < SIMD_BENCH_PER_FRAME; i++)
+    {
+      event.event_type = (bench_rand() % 4) ? EVENT_DROP : EVENT_FLIP;
+      event.reserved[0] = bench_rand() % 8;
+      event.reserved[1] = bench_rand();
+      event.reserved[2] = bench_rand() % 4;
+      event.time.year = 2018 + bench_rand() % 3;
+      event.time.month = 1 + bench_rand() % 12;
+      event.time.dow = bench_rand() % 7;
+      event.time.day = 1 + bench_rand() % 28;
+      event.time.hour = bench_rand() % 24;
+      event.time.minute = bench_rand() % 60;
+      event.time.second = bench_rand() % 60;
+      event.data = bench_rand() % 8192;
+      codec_encode_event(&event, frame + CODEC_HDR_LEN + used + i * CODEC_EVENT_LEN);
+    }
+
+    len = codec_frame(version, PKT_RES_DUMP, frame, used + SIMD_BENCH_PER_FRAME * CODEC_EVENT_LEN);
+    if(f % SIMD_BENCH_BAD_EVERY == SIMD_BENCH_BAD_EVERY - 1)
+    {
+      frame[CODEC_HDR_LEN + bench_rand() % (len - CODEC_HDR_LEN)] ^= 1 << (bench_rand() % 8);
+      bad++;
+    }
+
+    offsets[f] = pos;
+    memcpy(wire + pos, frame, len);
+    pos += len;
+  }
+  offsets[num_frames] = pos;
+
+  return bad;
+}
+
+/* the frames that pass, through the collector's old check */
+static uint32_t bench_check_codec(uint8_t version, uint32_t num_frames)
+{
+  uint32_t f, i, len, crc, ok = 0;
+  const uint8_t * frame;
+  uint8_t checksum;
+
+  for(f = 0; f < num_frames; f++)
+  {
+    frame = wire + offsets[f];
+    len = CODEC_HDR_LEN + frame[1];
+    if(version >= PROTO_VERSION_CRC32)
+    {
+      crc = CRC32_FINAL(crc32_update(CRC32_INIT, frame, len));
+      ok += crc == (frame[len] | (frame[len + 1] << 8) | (frame[len + 2] << 16) | ((uint32_t)frame[len + 3] << 24));
+      continue;
+    }
+    for(i = 0, checksum = 0; i <= len; i++) checksum ^= frame[i];
+    ok += !checksum;
+  }
+
+  return ok;
+}
+
+static uint32_t bench_check(uint8_t version, uint32_t num_frames)
+{
+  uint32_t f, ok = 0;
+
+  for(f = 0; f < num_frames; f++) ok += simd_frame_ok(version, wire + offsets[f], offsets[f + 1] - offsets[f]);
+
+  return ok;
+}
+
+/* every frame decoded, damaged or not, so each run does the same work */
+static void bench_decode_codec(uint32_t num_frames)
+{
+  uint32_t f, i;
+
+  for(f = 0; f < num_frames; f++)
+  {
+    for(i = 0; i < SIMD_BENCH_PER_FRAME; i++)
+    {
+      codec_decode_event(wire + offsets[f] + CODEC_HDR_LEN + sizeof(res_dump_t) + i * CODEC_EVENT_LEN, &records[i]);
+    }
+  }
+}
+
+static void bench_decode(uint32_t num_frames)
+{
+  uint32_t f;
+
+  for(f = 0; f < num_frames; f++)
+  {
+    simd_events(wire + offsets[f] + CODEC_HDR_LEN + sizeof(res_dump_t), SIMD_BENCH_PER_FRAME, &cols,
+                f * SIMD_BENCH_PER_FRAME);
+  }
+}
+
+/* columns against codec_decode_event, returns the number of rows that differ */
+static uint32_t bench_verify(uint32_t num_frames)
+{
+  uint32_t f, i, row, wrong = 0;
+  event_t event;
+
+  for(f = 0, row = 0; f < num_frames; f++)
+  {
+    for(i = 0; i < SIMD_BENCH_PER_FRAME; i++, row++)
+    {
+      codec_decode_event(wire + offsets[f] + CODEC_HDR_LEN + sizeof(res_dump_t) + i * CODEC_EVENT_LEN, &event);
+      wrong += type[row] != event.event_type || merged[row] != event.reserved[0] ||
+               span_ms[row] != (event.reserved[1] | (event.reserved[2] << 8)) ||
+               secs[row] != unpack_seconds(&event.time) || data[row] != event.data;
+    }
+  }
+
+  return wrong;
+}
+
+int main(int argc, char ** argv)
+{
+  uint32_t num_frames = 16384, runs = 5, num_events, bad, ok, r, wrong = 0, failed = 0;
+  uint8_t version = PROTO_VERSION_CRC32;
+  uint64_t start, check_ns, decode_ns, t;
+  int level, max, opt;
+  double bytes, event_bytes;
+
+  while((opt = getopt(argc, argv, "f:r:1")) != -1)
+  {
+    switch(opt)
+    {
+      case 'f': num_frames = atoi(optarg); break;
+      case 'r': runs = atoi(optarg); break;
+      case '1': version = PROTO_VERSION_XOR; break;
+      default:
+        fprintf(stderr, "usage: %s [-f frames] [-r runs] [-1]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(!num_frames || num_frames > SIMD_BENCH_MAX_FRAMES || !runs)
+  {
+    fprintf(stderr, "%s: 1 to %u frames, at least 1 run\n", argv[0], SIMD_BENCH_MAX_FRAMES);
+    return 1;
+  }
+
+  bad = bench_frames(version, num_frames);
+  num_events = num_frames * SIMD_BENCH_PER_FRAME;
+  bytes = offsets[num_frames];
+  event_bytes = (double)num_events * CODEC_EVENT_LEN;
+  max = simd_level();
+
+  printf("%u v%u dump frames, %.0f KB, %u events, %u damaged\n", num_frames, version, bytes / 1024, num_events, bad);
+  printf("%-7s %9s %12s %6s %9s %12s\n", "level", "check", "frames/s", "bad", "decode", "events/s");
+
+  /* -1 is the codec line */
+  for(level = -1; level <= max; level++)
+  {
+    if(level >= 0) simd_set_level(level);
+    check_ns = decode_ns = ~0ull;
+    ok = 0;
+    for(r = 0; r < runs; r++)
+    {
+      start = bench_now_ns();
+      ok = (level < 0) ? bench_check_codec(version, num_frames) : bench_check(version, num_frames);
+      t = bench_now_ns() - start;
+      if(t < check_ns) check_ns = t;
+
+      start = bench_now_ns();
+      if(level < 0) bench_decode_codec(num_frames);
+      else bench_decode(num_frames);
+      t = bench_now_ns() - start;
+      if(t < decode_ns) decode_ns = t;
+    }
+
+    if(level >= 0)
+    {
+      wrong = bench_verify(num_frames);
+      memset(secs, 0, num_events * sizeof(uint32_t));
+    }
+    failed += (num_frames - ok != bad) || wrong;
+
+    printf("%-7s %5.2f GB/s %12.0f %6u %5.2f GB/s %12.0f%s\n", (level < 0) ? "codec" : simd_level_name(level),
+           bytes / check_ns, num_frames / (check_ns / 1e9), num_frames - ok, event_bytes / decode_ns,
+           num_events / (decode_ns / 1e9), wrong ? "  columns differ" : "");
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file store.c
+ * @brief Append only event store for a fleet, on the host
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pack.h"
+#include "store.h"
+#include "unpack.h"
+
+#define STORE_COLS_LEN (STORE_SEG_EVENTS * (sizeof(uint16_t) + 2 * sizeof(uint32_t) + sizeof(uint8_t)))
+#define STORE_FILE_LEN (STORE_HDR_LEN + STORE_COLS_LEN)
+#define STORE_BATCH (PACK_MAX_EVENTS) /* rows converted at once by store_append_events */
+
+_Static_assert(sizeof(store_hdr_t) <= STORE_HDR_LEN, "segment index fits its header");
+
+
+/* index */
+
+static void store_index_init(store_index_t * index, const store_row_t * row)
+{
+  index->min_time = row->time;
+  index->max_time = row->time;
+  index->min_package = row->package_id;
+  index->max_package = row->package_id;
+  memset(index->filter, 0, sizeof(index->filter));
+  index->filter[STORE_FILTER_BIT(row->package_id) / 32] |= 1u << (STORE_FILTER_BIT(row->package_id) % 32);
+}
+
+static void store_index_add(store_index_t * index, const store_row_t * row)
+{
+  if(row->time < index->min_time) index->min_time = row->time;
+  if(row->time > index->max_time) index->max_time = row->time;
+  if(row->package_id < index->min_package) index->min_package = row->package_id;
+  if(row->package_id > index->max_package) index->max_package = row->package_id;
+  index->filter[STORE_FILTER_BIT(row->package_id) / 32] |= 1u << (STORE_FILTER_BIT(row->package_id) % 32);
+}
+
+/* 0 if nothing in the range can match */
+static uint8_t store_index_match(const store_index_t * index, const store_query_t * query)
+{
+  uint8_t bit;
+
+  if(index->max_time < query->from || index->min_time > query->to) return 0;
+  if(query->package_id == STORE_ANY_PACKAGE) return 1;
+  if(query->package_id < index->min_package || query->package_id > index->max_package) return 0;
+
+  bit = STORE_FILTER_BIT(query->package_id);
+  return (index->filter[bit / 32] >> (bit % 32)) & 1;
+}
+
+
+/* segments */
+
+static void store_seg_path(const store_t * store, uint32_t num, char * path)
+{
+  snprintf(path, STORE_PATH_MAX + 16, "%s/seg-%06u.pps", store->dir, num);
+}
+
+/* maps a segment file, creating it at full size if it is new */
+static store_e store_seg_map(store_t * store, uint32_t num, uint8_t create)
+{
+  char path[STORE_PATH_MAX + 16];
+  store_seg_t * seg = &store->segs[num];
+  struct stat st;
+  uint8_t * base;
+
+  store_seg_path(store, num, path);
+  seg->fd = open(path, create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+  if(seg->fd < 0) return STORE_SYS_ERR;
+
+  if(create ? ftruncate(seg->fd, STORE_FILE_LEN) : (fstat(seg->fd, &st) || st.st_size != STORE_FILE_LEN))
+  {
+    close(seg->fd);
+    return create ? STORE_SYS_ERR : STORE_BAD_FILE;
+  }
+
+  base = mmap(NULL, STORE_FILE_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+  if(base == MAP_FAILED)
+  {
+    close(seg->fd);
+    return STORE_SYS_ERR;
+  }
+
+  seg->hdr = (store_hdr_t *)base;
+  seg->package_id = (uint16_t *)(base + STORE_HDR_LEN);
+  seg->time = (uint32_t *)(seg->package_id + STORE_SEG_EVENTS);
+  seg->type = (uint8_t *)(seg->time + STORE_SEG_EVENTS);
+  seg->data = (uint32_t *)(seg->type + STORE_SEG_EVENTS);
+
+  if(create)
+  {
+    /* a new file reads as zeros, the count stays 0 until rows are in */
+    seg->hdr->magic = STORE_MAGIC;
+    seg->hdr->version = STORE_VERSION;
+    seg->hdr->capacity = STORE_SEG_EVENTS;
+  }
+  else if(seg->hdr->magic != STORE_MAGIC || seg->hdr->version != STORE_VERSION ||
+          seg->hdr->capacity != STORE_SEG_EVENTS || seg->hdr->count > STORE_SEG_EVENTS)
+  {
+    munmap(base, STORE_FILE_LEN);
+    close(seg->fd);
+    return STORE_BAD_FILE;
+  }
+
+  return STORE_SUCCESS;
+}
+
+static void store_seg_unmap(store_seg_t * seg)
+{
+  munmap(seg->hdr, STORE_FILE_LEN);
+  close(seg->fd);
+  seg->fd = -1;
+}
+
+
+/* store */
+
+store_e store_open(store_t * store, const char * dir)
+{
+  char path[STORE_PATH_MAX + 16];
+  store_e status;
+
+  if(!store || !dir) return STORE_NULL_PTR;
+  if(strlen(dir) >= STORE_PATH_MAX) return STORE_SYS_ERR;
+
+  strcpy(store->dir, dir);
+  store->num_segments = 0;
+  store->synced = 0;
+  store->count = 0;
+  if(mkdir(dir, 0755) && errno != EEXIST) return STORE_SYS_ERR;
+
+  /* segments are numbered from 0 with no gaps */
+  while(store->num_segments < STORE_MAX_SEGMENTS)
+  {
+    store_seg_path(store, store->num_segments, path);
+    if(access(path, F_OK)) break;
+
+    status = store_seg_map(store, store->num_segments, 0);
+    if(status != STORE_SUCCESS)
+    {
+      store_close(store);
+      return status;
+    }
+    store->count += store->segs[store->num_segments].hdr->count;
+    store->num_segments++;
+  }
+  if(store->num_segments) store->synced = store->num_segments - 1;
+
+  return STORE_SUCCESS;
+}
+
+store_e store_append(store_t * store, const store_row_t * rows, uint32_t num_rows)
+{
+  store_seg_t * seg;
+  store_hdr_t * hdr;
+  uint32_t i, pos;
+  store_e status;
+
+  if(!store || (!rows && num_rows)) return STORE_NULL_PTR;
+
+  while(num_rows)
+  {
+    seg = store->num_segments ? &store->segs[store->num_segments - 1] : NULL;
+    if(!seg || seg->hdr->count == STORE_SEG_EVENTS)
+    {
+      if(store->num_segments == STORE_MAX_SEGMENTS) return STORE_FULL;
+      status = store_seg_map(store, store->num_segments, 1);
+      if(status != STORE_SUCCESS) return status;
+      seg = &store->segs[store->num_segments++];
+    }
+    hdr = seg->hdr;
+
+    /* as many as fit in this segment, then the count */
+    for(pos = hdr->count; num_rows && pos < STORE_SEG_EVENTS; pos++, rows++, num_rows--)
+    {
+      seg->package_id[pos] = rows->package_id;
+      seg->time[pos] = rows->time;
+      seg->type[pos] = rows->type;
+      seg->data[pos] = rows->data;
+
+      i = pos / STORE_BLOCK_EVENTS;
+      if(pos % STORE_BLOCK_EVENTS) store_index_add(&hdr->blocks[i], rows);
+      else store_index_init(&hdr->blocks[i], rows);
+      if(pos) store_index_add(&hdr->all, rows);
+      else store_index_init(&hdr->all, rows);
+    }
+    store->count += pos - hdr->count;
+    __atomic_store_n(&hdr->count, pos, __ATOMIC_RELEASE);
+  }
+
+  return STORE_SUCCESS;
+}
+
+store_e store_append_events(store_t * store, uint16_t package_id, const event_t * events, uint32_t num_events)
+{
+  store_row_t rows[STORE_BATCH];
+  uint32_t i, n;
+  store_e status;
+
+  if(!store || (!events && num_events)) return STORE_NULL_PTR;
+
+  while(num_events)
+  {
+    n = (num_events > STORE_BATCH) ? STORE_BATCH : num_events;
+    for(i = 0; i < n; i++)
+    {
+      rows[i].package_id = package_id;
+      rows[i].type = events[i].event_type;
+      rows[i].time = unpack_seconds(&events[i].time);
+      rows[i].data = events[i].data;
+    }
+
+    status = store_append(store, rows, n);
+    if(status != STORE_SUCCESS) return status;
+    events += n;
+    num_events -= n;
+  }
+
+  return STORE_SUCCESS;
+}
+
+store_e store_sync(store_t * store)
+{
+  uint32_t i;
+
+  if(!store) return STORE_NULL_PTR;
+
+  /* only the last segment changes, once a segment fills it is flushed for good */
+  for(i = store->synced; i < store->num_segments; i++)
+  {
+    if(msync(store->segs[i].hdr, STORE_FILE_LEN, MS_SYNC)) return STORE_SYS_ERR;
+  }
+  if(store->num_segments) store->synced = store->num_segments - 1;
+
+  return STORE_SUCCESS;
+}
+
+uint64_t store_query(const store_t * store, const store_query_t * query, store_row_cb cb, void * ctx,
+                     store_result_t * result)
+{
+  store_result_t res = { 0, 0, 0, 0 };
+  const store_seg_t * seg;
+  store_row_t row;
+  uint32_t s, b, i, end, count;
+  uint8_t used;
+
+  if(!store || !query) return 0;
+
+  for(s = 0; s < store->num_segments; s++)
+  {
+    seg = &store->segs[s];
+    count = __atomic_load_n(&seg->hdr->count, __ATOMIC_ACQUIRE);
+    if(!count || !store_index_match(&seg->hdr->all, query)) continue;
+
+    used = 0;
+    for(b = 0; b * STORE_BLOCK_EVENTS < count; b++)
+    {
+      if(!store_index_match(&seg->hdr->blocks[b], query)) continue;
+      used = 1;
+      res.blocks++;
+
+      end = (b + 1) * STORE_BLOCK_EVENTS;
+      if(end > count) end = count;
+      res.scanned += end - b * STORE_BLOCK_EVENTS;
+
+      /* cheapest column first, the rest only on a match */
+      for(i = b * STORE_BLOCK_EVENTS; i < end; i++)
+      {
+        if(query->package_id != STORE_ANY_PACKAGE && seg->package_id[i] != query->package_id) continue;
+        if(seg->time[i] < query->from || seg->time[i] > query->to) continue;
+        if(query->type != STORE_ANY_TYPE && seg->type[i] != query->type) continue;
+
+        res.rows++;
+        if(!cb) continue;
+        row.package_id = seg->package_id[i];
+        row.type = seg->type[i];
+        row.time = seg->time[i];
+        row.data = seg->data[i];
+        cb(ctx, &row);
+      }
+    }
+    res.segments += used;
+  }
+
+  if(result) *result = res;
+
+  return res.rows;
+}
+
+store_e store_close(store_t * store)
+{
+  store_e status;
+  uint32_t i;
+
+  if(!store) return STORE_NULL_PTR;
+
+  status = store_sync(store);
+  for(i = 0; i < store->num_segments; i++) store_seg_unmap(&store->segs[i]);
+  store->num_segments = 0;
+  store->count = 0;
+
+  return status;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file store.h
+ * @brief Append only event store for a fleet, on the host
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Events from every package go into a directory of segment files, each
+ * mapped with mmap and filled in order. A segment holds up to
+ * STORE_SEG_EVENTS rows in four fixed width columns (package id, time,
+ * type, data) after a header with a sparse index: the time range, the
+ * package id range and a package filter for the whole segment and for
+ * every STORE_BLOCK_EVENTS rows. A query skips any segment or block
+ * whose index rules it out and only reads the columns it filters on
+ * for the rest.
+ *
+ * Rows are counted in the header last, so a crash loses at most the
+ * rows appended since the last store_sync(). One writer at a time;
+ * queries may run alongside it on the same thread.
+ *
+ * Segment layout, little endian like the host:
+ *   store_hdr_t, padded to STORE_HDR_LEN
+ *   uint16_t package_id[STORE_SEG_EVENTS]
+ *   uint32_t time[STORE_SEG_EVENTS]        seconds since 2000, as rtc_to_seconds
+ *   uint8_t type[STORE_SEG_EVENTS]         event_type_e
+ *   uint32_t data[STORE_SEG_EVENTS]
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stdint.h>
+#include "packets.h"
+
+#define STORE_SEG_EVENTS (1 << 20) /* rows per segment, 11 MB of columns */
+#define STORE_BLOCK_EVENTS (4096) /* rows per index entry */
+#define STORE_SEG_BLOCKS (STORE_SEG_EVENTS / STORE_BLOCK_EVENTS)
+#define STORE_MAX_SEGMENTS (1024)
+#define STORE_HDR_LEN (16384) /* header and index, page aligned */
+#define STORE_FILTER_WORDS (8) /* 256 bit package filter */
+#define STORE_FILTER_BIT(id) ((uint8_t)(((uint32_t)(id) * 2654435761u) >> 24))
+#define STORE_PATH_MAX (256)
+#define STORE_MAGIC (0x53535050) /* "PPSS" */
+#define STORE_VERSION (1)
+
+#define STORE_ANY_PACKAGE (0xFFFFFFFF)
+#define STORE_ANY_TYPE (0xFFFF)
+
+/*
+ * @brief Store status code
+ */
+typedef enum
+{
+  STORE_SUCCESS,
+  STORE_NULL_PTR,
+  STORE_FULL, /* every segment is full */
+  STORE_BAD_FILE, /* a segment is not from this version of the store */
+  STORE_SYS_ERR /* a file call failed, see errno */
+} store_e;
+
+/*
+ * @brief One event as stored
+ */
+typedef struct
+{
+  uint16_t package_id;
+  uint8_t type; /* event_type_e */
+  uint32_t time; /* seconds since 2000 */
+  uint32_t data;
+} store_row_t;
+
+/*
+ * @brief Index entry, for a block or a whole segment
+ *
+ * The filter has bit STORE_FILTER_BIT(package_id) set for every package
+ * in the range, so a clear bit rules a package out.
+ */
+typedef struct
+{
+  uint32_t min_time;
+  uint32_t max_time;
+  uint16_t min_package;
+  uint16_t max_package;
+  uint32_t filter[STORE_FILTER_WORDS];
+} store_index_t;
+
+/*
+ * @brief Segment header, at the start of each file
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity; /* STORE_SEG_EVENTS when written */
+  uint32_t count; /* rows, written after the rows and the index */
+  store_index_t all;
+  store_index_t blocks[STORE_SEG_BLOCKS];
+} store_hdr_t;
+
+/*
+ * @brief A mapped segment
+ */
+typedef struct
+{
+  int fd;
+  store_hdr_t * hdr;
+  uint16_t * package_id;
+  uint32_t * time;
+  uint8_t * type;
+  uint32_t * data;
+} store_seg_t;
+
+/*
+ * @brief What to look for, each filter may be left open
+ */
+typedef struct
+{
+  uint32_t package_id; /* STORE_ANY_PACKAGE for all */
+  uint16_t type; /* STORE_ANY_TYPE for all */
+  uint32_t from; /* first second, inclusive */
+  uint32_t to; /* last second, inclusive */
+} store_query_t;
+
+/*
+ * @brief How much of the store a query read
+ */
+typedef struct
+{
+  uint64_t rows; /* rows that matched */
+  uint64_t scanned; /* rows read */
+  uint32_t blocks; /* blocks read */
+  uint32_t segments; /* segments with a block read */
+} store_result_t;
+
+/*
+ * @brief Called with each matching row, in the order appended
+ */
+typedef void (*store_row_cb)(void * ctx, const store_row_t * row);
+
+/*
+ * @brief Store
+ */
+typedef struct
+{
+  char dir[STORE_PATH_MAX];
+  uint32_t num_segments;
+  uint32_t synced; /* first segment store_sync() still has to flush */
+  uint64_t count; /* rows in every segment */
+  store_seg_t segs[STORE_MAX_SEGMENTS];
+} store_t;
+
+/**
+ * @brief Opens a store, creating the directory if needed
+ *
+ * Maps every segment already in the directory
+ *
+ * @param store Pointer to the store
+ * @param dir The directory
+ *
+ * @return A store status code
+ */
+store_e store_open(store_t * store, const char * dir);
+
+/**
+ * @brief Appends rows, starting new segments as they fill
+ *
+ * @param store Pointer to the store
+ * @param rows Pointer to the rows
+ * @param num_rows The number of rows
+ *
+ * @return A store status code, STORE_FULL with only some of the rows stored
+ */
+store_e store_append(store_t * store, const store_row_t * rows, uint32_t num_rows);
+
+/**
+ * @brief Appends the events of one dump
+ *
+ * @param store Pointer to the store
+ * @param package_id The package the dump came from
+ * @param events Pointer to the events, such as coll_msg_t.events
+ * @param num_events The number of events
+ *
+ * @return A store status code
+ */
+store_e store_append_events(store_t * store, uint16_t package_id, const event_t * events, uint32_t num_events);
+
+/**
+ * @brief Writes everything appended so far to disk
+ *
+ * @param store Pointer to the store
+ *
+ * @return A store status code
+ */
+store_e store_sync(store_t * store);
+
+/**
+ * @brief Finds rows
+ *
+ * @param store Pointer to the store
+ * @param query Pointer to the filters
+ * @param cb Called with each match, may be NULL to only count
+ * @param ctx Passed to the callback
+ * @param result Pointer to the location to store the counts, may be NULL
+ *
+ * @return The number of matching rows
+ */
+uint64_t store_query(const store_t * store, const store_query_t * query, store_row_cb cb, void * ctx,
+                     store_result_t * result);
+
+/**
+ * @brief Syncs and unmaps every segment
+ *
+ * @param store Pointer to the store
+ *
+ * @return A store status code
+ */
+store_e store_close(store_t * store);
+
+#endif /* __STORE_H__ */
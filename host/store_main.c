@@ -0,0 +1,269 @@
+/**
+ * @file store_main.c
+ * @brief Ingest and query benchmark for the event store, see store.h
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Fills a store with a fleet's worth of dumps: each dump is one package's
+ * log, up to PACK_MAX_EVENTS events from the few days before it was
+ * collected, and collection runs evenly over the span. Appends and the
+ * final sync are timed apart from making the dumps. The store is then
+ * reopened and asked the questions a gateway gets, all drops for one
+ * package in one week and every event in the fleet in one hour, and the
+ * first of each are checked against a scan of the whole store.
+ *
+ * usage: pps_store [-d dir] [-n events] [-p packages] [-D days] [-q queries] [-k]
+ *
+ * Without -d the store goes in a new directory under /tmp, removed at the
+ * end unless -k is given.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+/* system headers first, helpers.h poisons the allocator */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pack.h"
+#include "packets.h"
+#include "store.h"
+
+#define STORE_BENCH_START (578534400) /* 2018/05/01, seconds since 2000 */
+#define STORE_BENCH_DAY (86400)
+#define STORE_BENCH_LAG (3 * STORE_BENCH_DAY) /* oldest event in a dump */
+#define STORE_BENCH_CHECKS (20) /* queries of each kind checked by a full scan */
+#define STORE_BENCH_MAX_QUERIES (100000)
+#define STORE_BENCH_ROW_LEN (sizeof(uint16_t) + 2 * sizeof(uint32_t) + sizeof(uint8_t))
+
+static store_t store;
+static uint32_t latency_ns[STORE_BENCH_MAX_QUERIES];
+static uint32_t rng = 2463534242u;
+
+static uint32_t bench_rand()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+
+  return rng;
+}
+
+static uint64_t bench_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_cmp(const void * a, const void * b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static int bench_time_cmp(const void * a, const void * b)
+{
+  const store_row_t * x = (const store_row_t *)a, * y = (const store_row_t *)b;
+
+  return (x->time > y->time) - (x->time < y->time);
+}
+
+/* one package's dump, collected at now */
+static uint32_t bench_dump(store_row_t * rows, uint32_t packages, uint32_t now)
+{
+  uint32_t i, n = 1 + bench_rand() % PACK_MAX_EVENTS, r;
+  uint16_t package_id = 1 + bench_rand() % packages;
+
+  for(i = 0; i < n; i++)
+  {
+    r = bench_rand() % 100;
+    rows[i].package_id = package_id;
+    rows[i].type = (r < 70) ? EVENT_DROP : (r < 99) ? EVENT_FLIP : EVENT_CORRUPT;
+    rows[i].time = now - bench_rand() % STORE_BENCH_LAG;
+    rows[i].data = 256 + bench_rand() % 4096;
+  }
+  qsort(rows, n, sizeof(store_row_t), bench_time_cmp);
+
+  return n;
+}
+
+/* the answer without the index */
+static uint64_t bench_scan(const store_query_t * query)
+{
+  const store_seg_t * seg;
+  uint64_t rows = 0;
+  uint32_t s, i;
+
+  for(s = 0; s < store.num_segments; s++)
+  {
+    seg = &store.segs[s];
+    for(i = 0; i < seg->hdr->count; i++)
+    {
+      rows += (query->package_id == STORE_ANY_PACKAGE || seg->package_id[i] == query->package_id) &&
+              seg->time[i] >= query->from && seg->time[i] <= query->to &&
+              (query->type == STORE_ANY_TYPE || seg->type[i] == query->type);
+    }
+  }
+
+  return rows;
+}
+
+/* runs one kind of query, returns the number that disagreed with a scan */
+static uint32_t bench_queries(const char * name, uint32_t num, uint32_t packages, uint32_t span, uint32_t window,
+                              uint8_t one_package)
+{
+  store_query_t query;
+  store_result_t res;
+  uint64_t start, rows = 0, scanned = 0, blocks = 0, scan_ns = 0, want;
+  uint32_t i, wrong = 0, checks = 0, total_blocks = 0;
+
+  for(i = 0; i < store.num_segments; i++)
+  {
+    total_blocks += (store.segs[i].hdr->count + STORE_BLOCK_EVENTS - 1) / STORE_BLOCK_EVENTS;
+  }
+
+  for(i = 0; i < num; i++)
+  {
+    query.package_id = one_package ? 1 + bench_rand() % packages : STORE_ANY_PACKAGE;
+    query.type = one_package ? EVENT_DROP : STORE_ANY_TYPE;
+    query.from = STORE_BENCH_START + bench_rand() % (span - window);
+    query.to = query.from + window - 1;
+
+    start = bench_now_ns();
+    store_query(&store, &query, NULL, NULL, &res);
+    latency_ns[i] = bench_now_ns() - start;
+    rows += res.rows;
+    scanned += res.scanned;
+    blocks += res.blocks;
+
+    if(i < STORE_BENCH_CHECKS)
+    {
+      start = bench_now_ns();
+      want = bench_scan(&query);
+      scan_ns += bench_now_ns() - start;
+      checks++;
+      wrong += want != res.rows;
+    }
+  }
+  qsort(latency_ns, num, sizeof(uint32_t), bench_cmp);
+
+  printf("%s: %u queries, %.1f rows each, %.1f of %u blocks and %.0f rows read each\n", name, num,
+         (double)rows / num, (double)blocks / num, total_blocks, (double)scanned / num);
+  printf("  latency p50 %.1f us, p99 %.1f us, max %.1f us; full scan %.1f ms; %u of %u checks wrong\n",
+         latency_ns[num / 2] / 1e3, latency_ns[(num * 99) / 100] / 1e3, latency_ns[num - 1] / 1e3,
+         checks ? scan_ns / 1e6 / checks : 0, wrong, checks);
+
+  return wrong;
+}
+
+int main(int argc, char ** argv)
+{
+  static store_row_t rows[PACK_MAX_EVENTS];
+  char tmp[] = "/tmp/pps-store-XXXXXX", path[STORE_PATH_MAX + 16];
+  const char * dir = NULL;
+  uint32_t events = 4000000, packages = 2000, days = 365, queries = 1000, i, n, wrong;
+  uint64_t done = 0, append_ns = 0, start;
+  uint8_t keep = 0;
+  double elapsed;
+  int opt;
+
+  while((opt = getopt(argc, argv, "d:n:p:D:q:k")) != -1)
+  {
+    switch(opt)
+    {
+      case 'd': dir = optarg; keep = 1; break;
+      case 'n': events = atoi(optarg); break;
+      case 'p': packages = atoi(optarg); break;
+      case 'D': days = atoi(optarg); break;
+      case 'q': queries = atoi(optarg); break;
+      case 'k': keep = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-d dir] [-n events] [-p packages] [-D days] [-q queries] [-k]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(!events || !packages || packages > 0xFFFF || days < 8 || !queries || queries > STORE_BENCH_MAX_QUERIES ||
+     events > (uint64_t)STORE_SEG_EVENTS * STORE_MAX_SEGMENTS)
+  {
+    fprintf(stderr, "%s: 1 to 65535 packages, at least 8 days, 1 to %u queries, at most %u segments of events\n",
+            argv[0], STORE_BENCH_MAX_QUERIES, STORE_MAX_SEGMENTS);
+    return 1;
+  }
+  if(!dir && !(dir = mkdtemp(tmp)))
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  if(store_open(&store, dir) != STORE_SUCCESS)
+  {
+    perror(dir);
+    return 1;
+  }
+  if(store.count)
+  {
+    fprintf(stderr, "%s: %s already holds %llu events, use a new directory\n", argv[0], dir,
+            (unsigned long long)store.count);
+    store_close(&store);
+    return 1;
+  }
+
+  /* ingest */
+  while(done < events)
+  {
+    n = bench_dump(rows, packages, STORE_BENCH_START + STORE_BENCH_LAG +
+                                   (uint64_t)(days * STORE_BENCH_DAY - STORE_BENCH_LAG) * done / events);
+    if(n > events - done) n = events - done;
+
+    start = bench_now_ns();
+    if(store_append(&store, rows, n) != STORE_SUCCESS)
+    {
+      perror("store_append");
+      return 1;
+    }
+    append_ns += bench_now_ns() - start;
+    done += n;
+  }
+  start = bench_now_ns();
+  store_sync(&store);
+  elapsed = (bench_now_ns() - start) / 1e9;
+
+  printf("%llu events from %u packages over %u days in %u segments (%s)\n", (unsigned long long)done, packages, days,
+         store.num_segments, dir);
+  printf("ingest %.0f events/s, %.1f MB/s of columns; sync %.3f s\n", done / (append_ns / 1e9),
+         done * STORE_BENCH_ROW_LEN / (append_ns / 1e3), elapsed);
+
+  /* what a gateway coming back up sees */
+  store_close(&store);
+  start = bench_now_ns();
+  if(store_open(&store, dir) != STORE_SUCCESS || store.count != done)
+  {
+    fprintf(stderr, "%s: reopened with %llu events\n", argv[0], (unsigned long long)store.count);
+    return 1;
+  }
+  printf("reopen %.2f ms\n", (bench_now_ns() - start) / 1e6);
+
+  wrong = bench_queries("drops, one package, one week", queries, packages, days * STORE_BENCH_DAY,
+                        7 * STORE_BENCH_DAY, 1);
+  wrong += bench_queries("all events, whole fleet, one hour", queries, packages, days * STORE_BENCH_DAY, 3600, 0);
+
+  n = store.num_segments;
+  store_close(&store);
+  if(!keep)
+  {
+    for(i = 0; i < n; i++)
+    {
+      snprintf(path, sizeof(path), "%s/seg-%06u.pps", dir, i);
+      unlink(path);
+    }
+    rmdir(dir);
+  }
+
+  return wrong ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file unpack.c
+ * @brief Packed dump decoder for the host tools
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include <string.h>
+
+#include "pack.h"
+#include "unpack.h"
+
+#define UNPACK_DAY (86400)
+
+static uint8_t unpack_varint(const uint8_t * in, uint32_t len, uint32_t * pos, uint32_t * value)
+{
+  uint32_t shift = 0;
+  uint8_t b;
+
+  *value = 0;
+  do
+  {
+    if(*pos >= len || shift > 28) return 0;
+    b = in[(*pos)++];
+    *value |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while(b & 0x80);
+
+  return 1;
+}
+
+void unpack_time(uint32_t secs, uint8_t dow, rtc_t * time)
+{
+  /* days since 0000/03/01, the inverse of rtc_to_seconds */
+  uint32_t days = secs / UNPACK_DAY + 730425;
+  uint32_t rem = secs % UNPACK_DAY;
+  uint32_t era = days / 146097;
+  uint32_t doe = days - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+
+  time->day = doy - (153 * mp + 2) / 5 + 1;
+  time->month = (mp < 10) ? mp + 3 : mp - 9;
+  time->year = yoe + era * 400 + (time->month <= 2);
+  time->dow = dow;
+  time->hour = rem / 3600;
+  time->minute = rem / 60 % 60;
+  time->second = rem % 60;
+}
+
+uint32_t unpack_seconds(const rtc_t * time)
+{
+  uint32_t y, m, days;
+
+  if(time->year < 2000) return 0;
+
+  y = time->year - (time->month <= 2);
+  m = (time->month + 9) % 12;
+  days = 365 * y + y / 4 - y / 100 + y / 400 + (153 * m + 2) / 5 + time->day - 1 - 730425;
+
+  return ((days * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
+
+uint8_t unpack_events(const uint8_t * in, uint32_t len, uint32_t num_events, event_t * events)
+{
+  uint32_t types_len = (2 * num_events + 7) / 8;
+  uint32_t flags_len = (num_events + 7) / 8;
+  uint32_t i, pos, base, secs, value;
+  int32_t days;
+  const uint8_t * types, * flags;
+  uint8_t type, dow;
+
+  if(!num_events) return 1;
+  if(num_events > PACK_MAX_EVENTS || len < PACK_BASE_LEN + types_len + flags_len) return 0;
+
+  base = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+  dow = in[4];
+  types = in + PACK_BASE_LEN;
+  flags = types + types_len;
+  pos = PACK_BASE_LEN + types_len + flags_len;
+
+  /* types, with the other column */
+  for(i = 0; i < num_events; i++)
+  {
+    memset(&events[i], 0, sizeof(event_t));
+    type = (types[i / 4] >> (2 * (i % 4))) & 0x03;
+    switch(type)
+    {
+      case PACK_TYPE_DROP: events[i].event_type = EVENT_DROP; break;
+      case PACK_TYPE_FLIP: events[i].event_type = EVENT_FLIP; break;
+      case PACK_TYPE_CORRUPT: events[i].event_type = EVENT_CORRUPT; break;
+      default:
+        if(pos >= len) return 0;
+        events[i].event_type = in[pos++];
+        break;
+    }
+  }
+
+  /* reserved */
+  for(i = 0; i < num_events; i++)
+  {
+    if(!((flags[i / 8] >> (i % 8)) & 1)) continue;
+    if(!unpack_varint(in, len, &pos, &value)) return 0;
+    events[i].reserved[0] = value;
+    events[i].reserved[1] = value >> 8;
+    events[i].reserved[2] = value >> 16;
+  }
+
+  /* time deltas, zigzag, and the day of the week counted on from the base */
+  secs = base;
+  for(i = 0; i < num_events; i++)
+  {
+    if(i)
+    {
+      if(!unpack_varint(in, len, &pos, &value)) return 0;
+      secs += (value >> 1) ^ -(value & 1);
+    }
+    days = (int32_t)(secs / UNPACK_DAY) - (int32_t)(base / UNPACK_DAY);
+    unpack_time(secs, ((dow + days) % 7 + 7) % 7, &events[i].time);
+  }
+
+  /* data */
+  for(i = 0; i < num_events; i++)
+  {
+    if(!unpack_varint(in, len, &pos, &events[i].data)) return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file unpack.h
+ * @brief Packed dump decoder for the host tools
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Turns the column layout pack_events() writes (see pack.h) back into
+ * event records, the same way scripts/dump_pack.py does.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __UNPACK_H__
+#define __UNPACK_H__
+
+#include <stdint.h>
+#include "packets.h"
+
+/**
+ * @brief Decode the events of one packed dump packet
+ *
+ * @param in Pointer to the packed events, after the res_dump_t header
+ * @param len The length of the packed events
+ * @param num_events Events in the packet, at most PACK_MAX_EVENTS
+ * @param events Pointer to num_events records to fill
+ *
+ * @return 1 on success, 0 if the columns run past len
+ */
+uint8_t unpack_events(const uint8_t * in, uint32_t len, uint32_t num_events, event_t * events);
+
+/**
+ * @brief Convert seconds since 2000/01/01 to a calendar time
+ *
+ * @param secs Seconds since 2000/01/01, as rtc_to_seconds returns
+ * @param dow Day of the week to store
+ * @param time Pointer to the time to fill
+ *
+ * @return none
+ */
+void unpack_time(uint32_t secs, uint8_t dow, rtc_t * time);
+
+/**
+ * @brief Convert a calendar time to seconds since 2000/01/01
+ *
+ * The same count as rtc_to_seconds, which cannot be linked without the
+ * board's RTC. The day of the week is ignored.
+ *
+ * @param time Pointer to the time to convert
+ *
+ * @return seconds since 2000, 0 for times before 2000
+ */
+uint32_t unpack_seconds(const rtc_t * time);
+
+#endif /* __UNPACK_H__ */
@@ -53,6 +53,13 @@
 #define ADXL_INT_SINGLE_TAP (1 << 6)
 #define ADXL_INT_DATA_READY (1 << 7)
 
+#define ADXL_BW_RATE_MASK       (0x0F) /* 3200 Hz at 0x0F, halving with each code below */
+#define ADXL_FIFO_CTL_BYPASS    (0x00)
+#define ADXL_FIFO_CTL_STREAM    (0x80) /* keeps the newest samples once full */
+#define ADXL_FIFO_STATUS_ENTRIES (0x3F)
+#define ADXL_FIFO_DEPTH         (32)
+#define ADXL_SAMPLE_LEN         (6) /* DATAX0 to DATAZ1, one FIFO entry */
+
 #define ADXL_ACT_INACT_CTRL_ACT_AC_DC (1 << 7)
 #define ADXL_ACT_INACT_CTRL_ACT_X (1 << 6)
 #define ADXL_ACT_INACT_CTRL_ACT_Y (1 << 5)
@@ -79,7 +86,7 @@ __attribute__((always_inline)) inline uint8_t adxl_get_dev_id()
  */
 __attribute__((always_inline)) inline int16_t adxl_get_x()
 {
-  return (spi_read(ADXL_DATAX1) << 8) | spi_read(ADXL_DATAX0);
+  return spi_read_double(ADXL_DATAX0);
 }
 
 /**
@@ -89,7 +96,7 @@ __attribute__((always_inline)) inline int16_t adxl_get_x()
  */
 __attribute__((always_inline)) inline int16_t adxl_get_y()
 {
-    return (spi_read(ADXL_DATAY1) << 8) | spi_read(ADXL_DATAY0);
+  return spi_read_double(ADXL_DATAY0);
 }
 
 /**
@@ -99,7 +106,23 @@ __attribute__((always_inline)) inline int16_t adxl_get_y()
  */
 __attribute__((always_inline)) inline int16_t adxl_get_z()
 {
-    return (spi_read(ADXL_DATAZ1) << 8) | spi_read(ADXL_DATAZ0);
+  return spi_read_double(ADXL_DATAZ0);
+}
+
+/**
+ * @brief get the largest reading of the three axes
+ *
+ * @return largest absolute axis value, 256 per g at the 2g range
+ */
+__attribute__((always_inline)) inline uint32_t adxl_get_peak()
+{
+  int32_t x = adxl_get_x(), y = adxl_get_y(), z = adxl_get_z();
+  uint32_t peak = (x < 0) ? -x : x;
+
+  if(((y < 0) ? -y : y) > peak) peak = (y < 0) ? -y : y;
+  if(((z < 0) ? -z : z) > peak) peak = (z < 0) ? -z : z;
+
+  return peak;
 }
 
 /**
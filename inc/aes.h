@@ -0,0 +1,128 @@
+/**
+ * @file aes.h
+ * @brief AES-256 encryption
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Only the forward cipher is needed: single blocks for deriving keys,
+ * and OFB for sealing frames, where decrypting is the same as
+ * encrypting. Uses the AES256 accelerator on the MSP432, fed and
+ * emptied by the DMA, and a byte oriented loop on host builds or when
+ * built with AES_SOFTWARE. Both give the same output.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __AES_H__
+#define __AES_H__
+
+#include <stdint.h>
+
+#define AES_BLOCK_LEN (16)
+#define AES_KEY_LEN (32)
+#define AES_ROUNDS (14)
+#define AES_ROUND_UP(len) (((len) + AES_BLOCK_LEN - 1) & ~(AES_BLOCK_LEN - 1))
+
+/*
+ * @brief Key and its schedule
+ *
+ * The accelerator expands the key itself, the schedule is for the loop
+ */
+typedef struct
+{
+  uint8_t key[AES_KEY_LEN];
+  uint8_t round_keys[(AES_ROUNDS + 1) * AES_BLOCK_LEN];
+} aes_ctx_t;
+
+/**
+ * @brief Sets up a key
+ *
+ * @param ctx Pointer to the context to fill
+ * @param key Pointer to AES_KEY_LEN bytes of key
+ *
+ * @return none
+ */
+void aes_init(aes_ctx_t * ctx, const uint8_t * key);
+
+/**
+ * @brief Encrypts one block
+ *
+ * @param ctx Pointer to the key
+ * @param in Pointer to AES_BLOCK_LEN bytes of plaintext
+ * @param out Pointer to AES_BLOCK_LEN bytes for the ciphertext, may be in
+ *
+ * @return none
+ */
+void aes_encrypt(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out);
+
+/**
+ * @brief Encrypts or decrypts in output feedback mode
+ *
+ * The accelerator works a block at a time, so on the part in and out
+ * must be half word aligned with room up to AES_ROUND_UP(len); the
+ * bytes past len are written with junk. out may be in.
+ *
+ * @param ctx Pointer to the key
+ * @param iv Pointer to AES_BLOCK_LEN bytes, never used twice with a key
+ * @param in Pointer to the input
+ * @param out Pointer to the output
+ * @param len The number of bytes
+ *
+ * @return none
+ */
+void aes_ofb(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len);
+
+/**
+ * @brief aes_encrypt() with the loop
+ *
+ * @param ctx Pointer to the key
+ * @param in Pointer to the plaintext block
+ * @param out Pointer to the ciphertext block
+ *
+ * @return none
+ */
+void aes_encrypt_sw(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out);
+
+/**
+ * @brief aes_ofb() with the loop, any length
+ *
+ * @param ctx Pointer to the key
+ * @param iv Pointer to the IV
+ * @param in Pointer to the input
+ * @param out Pointer to the output
+ * @param len The number of bytes
+ *
+ * @return none
+ */
+void aes_ofb_sw(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len);
+
+#ifndef HOST_BUILD
+/**
+ * @brief aes_encrypt() with the accelerator
+ *
+ * @param ctx Pointer to the key
+ * @param in Pointer to the plaintext block
+ * @param out Pointer to the ciphertext block
+ *
+ * @return none
+ */
+void aes_encrypt_hw(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out);
+
+/**
+ * @brief aes_ofb() with the accelerator and the DMA
+ *
+ * The DMA moves every block in and out while the CPU waits, so
+ * interrupts are still taken
+ *
+ * @param ctx Pointer to the key
+ * @param iv Pointer to the IV
+ * @param in Pointer to the input, room for whole blocks
+ * @param out Pointer to the output, room for whole blocks
+ * @param len The number of bytes
+ *
+ * @return none
+ */
+void aes_ofb_hw(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len);
+#endif /* HOST_BUILD */
+
+#endif /* __AES_H__ */
@@ -0,0 +1,98 @@
+/**
+ * @file arena.h
+ * @brief Static memory arena with fixed size pools
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Replaces the heap. Every pool is sized at compile time and placed by
+ * the linker in the .bss.arena section, so memory use is fixed at build
+ * time and allocation never fragments.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/04
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "helpers.h"
+
+#define ARENA_SECTION __attribute__((section(".bss.arena")))
+
+#define ARENA_EVENT_POOL_LEN (128) /* events kept in the log */
+#define ARENA_PAYLOAD_POOL_LEN (1) /* command payloads in flight */
+#define ARENA_PAYLOAD_SIZE (256) /* pkt_len is one byte */
+#define ARENA_TRACKING_SIZE (256) /* tracking_len is one byte */
+
+/*
+ * @brief Arena status code
+ */
+typedef enum
+{
+  AR_SUCCESS,
+  AR_NULL_PTR,
+  AR_INVALID_PARAM
+} ar_e;
+
+/*
+ * @brief Arena pools
+ */
+typedef enum
+{
+  ARENA_POOL_EB = 0, /* eb_t */
+  ARENA_POOL_CB, /* cb_t */
+  ARENA_POOL_RX, /* UART RX ring storage */
+  ARENA_POOL_EVENT, /* ll_event_t */
+  ARENA_POOL_PAYLOAD, /* received command payloads */
+  ARENA_POOL_TRACKING, /* tracking number */
+  ARENA_NUM_POOLS
+} arena_pool_e;
+
+/**
+ * @brief Initialize the arena
+ *
+ * Builds the free list of every pool
+ *
+ * @return none
+ */
+void arena_init();
+
+/**
+ * @brief Allocate a block from a pool
+ *
+ * @param pool The pool to allocate from
+ *
+ * @return A pointer to the block, NULL if the pool is exhausted
+ */
+void * arena_alloc(arena_pool_e pool);
+
+/**
+ * @brief Return a block to its pool
+ *
+ * @param pool The pool the block was allocated from
+ * @param ptr The block to return
+ *
+ * @return An arena status code
+ */
+ar_e arena_free(arena_pool_e pool, void * ptr);
+
+/**
+ * @brief Get the block size of a pool
+ *
+ * @param pool The pool
+ *
+ * @return The size of each block in bytes
+ */
+uint32_t arena_block_size(arena_pool_e pool);
+
+/**
+ * @brief Get the usage of a pool
+ *
+ * @param pool The pool
+ * @param used Pointer to the location to store the blocks in use
+ * @param high_water Pointer to the location to store the most blocks ever in use
+ *
+ * @return An arena status code
+ */
+ar_e arena_get_usage(arena_pool_e pool, uint16_t * used, uint16_t * high_water);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,91 @@
+/**
+ * @file baud.h
+ * @brief Bluetooth UART rate negotiation
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Moving the link off 9600 baud takes three steps, run from the main
+ * loop so sensing carries on meanwhile:
+ *
+ *   1. send AT+BAUDn to the HC-06 and wait for its OK
+ *   2. switch the EUSCI_A2 divider and announce the new rate
+ *   3. wait for the app to confirm with PKT_CMD_BAUD at the new rate
+ *
+ * If the module does not answer, the old rate is kept. If the app does
+ * not confirm, the module and the EUSCI are both put back.
+ *
+ * Only built in with BAUD_SWITCH, for modules that take AT commands
+ * while connected. The AT command goes out on the same link as the
+ * app, which the HC-06 passes through to the phone.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/08
+ */
+#ifndef __BAUD_H__
+#define __BAUD_H__
+
+#include "helpers.h"
+#include "packets.h"
+
+#define BAUD_AT_TIMEOUT (MCLK_HZ / 2) /* 500ms for the module to answer */
+#define BAUD_CONFIRM_TIMEOUT (MCLK_HZ * 2) /* 2s for the app to confirm */
+#define BAUD_AT_RESP_LEN (8) /* "OK115200" */
+
+/*
+ * @brief Baud negotiation result, returned by baud_poll
+ */
+typedef enum
+{
+  BAUD_NONE = 0, /* nothing happened */
+  BAUD_SWITCHED, /* module and UART are at the new rate, waiting for confirmation */
+  BAUD_CONFIRMED, /* app confirmed the new rate */
+  BAUD_FAILED, /* module did not answer, still at the old rate */
+  BAUD_REVERTED /* app did not confirm, back at the old rate */
+} baud_e;
+
+/**
+ * @brief Start switching the Bluetooth UART to a new rate
+ *
+ * @param rate The baud_rate_e to switch to
+ *
+ * @return 1 if started, 0 if the rate is invalid or a switch is in progress
+ */
+uint8_t baud_start(uint8_t rate);
+
+/**
+ * @brief Confirm the new rate
+ *
+ * Called when PKT_CMD_BAUD arrives while waiting for confirmation
+ *
+ * @param rate The rate the app asked for
+ *
+ * @return 1 if it matches the rate being switched to
+ */
+uint8_t baud_confirm(uint8_t rate);
+
+/**
+ * @brief Check if waiting for the app to confirm
+ *
+ * @return 1 while waiting
+ */
+uint8_t baud_confirming();
+
+/**
+ * @brief Step the negotiation, call from the main loop
+ *
+ * @return A baud negotiation result
+ */
+baud_e baud_poll();
+
+/**
+ * @brief Take a received byte while talking to the module
+ *
+ * Called from the UART interrupt before the packet parser
+ *
+ * @param data The received byte
+ *
+ * @return 1 if the byte was used, 0 if it belongs to the packet parser
+ */
+uint8_t baud_rx(uint8_t data);
+
+#endif /* __BAUD_H__ */
@@ -0,0 +1,31 @@
+/**
+ * @file bench.h
+ * @brief On-target micro benchmarks
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Times the hot path with the cycle counter and prints cycles per
+ * operation over the on-board UART. Build once with and once without
+ * RAM_HOT_PATH to compare flash and SRAM execution.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/05
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "helpers.h"
+
+#define BENCH_ITERATIONS (256)
+#define BENCH_PACK_EVENTS (64) /* events in the mock log for the pack benchmark */
+#define BENCH_AES_FRAMES_PER (16) /* iterations per frame encrypted, a frame is BENCH_ITERATIONS bytes */
+#define BENCH_DUMP_EVENTS (15) /* events in a full raw dump frame */
+
+/**
+ * @brief Run every benchmark and print the results
+ *
+ * @return none
+ */
+void bench_run();
+
+#endif /* __BENCH_H__ */
@@ -31,7 +31,7 @@ typedef enum
   CB_SUCCESS,
   CB_NULL_PTR,
   CB_INVALID_PARAM,
-  CB_MALLOC_FAILED,
+  CB_ALLOC_FAILED,
   CB_FULL,
   CB_EMPTY
 } cb_e;
@@ -39,10 +39,10 @@ typedef enum
 /**
  * @brief Initialize circular buffer
  * 
- * Allocate memory for circular buffer and setup the structure
+ * Allocate the circular buffer from the arena and setup the structure
  * 
  * @param ptr_buf A pointer to the circular buffer pointer to be allocated
- * @param len The length of the buffer to allocate in memory
+ * @param len The length of the buffer, must fit in an ARENA_POOL_RX block
  * @param item_size The size of each item in the buffer
  *
  * @return A circular buffer status code
@@ -52,7 +52,7 @@ cb_e cb_init(cb_t ** ptr_buf, uint32_t len, uint32_t item_size);
 /**
  * @brief Destroy circular buffer
  *
- * Free memory used by circular buffer.
+ * Return memory used by circular buffer to the arena.
  * 
  * @param ptr_buf A pointer to the buffer to be freed
  *
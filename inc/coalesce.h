@@ -0,0 +1,65 @@
+/**
+ * @file coalesce.h
+ * @brief Merges bursts of triggers into single events
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * A rough ride can fire the tap interrupt dozens of times in a few
+ * seconds. Triggers of the same type that come within the window of
+ * the one before are merged into one open record, which is stored once
+ * the window passes with no new trigger:
+ *
+ *   time        | time of the first trigger
+ *   reserved[0] | number of triggers, saturates at 255
+ *   reserved[1] | milliseconds from the first trigger to the last,
+ *   reserved[2] |   little endian, saturates at 65535
+ *   data        | largest trigger magnitude
+ *
+ * A lone trigger is stored as a record with a count of 1 and no
+ * duration.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/10
+ */
+#ifndef __COALESCE_H__
+#define __COALESCE_H__
+
+#include "event_buf.h"
+#include "packets.h"
+
+#define COALESCE_DEFAULT_MS (2000) /* window used when init leaves it 0 */
+#define COALESCE_NUM_TYPES (2) /* drops and flips */
+
+/**
+ * @brief Initialize coalescing
+ *
+ * @param buf Pointer to the event buffer records are stored in
+ * @param window_ms Longest gap between merged triggers, 0 for the default
+ *
+ * @return none
+ */
+void coalesce_init(eb_t * buf, uint16_t window_ms);
+
+/**
+ * @brief Report a trigger
+ *
+ * Safe to call from interrupts. Stores the open record first if this
+ * trigger cannot join it.
+ *
+ * @param event_type The type of event
+ * @param magnitude The size of the trigger, the record keeps the largest
+ *
+ * @return none
+ */
+void coalesce_trigger(event_type_e event_type, uint32_t magnitude);
+
+/**
+ * @brief Store records whose window has passed
+ *
+ * Called from the main loop
+ *
+ * @return none
+ */
+void coalesce_poll();
+
+#endif /* __COALESCE_H__ */
@@ -0,0 +1,261 @@
+/**
+ * @file codec.h
+ * @brief Wire encoder and decoder for packets.h messages
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Every message is described by a table of fields, so the wire format
+ * (little endian, no padding) never depends on how the compiler lays
+ * out the structs. Frames are encoded in one pass into a contiguous
+ * buffer:
+ *
+ *   type | pkt_len | payload | trailer (XOR byte or CRC32)
+ *
+ * From PROTO_VERSION_COBS the frame is COBS encoded and sent between
+ * 0x00 delimiters, so a receiver that loses its place picks up again at
+ * the next delimiter. Each block starts with a code byte, one more than
+ * the number of non-zero bytes that follow. A code below 0xFF means the
+ * block was ended by a zero, which is dropped from the wire and put
+ * back by the decoder unless the block is the last in the frame.
+ *
+ * Builds on the host as well as the target.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/07
+ */
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include <stddef.h>
+#include "packets.h"
+
+#define CODEC_HDR_LEN (2) /* type and pkt_len */
+#define CODEC_TRAILER_MAX (4)
+#define CODEC_FRAME_MAX (CODEC_HDR_LEN + PKT_MAX_PAYLOAD + CODEC_TRAILER_MAX)
+#define CODEC_EVENT_LEN (16)
+#define CODEC_COBS_DELIM (0x00)
+#define CODEC_COBS_MAX_RUN (254) /* non-zero bytes in a 0xFF block */
+#define CODEC_WIRE_MAX (CODEC_FRAME_MAX + CODEC_FRAME_MAX / CODEC_COBS_MAX_RUN + 3) /* COBS and delimiters */
+
+/*
+ * @brief Codec status code
+ */
+typedef enum
+{
+  CODEC_SUCCESS,
+  CODEC_NULL_PTR,
+  CODEC_UNKNOWN_TYPE,
+  CODEC_SHORT, /* payload ended before the last field */
+  CODEC_OVERFLOW /* a field does not fit its buffer */
+} codec_e;
+
+/*
+ * @brief Field types
+ */
+typedef enum
+{
+  FIELD_U8, /* count bytes */
+  FIELD_U16, /* count little endian half words */
+  FIELD_U32, /* count little endian words */
+  FIELD_RTC, /* rtc_t, year little endian then six bytes */
+  FIELD_PAD, /* count zero bytes on the wire, skipped in the struct */
+  FIELD_VAR /* up to count bytes, length from the preceding FIELD_U8 */
+} field_type_e;
+
+/*
+ * @brief Field descriptor
+ */
+typedef struct
+{
+  uint8_t type; /* field_type_e */
+  uint8_t count;
+  uint16_t offset; /* offset in the struct */
+} field_t;
+
+/*
+ * @brief Message descriptor
+ */
+typedef struct
+{
+  uint8_t pkt_type; /* pkt_type_e */
+  uint8_t num_fields;
+  uint8_t num_required; /* fields after these may be left off the end */
+  const field_t * fields;
+} msg_desc_t;
+
+/*
+ * @brief Streaming COBS decoder
+ */
+typedef struct
+{
+  uint8_t left; /* bytes left in the block */
+  uint8_t zero; /* block ended by an implied zero */
+} cobs_dec_t;
+
+/**
+ * @brief Encode a message payload
+ *
+ * @param pkt_type The packet type of the message
+ * @param msg Pointer to the message struct, may be NULL for empty messages
+ * @param out Pointer to the output buffer
+ * @param cap The size of the output buffer
+ * @param len Pointer to the location to store the encoded length
+ *
+ * @return A codec status code
+ */
+codec_e codec_encode(uint8_t pkt_type, const void * msg, uint8_t * out, uint32_t cap, uint32_t * len);
+
+/**
+ * @brief Decode a message payload
+ *
+ * Fields are written in order, so on CODEC_SHORT everything before the
+ * missing field has been filled in. Optional fields that are left off
+ * are not touched.
+ *
+ * @param pkt_type The packet type of the message
+ * @param in Pointer to the payload
+ * @param len The length of the payload
+ * @param msg Pointer to the message struct to fill
+ *
+ * @return A codec status code
+ */
+codec_e codec_decode(uint8_t pkt_type, const uint8_t * in, uint32_t len, void * msg);
+
+/**
+ * @brief Check a batch command payload
+ *
+ * @param in Pointer to the payload
+ * @param len The length of the payload
+ * @param batch Pointer to the batch to fill, cmds points into in
+ *
+ * @return CODEC_SUCCESS, CODEC_SHORT if an entry runs past the end, or
+ *         CODEC_OVERFLOW for more than BATCH_MAX_CMDS entries
+ */
+codec_e codec_batch_parse(const uint8_t * in, uint32_t len, cmd_batch_t * batch);
+
+/**
+ * @brief Get the next command of a checked batch
+ *
+ * @param batch Pointer to the batch
+ * @param pos Offset of the entry in cmds, start at 0, moved to the next entry
+ * @param pkt_type Pointer to the location to store the command type
+ * @param payload Pointer to the location to store the command payload
+ * @param len Pointer to the location to store the command payload length
+ *
+ * @return 1 if there was a command, 0 at the end
+ */
+uint8_t codec_batch_next(const cmd_batch_t * batch, uint32_t * pos, uint8_t * pkt_type, const uint8_t ** payload,
+                         uint8_t * len);
+
+/**
+ * @brief Add a command to a batch command payload
+ *
+ * @param pkt_type The packet type of the command
+ * @param msg Pointer to the command struct, may be NULL for empty messages
+ * @param out Pointer to the batch payload
+ * @param cap The size of the batch payload buffer
+ * @param len Length of the batch payload so far, updated on success
+ *
+ * @return A codec status code
+ */
+codec_e codec_batch_add(uint8_t pkt_type, const void * msg, uint8_t * out, uint32_t cap, uint32_t * len);
+
+/**
+ * @brief Encode an event record
+ *
+ * @param event Pointer to the event
+ * @param out Pointer to CODEC_EVENT_LEN bytes of output
+ *
+ * @return none
+ */
+void codec_encode_event(const event_t * event, uint8_t * out);
+
+/**
+ * @brief Decode an event record
+ *
+ * @param in Pointer to CODEC_EVENT_LEN bytes of input
+ * @param event Pointer to the event to fill
+ *
+ * @return none
+ */
+void codec_decode_event(const uint8_t * in, event_t * event);
+
+/**
+ * @brief Wrap an encoded payload into a frame
+ *
+ * The payload must already be at frame + CODEC_HDR_LEN. Writes the
+ * header in front of it and the trailer after it.
+ *
+ * @param version The protocol version, selects the trailer
+ * @param pkt_type The packet type
+ * @param frame Pointer to the frame buffer, at least CODEC_FRAME_MAX bytes
+ * @param payload_len The length of the payload
+ *
+ * @return The length of the whole frame, 0 if the payload is too long
+ */
+uint32_t codec_frame(uint8_t version, uint8_t pkt_type, uint8_t * frame, uint32_t payload_len);
+
+/**
+ * @brief Get the length of the frame trailer
+ *
+ * @param version The protocol version
+ *
+ * @return The trailer length in bytes
+ */
+uint32_t codec_trailer_len(uint8_t version);
+
+/**
+ * @brief Reset a COBS decoder for a new frame
+ *
+ * @param dec Pointer to the decoder
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void codec_cobs_init(cobs_dec_t * dec)
+{
+  dec->left = 0;
+  dec->zero = 0;
+}
+
+/**
+ * @brief Decode one byte of a COBS frame
+ *
+ * The delimiter is not passed in, the caller checks for it
+ *
+ * @param dec Pointer to the decoder
+ * @param in The encoded byte, not CODEC_COBS_DELIM
+ * @param out Pointer to the location to store the decoded byte
+ *
+ * @return 1 if a byte was decoded, 0 if in was a code byte with nothing to output
+ */
+__attribute__((always_inline)) inline uint8_t codec_cobs_byte(cobs_dec_t * dec, uint8_t in, uint8_t * out)
+{
+  if(dec->left)
+  {
+    dec->left--;
+    *out = in;
+    return 1;
+  }
+
+  /* code byte, the previous block's zero is now known not to be the last */
+  uint8_t zero = dec->zero;
+  dec->left = in - 1;
+  dec->zero = (in != 0xFF);
+  *out = 0;
+
+  return zero;
+}
+
+/**
+ * @brief Check that a COBS frame ended on a block boundary
+ *
+ * @param dec Pointer to the decoder
+ *
+ * @return 1 if the frame is complete
+ */
+__attribute__((always_inline)) inline uint8_t codec_cobs_done(cobs_dec_t * dec)
+{
+  return dec->left == 0;
+}
+
+#endif /* __CODEC_H__ */
@@ -0,0 +1,94 @@
+/**
+ * @file config.h
+ * @brief Package configuration kept in flash across resets
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * PKT_CMD_INIT saves the package parameters, and boot restores them so
+ * a reset resumes tracking instead of waiting for the app. Records are
+ * written alternately to two bank 1 sectors, which the linker command
+ * file must keep free of code:
+ *
+ *   magic | crc | version | len | seq | config_t
+ *
+ * The CRC32 covers everything after it. Boot takes the valid record
+ * with the highest sequence number, so a reset part way through a save
+ * leaves the previous record in place. Records with another version or
+ * length are ignored until the next init writes a new one.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/11
+ */
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include "flash.h"
+#include "packets.h"
+
+#define CONFIG_MAGIC (0x43505050) /* "PPPC" */
+#define CONFIG_VERSION (2) /* 2 added the device key */
+#define CONFIG_NUM_SLOTS (2)
+#define CONFIG_SLOT_ADDR(n) FLASH_SECTOR_ADDR(FLASH_NUM_SECTORS - CONFIG_NUM_SLOTS + (n)) /* last two sectors */
+
+/*
+ * @brief Config status code
+ */
+typedef enum
+{
+  CONFIG_SUCCESS,
+  CONFIG_NULL_PTR,
+  CONFIG_EMPTY, /* no valid record */
+  CONFIG_WRITE_FAILED
+} config_e;
+
+/*
+ * @brief Saved configuration
+ */
+typedef struct
+{
+  uint16_t package_id;
+  uint16_t coalesce_ms;
+  uint8_t carrier_access_code;
+  uint8_t user_access_code;
+  uint8_t flags; /* as in cmd_init_t */
+  uint8_t tracking_len;
+  uint8_t tracking[CMD_INIT_TRACKING_MAX];
+  uint8_t reserved;
+  rtc_t init_time; /* time sent with the init, restores the RTC if it stopped */
+  uint8_t key[SESSION_KEY_LEN]; /* device key from PKT_CMD_KEY, all zero if none */
+} config_t;
+
+/*
+ * @brief Record as stored in flash
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t crc;
+  uint16_t version;
+  uint16_t len; /* sizeof(config_t) */
+  uint32_t seq;
+  config_t config;
+} config_rec_t;
+
+/**
+ * @brief Load the newest valid configuration
+ *
+ * @param ptr_config Pointer to the location to store the configuration
+ *
+ * @return A config status code, CONFIG_EMPTY if there is none
+ */
+config_e config_load(config_t * ptr_config);
+
+/**
+ * @brief Save a configuration
+ *
+ * Erases the older slot and writes the record there
+ *
+ * @param ptr_config Pointer to the configuration
+ *
+ * @return A config status code
+ */
+config_e config_save(const config_t * ptr_config);
+
+#endif /* __CONFIG_H__ */
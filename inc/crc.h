@@ -0,0 +1,61 @@
+/**
+ * @file crc.h
+ * @brief CRC32 functions
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Standard CRC-32 (IEEE 802.3, same as zlib). Uses the CRC32 peripheral
+ * on the MSP432 and a table driven loop on host builds or when built
+ * with CRC_SOFTWARE. The running value can be carried between calls so
+ * frames can be checked while they stream.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/06
+ */
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#include "helpers.h"
+
+#define CRC32_INIT (0xFFFFFFFF)
+#define CRC32_FINAL(crc) ((crc) ^ 0xFFFFFFFF)
+
+/**
+ * @brief Add a block to a running CRC32
+ *
+ * Start with CRC32_INIT and pass the result through CRC32_FINAL once
+ * every block has been added
+ *
+ * @param crc The running CRC of the preceding bytes
+ * @param ptr Pointer to the block
+ * @param len The length of the block
+ *
+ * @return The updated running CRC
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t * ptr, uint32_t len);
+
+/**
+ * @brief Add a block to a running CRC32 with the table driven loop
+ *
+ * @param crc The running CRC of the preceding bytes
+ * @param ptr Pointer to the block
+ * @param len The length of the block
+ *
+ * @return The updated running CRC
+ */
+uint32_t crc32_update_sw(uint32_t crc, const uint8_t * ptr, uint32_t len);
+
+#ifndef HOST_BUILD
+/**
+ * @brief Add a block to a running CRC32 with the CRC32 peripheral
+ *
+ * @param crc The running CRC of the preceding bytes
+ * @param ptr Pointer to the block
+ * @param len The length of the block
+ *
+ * @return The updated running CRC
+ */
+uint32_t crc32_update_hw(uint32_t crc, const uint8_t * ptr, uint32_t len);
+#endif /* HOST_BUILD */
+
+#endif /* __CRC_H__ */
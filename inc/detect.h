@@ -0,0 +1,72 @@
+/**
+ * @file detect.h
+ * @brief Drop and flip detection
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * On the board the ADXL345 finds drops itself, raising a single tap
+ * interrupt when an axis goes over THRESH_TAP and comes back within DUR,
+ * and the main loop counts flips from the z axis. detect_tap() applies
+ * the same tap rule to raw samples, with the register values adxl_init()
+ * programs, so recordings can be run through the detector on the host
+ * (see host/replay.c).
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __DETECT_H__
+#define __DETECT_H__
+
+#include <stdint.h>
+
+#define DETECT_TAP_THRESH (0xFF) /* THRESH_TAP, 62.5 mg per count */
+#define DETECT_TAP_DUR (0x40) /* DUR, 625 us per count */
+#define DETECT_FLIP_COUNT (0x400) /* readings upside down in a row for a flip */
+
+#define DETECT_COUNTS_PER_G (256) /* full resolution samples */
+#define DETECT_TAP_LEVEL (DETECT_TAP_THRESH * DETECT_COUNTS_PER_G / 16)
+#define DETECT_TAP_DUR_US (DETECT_TAP_DUR * 625)
+
+/*
+ * @brief Detector state
+ */
+typedef struct
+{
+  uint32_t over_start; /* time the tap went over the threshold, us */
+  uint32_t peak; /* largest axis while over */
+  uint32_t flip_count; /* readings upside down in a row */
+  uint8_t over;
+} detect_t;
+
+/**
+ * @brief Initializes a detector
+ *
+ * @param det Pointer to the detector
+ *
+ * @return none
+ */
+void detect_init(detect_t * det);
+
+/**
+ * @brief Runs the ADXL345 single tap rule on a sample
+ *
+ * @param det Pointer to the detector
+ * @param time_us Sample time in microseconds, may wrap
+ * @param x, y, z Sample at DETECT_COUNTS_PER_G
+ * @param peak Set to the largest axis of the tap when one ends
+ *
+ * @return 1 when a tap ends on this sample
+ */
+uint8_t detect_tap(detect_t * det, uint32_t time_us, int16_t x, int16_t y, int16_t z, uint32_t * peak);
+
+/**
+ * @brief Counts a z axis reading towards a flip
+ *
+ * @param det Pointer to the detector
+ * @param z z axis reading, above 0 when upside down
+ *
+ * @return 1 on the reading that completes DETECT_FLIP_COUNT in a row
+ */
+uint8_t detect_flip(detect_t * det, int16_t z);
+
+#endif /* __DETECT_H__ */
@@ -4,14 +4,39 @@
  *
  * For CSCI 4830-019 Wireless X final project
  *
+ * Every EB_BLOCK_LEN events in arrival order form a block, and the
+ * buffer keeps the time range, event types and largest data value of
+ * each one. A filtered iterator checks a block before walking it and
+ * jumps over blocks that cannot hold a match, so a query touches the
+ * events it returns plus a few neighbours rather than the whole log.
+ * The ranges only ever widen, removing events from a block does not
+ * shrink them.
+ *
+ * The log never grows past the event pool. Once it is full the
+ * retention policy picks which event makes room for a new one, in
+ * constant time: every event is also queued, oldest first, on one lane
+ * chosen by the policy, and the victim is always the head of a lane or
+ * the next in a walk along one.
+ *
+ *   EB_OVERWRITE_OLDEST | one lane, the oldest event goes
+ *   EB_KEEP_SEVERE      | a lane per power of two of the data, the oldest
+ *                       | of the least severe goes, or the new event if
+ *                       | it is less severe still
+ *   EB_THIN_FLIPS       | flips and the rest, every other flip goes
+ *                       | starting from the oldest, and once flips run
+ *                       | out the oldest event goes
+ *
  * @author Christopher Morroni
  * @date 2018/05/01
  */
 #ifndef __EVENT_BUF_H__
 #define __EVENT_BUF_H__
 
+#include "arena.h"
 #include "packets.h"
 #include "rtc.h"
+#include "summary.h"
+#include "trace.h"
 
 /*
  * @brief Event buffer status code
@@ -20,28 +45,95 @@ typedef enum
 {
   EB_SUCCESS,
   EB_NULL_PTR,
-  EB_MALLOC_FAILED,
-  EB_EMPTY
+  EB_ALLOC_FAILED,
+  EB_EMPTY,
+  EB_CORRUPT,
+  EB_EVICTED /* the retention policy gave up the new event itself */
 } eb_e;
 
+/*
+ * @brief Retention policy, selected by the init flags
+ */
+typedef enum
+{
+  EB_OVERWRITE_OLDEST = 0,
+  EB_KEEP_SEVERE,
+  EB_THIN_FLIPS,
+  EB_NUM_POLICIES
+} eb_policy_e;
+
+#define EB_BLOCK_LEN (8) /* events per index block */
+/* the oldest block can be part empty, so one more than a full pool needs */
+#define EB_NUM_BLOCKS ((ARENA_EVENT_POOL_LEN + EB_BLOCK_LEN - 1) / EB_BLOCK_LEN + 1)
+#define EB_NUM_LANES (32) /* bits in lane_map */
+#define EB_LANE_FLIPS (0) /* EB_THIN_FLIPS lanes */
+#define EB_LANE_OTHER (1)
+
 typedef struct ll_event_t
 {
   event_t event;
+  uint32_t crc; /* CRC32 of event, checked when it is read back */
   struct ll_event_t * prev;
   struct ll_event_t * next;
+  struct ll_event_t * lane_next; /* next newer event in the same eviction lane */
 } ll_event_t;
 
+/*
+ * @brief Index entry for a block of events
+ */
+typedef struct
+{
+  ll_event_t * first; /* oldest event in the block */
+  uint32_t min_time; /* seconds since 2000 */
+  uint32_t max_time;
+  uint32_t max_data;
+  uint8_t type_mask; /* bit n set if the block has an event of type n */
+  uint8_t count; /* events added, a block takes no more after EB_BLOCK_LEN */
+} eb_block_t;
+
 typedef struct
 {
   ll_event_t * head;
   ll_event_t * tail;
   uint32_t count;
+  eb_block_t blocks[EB_NUM_BLOCKS]; /* oldest first */
+  uint32_t num_blocks;
+  ll_event_t * lane_head[EB_NUM_LANES]; /* oldest event in each lane */
+  ll_event_t * lane_tail[EB_NUM_LANES];
+  uint32_t lane_map; /* bit n set if lane n has events */
+  ll_event_t * thin_prev; /* flip kept last by EB_THIN_FLIPS, the next one goes */
+  uint8_t policy; /* eb_policy_e */
+  uint8_t pinned; /* no evictions while set */
+  uint32_t evicted; /* events given up by the retention policy */
 } eb_t;
 
+/*
+ * @brief Event filter, an event matches if all of these hold
+ */
+typedef struct
+{
+  uint32_t start; /* earliest time, seconds since 2000 */
+  uint32_t end; /* latest time, inclusive */
+  uint32_t min_data; /* smallest data value */
+  uint8_t type_mask; /* bit n matches event type n, types above 7 never match */
+} eb_filter_t;
+
+/*
+ * @brief Event buffer iterator, oldest to newest
+ */
+typedef struct
+{
+  ll_event_t * curr;
+  eb_t * buf;
+  const eb_filter_t * filter; /* NULL for every event */
+  uint32_t block; /* index of the block being walked */
+  ll_event_t * block_end; /* first event of the next block, NULL in the newest */
+} eb_iter_t;
+
 /**
  * @brief Initialize event buffer
  * 
- * Allocate memory for event buffer and setup the structure
+ * Allocate the event buffer from the arena and setup the structure
  * 
  * @param ptr_buf A pointer to the event buffer pointer to be allocated
  *
@@ -52,7 +144,7 @@ eb_e eb_init(eb_t ** ptr_buf);
 /**
  * @brief Destroy event buffer
  *
- * Free memory used by event buffer.
+ * Return memory used by event buffer to the arena.
  * 
  * @param ptr_buf A pointer to the buffer to be freed
  *
@@ -63,12 +155,13 @@ eb_e eb_free(eb_t ** ptr_buf);
 /**
  * @brief Add item to event buffer
  * 
- * Add data to an event buffer
+ * Add data to an event buffer, evicting an event if the log is full
  * 
  * @param buf Pointer to the event buffer
  * @param ptr_data Event to add to buffer
  *
- * @return An event buffer status code
+ * @return An event buffer status code, EB_EVICTED if the policy kept the
+ *         log as it was, EB_ALLOC_FAILED if the log is full and pinned
  */
 eb_e eb_add_item(eb_t * buf, event_t * ptr_data);
 
@@ -80,7 +173,7 @@ eb_e eb_add_item(eb_t * buf, event_t * ptr_data);
  * @param buf Pointer to the event buffer
  * @param ptr_data Pointer to where data removed from buffer will be stored
  *
- * @return An event buffer status code
+ * @return An event buffer status code, EB_CORRUPT if the event failed its CRC check
  */
 eb_e eb_remove_item(eb_t * buf, event_t * ptr_data);
 
@@ -93,15 +186,112 @@ eb_e eb_remove_item(eb_t * buf, event_t * ptr_data);
  * @param ptr_data Pointer to where the event will be stored
  * @param idx Index of th requested event
  *
- * @return An event buffer status code
+ * @return An event buffer status code, EB_CORRUPT if the event failed its CRC check
  */
 eb_e eb_seek_item(eb_t * buf, event_t * ptr_data, uint32_t idx);
 
+/**
+ * @brief Select the retention policy
+ *
+ * Sorts the events already in the log into the new policy's lanes
+ *
+ * @param buf Pointer to the event buffer
+ * @param policy The retention policy, out of range selects EB_OVERWRITE_OLDEST
+ *
+ * @return An event buffer status code
+ */
+eb_e eb_set_policy(eb_t * buf, eb_policy_e policy);
+
+/**
+ * @brief Pin the log
+ *
+ * While pinned nothing is evicted, so pointers from eb_iter_next stay
+ * valid. New events that find the log full are lost instead.
+ *
+ * @param buf Pointer to the event buffer
+ * @param pinned 1 to pin, 0 to release
+ *
+ * @return An event buffer status code
+ */
+eb_e eb_pin(eb_t * buf, uint8_t pinned);
+
+/**
+ * @brief Start iterating over the buffer from the oldest event
+ *
+ * @param buf Pointer to the event buffer
+ * @param iter Pointer to the iterator to set up
+ *
+ * @return An event buffer status code
+ */
+eb_e eb_iter_begin(eb_t * buf, eb_iter_t * iter);
+
+/**
+ * @brief Start iterating over the events that match a filter
+ *
+ * eb_iter_next then skips events that do not match, and events that
+ * fail their CRC check since their fields cannot be trusted. A full
+ * dump still reports those.
+ *
+ * @param buf Pointer to the event buffer
+ * @param iter Pointer to the iterator to set up
+ * @param filter Pointer to the filter, must outlive the iterator
+ *
+ * @return An event buffer status code
+ */
+eb_e eb_iter_filter(eb_t * buf, eb_iter_t * iter, const eb_filter_t * filter);
+
+/**
+ * @brief Count the events left in an iteration
+ *
+ * The iterator itself is not advanced
+ *
+ * @param iter Pointer to the iterator
+ *
+ * @return The number of events eb_iter_next would still return
+ */
+uint32_t eb_iter_count(const eb_iter_t * iter);
+
+/**
+ * @brief Get the next event without copying it
+ *
+ * The event stays in the buffer, so nothing may remove events while the
+ * pointer is in use. New events can still be added if the log is pinned.
+ *
+ * @param iter Pointer to the iterator
+ * @param ptr_event Pointer to the location to store the event pointer
+ *
+ * @return An event buffer status code, EB_EMPTY at the end of the buffer,
+ *         EB_CORRUPT if the event failed its CRC check
+ */
+eb_e eb_iter_next(eb_iter_t * iter, const event_t ** ptr_event);
+
+/**
+ * @brief Add a finished event record to the buffer
+ *
+ * Also counts it in the summary and traces it
+ *
+ * @param buf Pointer to an event buffer
+ * @param event Pointer to the event
+ *
+ * @return An event buffer status code
+ */
+__attribute__((always_inline)) inline eb_e eb_new_record(eb_t * buf, event_t * event)
+{
+  eb_e status = eb_add_item(buf, event);
+  summary_add(event, status == EB_SUCCESS);
+  if(status == EB_SUCCESS) TRACE2(TRC_EVENT, event->event_type, event->data);
+  else if(status == EB_EVICTED) TRACE2(TRC_EVENT_EVICTED, event->event_type, buf->policy);
+  else TRACE2(TRC_EVENT_LOST, event->event_type, status);
+
+  return status;
+}
+
 /**
  * @brief Add an event to the buffer
  *
  * @param buf Pointer to an event buffer
  * @param event_type The type of event
+ * @param data Extra data
  *
  * @return An event buffer status code
  */
@@ -109,10 +299,11 @@ __attribute__((always_inline)) inline eb_e eb_new_event(eb_t * buf, event_type_e
 {
   event_t event;
   event.event_type = event_type;
+  memset(event.reserved, 0, sizeof(event.reserved));
   event.time = rtc_get_time();
   event.data = data;
 
-  return eb_add_item(buf, &event);
+  return eb_new_record(buf, &event);
 }
 
 /**
@@ -132,4 +323,21 @@ __attribute__((always_inline)) inline eb_e eb_get_count(eb_t * buf, uint32_t * c
   return EB_SUCCESS;
 }
 
+/**
+ * @brief Get the number of events given up by the retention policy
+ *
+ * @param buf Pointer to an event buffer
+ * @param evicted Pointer to the location to store the count
+ *
+ * @return An event buffer status code
+ */
+__attribute__((always_inline)) inline eb_e eb_get_evicted(eb_t * buf, uint32_t * evicted)
+{
+  /* check inputs */
+  if(!buf || !evicted) return EB_NULL_PTR;
+
+  *evicted = buf->evicted;
+  return EB_SUCCESS;
+}
+
 #endif /* __EVENT_BUF_H__ */
@@ -0,0 +1,78 @@
+/**
+ * @file flash.h
+ * @brief Erase and program the main flash
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Word at a time programming through the flash controller, enough for
+ * small records. Sectors are write protected again when each call
+ * returns. Host builds work on a RAM image with the same rules as the
+ * part: erased bytes read 0xFF and programming can only clear bits.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/11
+ */
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include <stdint.h>
+
+#define FLASH_SECTOR_LEN (4096)
+#define FLASH_BANK1_BASE (0x00020000)
+#define FLASH_SECTOR_ADDR(n) (FLASH_BANK1_BASE + (n) * FLASH_SECTOR_LEN) /* bank 1 sector n */
+#define FLASH_NUM_SECTORS (32) /* per bank */
+
+/*
+ * @brief Flash status code
+ */
+typedef enum
+{
+  FLASH_SUCCESS,
+  FLASH_INVALID_PARAM, /* not a bank 1 sector, or not word aligned */
+  FLASH_ERASE_FAILED,
+  FLASH_PROGRAM_FAILED /* read back did not match */
+} flash_e;
+
+/**
+ * @brief Erase a bank 1 sector
+ *
+ * @param addr Start address of the sector
+ *
+ * @return A flash status code
+ */
+flash_e flash_erase(uint32_t addr);
+
+/**
+ * @brief Program words into erased flash
+ *
+ * @param addr Destination in bank 1, word aligned
+ * @param data Pointer to the data, word aligned
+ * @param len Number of bytes, a multiple of 4, all in the sector of addr
+ *
+ * @return A flash status code
+ */
+flash_e flash_program(uint32_t addr, const void * data, uint32_t len);
+
+/**
+ * @brief Get a pointer to read flash through
+ *
+ * @param addr Flash address
+ *
+ * @return A pointer to the contents at addr
+ */
+const void * flash_read(uint32_t addr);
+
+#ifdef HOST_BUILD
+/**
+ * @brief Get the RAM image behind bank 1
+ *
+ * Host builds only, to load, save or corrupt the contents
+ *
+ * @param addr Flash address in bank 1
+ *
+ * @return A pointer to the image at addr
+ */
+uint8_t * flash_sim_image(uint32_t addr);
+#endif /* HOST_BUILD */
+
+#endif /* __FLASH_H__ */
@@ -0,0 +1,69 @@
+/**
+ * @file hal.h
+ * @brief Hardware abstraction for the UART transmit path
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Peripherals are set up and polled through the register structs in
+ * msp.h, which the host build backs with plain memory (see host/). A
+ * write to TXBUF is the one access plain memory cannot stand in for, as
+ * the byte has to go somewhere, so the UART driver sends through these.
+ * On the part they are the register accesses they replace; HOST_BUILD
+ * takes them from host/hal_host.c. The accelerometer needs nothing here,
+ * the host build swaps spi.c for a model of the ADXL345 behind spi.h.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#include "msp.h"
+#include <stdint.h>
+
+#ifndef HOST_BUILD
+/**
+ * @brief checks if a UART can take another byte
+ *
+ * @param uart_num 0 or 1
+ *
+ * @return non-zero if TXBUF is empty
+ */
+__attribute__((always_inline)) inline uint8_t hal_uart_tx_ready(uint8_t uart_num)
+{
+  return ((uart_num == 0) ? EUSCI_A0 : EUSCI_A2)->IFG & EUSCI_A_IFG_TXIFG;
+}
+
+/**
+ * @brief writes a byte to a UART
+ *
+ * Only call once hal_uart_tx_ready() is set
+ *
+ * @param uart_num 0 or 1
+ * @param data The byte to send
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void hal_uart_tx(uint8_t uart_num, uint8_t data)
+{
+  ((uart_num == 0) ? EUSCI_A0 : EUSCI_A2)->TXBUF = data;
+}
+
+/**
+ * @brief checks if a UART is still shifting out a byte
+ *
+ * @param uart_num 0 or 1
+ *
+ * @return non-zero while the UART is busy
+ */
+__attribute__((always_inline)) inline uint8_t hal_uart_busy(uint8_t uart_num)
+{
+  return ((uart_num == 0) ? EUSCI_A0 : EUSCI_A2)->STATW & EUSCI_A_STATW_BUSY;
+}
+#else
+uint8_t hal_uart_tx_ready(uint8_t uart_num);
+void hal_uart_tx(uint8_t uart_num, uint8_t data);
+uint8_t hal_uart_busy(uint8_t uart_num);
+#endif /* HOST_BUILD */
+
+#endif /* __HAL_H__ */
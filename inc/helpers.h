@@ -11,12 +11,37 @@
 #define __HELPERS_H__
 
 #include "msp.h"
+#include <string.h>
+
+/* all memory comes from the static arena, see arena.h */
+#if defined __GNUC__
+#pragma GCC poison malloc calloc realloc free
+#endif
 
 #define UNUSED(x) if(x)
 
 #define BEGIN_CRITICAL_SECTION() __disable_irq()
 #define END_CRITICAL_SECTION() __enable_irq()
 
+#define MCLK_HZ (3000000) /* default DCO frequency */
+
+/* SMCLK runs from the DCO undivided, selects the UART divider table */
+#ifndef SMCLK_HZ
+#define SMCLK_HZ MCLK_HZ
+#endif
+#define CYCLE_COUNT() (DWT->CYCCNT)
+
+/* build with RAM_HOT_PATH to run the hot path from SRAM instead of flash */
+#if defined RAM_HOT_PATH
+#if defined __TI_COMPILER_VERSION__
+#define RAMFUNC __attribute__((ramfunc))
+#else
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call))
+#endif
+#else
+#define RAMFUNC
+#endif
+
 #define BASE_2 (2)
 #define BASE_8 (8)
 #define BASE_10 (10)
@@ -49,4 +74,29 @@ uint8_t * my_reverse(uint8_t * src, uint32_t length);
  */
 uint8_t my_itoa(int32_t data, uint8_t * ptr, uint32_t base);
 
+/**
+ * @brief Running XOR checksum
+ *
+ * @param seed The checksum of the preceding bytes
+ * @param ptr Pointer to the block to add to the checksum
+ * @param length The length of the block
+ *
+ * @return The updated checksum
+ */
+uint8_t my_checksum(uint8_t seed, uint8_t * ptr, uint32_t length);
+
+/**
+ * @brief Starts the core cycle counter
+ *
+ * Enables the DWT cycle counter read by CYCLE_COUNT()
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void cycle_counter_init()
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
 #endif /* __HELPERS_H__ */
@@ -0,0 +1,96 @@
+/**
+ * @file monitor.h
+ * @brief Main loop latency monitor and deadline watchdog
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Records the length of every main loop iteration in a log2 histogram
+ * and tracks how long each task goes between services. The WDT_A is
+ * only fed while every task is within its deadline, so a stalled loop
+ * resets the device instead of silently missing events. Dumps and
+ * queries block the loop for as long as the link takes, seconds for a
+ * full log at 9600 baud, so they feed it once a frame with mon_kick().
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/05
+ */
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#include "helpers.h"
+#include "packets.h"
+
+#define MON_HIST_BINS STATS_HIST_BINS
+#define MON_HIST_SHIFT (9) /* bin 0 holds iterations below 2^9 cycles */
+
+#define MON_SENSE_DEADLINE (MCLK_HZ / 10) /* 100ms between flip samples */
+#define MON_RX_DEADLINE (MCLK_HZ / 2) /* 500ms between RX ring checks */
+
+/* ACLK / 2^15, 1s at 32kHz */
+#define MON_WDT_CONFIG (WDT_A_CTL_PW | WDT_A_CTL_SSEL__ACLK | WDT_A_CTL_IS_4)
+
+/*
+ * @brief Monitored tasks
+ */
+typedef enum
+{
+  MON_TASK_SENSE = 0,
+  MON_TASK_RX,
+  MON_NUM_TASKS
+} mon_task_e;
+
+/**
+ * @brief Initialize the monitor and start the watchdog
+ *
+ * @return none
+ */
+void mon_init();
+
+/**
+ * @brief Mark the start of a main loop iteration
+ *
+ * Records the length of the previous iteration
+ *
+ * @return none
+ */
+void mon_loop();
+
+/**
+ * @brief Mark a task as serviced
+ *
+ * Counts a deadline miss if the task waited longer than its deadline
+ *
+ * @param task The task that ran
+ *
+ * @return none
+ */
+void mon_task_serviced(mon_task_e task);
+
+/**
+ * @brief Feed the watchdog if every task is within its deadline
+ *
+ * @return none
+ */
+void mon_feed();
+
+/**
+ * @brief Feed the watchdog from a command that blocks the main loop
+ *
+ * Only for loops that are still moving, such as a dump waiting on the
+ * link a frame at a time. Tasks past their deadline are still counted
+ * as missed when they next run.
+ *
+ * @return none
+ */
+void mon_kick();
+
+/**
+ * @brief Copy the histogram and miss counters into a stats response
+ *
+ * @param ptr_stats Pointer to the stats response
+ *
+ * @return none
+ */
+void mon_get_stats(res_stats_t * ptr_stats);
+
+#endif /* __MONITOR_H__ */
@@ -0,0 +1,71 @@
+/**
+ * @file pack.h
+ * @brief Packed event encoding for dumps
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Stored events repeat most of their bytes from one record to the next,
+ * so PKT_RES_DUMP_PACKED sends them column by column instead:
+ *
+ *   base    | first event time, u32 seconds since 2000 then u8 dow
+ *   types   | 2 bits per event, LSB first, pack_type_e
+ *   flags   | 1 bit per event, set if the reserved bytes are not zero
+ *   other   | u8 event type for every PACK_TYPE_OTHER event
+ *   reserved| varint of the 24 bit reserved value for every flagged event
+ *   time    | varint zigzag seconds from the previous event, all but the first
+ *   data    | varint data for every event
+ *
+ * Varints are 7 bits per byte, least significant first, high bit set on
+ * all but the last byte. The day of the week is only sent for the first
+ * event; the decoder counts on from it by whole days. Each packet can be
+ * decoded on its own. The base is left out when a packet has no events.
+ *
+ * Every column is a separate pass over the events, so the encoder needs
+ * no buffer beyond the packet it writes into.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/09
+ */
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include "event_buf.h"
+#include "packets.h"
+
+#define PACK_BASE_LEN (5)
+#define PACK_MAX_EVENTS (255) /* num_events is one byte */
+
+/*
+ * @brief Packed event types
+ */
+typedef enum
+{
+  PACK_TYPE_DROP = 0,
+  PACK_TYPE_FLIP,
+  PACK_TYPE_OTHER, /* type sent in the other column */
+  PACK_TYPE_CORRUPT
+} pack_type_e;
+
+/**
+ * @brief Count the events that fit in one packet
+ *
+ * @param iter Pointer to the iterator, advanced past the counted events
+ * @param max_events Most events to count
+ * @param cap Bytes available for the packed events
+ *
+ * @return The number of events that fit
+ */
+uint32_t pack_count(eb_iter_t * iter, uint32_t max_events, uint32_t cap);
+
+/**
+ * @brief Pack events
+ *
+ * @param iter Pointer to the iterator, advanced past the packed events
+ * @param num_events The number of events to pack, from pack_count
+ * @param out Pointer to the output, at least as long as the cap given to pack_count
+ *
+ * @return The number of bytes written
+ */
+uint32_t pack_events(eb_iter_t * iter, uint32_t num_events, uint8_t * out);
+
+#endif /* __PACK_H__ */
@@ -11,7 +11,51 @@
 #ifndef __PACKETS_H__
 #define __PACKETS_H__
 
-#include "msp.h"
+#include <stdint.h>
+
+/* protocol versions, negotiated with PKT_CMD_VERSION */
+#define PROTO_VERSION_XOR (1) /* one byte running XOR trailer */
+#define PROTO_VERSION_CRC32 (2) /* four byte CRC32 trailer, little endian */
+#define PROTO_VERSION_COBS (3) /* CRC32 frame, COBS encoded between 0x00 delimiters */
+#define PROTO_VERSION_MAX PROTO_VERSION_COBS
+
+#define PKT_MAX_PAYLOAD (255) /* pkt_len is one byte */
+#define CMD_INIT_FIXED_LEN (16) /* init payload before the tracking number */
+#define CMD_INIT_TRACKING_MAX (PKT_MAX_PAYLOAD - CMD_INIT_FIXED_LEN)
+
+#define CMD_INIT_TRACK_DROPS (1 << 0) /* cmd_init_t flags */
+#define CMD_INIT_TRACK_FLIPS (1 << 1)
+#define CMD_INIT_POLICY_SHIFT (2) /* eb_policy_e in bits 2 and 3 */
+#define CMD_INIT_POLICY_MASK (0x3 << CMD_INIT_POLICY_SHIFT)
+
+#define STATS_HIST_BINS (16)
+#define STATS_NUM_TASKS (2)
+#define STATS_NUM_POOLS (6)
+
+#define SUMMARY_NUM_TYPES (2) /* drops and flips */
+#define SUMMARY_HOURS (24)
+
+#define BATCH_MAX_CMDS (8) /* commands in one PKT_CMD_BATCH */
+#define BATCH_ENTRY_HDR_LEN (2) /* type and len in front of each command */
+
+#define SESSION_KEY_LEN (32) /* AES-256 */
+#define SESSION_NONCE_LEN (16)
+#define SEAL_HDR_LEN (2) /* res_sealed_t, in the clear */
+#define SEAL_OVERHEAD (SEAL_HDR_LEN + 1) /* and the sealed type */
+#define SEAL_MAX_PAYLOAD (PKT_MAX_PAYLOAD - SEAL_OVERHEAD) /* largest payload that can be sealed */
+
+#define CAPS_FIXED_LEN (15) /* caps payload before the command list */
+#define CAPS_MAX_CMDS (32) /* commands one PKT_RES_CAPS can list */
+#define CAPS_CMD_LEN (4) /* type, min_len, max_len and min_version of each */
+#define CAPS_AUTH_CHECK (1 << 0) /* res_caps_t features: access codes are checked */
+#define CAPS_CRC_CHECK (1 << 1) /* v1 XOR trailers are checked */
+#define CAPS_SEAL_REQUIRED (1 << 2) /* dumps and queries only in a session */
+#define CAPS_HAVE_KEY (1 << 3) /* a device key is set, sessions can be opened */
+
+#define STREAM_SAMPLES_LEN (240) /* sample bytes in every stream response */
+#define STREAM_XYZ_PER_FRAME (STREAM_SAMPLES_LEN / 6) /* x, y and z, int16_t each */
+#define STREAM_MAG_PER_FRAME (STREAM_SAMPLES_LEN / 2) /* uint16_t each */
+#define STREAM_FLAG_FIFO_FULL (1 << 0) /* res_stream_t flags */
 
 /*
  * @brief Device status
@@ -31,9 +75,28 @@ typedef enum
   PKT_CMD_STATUS = 0x00,
   PKT_CMD_INIT,
   PKT_CMD_DUMP,
+  PKT_CMD_STATS,
+  PKT_CMD_VERSION,
+  PKT_CMD_BAUD,
+  PKT_CMD_SUMMARY,
+  PKT_CMD_QUERY,
+  PKT_CMD_STREAM,
+  PKT_CMD_BATCH, /* several commands in one frame, see cmd_batch_t */
+  PKT_CMD_KEY,
+  PKT_CMD_SESSION,
+  PKT_CMD_CAPS, /* no payload */
   PKT_RES_ACK = 0x80,
   PKT_RES_STATUS,
   PKT_RES_DUMP,
+  PKT_RES_STATS,
+  PKT_RES_VERSION,
+  PKT_RES_BAUD,
+  PKT_RES_DUMP_PACKED,
+  PKT_RES_SUMMARY,
+  PKT_RES_STREAM,
+  PKT_RES_SESSION,
+  PKT_RES_SEALED, /* another response encrypted, see res_sealed_t */
+  PKT_RES_CAPS,
   PKT_RES_NAK = 0x8F
 } pkt_type_e;
 
@@ -43,9 +106,43 @@ typedef enum
 typedef enum
 {
   EVENT_DROP = 0,
-  EVENT_FLIP
+  EVENT_FLIP,
+  EVENT_CORRUPT = 0xFF /* stored record failed its CRC check */
 } event_type_e;
 
+/*
+ * @brief Dump encoding, requested per dump
+ */
+typedef enum
+{
+  DUMP_ENC_RAW = 0, /* PKT_RES_DUMP, event_t records */
+  DUMP_ENC_PACKED /* PKT_RES_DUMP_PACKED, see pack.h */
+} dump_enc_e;
+
+/*
+ * @brief Accelerometer stream contents, requested with PKT_CMD_STREAM
+ */
+typedef enum
+{
+  STREAM_OFF = 0, /* stop streaming */
+  STREAM_XYZ, /* raw x, y and z in ADXL345 counts */
+  STREAM_MAG, /* magnitude of x, y and z in ADXL345 counts */
+  STREAM_NUM_MODES
+} stream_mode_e;
+
+/*
+ * @brief Bluetooth UART rate
+ */
+typedef enum
+{
+  BAUD_9600 = 0,
+  BAUD_19200,
+  BAUD_38400,
+  BAUD_57600,
+  BAUD_115200,
+  BAUD_NUM_RATES
+} baud_rate_e;
+
 /*
  * @brief ACK
  */
@@ -75,10 +172,12 @@ typedef struct
 typedef struct
 {
   uint8_t event_type; /* 0x00 - drop
-                         0x01 - flip */
-  uint8_t reserved[3];
-  rtc_t time; /* time of event */
-  uint32_t data; /* extra data (acceleration value) */
+                         0x01 - flip
+                         0xFF - corrupt */
+  uint8_t reserved[3]; /* 0 - triggers merged into the event
+                          1, 2 - ms from the first trigger to the last */
+  rtc_t time; /* time of the first trigger */
+  uint32_t data; /* extra data (peak acceleration) */
 } event_t;
 
 /*
@@ -87,15 +186,18 @@ typedef struct
 typedef struct
 {
   uint16_t package_id; /* internal package id */
-  uint8_t reserved_0[2];
+  uint16_t coalesce_ms; /* longest gap between triggers merged into one event, 0 for the default */
   rtc_t time; /* current time */
   uint8_t carrier_access_code; /* access code for carriers */
   uint8_t user_access_code; /* access code for users */
-  uint8_t track_drops :1; /* track package drops; 0: false, 1: true */
-  uint8_t track_flips :1; /* track package flips; 0: false, 1: true */
-  uint32_t reserved_1 :6;
+  uint8_t flags; /* bit 0 - track package drops
+                    bit 1 - track package flips
+                    bits 2-3 - retention policy once the log is full:
+                      0 - overwrite the oldest
+                      1 - keep the most severe
+                      2 - thin out flips */
   uint8_t tracking_len; /* length of tracking number in bytes */
-  uint8_t * tracking; /* tracking number */
+  uint8_t tracking[CMD_INIT_TRACKING_MAX]; /* tracking number */
 } cmd_init_t;
 
 /*
@@ -104,8 +206,116 @@ typedef struct
 typedef struct
 {
   uint8_t access_code; /* carrier or user, determines what data to dump */
+  uint8_t encoding; /* dump_enc_e, optional, raw if left out */
 } cmd_dump_t;
 
+/*
+ * @brief Version command structure
+ */
+typedef struct
+{
+  uint8_t version; /* highest protocol version the app supports */
+} cmd_version_t;
+
+/*
+ * @brief Baud command structure
+ *
+ * Sent once to start the switch, and again at the new rate to confirm it.
+ * NAKed unless the firmware is built with BAUD_SWITCH, the HC-06 only
+ * takes AT commands while no phone is connected
+ */
+typedef struct
+{
+  uint8_t rate; /* baud_rate_e */
+} cmd_baud_t;
+
+/*
+ * @brief Summary command structure
+ */
+typedef struct
+{
+  uint8_t access_code; /* carrier or user */
+} cmd_summary_t;
+
+/*
+ * @brief Query command structure
+ *
+ * Answered with the events that match every condition, in the same
+ * dump responses as PKT_CMD_DUMP
+ */
+typedef struct
+{
+  uint8_t access_code; /* carrier or user */
+  uint8_t encoding; /* dump_enc_e */
+  uint8_t type_mask; /* bit n selects event type n */
+  uint8_t reserved;
+  uint32_t start; /* earliest event time, seconds since 2000/01/01 */
+  uint32_t end; /* latest event time, inclusive */
+  uint32_t min_data; /* smallest event data, the severity */
+} cmd_query_t;
+
+/*
+ * @brief Stream command structure
+ *
+ * Acknowledged, then answered with PKT_RES_STREAM frames until sent
+ * again with STREAM_OFF
+ */
+typedef struct
+{
+  uint8_t access_code; /* carrier or user */
+  uint8_t mode; /* stream_mode_e */
+  uint8_t rate; /* ADXL345 BW_RATE code, 0x06 (6.25 Hz) to 0x0D (800 Hz) */
+  uint8_t decimation; /* send one sample in this many, 0 is the same as 1 */
+} cmd_stream_t;
+
+/*
+ * @brief Batch command structure
+ *
+ * The payload is up to BATCH_MAX_CMDS commands back to back, each as
+ *
+ *   type | len | payload
+ *
+ * They are run in order and each is answered as if it had been sent on
+ * its own, the responses going out back to back. If an entry runs past
+ * the end of the payload or there are too many, nothing is run and the
+ * batch gets one NAK; an empty batch gets an ACK. PKT_CMD_VERSION, PKT_CMD_BAUD and PKT_CMD_BATCH
+ * change the link or nest, so in a batch they get a NAK of their own.
+ */
+typedef struct
+{
+  uint8_t num_cmds;
+  uint8_t len; /* length of cmds */
+  const uint8_t * cmds; /* the commands, in the received payload */
+} cmd_batch_t;
+
+/*
+ * @brief Key command structure
+ *
+ * Sets the device key sessions are opened with. Only accepted until the
+ * board is tracking, at the depot, and over PROTO_VERSION_CRC32 or
+ * later; kept with the configuration the init that follows saves.
+ */
+typedef struct
+{
+  uint8_t key[SESSION_KEY_LEN];
+} cmd_key_t;
+
+/*
+ * @brief Session command structure
+ *
+ * Opens an encrypted session, answered with a PKT_RES_SESSION. Both
+ * sides then take the session key as the device key's encryption of
+ * the app's nonce followed by its encryption of the board's, and until
+ * the session ends every dump and query response goes out sealed in a
+ * PKT_RES_SEALED. Sent with no nonce, or an all zero one, it ends the
+ * session instead and is acknowledged.
+ */
+typedef struct
+{
+  uint8_t access_code; /* carrier or user */
+  uint8_t nonce[SESSION_NONCE_LEN]; /* new for every session */
+} cmd_session_t;
+
 /*
  * @brief Status response structure
  */
@@ -115,19 +325,151 @@ typedef struct
   uint8_t status_code; /* 0x00 - uninitialized
                           0x01 - initialized and tracking
                           0x02 - error */
+  uint8_t reserved;
+  uint16_t evicted; /* events given up by the retention policy, saturates */
+  uint8_t policy; /* retention policy in use, as in the init flags */
+  uint8_t reserved_1;
 } res_status_t;
 
 /*
  * @brief Dump response structure
+ *
+ * Followed on the wire by num_events event_t records, or for
+ * PKT_RES_DUMP_PACKED by the packed events. A log too long for one
+ * packet is sent as several dump responses.
  */
 typedef struct
 {
   uint16_t package_id; /* internal package id */
-  uint8_t num_events; /* number of events in log */
-  uint8_t reserved;
-  event_t * events; /* events */
+  uint8_t num_events; /* number of events in this packet */
+  uint8_t frames_left; /* dump responses still to follow */
 } res_dump_t;
 
+/*
+ * @brief Stream response structure
+ *
+ * Followed on the wire by STREAM_SAMPLES_LEN bytes of samples, oldest
+ * first, little endian: STREAM_XYZ_PER_FRAME x, y, z triples or
+ * STREAM_MAG_PER_FRAME magnitudes. The samples in one frame are evenly
+ * spaced; dropped counts those left out between this frame and the one
+ * before because the link could not keep up.
+ */
+typedef struct
+{
+  uint16_t seq; /* frame number since the stream started, wraps */
+  uint16_t dropped; /* samples not sent before this frame, saturates */
+  uint8_t mode; /* stream_mode_e */
+  uint8_t rate; /* BW_RATE code the samples were taken at */
+  uint8_t decimation; /* samples taken per sample sent, raised when the link falls behind */
+  uint8_t flags; /* bit 0 - the sensor FIFO filled, samples were lost before this frame */
+} res_stream_t;
+
+/*
+ * @brief Session response structure
+ */
+typedef struct
+{
+  uint8_t nonce[SESSION_NONCE_LEN]; /* the board's, never repeats */
+} res_session_t;
+
+/*
+ * @brief Sealed response structure
+ *
+ * Followed on the wire by the type and payload of the response sealed
+ * inside, encrypted with AES-256 in OFB mode under the session key. The
+ * IV is seq, little endian, then zeros; seq counts the frames sealed in
+ * the session, so no IV is used twice with a key and a frame lost on
+ * the way does not stop the next one from opening. The frame trailer
+ * covers the ciphertext.
+ */
+typedef struct
+{
+  uint16_t seq; /* frames sealed before this one in the session */
+} res_sealed_t;
+
+/*
+ * @brief Capabilities response structure
+ *
+ * What this firmware runs, so an app can pick its commands and
+ * encodings without trying them first. cmds has CAPS_CMD_LEN bytes for
+ * each command the board takes:
+ *
+ *   type | min_len | max_len | min_version
+ *
+ * A command is refused with a NAK when its payload is outside the
+ * limits or the link is below min_version, so a field added to a
+ * command later is only sent to boards whose max_len covers it.
+ */
+typedef struct
+{
+  uint8_t proto_max; /* highest version PKT_CMD_VERSION switches to */
+  uint8_t proto_version; /* version the link is at */
+  uint8_t max_payload; /* longest payload either way */
+  uint8_t batch_max; /* commands in one PKT_CMD_BATCH */
+  uint16_t max_frame; /* longest frame on the wire at proto_version, delimiters included */
+  uint16_t rx_buf_len; /* bytes the board holds before reading them, more sent back to back may be lost */
+  uint16_t log_len; /* events the log holds */
+  uint8_t dump_encodings; /* bit n set for each dump_enc_e n */
+  uint8_t stream_modes; /* bit n set for each stream_mode_e n */
+  uint8_t baud_rates; /* bit n set for each baud_rate_e n */
+  uint8_t features; /* CAPS_* */
+  uint8_t cmds_len; /* bytes in cmds */
+  uint8_t cmds[CAPS_MAX_CMDS * CAPS_CMD_LEN];
+} res_caps_t;
+
+/*
+ * @brief Stats response structure
+ */
+typedef struct
+{
+  uint32_t max_latency; /* longest main loop iteration in cycles */
+  uint32_t latency_hist[STATS_HIST_BINS]; /* bin 0: < 512 cycles
+                                             bin n: 2^(n+8) to 2^(n+9) - 1 cycles
+                                             bin 15: 2^23 cycles or more */
+  uint32_t deadline_misses[STATS_NUM_TASKS]; /* 0 - sensor, 1 - RX ring */
+  uint16_t arena_high_water[STATS_NUM_POOLS]; /* most blocks ever used per arena pool */
+} res_stats_t;
+
+/*
+ * @brief Summary response structure
+ *
+ * Counts every event recorded since tracking began, including ones that
+ * could not be stored. A coalesced record counts once per trigger merged
+ * into it. Severity is the event data, the peak of a burst, and the mean
+ * is taken over records.
+ */
+typedef struct
+{
+  uint16_t package_id; /* internal package id */
+  uint16_t lost; /* events that could not be stored in the log */
+  uint16_t count[SUMMARY_NUM_TYPES]; /* 0 - drops, 1 - flips */
+  uint32_t max_severity[SUMMARY_NUM_TYPES];
+  uint32_t mean_severity[SUMMARY_NUM_TYPES];
+  rtc_t first; /* time of the first event, zero if none */
+  rtc_t last; /* time of the last event */
+  uint16_t hour_hist[SUMMARY_HOURS]; /* events by hour of the day */
+} res_summary_t;
+
+/*
+ * @brief Version response structure
+ *
+ * Sent with the old framing, the new version applies from the next packet
+ */
+typedef struct
+{
+  uint8_t version; /* protocol version in use */
+} res_version_t;
+
+/*
+ * @brief Baud response structure
+ *
+ * Sent at the new rate once the Bluetooth module has switched
+ */
+typedef struct
+{
+  uint8_t rate; /* baud_rate_e */
+} res_baud_t;
+
 /*
  * @brief Acknowledge response structure
  */
@@ -144,13 +486,18 @@ typedef struct
   uint8_t type; /* 0x00 - status command
                    0x01 - init command
                    0x02 - dump command
+                   0x03 - stats command
+                   0x04 - version command
                    0x80 - acknowledge
                    0x81 - status response
                    0x82 - dump response 
+                   0x83 - stats response
+                   0x84 - version response
                    0x8F - non-acknowledge */
   uint8_t pkt_len;
-  uint8_t * ptr_pkt;
-  uint8_t checksum; /* running XOR of all bytes in packet */
+  uint8_t * ptr_pkt; /* the trailer is added by the UART functions:
+                        v1 - running XOR of all bytes in packet
+                        v2 - CRC32 of all bytes in packet */
 } pkt_t;
 
 #endif /* __PACKETS_H__ */
@@ -28,4 +28,15 @@ void rtc_init(rtc_t curr_time);
  */
 rtc_t rtc_get_time();
 
+/**
+ * @brief converts a time to seconds since 2000/01/01 00:00:00
+ *
+ * The day of the week is ignored
+ *
+ * @param time Pointer to the time to convert
+ *
+ * @return seconds since 2000, 0 for times before 2000
+ */
+uint32_t rtc_to_seconds(const rtc_t * time);
+
 #endif /* __RTC_H__ */
@@ -0,0 +1,94 @@
+/**
+ * @file seal.h
+ * @brief Encrypted sessions and sealed frames
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * With AUTH_CHECK off the access codes go over the air in the clear, so
+ * anyone in range can dump the log. An encrypted session (see
+ * cmd_session_t) keeps the log to whoever holds the device key: while
+ * one is open the board seals its dump and query responses, and the
+ * collector opens them with the same key.
+ *
+ * Sealing is a stage between putting a frame together and queueing it.
+ * The frame's segments, header and stored events, are gathered into
+ * one buffer and run through aes_ofb() into the buffer the frame goes
+ * out from. On the part the accelerator and the DMA do that while the
+ * frame before is still being sent by the transmit interrupt.
+ *
+ * This keeps the log secret, it does not prove where a frame came from:
+ * there is no MAC, and the frame trailer is over the ciphertext.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __SEAL_H__
+#define __SEAL_H__
+
+#include <stdint.h>
+#include "aes.h"
+#include "packets.h"
+#include "uart.h"
+
+/* a sealed payload with room for the accelerator's last block */
+#define SEAL_BUF_LEN (SEAL_HDR_LEN + AES_ROUND_UP(PKT_MAX_PAYLOAD - SEAL_HDR_LEN))
+#define SEAL_MAX_SEQ (0xFFFF) /* frames one session can seal */
+
+/*
+ * @brief Session key and frame count
+ */
+typedef struct
+{
+  aes_ctx_t aes;
+  uint32_t seq; /* frames sealed so far */
+} seal_t;
+
+/**
+ * @brief Starts a session
+ *
+ * @param seal Pointer to the session to fill
+ * @param device Pointer to the device key
+ * @param app_nonce Pointer to the nonce from cmd_session_t
+ * @param dev_nonce Pointer to the nonce from res_session_t
+ *
+ * @return none
+ */
+void seal_derive(seal_t * seal, const aes_ctx_t * device, const uint8_t * app_nonce, const uint8_t * dev_nonce);
+
+/**
+ * @brief Seals a response into a PKT_RES_SEALED payload
+ *
+ * The segments are gathered before out is written, so they may point
+ * into it.
+ *
+ * @param seal Pointer to the session
+ * @param pkt_type The type of the response
+ * @param segs The response payload, in pieces
+ * @param num_segs The number of pieces
+ * @param out Pointer to SEAL_BUF_LEN bytes, word aligned
+ * @param len Pointer to the location to store the sealed payload length
+ *
+ * @return 1 on success, 0 if the payload is over SEAL_MAX_PAYLOAD or the
+ *         session has sealed SEAL_MAX_SEQ frames
+ */
+uint8_t seal_frame(seal_t * seal, uint8_t pkt_type, const sg_seg_t * segs, uint8_t num_segs, uint8_t * out,
+                   uint32_t * len);
+
+/**
+ * @brief Opens a PKT_RES_SEALED payload
+ *
+ * Safe to call from several threads with the same session
+ *
+ * @param seal Pointer to the session
+ * @param in Pointer to the sealed payload
+ * @param len The length of the sealed payload
+ * @param pkt_type Pointer to the location to store the type of the response inside
+ * @param out Pointer to PKT_MAX_PAYLOAD bytes for its payload
+ * @param out_len Pointer to the location to store the payload length
+ *
+ * @return 1 on success, 0 if too short to be sealed
+ */
+uint8_t seal_open(const seal_t * seal, const uint8_t * in, uint32_t len, uint8_t * pkt_type, uint8_t * out,
+                  uint32_t * out_len);
+
+#endif /* __SEAL_H__ */
@@ -38,6 +38,17 @@ void spi_write(uint8_t addr, uint8_t data);
  */
 uint8_t spi_read(uint8_t addr);
 
+/**
+ * @brief Reads consecutive registers on a SPI device in one transfer
+ *
+ * @param addr The address of the first register
+ * @param ptr_data Pointer to where the data will be stored
+ * @param len The number of registers to read
+ *
+ * @return none
+ */
+void spi_read_burst(uint8_t addr, uint8_t * ptr_data, uint8_t len);
+
 /**
  * @brief Reads from two registers on a SPI device
  *
@@ -0,0 +1,88 @@
+/**
+ * @file stream.h
+ * @brief Live accelerometer stream over Bluetooth
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * For field diagnosis and tuning the thresholds. PKT_CMD_STREAM puts the
+ * ADXL345 FIFO in stream mode at the rate asked for, and stream_poll()
+ * empties it from the main loop a batch at a time. One sample in every
+ * decimation goes into a fixed size PKT_RES_STREAM frame: x, y and z are
+ * read from the part straight into the frame, the magnitude costs an
+ * integer square root.
+ *
+ * There are two frames. One is sent by the interrupt driven transmit
+ * engine while the other fills, so sensing never waits on the link. If
+ * a frame fills while the other is still going out the link is behind:
+ * the full frame is held, samples are dropped until it can go and
+ * counted in the next frame, and the decimation is doubled. Once
+ * STREAM_RECOVER_FRAMES frames in a row have gone out without waiting
+ * it is halved again, back down to the one asked for.
+ *
+ * While streaming the flip check takes z from the stream, since reading
+ * the data registers would take samples out of the FIFO. A drop still
+ * reads the part from the tap interrupt, which costs the stream a few
+ * samples.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "packets.h"
+
+#define STREAM_HDR_LEN (8) /* res_stream_t on the wire */
+#define STREAM_FRAME_LEN (STREAM_HDR_LEN + STREAM_SAMPLES_LEN)
+#define STREAM_RATE_MIN (0x06) /* 6.25 Hz */
+#define STREAM_RATE_MAX (0x0D) /* 800 Hz, the FIFO fills in 40ms */
+#define STREAM_MAX_DECIMATION (128)
+#define STREAM_RECOVER_FRAMES (16) /* frames sent without waiting before the decimation is lowered */
+
+/**
+ * @brief Start, change or stop the stream
+ *
+ * A frame being filled is thrown away. The sensor rate in use before
+ * the stream started is put back when it stops.
+ *
+ * @param mode A stream_mode_e, STREAM_OFF stops
+ * @param rate The BW_RATE code, STREAM_RATE_MIN to STREAM_RATE_MAX
+ * @param decimation Send one sample in this many, 0 is the same as 1
+ *
+ * @return 1 on success, 0 for an invalid mode or rate
+ */
+uint8_t stream_start(uint8_t mode, uint8_t rate, uint8_t decimation);
+
+/**
+ * @brief Stop the stream
+ *
+ * @return none
+ */
+void stream_stop();
+
+/**
+ * @brief Check if streaming
+ *
+ * @return 1 while streaming
+ */
+uint8_t stream_active();
+
+/**
+ * @brief Empty the sensor FIFO into frames and send the full ones
+ *
+ * Called from the main loop, never waits for the link
+ *
+ * @return none
+ */
+void stream_poll();
+
+/**
+ * @brief Get the newest z reading taken by the stream
+ *
+ * @param z Where to store the reading
+ *
+ * @return 1 if there is one, 0 if not streaming or nothing read yet
+ */
+uint8_t stream_get_z(int16_t * z);
+
+#endif /* __STREAM_H__ */
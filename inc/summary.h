@@ -0,0 +1,49 @@
+/**
+ * @file summary.h
+ * @brief Running aggregates of recorded events
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Updated as each event is recorded, so a summary costs the same to
+ * serve however long the log is, and still counts events the log had
+ * no room for.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/10
+ */
+#ifndef __SUMMARY_H__
+#define __SUMMARY_H__
+
+#include "packets.h"
+
+/**
+ * @brief Clear the aggregates
+ *
+ * @return none
+ */
+void summary_init();
+
+/**
+ * @brief Add a recorded event
+ *
+ * Safe to call from interrupts
+ *
+ * @param event Pointer to the event
+ * @param stored 1 if the event made it into the log
+ *
+ * @return none
+ */
+void summary_add(const event_t * event, uint8_t stored);
+
+/**
+ * @brief Fill a summary response
+ *
+ * The package id is left for the caller
+ *
+ * @param ptr_summary Pointer to the summary response
+ *
+ * @return none
+ */
+void summary_get(res_summary_t * ptr_summary);
+
+#endif /* __SUMMARY_H__ */
@@ -0,0 +1,134 @@
+/**
+ * @file trace.h
+ * @brief Binary trace ring for the on-board UART
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * Call sites store a format ID, up to two raw arguments and a cycle
+ * timestamp in a RAM ring. trace_drain() sends the records out of the
+ * on-board UART from the main loop without blocking, and
+ * scripts/trace_decode.py turns them back into text using the format
+ * strings in the comments of trace_fmt_e.
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/04
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "helpers.h"
+
+#define TRACE_BUF_LEN (32) /* records, must be a power of 2 */
+#define TRACE_MAX_ARGS (2)
+#define TRACE_SYNC (0xA5)
+
+/*
+ * @brief Trace format IDs
+ *
+ * The string in the comment is the format used by the host decoder,
+ * keep one entry per line.
+ */
+typedef enum
+{
+  TRC_BOOT = 0,    /* "boot" */
+  TRC_PKT_RX,      /* "rx type=0x%02x len=%u" */
+  TRC_PKT_BAD_CRC, /* "rx type=0x%02x bad checksum 0x%02x" */
+  TRC_EVENT,       /* "event type=%u data=0x%x" */
+  TRC_EVENT_LOST,  /* "event type=%u lost, status=%u" */
+  TRC_ARENA_HIGH_WATER, /* "arena pool=%u high water=%u" */
+  TRC_BAUD,        /* "baud rate=%u result=%u" */
+  TRC_EVENT_EVICTED, /* "event type=%u evicted, policy=%u" */
+  TRC_BOOT_PHASE,  /* "boot phase=%u done" */
+  TRC_STREAM       /* "stream mode=%u decimation=%u" */
+} trace_fmt_e;
+
+/*
+ * @brief Trace record as stored and as sent over the wire
+ */
+typedef struct
+{
+  uint8_t sync; /* TRACE_SYNC, lets the decoder find record boundaries */
+  uint8_t fmt; /* trace_fmt_e */
+  uint8_t seq; /* gaps in the sequence mean records were dropped */
+  uint8_t nargs;
+  uint32_t cycles; /* cycle counter when the record was written */
+  uint32_t args[TRACE_MAX_ARGS];
+} trace_rec_t;
+
+/*
+ * @brief Trace ring
+ */
+typedef struct
+{
+  trace_rec_t recs[TRACE_BUF_LEN];
+  uint32_t head; /* free running write index */
+  uint32_t tail; /* free running read index */
+  uint32_t drain_off; /* bytes of the tail record already sent */
+  uint32_t dropped; /* records lost to a full ring */
+  uint8_t seq;
+} trace_t;
+
+extern trace_t trace;
+
+/**
+ * @brief Initialize the trace ring
+ *
+ * Also starts the cycle counter used for timestamps
+ *
+ * @return none
+ */
+void trace_init();
+
+/**
+ * @brief Send pending trace bytes
+ *
+ * Writes to the on-board UART only while it is ready, never waits
+ *
+ * @return none
+ */
+void trace_drain();
+
+/**
+ * @brief Add a record to the trace ring
+ *
+ * Safe to call from interrupts and critical sections. If the ring is
+ * full the record is dropped and counted.
+ *
+ * @param fmt The trace format ID
+ * @param nargs The number of arguments used by the format
+ * @param arg0 The first argument
+ * @param arg1 The second argument
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void trace_write(trace_fmt_e fmt, uint8_t nargs, uint32_t arg0, uint32_t arg1)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if(trace.head - trace.tail < TRACE_BUF_LEN)
+  {
+    trace_rec_t * rec = &trace.recs[trace.head & (TRACE_BUF_LEN - 1)];
+    rec->sync = TRACE_SYNC;
+    rec->fmt = fmt;
+    rec->seq = trace.seq;
+    rec->nargs = nargs;
+    rec->cycles = CYCLE_COUNT();
+    rec->args[0] = arg0;
+    rec->args[1] = arg1;
+    trace.head++;
+  }
+  else
+  {
+    trace.dropped++;
+  }
+  trace.seq++;
+
+  __set_PRIMASK(primask);
+}
+
+#define TRACE0(fmt) trace_write((fmt), 0, 0, 0)
+#define TRACE1(fmt, a) trace_write((fmt), 1, (uint32_t)(a), 0)
+#define TRACE2(fmt, a, b) trace_write((fmt), 2, (uint32_t)(a), (uint32_t)(b))
+
+#endif /* __TRACE_H__ */
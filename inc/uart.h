@@ -14,11 +14,22 @@
 #define __UART_H__
 
 #include "circbuf.h"
+#include "codec.h"
 #include "packets.h"
 
-#define UART_RX_BUF_LEN (64)
+#define UART_RX_BUF_LEN (CODEC_WIRE_MAX) /* a whole frame, commands are only read once complete */
 #define UART_NUM_LOG (0)
 #define UART_NUM_BT (1)
+#define UART_SG_MAX_SEGS (20) /* payload segments per frame */
+
+/**
+ * @brief scatter-gather segment
+ */
+typedef struct
+{
+  const uint8_t * ptr;
+  uint32_t len;
+} sg_seg_t;
 
 /**
  * @brief initializes UART
@@ -42,6 +53,16 @@ void uart_init(cb_t ** ptr_uart_rx_buf);
  */
 void uart_send_blocking(uint8_t uart_num, uint8_t data);
 
+/**
+ * @brief sends a byte over UART if it is ready
+ *
+ * @param uart_num 0 or 1
+ * @param data The byte to send
+ *
+ * @return 1 if the byte was sent, 0 if the UART was busy
+ */
+uint8_t uart_send_nonblocking(uint8_t uart_num, uint8_t data);
+
 /**
  * @brief sends a block of data over UART
  *
@@ -51,7 +72,7 @@ void uart_send_blocking(uint8_t uart_num, uint8_t data);
  *
  * @return none
  */
-void uart_send_n_blocking(uint8_t uart_num, uint8_t * ptr_data, uint8_t len);
+void uart_send_n_blocking(uint8_t uart_num, uint8_t * ptr_data, uint32_t len);
 
 /**
  * @brief sends a string over UART
@@ -83,6 +104,129 @@ void uart_send_int_blocking(uint8_t uart_num, int32_t data);
  */
 void uart_send_pkt(uint8_t uart_num, pkt_t * ptr_pkt);
 
+/**
+ * @brief starts sending a frame from a list of segments
+ *
+ * The header and trailer are added by the transmit engine, which
+ * computes the checksum as each segment goes out. Nothing is copied, so
+ * the segments must stay valid until uart_tx_busy() returns 0. The
+ * Bluetooth UART is interrupt driven, the on-board UART is sent by
+ * uart_send_sg().
+ *
+ * @param uart_num 0 or 1
+ * @param type The packet type
+ * @param segs The payload segments
+ * @param num_segs The number of payload segments, at most UART_SG_MAX_SEGS
+ *
+ * @return 1 if the frame was queued, 0 if the engine is busy or the frame is invalid
+ */
+uint8_t uart_send_sg_start(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs);
+
+/**
+ * @brief sends a frame from a list of segments
+ *
+ * Waits for any frame in progress, then for this one to finish
+ *
+ * @param uart_num 0 or 1
+ * @param type The packet type
+ * @param segs The payload segments
+ * @param num_segs The number of payload segments, at most UART_SG_MAX_SEGS
+ *
+ * @return none
+ */
+void uart_send_sg(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs);
+
+/**
+ * @brief queues a frame from a list of segments behind the one in progress
+ *
+ * Waits for any frame in progress, then starts this one and returns
+ * while it goes out, so the next can be put together meanwhile. The
+ * segments must stay valid until the frame after this one is queued or
+ * uart_tx_flush() returns.
+ *
+ * @param uart_num 0 or 1
+ * @param type The packet type
+ * @param segs The payload segments
+ * @param num_segs The number of payload segments, at most UART_SG_MAX_SEGS
+ *
+ * @return none
+ */
+void uart_send_sg_queue(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs);
+
+/**
+ * @brief waits for the frame in progress to finish
+ *
+ * @param uart_num 0 or 1
+ *
+ * @return none
+ */
+void uart_tx_flush(uint8_t uart_num);
+
+/**
+ * @brief checks if the transmit engine is sending a frame
+ *
+ * @param uart_num 0 or 1
+ *
+ * @return 1 while a frame is in progress
+ */
+uint8_t uart_tx_busy(uint8_t uart_num);
+
+/**
+ * @brief sends the next byte of the frame in progress
+ *
+ * Called from the UART interrupt when TXIFG is set
+ *
+ * @param uart_num 0 or 1
+ *
+ * @return none
+ */
+void uart_tx_isr(uint8_t uart_num);
+
+/**
+ * @brief sets the UART rate
+ *
+ * Waits for the transmitter to finish, then reprograms the divider from
+ * the table for SMCLK_HZ
+ *
+ * @param uart_num 0 or 1
+ * @param rate A baud_rate_e
+ *
+ * @return 1 on success, 0 for an invalid UART or rate
+ */
+uint8_t uart_set_baud(uint8_t uart_num, uint8_t rate);
+
+/**
+ * @brief gets the Bluetooth UART rate
+ *
+ * @return The baud_rate_e in use
+ */
+uint8_t uart_get_baud();
+
+/**
+ * @brief sets the protocol version
+ *
+ * Changes the frame trailer for both directions. Only call between packets.
+ *
+ * @param version A PROTO_VERSION_* value
+ *
+ * @return none
+ */
+void uart_set_proto_version(uint8_t version);
+
+/**
+ * @brief gets the protocol version
+ *
+ * @return The protocol version in use
+ */
+uint8_t uart_get_proto_version();
+
+/**
+ * @brief gets the length of the frame trailer
+ *
+ * @return 1 for the XOR checksum, 4 for CRC32
+ */
+uint8_t uart_trailer_len();
+
 /**
  * @brief sends a byte over the on-chip UART
  *
@@ -103,7 +247,7 @@ __attribute__((always_inline)) inline void log_send(uint8_t data)
  *
  * @return none
  */
-__attribute__((always_inline)) inline void log_send_n(uint8_t * ptr_data, uint8_t len)
+__attribute__((always_inline)) inline void log_send_n(uint8_t * ptr_data, uint32_t len)
 {
   uart_send_n_blocking(UART_NUM_LOG, ptr_data, len);
 }
@@ -164,7 +308,7 @@ __attribute__((always_inline)) inline void bt_send(uint8_t data)
  *
  * @return none
  */
-__attribute__((always_inline)) inline void bt_send_n(uint8_t * ptr_data, uint8_t len)
+__attribute__((always_inline)) inline void bt_send_n(uint8_t * ptr_data, uint32_t len)
 {
   uart_send_n_blocking(UART_NUM_BT, ptr_data, len);
 }
@@ -193,6 +337,34 @@ __attribute__((always_inline)) inline void bt_send_int(int32_t data)
   uart_send_int_blocking(UART_NUM_BT, data);
 }
 
+/**
+ * @brief sends a frame from a list of segments over Bluetooth
+ *
+ * @param type The packet type
+ * @param segs The payload segments
+ * @param num_segs The number of payload segments
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void bt_send_sg(uint8_t type, const sg_seg_t * segs, uint8_t num_segs)
+{
+  uart_send_sg(UART_NUM_BT, type, segs, num_segs);
+}
+
+/**
+ * @brief queues a frame from a list of segments over Bluetooth
+ *
+ * @param type The packet type
+ * @param segs The payload segments
+ * @param num_segs The number of payload segments
+ *
+ * @return none
+ */
+__attribute__((always_inline)) inline void bt_send_sg_queue(uint8_t type, const sg_seg_t * segs, uint8_t num_segs)
+{
+  uart_send_sg_queue(UART_NUM_BT, type, segs, num_segs);
+}
+
 /**
  * @brief sends a packet over Bluetooth
  *
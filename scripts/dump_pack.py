@@ -0,0 +1,124 @@
+# Packed dump encoding, see inc/pack.h
+#
+# Events are tuples of (event_type, reserved, (year, month, dow, day, hour,
+# minute, second), data), reserved being the three reserved bytes as a
+# little endian integer.
+
+import datetime
+import struct
+
+TYPE_DROP = 0
+TYPE_FLIP = 1
+TYPE_OTHER = 2
+TYPE_CORRUPT = 3
+
+EVENT_CORRUPT = 0xFF
+EPOCH = datetime.datetime(2000, 1, 1)
+
+def to_seconds(time):
+  year, month, dow, day, hour, minute, second = time
+  if year < 2000:
+    return 0
+  return int((datetime.datetime(year, month, day, hour, minute, second) - EPOCH).total_seconds())
+
+def from_seconds(secs, dow):
+  t = EPOCH + datetime.timedelta(seconds=secs)
+  return (t.year, t.month, dow, t.day, t.hour, t.minute, t.second)
+
+def zigzag(value):
+  value &= 0xFFFFFFFF
+  return ((value << 1) ^ (0xFFFFFFFF if value & 0x80000000 else 0)) & 0xFFFFFFFF
+
+def unzigzag(value):
+  value = (value >> 1) ^ -(value & 1)
+  return value
+
+def put_varint(value):
+  out = bytearray()
+  while value >= 0x80:
+    out.append((value & 0x7F) | 0x80)
+    value >>= 7
+  out.append(value)
+  return bytes(out)
+
+def get_varint(data, pos):
+  value = shift = 0
+  while True:
+    b = data[pos]
+    pos += 1
+    value |= (b & 0x7F) << shift
+    shift += 7
+    if not b & 0x80:
+      return value, pos
+
+def pack(events):
+  # mirrors pack_events, all events in one block
+  n = len(events)
+  if not n:
+    return b''
+  types = bytearray((2 * n + 7) // 8)
+  flags = bytearray((n + 7) // 8)
+  other = bytearray()
+  reserved = bytearray()
+  times = bytearray()
+  data = bytearray()
+  prev = 0
+  for i, (event_type, res, time, value) in enumerate(events):
+    code = {0: TYPE_DROP, 1: TYPE_FLIP, EVENT_CORRUPT: TYPE_CORRUPT}.get(event_type, TYPE_OTHER)
+    types[i // 4] |= code << (2 * (i % 4))
+    if code == TYPE_OTHER:
+      other.append(event_type)
+    if res:
+      flags[i // 8] |= 1 << (i % 8)
+      reserved += put_varint(res)
+    secs = to_seconds(time)
+    if i:
+      times += put_varint(zigzag(secs - prev))
+    prev = secs
+    data += put_varint(value)
+  base = struct.pack('<IB', to_seconds(events[0][2]), events[0][2][2])
+  return base + bytes(types + flags + other + reserved + times + data)
+
+def unpack(payload, n):
+  if not n:
+    return []
+  secs, dow = struct.unpack('<IB', payload[:5])
+  pos = 5
+  types = payload[pos : pos + (2 * n + 7) // 8]
+  pos += len(types)
+  flags = payload[pos : pos + (n + 7) // 8]
+  pos += len(flags)
+  codes = [(types[i // 4] >> (2 * (i % 4))) & 3 for i in range(n)]
+  flagged = [(flags[i // 8] >> (i % 8)) & 1 for i in range(n)]
+
+  event_types = []
+  for code in codes:
+    if code == TYPE_OTHER:
+      event_types.append(payload[pos])
+      pos += 1
+    else:
+      event_types.append({TYPE_DROP: 0, TYPE_FLIP: 1, TYPE_CORRUPT: EVENT_CORRUPT}[code])
+
+  reserved = []
+  for f in flagged:
+    value = 0
+    if f:
+      value, pos = get_varint(payload, pos)
+    reserved.append(value)
+
+  stamps = [secs]
+  for i in range(1, n):
+    delta, pos = get_varint(payload, pos)
+    stamps.append((stamps[-1] + unzigzag(delta)) & 0xFFFFFFFF)
+
+  data = []
+  for i in range(n):
+    value, pos = get_varint(payload, pos)
+    data.append(value)
+
+  day0 = secs // 86400
+  events = []
+  for i in range(n):
+    event_dow = (dow + stamps[i] // 86400 - day0) % 7
+    events.append((event_types[i], reserved[i], from_seconds(stamps[i], event_dow), data[i]))
+  return events
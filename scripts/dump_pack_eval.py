@@ -0,0 +1,108 @@
+# Packed dump evaluation
+#
+# Builds shipment logs like the ones the device records and compares the
+# size of a raw dump against a packed one, both split into packets the
+# way send_dump_pkt and send_packed_dump_pkt do it.
+#
+# usage: python dump_pack_eval.py [--seed S]
+
+import argparse
+import datetime
+import random
+
+import dump_pack
+
+EVENT_LEN = 16
+HDR_LEN = 4 # res_dump_t
+FRAME_OVERHEAD = 2 + 4 # type, len, CRC32
+MAX_PAYLOAD = 255
+BAUD = 9600
+
+def event(t, event_type, data):
+  time = (t.year, t.month, (t.weekday() + 1) % 7, t.day, t.hour, t.minute, t.second)
+  return (event_type, 0, time, data)
+
+def ground(rng, data):
+  # a few days by truck, bursts of drops and flips at each sort facility
+  events = []
+  t = datetime.datetime(2018, 5, 7, 8, 0, 0)
+  for stop in range(rng.randint(4, 7)):
+    for _ in range(rng.randint(3, 20)):
+      t += datetime.timedelta(seconds=rng.randint(2, 90))
+      kind = 1 if rng.random() < 0.3 else 0
+      events.append(event(t, kind, data(rng, kind)))
+    t += datetime.timedelta(hours=rng.randint(4, 14))
+  return events
+
+def air(rng, data):
+  # overnight air, few events but a long time between them
+  events = []
+  t = datetime.datetime(2018, 5, 7, 17, 0, 0)
+  for _ in range(rng.randint(5, 15)):
+    t += datetime.timedelta(minutes=rng.randint(10, 400))
+    kind = 1 if rng.random() < 0.2 else 0
+    events.append(event(t, kind, data(rng, kind)))
+  return events
+
+def rough(rng, data):
+  # a parcel that got thrown around, fills the event pool
+  events = []
+  t = datetime.datetime(2018, 5, 7, 9, 0, 0)
+  for _ in range(128):
+    t += datetime.timedelta(seconds=rng.randint(1, 600))
+    kind = 1 if rng.random() < 0.4 else 0
+    events.append(event(t, kind, data(rng, kind)))
+  return events
+
+def no_data(rng, kind):
+  # the firmware stores 0 today
+  return 0
+
+def peak_g(rng, kind):
+  # peak acceleration in ADXL345 counts, 256 per g
+  return 0 if kind else rng.randint(512, 4000)
+
+def raw_size(events):
+  per_pkt = (MAX_PAYLOAD - HDR_LEN) // EVENT_LEN
+  pkts = max(1, (len(events) + per_pkt - 1) // per_pkt)
+  return pkts * (HDR_LEN + FRAME_OVERHEAD) + len(events) * EVENT_LEN
+
+def packed_size(events):
+  # greedy split, same as pack_count
+  size = 0
+  i = 0
+  while True:
+    n = 0
+    while i + n < len(events) and n < 255:
+      if len(dump_pack.pack(events[i : i + n + 1])) > MAX_PAYLOAD - HDR_LEN:
+        break
+      n += 1
+    block = dump_pack.pack(events[i : i + n])
+    assert dump_pack.unpack(block, n) == events[i : i + n]
+    size += HDR_LEN + FRAME_OVERHEAD + len(block)
+    i += n
+    if i >= len(events):
+      return size
+
+def main():
+  parser = argparse.ArgumentParser(description='Packed dump evaluation')
+  parser.add_argument('--seed', type=int, default=4830)
+  args = parser.parse_args()
+  rng = random.Random(args.seed)
+
+  print("{:<10} {:<8} {:>7} {:>8} {:>8} {:>7} {:>10}".format(
+        "log", "data", "events", "raw B", "packed B", "ratio", "saved ms"))
+  for name, make in (("ground", ground), ("air", air), ("rough", rough)):
+    for data_name, data in (("none", no_data), ("peak", peak_g)):
+      raw = packed = count = 0
+      for _ in range(50):
+        events = make(rng, data)
+        count += len(events)
+        raw += raw_size(events)
+        packed += packed_size(events)
+      saved = (raw - packed) / 50 * 10 * 1000 / BAUD
+      print("{:<10} {:<8} {:>7.1f} {:>8.1f} {:>8.1f} {:>6.2f}x {:>10.0f}".format(
+            name, data_name, count / 50, raw / 50, packed / 50, raw / packed, saved))
+
+if __name__ == '__main__':
+  main()
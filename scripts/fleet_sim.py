@@ -0,0 +1,380 @@
+# Fleet load test against simulated boards
+#
+# Starts a number of host/pps_host instances, each on its own Bluetooth
+# pseudo-terminal, and drains them all at once the way a hub gateway
+# does. Every device gets a status, a switch to protocol v3, an init, a
+# log of drops and flips made through the simulator's stdin, and then a
+# number of dump sessions run against every device at the same time.
+#
+# -e makes each link flip bits (see sim_line_noise in host/hal_host.c).
+# A request is sent again when its answer does not come, fails its
+# checksum or is a NAK; a dump with a bad frame is asked for again from
+# the start. Reports events per second across the fleet during the dump
+# rounds, dump latency percentiles per device and overall, and the number
+# of retransmits.
+#
+# usage: python fleet_sim.py [--devices N] [--events N] [--error-ppm PPM] [--rounds N]
+
+import argparse
+import datetime
+import os
+import random
+import select
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import tty
+import zlib
+
+PROTO_VERSION_XOR = 1
+PROTO_VERSION_COBS = 3
+
+PKT_CMD_STATUS = 0x00
+PKT_CMD_INIT = 0x01
+PKT_CMD_DUMP = 0x02
+PKT_CMD_VERSION = 0x04
+PKT_RES_ACK = 0x80
+PKT_RES_STATUS = 0x81
+PKT_RES_DUMP = 0x82
+PKT_RES_VERSION = 0x84
+PKT_RES_DUMP_PACKED = 0x86
+PKT_RES_NAK = 0x8F
+
+ACCESS_CARRIER = 0x8A
+ACCESS_USER = 0xB2
+COALESCE_MS = 20 # short, so injected events are not merged
+FLIP_MS = 200 # long enough upside down for DETECT_FLIP_COUNT readings
+QUIET_S = 0.3 # line idle this long after a bad frame, the rest has arrived
+SWITCH_S = 0.05 # the board changes framing after its version answer is out
+RETRIES = 20
+
+def cobs_encode(data):
+  # code byte is one more than the non-zero bytes that follow
+  out = bytearray()
+  block = bytearray()
+  for b in data:
+    if b == 0:
+      out += bytes([len(block) + 1]) + block
+      block = bytearray()
+    else:
+      block.append(b)
+      if len(block) == 254:
+        out += bytes([255]) + block
+        block = bytearray()
+  out += bytes([len(block) + 1]) + block
+  return bytes(out)
+
+def cobs_decode(data):
+  out = bytearray()
+  i = 0
+  while i < len(data):
+    code = data[i]
+    if code == 0 or i + code > len(data) + (code == 255):
+      return None
+    out += data[i + 1 : i + code]
+    i += code
+    if code < 255 and i < len(data):
+      out.append(0)
+  return bytes(out)
+
+def percentile(values, p):
+  # nearest rank
+  if not values:
+    return 0.0
+  values = sorted(values)
+  return values[max(0, min(len(values) - 1, int(round(p / 100.0 * len(values) + 0.5)) - 1))]
+
+class LinkError(Exception):
+  pass
+
+class Device:
+  def __init__(self, index, args, rng, workdir):
+    self.index = index
+    self.args = args
+    self.rng = rng
+    self.link = os.path.join(workdir, "bt{}".format(index))
+    self.log = open(os.path.join(workdir, "dev{}.log".format(index)), "w")
+    self.proto = PROTO_VERSION_XOR
+    self.rx = bytearray()
+    self.fd = None
+    self.events = None # log length, from the first whole dump
+    self.retransmits = 0
+    self.latencies = []
+    self.dumped = 0
+    self.mismatches = 0
+    self.error = None
+    self.proc = subprocess.Popen([args.sim, "-b", self.link, "-e", str(args.error_ppm)],
+                                 stdin=subprocess.PIPE, stdout=self.log, stderr=self.log)
+
+  def open(self):
+    deadline = time.time() + 5
+    while not os.path.exists(self.link):
+      if time.time() > deadline:
+        raise LinkError("simulator did not start")
+      time.sleep(0.02)
+    self.fd = os.open(self.link, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    tty.setraw(self.fd)
+
+  def close(self):
+    if self.proc.poll() is None:
+      self.command("quit")
+      try:
+        self.proc.wait(2)
+      except subprocess.TimeoutExpired:
+        self.proc.kill()
+    if self.fd is not None:
+      os.close(self.fd)
+    self.log.close()
+
+  def command(self, line):
+    self.proc.stdin.write((line + "\n").encode())
+    self.proc.stdin.flush()
+
+  # link
+
+  def send(self, pkt_type, payload):
+    pkt = bytes([pkt_type, len(payload)]) + payload
+    if self.proto >= PROTO_VERSION_COBS:
+      pkt = b'\x00' + cobs_encode(pkt + struct.pack('<I', zlib.crc32(pkt) & 0xFFFFFFFF)) + b'\x00'
+    else:
+      crc = 0
+      for b in pkt:
+        crc ^= b
+      pkt += bytes([crc])
+    os.write(self.fd, pkt)
+
+  def fill(self, deadline):
+    # read what has arrived, False once past the deadline
+    wait = deadline - time.time()
+    if wait <= 0:
+      return False
+    r, _, _ = select.select([self.fd], [], [], wait)
+    if r:
+      try:
+        self.rx += os.read(self.fd, 4096)
+      except BlockingIOError:
+        pass
+    return True
+
+  def drain(self):
+    # wait for the line to go quiet and throw it away
+    while True:
+      r, _, _ = select.select([self.fd], [], [], QUIET_S)
+      if not r:
+        break
+      try:
+        os.read(self.fd, 4096)
+      except BlockingIOError:
+        pass
+    self.rx = bytearray()
+
+  def recv(self, timeout):
+    # (type, payload), None if nothing came, or (None, None) for a bad frame
+    deadline = time.time() + timeout
+    while True:
+      if self.proto >= PROTO_VERSION_COBS:
+        end = self.rx.find(b'\x00')
+        if end == 0:
+          del self.rx[0]
+          continue
+        if end > 0:
+          frame = cobs_decode(bytes(self.rx[:end]))
+          del self.rx[:end + 1]
+          if frame is None or len(frame) < 6 or len(frame) != 6 + frame[1]:
+            return (None, None)
+          if struct.unpack('<I', frame[-4:])[0] != zlib.crc32(frame[:-4]) & 0xFFFFFFFF:
+            return (None, None)
+          return (frame[0], frame[2:-4])
+      elif len(self.rx) >= 3 and len(self.rx) >= 3 + self.rx[1]:
+        n = 3 + self.rx[1]
+        frame = bytes(self.rx[:n])
+        del self.rx[:n]
+        crc = 0
+        for b in frame:
+          crc ^= b
+        return (frame[0], frame[2:-1]) if crc == 0 else (None, None)
+      if not self.fill(deadline):
+        if self.proc.poll() is not None:
+          raise LinkError("simulator exited with status {}".format(self.proc.returncode))
+        return None
+
+  def resync(self):
+    # v1 frames are counted by length, so a garbled length leaves the
+    # board waiting for bytes that are not coming. Feed it zeros until it
+    # answers, a zero status packet ends on a packet boundary.
+    self.drain()
+    for _ in range(3 + 255 + 1):
+      os.write(self.fd, b'\x00')
+      r, _, _ = select.select([self.fd], [], [], 0.03)
+      if r:
+        break
+    self.drain()
+
+  def request(self, pkt_type, payload, res_type):
+    for attempt in range(RETRIES):
+      if attempt:
+        self.retransmits += 1
+      self.send(pkt_type, payload)
+      res = self.recv(self.args.timeout)
+      if res and res[0] == res_type:
+        return res[1]
+      if self.proto < PROTO_VERSION_COBS:
+        self.resync()
+      else:
+        self.drain()
+    raise LinkError("no answer to 0x{:02X}".format(pkt_type))
+
+  # session
+
+  def negotiate(self):
+    for attempt in range(RETRIES):
+      if attempt:
+        self.retransmits += 1
+      self.send(PKT_CMD_VERSION, bytes([PROTO_VERSION_COBS]))
+      res = self.recv(self.args.timeout)
+      if res and res[0] == PKT_RES_VERSION and res[1][0] == PROTO_VERSION_COBS:
+        self.proto = PROTO_VERSION_COBS
+        time.sleep(SWITCH_S)
+        return
+      # the answer may have been lost after the board switched
+      self.drain()
+      self.proto = PROTO_VERSION_COBS
+      self.send(PKT_CMD_STATUS, b'')
+      res = self.recv(self.args.timeout)
+      if res and res[0] == PKT_RES_STATUS:
+        return
+      self.proto = PROTO_VERSION_XOR
+      self.resync()
+    raise LinkError("could not switch to protocol v3")
+
+  def init(self):
+    t = datetime.datetime.today()
+    payload = struct.pack('<HH', 0x1000 + self.index, COALESCE_MS)
+    payload += struct.pack('<H6B', t.year, t.month, (t.weekday() + 1) % 7, t.day, t.hour, t.minute, t.second)
+    payload += bytes([ACCESS_CARRIER, ACCESS_USER, 0x03, 18]) # drops and flips, overwrite the oldest
+    payload += "1ZFLEET{:011d}".format(self.index).encode()
+    self.request(PKT_CMD_INIT, payload, PKT_RES_ACK)
+
+  def fill_log(self):
+    # drops and flips far enough apart that coalescing keeps them
+    for _ in range(self.args.events):
+      if self.rng.random() < self.args.flips:
+        self.command("flip")
+        time.sleep(FLIP_MS / 1000.0)
+        self.command("upright")
+      else:
+        self.command("drop {:.1f}".format(self.rng.uniform(18, 40)))
+      time.sleep(COALESCE_MS * 3 / 1000.0)
+
+  def dump(self):
+    # the whole log, from the start again if any frame is lost
+    res_type = PKT_RES_DUMP_PACKED if self.args.packed else PKT_RES_DUMP
+    start = time.time()
+    for attempt in range(RETRIES):
+      if attempt:
+        self.retransmits += 1
+      self.send(PKT_CMD_DUMP, bytes([ACCESS_CARRIER, 1 if self.args.packed else 0]))
+      count = 0
+      left = None
+      while True:
+        res = self.recv(self.args.timeout)
+        if not res or res[0] != res_type:
+          break
+        package_id, num_events, frames_left = struct.unpack('<HBB', res[1][:4])
+        if left is not None and frames_left != left - 1:
+          break
+        count += num_events
+        left = frames_left
+        if not left:
+          self.latencies.append(time.time() - start)
+          self.dumped += count
+          if self.events is None:
+            self.events = count
+          elif count != self.events:
+            self.mismatches += 1
+          return
+      self.drain()
+    raise LinkError("dump failed")
+
+  def setup(self):
+    self.open()
+    self.request(PKT_CMD_STATUS, b'', PKT_RES_STATUS)
+    self.negotiate()
+    self.init()
+    self.fill_log()
+
+def run(device, barrier, rounds):
+  try:
+    device.setup()
+  except LinkError as e:
+    device.error = str(e)
+  barrier.wait()
+  if device.error:
+    return
+  try:
+    for _ in range(rounds):
+      device.dump()
+  except LinkError as e:
+    device.error = str(e)
+
+def main():
+  parser = argparse.ArgumentParser(description='Fleet load test against simulated boards')
+  parser.add_argument('--devices', type=int, default=8)
+  parser.add_argument('--events', type=int, default=32, help='drops and flips made on each device')
+  parser.add_argument('--flips', type=float, default=0.25, help='share of the events that are flips')
+  parser.add_argument('--error-ppm', type=int, default=0, help='bytes in a million with a bit flipped')
+  parser.add_argument('--rounds', type=int, default=3, help='dumps of each device')
+  parser.add_argument('--packed', action='store_true', help='ask for packed dumps')
+  parser.add_argument('--timeout', type=float, default=1.0, help='seconds to wait for each frame')
+  parser.add_argument('--seed', type=int, default=4830)
+  parser.add_argument('--sim', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'host', 'pps_host'))
+  args = parser.parse_args()
+
+  if not os.path.exists(args.sim):
+    sys.exit("{} not found, run make -C host".format(args.sim))
+
+  rng = random.Random(args.seed)
+  workdir = tempfile.mkdtemp(prefix='pps-fleet-')
+  devices = [Device(i, args, random.Random(rng.random()), workdir) for i in range(args.devices)]
+  barrier = threading.Barrier(args.devices + 1)
+  threads = [threading.Thread(target=run, args=(d, barrier, args.rounds)) for d in devices]
+
+  try:
+    for t in threads:
+      t.start()
+    barrier.wait()
+    start = time.time()
+    for t in threads:
+      t.join()
+    elapsed = time.time() - start
+  finally:
+    for d in devices:
+      d.close()
+
+  print("{:<6} {:>7} {:>7} {:>8} {:>8} {:>8} {:>8}  {}".format(
+        "device", "events", "dumps", "p50 ms", "p90 ms", "max ms", "retrans", "notes"))
+  latencies = []
+  for d in devices:
+    latencies += d.latencies
+    notes = d.error or ("{} dumps differ from the first".format(d.mismatches) if d.mismatches else "")
+    print("{:<6} {:>7} {:>7} {:>8.0f} {:>8.0f} {:>8.0f} {:>8}  {}".format(
+          d.index, d.events or 0, len(d.latencies), percentile(d.latencies, 50) * 1e3,
+          percentile(d.latencies, 90) * 1e3, max(d.latencies or [0]) * 1e3, d.retransmits, notes))
+
+  dumped = sum(d.dumped for d in devices)
+  print("\n{} devices, {} dumps, {} events in {:.2f} s: {:.1f} events/s".format(
+        args.devices, len(latencies), dumped, elapsed, dumped / elapsed if elapsed else 0))
+  print("dump latency p50 {:.0f} ms, p90 {:.0f} ms, p99 {:.0f} ms, max {:.0f} ms".format(
+        percentile(latencies, 50) * 1e3, percentile(latencies, 90) * 1e3,
+        percentile(latencies, 99) * 1e3, max(latencies or [0]) * 1e3))
+  print("retransmits {}, failed devices {}".format(
+        sum(d.retransmits for d in devices), sum(1 for d in devices if d.error)))
+
+  shutil.rmtree(workdir, ignore_errors=True)
+
+if __name__ == '__main__':
+  main()
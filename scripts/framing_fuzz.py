@@ -0,0 +1,159 @@
+# Framing fuzz and throughput test
+#
+# Pushes random command frames through a noisy link model and counts how
+# many good frames per second reach the packet handler, for the length
+# framing of protocol v2 and the COBS framing of v3. The receivers mirror
+# EUSCIA2_IRQHandler and the read functions in main.c.
+#
+# usage: python framing_fuzz.py [--frames N] [--baud B] [--seed S]
+
+import argparse
+import random
+import struct
+import zlib
+
+BER_LIST = [0, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2]
+SLIP_LIST = [1e-5, 1e-4, 1e-3, 1e-2] # dropped or spurious bytes per byte
+BITS_PER_BYTE = 10 # start, 8 data, stop
+
+# payload sizes of the commands the app sends: status, init, dump, version
+CMD_SIZES = [0, 34, 1, 1]
+
+def cobs_encode(data):
+  out = bytearray()
+  block = bytearray()
+  for b in data:
+    if b == 0:
+      out += bytes([len(block) + 1]) + block
+      block = bytearray()
+    else:
+      block.append(b)
+      if len(block) == 254:
+        out += bytes([255]) + block
+        block = bytearray()
+  out += bytes([len(block) + 1]) + block
+  return bytes(out)
+
+def cobs_decode(data):
+  # returns None if the frame does not end on a block boundary
+  out = bytearray()
+  i = 0
+  while i < len(data):
+    code = data[i]
+    if code == 0 or i + code > len(data):
+      return None
+    out += data[i + 1 : i + code]
+    i += code
+    if code < 255 and i < len(data):
+      out.append(0)
+  return bytes(out)
+
+def make_frame(rng):
+  payload = bytes(rng.getrandbits(8) for _ in range(rng.choice(CMD_SIZES)))
+  frame = bytes([rng.randrange(5), len(payload)]) + payload
+  return frame + struct.pack('<I', zlib.crc32(frame) & 0xFFFFFFFF)
+
+def check_frame(frame):
+  if len(frame) < 6 or len(frame) != 6 + frame[1]:
+    return False
+  return zlib.crc32(frame[:-4]) & 0xFFFFFFFF == struct.unpack('<I', frame[-4:])[0]
+
+def encode_v2(frames):
+  return b''.join(frames)
+
+def encode_v3(frames):
+  return b''.join(b'\x00' + cobs_encode(f) + b'\x00' for f in frames)
+
+def receive_v2(stream):
+  # the ISR takes the first byte as a type and counts 1 + len + 4 more
+  frames = []
+  i = 0
+  while i + 2 <= len(stream):
+    n = 2 + stream[i + 1] + 4
+    frames.append(stream[i : i + n])
+    i += n
+  return frames
+
+def receive_v3(stream):
+  frames = []
+  for data in stream.split(b'\x00'):
+    if not data:
+      continue
+    frame = cobs_decode(data)
+    frames.append(frame if frame is not None else b'')
+  return frames
+
+def add_noise(stream, ber, rng):
+  if ber == 0:
+    return stream
+  out = bytearray(stream)
+  bits = len(out) * 8
+  # skip ahead by geometric gaps instead of rolling for every bit
+  pos = -1
+  while True:
+    pos += int(rng.expovariate(ber)) + 1
+    if pos >= bits:
+      break
+    out[pos // 8] ^= 1 << (pos % 8)
+  return bytes(out)
+
+def add_slips(stream, rate, rng):
+  out = bytearray()
+  for b in stream:
+    r = rng.random()
+    if r < rate / 2:
+      continue # dropped
+    out.append(b)
+    if r < rate:
+      out.append(rng.getrandbits(8)) # spurious
+  return bytes(out)
+
+def run(encode, receive, frames, ber, slip, baud, rng):
+  sent = set(frames)
+  stream = add_slips(add_noise(encode(frames), ber, rng), slip, rng)
+  good = bad = false_accept = 0
+  for frame in receive(stream):
+    if check_frame(frame):
+      if frame in sent:
+        good += 1
+      else:
+        false_accept += 1
+    else:
+      bad += 1
+  seconds = len(stream) * BITS_PER_BYTE / baud
+  return good, bad, false_accept, good / seconds
+
+def fuzz(rng, count):
+  # random bytes must never crash the receivers or pass as a frame
+  accepted = 0
+  for _ in range(count):
+    junk = bytes(rng.getrandbits(8) for _ in range(rng.randrange(1, 64)))
+    for receive in (receive_v2, receive_v3):
+      accepted += sum(1 for f in receive(junk) if check_frame(f))
+  return accepted
+
+def main():
+  parser = argparse.ArgumentParser(description='Framing fuzz and throughput test')
+  parser.add_argument('--frames', type=int, default=20000)
+  parser.add_argument('--baud', type=int, default=9600)
+  parser.add_argument('--seed', type=int, default=4830)
+  args = parser.parse_args()
+
+  rng = random.Random(args.seed)
+  frames = [make_frame(rng) for _ in range(args.frames)]
+
+  print("{} frames at {} baud, fa = bad frames that passed the CRC".format(args.frames, args.baud))
+  cases = [("BER", ber, 0) for ber in BER_LIST] + [("slip", 0, slip) for slip in SLIP_LIST]
+  for i, (label, ber, slip) in enumerate(cases):
+    if i == 0 or label != cases[i - 1][0]:
+      print("\n{:>8} | {:>6} {:>8} {:>7} {:>9} | {:>6} {:>8} {:>7} {:>9}".format(
+            label, "v2 ok", "v2 bad", "v2 fa", "v2 ok/s", "v3 ok", "v3 bad", "v3 fa", "v3 ok/s"))
+    row = []
+    for encode, receive in ((encode_v2, receive_v2), (encode_v3, receive_v3)):
+      row += run(encode, receive, frames, ber, slip, args.baud, random.Random(args.seed + 1))
+    print("{:>8} | {:>6} {:>8} {:>7} {:>9.1f} | {:>6} {:>8} {:>7} {:>9.1f}".format(ber or slip, *row))
+
+  print("\nfuzz: {} random buffers accepted as frames".format(fuzz(rng, 2000)))
+
+if __name__ == '__main__':
+  main()
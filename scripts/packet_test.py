@@ -1,144 +1,342 @@
+import sys
 import time
 import serial
 import threading
 import struct
 import datetime
+import zlib
 
-def send_init_pkt():
-  date = datetime.datetime.today()
-  pkt = bytes([0x01, # init type
-               34, # pkt_len 34
-               0xEF, 0xBE, # package_id 0xBEEF
-               0x00, 0x00, # reserved bytes
-               0xE2, 0x07, # year 2018
-               date.month,
-               (date.weekday() + 1) % 7,
-               date.day,
-               date.hour,
-               date.minute,
-               date.second,
-               0x8A, # carrier access code
-               0xB2, # user access code
-               0x03, # track drops and flips
-               18]) # tracking len
-  pkt += bytes(b'1ZA807T70336134832') # tracking number
-  crc = pkt[0]
-  for i in range(1,34):
-    crc ^= pkt[i]
-  pkt += bytes([crc]) # crc
-  print("Sending init packet\n")
-  ser.write(pkt)
-  return
+import dump_pack
+
+PROTO_VERSION_XOR = 1
+PROTO_VERSION_CRC32 = 2
+PROTO_VERSION_COBS = 3
+PROTO_VERSION_MAX = PROTO_VERSION_COBS
+
+proto_version = PROTO_VERSION_XOR
+
+BAUD_RATES = [9600, 19200, 38400, 57600, 115200]
+BAUD_MAX = len(BAUD_RATES) - 1
 
-def send_dump_pkt():
-  pkt = bytes([0x02, # dump type
-               1, # pkt_len 1
-               0x8A]) # access code
-  crc = pkt[0]
-  for i in range(1,3):
-    crc ^= pkt[i]
-  pkt += bytes([crc]) # crc
-  print("Sending dump packet\n")
+def add_trailer(pkt):
+  # v1: running XOR, v2: little endian CRC32
+  if proto_version >= PROTO_VERSION_CRC32:
+    return pkt + struct.pack('<I', zlib.crc32(pkt) & 0xFFFFFFFF)
+  crc = 0
+  for b in pkt:
+    crc ^= b
+  return pkt + bytes([crc])
+
+def cobs_encode(data):
+  # code byte is one more than the non-zero bytes that follow
+  out = bytearray()
+  block = bytearray()
+  for b in data:
+    if b == 0:
+      out += bytes([len(block) + 1]) + block
+      block = bytearray()
+    else:
+      block.append(b)
+      if len(block) == 254:
+        out += bytes([255]) + block
+        block = bytearray()
+  out += bytes([len(block) + 1]) + block
+  return bytes(out)
+
+def cobs_decode(data):
+  out = bytearray()
+  i = 0
+  while i < len(data):
+    code = data[i]
+    out += data[i + 1 : i + code]
+    i += code
+    if code < 255 and i < len(data):
+      out.append(0)
+  return bytes(out)
+
+def send_pkt(pkt_type, payload, name):
+  pkt = add_trailer(bytes([pkt_type, len(payload)]) + payload)
+  if proto_version >= PROTO_VERSION_COBS:
+    pkt = b'\x00' + cobs_encode(pkt) + b'\x00'
+  print("Sending {} packet\n".format(name))
   ser.write(pkt)
   return
 
+def send_init_pkt():
+  date = datetime.datetime.today()
+  payload = bytes([0xEF, 0xBE, # package_id 0xBEEF
+                   0x00, 0x00, # coalescing window, default
+                   0xE2, 0x07, # year 2018
+                   date.month,
+                   (date.weekday() + 1) % 7,
+                   date.day,
+                   date.hour,
+                   date.minute,
+                   date.second,
+                   0x8A, # carrier access code
+                   0xB2, # user access code
+                   0x03, # track drops and flips, overwrite the oldest once full
+                   18]) # tracking len
+  payload += bytes(b'1ZA807T70336134832') # tracking number
+  send_pkt(0x01, payload, "init")
+
+def send_dump_pkt(encoding=0):
+  send_pkt(0x02, bytes([0x8A, encoding]), "dump") # access code, raw or packed
+
+def send_query_pkt(type_mask, start, end, min_data, encoding=0):
+  # access code, encoding, type mask, reserved, start, end, min data
+  payload = struct.pack('<BBBxIII', 0x8A, encoding, type_mask, start, end, min_data)
+  send_pkt(0x07, payload, "query")
+
+def read_query():
+  # e.g. "df 24 0" for drops and flips in the last day of any severity
+  types, hours, min_data = input("types (d, f or df), hours back, min severity: ").split()
+  type_mask = (1 if 'd' in types else 0) | (2 if 'f' in types else 0)
+  end = int((datetime.datetime.today() - dump_pack.EPOCH).total_seconds())
+  send_query_pkt(type_mask, max(0, end - int(hours) * 3600), end, int(min_data))
+
+def send_stream_pkt(mode, rate=0x0A, decimation=1):
+  # access code, off/xyz/magnitude, BW_RATE code (0x0A is 100 Hz), decimation
+  send_pkt(0x08, bytes([0x8A, mode, rate, decimation]), "stream")
+
+def batch_entry(pkt_type, payload):
+  return bytes([pkt_type, len(payload)]) + payload
+
+def send_handoff_pkt():
+  # status, dump and summary in one frame, answered back to back
+  payload = batch_entry(0x00, bytes()) + batch_entry(0x02, bytes([0x8A, 0])) + batch_entry(0x06, bytes([0x8A]))
+  send_pkt(0x09, payload, "batch")
+
+def send_end_session_pkt():
+  send_pkt(0x0B, bytes([0x8A]), "end session") # access code, no nonce
+
+def send_caps_pkt():
+  send_pkt(0x0C, bytes(), "capabilities")
+
 def send_status_pkt():
-  pkt = bytes([0x00, # status type
-               0x00, # pkt_len 0
-               0x00]) # checksum 0
-  print("Sending status packet\n")
-  ser.write(pkt)
-  return
+  send_pkt(0x00, bytes(), "status")
+
+def send_summary_pkt():
+  send_pkt(0x06, bytes([0x8A]), "summary") # access code
+
+def send_stats_pkt():
+  send_pkt(0x03, bytes(), "stats")
+
+def send_version_pkt():
+  send_pkt(0x04, bytes([PROTO_VERSION_MAX]), "version")
+
+def send_baud_pkt(rate):
+  send_pkt(0x05, bytes([rate]), "baud")
+
+def read_cobs_frame():
+  # skip empty frames between back to back delimiters
+  data = b''
+  while not data:
+    data = ser.read_until(b'\x00')[:-1]
+  frame = cobs_decode(data)
+  if len(frame) < 6 or len(frame) != 6 + frame[1]:
+    return frame[0] if frame else 0, frame[2:-4], 0, 1
+  expected = zlib.crc32(frame[:-4]) & 0xFFFFFFFF
+  got = struct.unpack('<I', frame[-4:])[0]
+  return frame[0], frame[2:-4], expected, got
+
+def read_frame():
+  if proto_version >= PROTO_VERSION_COBS:
+    return read_cobs_frame()
+
+  # header, payload and trailer
+  pkt_hdr = ser.read(2)
+  payload = ser.read(pkt_hdr[1])
+  frame = pkt_hdr + payload
+  if proto_version >= PROTO_VERSION_CRC32:
+    expected = zlib.crc32(frame) & 0xFFFFFFFF
+    got = struct.unpack('<I', ser.read(4))[0]
+  else:
+    expected = 0
+    for b in frame:
+      expected ^= b
+    got = ser.read(1)[0]
+  return pkt_hdr[0], payload, expected, got
+
+def print_crc(expected, got):
+  if expected == got:
+    print("  CRC passed\n")
+  else:
+    print("  CRC failed - expected: {}, got: {}\n".format(expected, got))
+
+def print_event(event):
+  event_type = "drop" if event[0] == 0 else "flip" if event[0] == 1 else "corrupt"
+  year = (event[5] << 8) | event[4]
+  month = event[6]
+  dow = event[7]
+  day = event[8]
+  hour = event[9]
+  minute = event[10]
+  second = event[11]
+  data = (event[15] << 24) | (event[14] << 16) | (event[13] << 8) | event[12]
+  reserved = event[1] | (event[2] << 8) | (event[3] << 16)
+  print("  Event: {} {:02}/{:02}/{:02} {:02}:{:02}:{:02}{}".format(event_type, month, day, year, hour, minute, second,
+        burst_str(reserved, data)))
+
+def burst_str(reserved, data):
+  # merged triggers, see inc/coalesce.h
+  count = reserved & 0xFF
+  if count <= 1:
+    return " peak {}".format(data)
+  return " x{} over {} ms, peak {}".format(count, reserved >> 8, data)
 
 def serial_read():
+  global proto_version
   ser.isOpen()
   print("Connected to parcel\n")
   print("Usage:")
   print("  's': status")
   print("  'i': initialize")
-  print("  'd': get data\n")
+  print("  'd': get data")
+  print("  'z': get data, packed")
+  print("  'f': get filtered data")
+  print("  'm': event summary")
+  print("  't': loop timing stats")
+  print("  'v': negotiate protocol version")
+  print("  'b': raise the Bluetooth UART to {} baud (BAUD_SWITCH builds only, NAK on the HC-06)".format(BAUD_RATES[BAUD_MAX]))
+  print("  'h': depot handoff, status, data and summary in one batch")
+  print("  'x': stream x, y and z at 100 Hz")
+  print("  'g': stream the magnitude at 100 Hz")
+  print("  'o': stop streaming")
+  print("  'e': end an encrypted session")
+  print("  'c': capabilities\n")
   
   while running:
-    #get packet header
-    pkt_hdr = ser.read(2)
-    pkt_type = pkt_hdr[0]
-    crc = pkt_type
-    payload_len = pkt_hdr[1]
-    crc = crc ^ payload_len
+    pkt_type, payload, expected, got = read_frame()
     
     # main packet payload
     if pkt_type == 0x80: # ACK
       print("ACK:")
-      
-      # check CRC
-      pkt_crc = ser.read(1)[0]
-      if pkt_crc == crc:
-        print("  CRC passed\n")
-      else:
-        print("  CRC failed - expected: {}, got: {}\n".format(pkt_crc, crc))
         
     elif pkt_type == 0x81: # status
       print("Status:")
-      payload = ser.read(4)
       package_id = (payload[1] << 8) | payload[0]
       status_code = "uninitialized" if payload[2] == 0 else "tracking" if payload[2] == 1 else "error"
-      for i in range(0,4):
-        crc = crc ^ payload[i]
-      
-      # check CRC
-      pkt_crc = ser.read(1)[0]
       print("  ID: 0x{:X}".format(package_id))
       print("  status: {}".format(status_code))
-      if pkt_crc == crc:
-        print("  CRC passed\n")
-      else:
-        print("  CRC failed - expected: {}, got: {}\n".format(pkt_crc, crc))
+      if len(payload) >= 7:
+        policy = ["overwrite oldest", "keep severe", "thin flips"][payload[6]] if payload[6] < 3 else payload[6]
+        print("  evicted: {} ({})".format(payload[4] | (payload[5] << 8), policy))
       
     elif pkt_type == 0x82: # dump
       print("Dump:")
-      payload_hdr = ser.read(4)
-      package_id = (payload_hdr[1] << 8) | payload_hdr[0]
-      num_events = payload_hdr[2]
-      for i in range(0,4):
-        crc = crc ^ payload_hdr[i]
+      package_id = (payload[1] << 8) | payload[0]
+      num_events = payload[2]
+      frames_left = payload[3]
       print("  ID: 0x{:X}".format(package_id))
       print("  num_events: {}".format(num_events))
+      if frames_left:
+        print("  {} more dump packets to follow".format(frames_left))
       
       # get events
       for i in range(0, num_events):
-        event = ser.read(16)
-        event_type = "drop" if event[0] == 0 else "flip"
-        year = (event[5] << 8) | event[4]
-        month = event[6]
-        dow = event[7]
-        day = event[8]
-        hour = event[9]
-        minute = event[10]
-        second = event[11]
-        data = (event[15] << 24) | (event[14] << 16) | (event[13] << 8) | event[12]
-        print("  Event: {} {:02}/{:02}/{:02} {:02}:{:02}:{:02}".format(event_type, month, day, year, hour, minute, second))
-        for j in range(0, 16):
-          crc = crc ^ event[j]
-      
-      # check CRC
-      pkt_crc = ser.read(1)[0]
-      if pkt_crc == crc:
-        print("  CRC passed\n")
+        print_event(payload[4 + 16 * i : 4 + 16 * (i + 1)])
+
+    elif pkt_type == 0x86: # packed dump
+      print("Packed dump:")
+      package_id = (payload[1] << 8) | payload[0]
+      num_events = payload[2]
+      print("  ID: 0x{:X}".format(package_id))
+      print("  num_events: {} in {} bytes".format(num_events, len(payload) - 4))
+      if payload[3]:
+        print("  {} more dump packets to follow".format(payload[3]))
+      for event_type, reserved, time, data in dump_pack.unpack(payload[4:], num_events):
+        year, month, dow, day, hour, minute, second = time
+        event_type = "drop" if event_type == 0 else "flip" if event_type == 1 else "corrupt"
+        print("  Event: {} {:02}/{:02}/{:02} {:02}:{:02}:{:02}{}".format(event_type, month, day, year, hour, minute, second,
+              burst_str(reserved, data)))
+
+    elif pkt_type == 0x87: # summary
+      print("Summary:")
+      fields = struct.unpack('<HH2H2I2I', payload[:28])
+      first = struct.unpack('<H6B', payload[28:36])
+      last = struct.unpack('<H6B', payload[36:44])
+      hours = struct.unpack('<24H', payload[44:92])
+      print("  ID: 0x{:X}".format(fields[0]))
+      for i, name in enumerate(["drops", "flips"]):
+        print("  {}: {}, max severity {}, mean {}".format(name, fields[2 + i], fields[4 + i], fields[6 + i]))
+      print("  lost: {}".format(fields[1]))
+      if first[0]:
+        print("  first: {:02}/{:02}/{:02} {:02}:{:02}:{:02}".format(first[1], first[3], first[0], *first[4:]))
+        print("  last:  {:02}/{:02}/{:02} {:02}:{:02}:{:02}".format(last[1], last[3], last[0], *last[4:]))
+      print("  by hour: {}".format(" ".join("{}h:{}".format(h, n) for h, n in enumerate(hours) if n)))
+
+    elif pkt_type == 0x88: # stream
+      seq, dropped, mode, rate, decimation, flags = struct.unpack('<HHBBBB', payload[:8])
+      hz = 3200.0 / (1 << (15 - rate)) / decimation
+      if mode == 1:
+        samples = struct.unpack('<{}h'.format((len(payload) - 8) // 2), payload[8:])
+        text = "x {} y {} z {}".format(*samples[-3:])
       else:
-        print("  CRC failed - expected: {}, got: {}\n".format(pkt_crc, crc))
+        samples = struct.unpack('<{}H'.format((len(payload) - 8) // 2), payload[8:])
+        text = "magnitude {}..{}".format(min(samples), max(samples))
+      # one line per frame, the newest sample
+      print("Stream {}: {:.2f} Hz, {}{}{}".format(seq, hz, text, ", {} dropped".format(dropped) if dropped else "",
+            ", sensor FIFO filled" if flags & 1 else ""))
+      if got != expected:
+        print_crc(expected, got)
+      continue
+
+    elif pkt_type == 0x83: # stats
+      print("Stats:")
+      fields = struct.unpack('<I16I2I6H', payload)
+      print("  max loop latency: {} cycles ({:.3f} ms)".format(fields[0], fields[0] / 3000.0))
+      for i in range(0, 16):
+        if fields[1 + i]:
+          low = 0 if i == 0 else 1 << (i + 8)
+          print("  {:>8}+ cycles: {}".format(low, fields[1 + i]))
+      print("  deadline misses: sensor {}, rx {}".format(fields[17], fields[18]))
+      print("  arena high water: {}".format(list(fields[19:25])))
+
+    elif pkt_type == 0x84: # version
+      print("Version:")
+      print("  protocol version: {}".format(payload[0]))
+      print_crc(expected, got)
+      # the new version applies from the next packet
+      proto_version = payload[0]
+      continue
       
+    elif pkt_type == 0x85: # baud
+      print("Baud:")
+      print("  module switched to {} baud, confirming".format(BAUD_RATES[payload[0]]))
+      print_crc(expected, got)
+      # the device falls back if this does not arrive in 2s
+      send_baud_pkt(payload[0])
+      continue
+
+    elif pkt_type == 0x89: # session
+      print("Session:")
+      print("  board nonce: {}".format(payload.hex()))
+
+    elif pkt_type == 0x8A: # sealed, opened by pps_collect -k
+      print("Sealed:")
+      print("  seq {}, {} bytes of ciphertext".format(payload[0] | (payload[1] << 8), len(payload) - 2))
+
+    elif pkt_type == 0x8B: # capabilities
+      print("Capabilities:")
+      fields = struct.unpack('<BBBBHHHBBBBB', payload[:15])
+      print("  protocol version: {} of {}".format(fields[1], fields[0]))
+      print("  max payload: {}, max frame: {}, batch: {} commands".format(fields[2], fields[4], fields[3]))
+      print("  receive buffer: {} bytes, log: {} events".format(fields[5], fields[6]))
+      print("  dump encodings: 0x{:02X}, stream modes: 0x{:02X}, baud rates: 0x{:02X}, features: 0x{:02X}".format(
+            *fields[7:11]))
+      for i in range(15, 15 + fields[11], 4):
+        print("  command 0x{:02X}: {} to {} bytes, from v{}".format(*payload[i:i + 4]))
+
     elif pkt_type == 0x8F: # NAK
       print("NAK:")
-      
-      # check CRC
-      pkt_crc = struct.unpack('B', ser.read())[0]
-      if pkt_crc == crc:
-        print("  CRC passed\n")
-      else:
-        print("  CRC failed - expected: {}, got: {}\n".format(pkt_crc, crc))
         
     else:
       print("Unrecognized\n")
+      continue
+
+    # check CRC
+    print_crc(expected, got)
   
 def user_input():
   global running
@@ -150,14 +348,39 @@ def user_input():
       send_init_pkt()
     elif user_in == "d":
       send_dump_pkt()
+    elif user_in == "z":
+      send_dump_pkt(1)
     elif user_in == "s":
       send_status_pkt()
+    elif user_in == "f":
+      read_query()
+    elif user_in == "m":
+      send_summary_pkt()
+    elif user_in == "t":
+      send_stats_pkt()
+    elif user_in == "v":
+      send_version_pkt()
+    elif user_in == "b":
+      send_baud_pkt(BAUD_MAX)
+    elif user_in == "h":
+      send_handoff_pkt()
+    elif user_in == "x":
+      send_stream_pkt(1)
+    elif user_in == "g":
+      send_stream_pkt(2)
+    elif user_in == "o":
+      send_stream_pkt(0)
+    elif user_in == "e":
+      send_end_session_pkt()
+    elif user_in == "c":
+      send_caps_pkt()
       
   print("Closing")
 
 # Main
 running = 1
-ser = serial.Serial('COM21', 9600)
+port = sys.argv[1] if len(sys.argv) > 1 else 'COM21'
+ser = serial.Serial(port, 9600)
 
 thread_serial = threading.Thread(name='serial_read', target=serial_read)
 thread_serial.daemon = True
@@ -166,4 +389,4 @@ thread_input = threading.Thread(name='user_input', target=user_input)
 thread_serial.start()
 thread_input.start()
 
-thread_input.join()
\ No newline at end of file
+thread_input.join()
@@ -0,0 +1,98 @@
+# Synthetic accelerometer recordings for host/pps_replay
+#
+# Writes a labelled recording in the format host/replay.c reads: the
+# package sits upright at rest, gets dropped (free fall, then a short
+# impact spike), flipped and held upside down, and knocked around in ways
+# that should not count: bumps under the tap threshold, shoves that stay
+# over it too long, and tilts put back before a flip would register.
+# Only drops and flips are labelled.
+#
+# usage: python replay_gen.py [--seconds N] [--rate HZ] [--seed S] [-o recording.txt]
+
+import argparse
+import random
+import sys
+
+G = 256 # counts per g, full resolution
+NOISE = 6 # counts
+FLIP_COUNT = 0x400 # DETECT_FLIP_COUNT
+
+class Recording:
+  def __init__(self, rng, rate):
+    self.rng = rng
+    self.period = 1000000 // rate
+    self.t = 0
+    self.samples = []
+    self.labels = []
+
+  def sample(self, x, y, z):
+    n = lambda: self.rng.randint(-NOISE, NOISE)
+    self.samples.append((self.t, int(x) + n(), int(y) + n(), int(z) + n()))
+    self.t += self.period
+
+  def rest(self, secs, z=-G):
+    for _ in range(int(secs * 1000000 // self.period)):
+      self.sample(0, 0, z)
+
+  def spike(self, g, ms):
+    # one axis over g for ms, at least one sample
+    axis = self.rng.randrange(3)
+    for _ in range(max(1, ms * 1000 // self.period)):
+      v = [0, 0, -G]
+      v[axis] = g * G * self.rng.choice((-1, 1))
+      self.sample(*v)
+
+  def drop(self):
+    start = self.t
+    for _ in range(self.rng.randint(20, 60) * 1000 // self.period): # 20-60 ms falling
+      self.sample(0, 0, 0)
+    self.spike(self.rng.uniform(20, 40), self.rng.randint(5, 20))
+    self.rest(0.2)
+    self.labels.append((start, self.t, "drop"))
+
+  def bump(self):
+    self.spike(self.rng.uniform(2, 12), self.rng.randint(5, 20))
+
+  def shove(self):
+    self.spike(self.rng.uniform(20, 30), self.rng.randint(60, 150))
+
+  def flip(self):
+    start = self.t
+    hold = FLIP_COUNT * self.period / 1000000
+    self.rest(self.rng.uniform(hold + 2, hold * 2), z=G)
+    self.labels.append((start, self.t, "flip"))
+
+  def tilt(self):
+    hold = FLIP_COUNT * self.period / 1000000
+    self.rest(self.rng.uniform(0.5, hold * 0.8), z=G)
+
+def generate(rng, seconds, rate):
+  rec = Recording(rng, rate)
+  actions = ((rec.drop, 4), (rec.bump, 6), (rec.shove, 2), (rec.flip, 1), (rec.tilt, 2))
+  while rec.t < seconds * 1000000:
+    # far enough apart that coalescing keeps them separate
+    rec.rest(rng.uniform(3, 20))
+    action = rng.choices([a for a, _ in actions], [w for _, w in actions])[0]
+    action()
+  return rec
+
+def main():
+  parser = argparse.ArgumentParser(description='Synthetic accelerometer recordings')
+  parser.add_argument('--seconds', type=int, default=3600)
+  parser.add_argument('--rate', type=int, default=100)
+  parser.add_argument('--seed', type=int, default=4830)
+  parser.add_argument('-o', '--output', help='recording to write, stdout if not given')
+  args = parser.parse_args()
+
+  rec = generate(random.Random(args.seed), args.seconds, args.rate)
+  out = open(args.output, 'w') if args.output else sys.stdout
+  out.write("# replay_gen.py --seconds {} --rate {} --seed {}\n".format(args.seconds, args.rate, args.seed))
+  for start, end, kind in rec.labels:
+    out.write("label {} {} {}\n".format(start, end, kind))
+  for t, x, y, z in rec.samples:
+    out.write("{} {} {} {}\n".format(t, x, y, z))
+  if out is not sys.stdout:
+    out.close()
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,74 @@
+import re
+import struct
+import sys
+import os
+import serial
+
+# trace record: sync, fmt, seq, nargs, cycles, args[nargs]
+TRACE_SYNC = 0xA5
+TRACE_MAX_ARGS = 2
+CPU_HZ = 3000000 # default MCLK
+
+def load_formats():
+  # the format strings live in the comments of trace_fmt_e
+  path = os.path.join(os.path.dirname(__file__), '..', 'inc', 'trace.h')
+  src = open(path).read()
+  body = re.search(r'typedef enum\s*\{(.*?)\}\s*trace_fmt_e;', src, re.S).group(1)
+  formats = {}
+  idx = 0
+  for line in body.splitlines():
+    m = re.match(r'\s*(TRC_\w+)\s*(?:=\s*(\w+))?\s*,?\s*/\*\s*"(.*)"\s*\*/', line)
+    if not m:
+      continue
+    if m.group(2):
+      idx = int(m.group(2), 0)
+    formats[idx] = (m.group(1), m.group(3))
+    idx += 1
+  return formats
+
+def read_byte(src):
+  b = src.read(1)
+  if not b:
+    sys.exit(0)
+  return b[0]
+
+def decode(src):
+  formats = load_formats()
+  last_seq = None
+  last_cycles = None
+
+  while True:
+    # hunt for the start of a record
+    if read_byte(src) != TRACE_SYNC:
+      continue
+    fmt = read_byte(src)
+    seq = read_byte(src)
+    nargs = read_byte(src)
+    if fmt not in formats or nargs > TRACE_MAX_ARGS:
+      print("resync")
+      continue
+
+    cycles = struct.unpack('<I', src.read(4))[0]
+    args = struct.unpack('<{}I'.format(nargs), src.read(4 * nargs))
+
+    if last_seq is not None and seq != (last_seq + 1) & 0xFF:
+      print("  ({} records dropped)".format((seq - last_seq - 1) & 0xFF))
+    last_seq = seq
+
+    # cycle counter wraps every 2^32 cycles
+    delta = 0 if last_cycles is None else (cycles - last_cycles) & 0xFFFFFFFF
+    last_cycles = cycles
+
+    name, text = formats[fmt]
+    try:
+      text = text % args
+    except TypeError:
+      text = "{} {}".format(text, args)
+    print("{:10} +{:9.3f}ms {:3} {}".format(cycles, delta * 1000.0 / CPU_HZ, seq, text))
+
+# Main
+if len(sys.argv) > 1 and os.path.isfile(sys.argv[1]):
+  decode(open(sys.argv[1], 'rb'))
+else:
+  port = sys.argv[1] if len(sys.argv) > 1 else 'COM20'
+  decode(serial.Serial(port, 9600))
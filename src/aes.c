@@ -0,0 +1,237 @@
+/**
+ * @file aes.c
+ * @brief AES-256 encryption
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include <string.h>
+#include "msp.h"
+#include "aes.h"
+
+static const uint8_t aes_sbox[256] =
+{
+  0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+  0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+  0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+  0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+  0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+  0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+  0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+  0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+  0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+  0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+  0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+  0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+  0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+  0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+  0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+  0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+/* multiply by x in GF(2^8) */
+#define AES_XTIME(b) ((uint8_t)(((b) << 1) ^ (((b) & 0x80) ? 0x1B : 0x00)))
+
+void aes_init(aes_ctx_t * ctx, const uint8_t * key)
+{
+  uint8_t * w = ctx->round_keys, t[4], tmp, rcon = 0x01;
+  uint32_t i;
+
+  memcpy(ctx->key, key, AES_KEY_LEN);
+  memcpy(w, key, AES_KEY_LEN);
+
+  /* a word at a time, each from the one before and the one a key length back */
+  for(i = AES_KEY_LEN; i < sizeof(ctx->round_keys); i += 4)
+  {
+    memcpy(t, w + i - 4, 4);
+    if(i % AES_KEY_LEN == 0)
+    {
+      tmp = t[0];
+      t[0] = aes_sbox[t[1]] ^ rcon;
+      t[1] = aes_sbox[t[2]];
+      t[2] = aes_sbox[t[3]];
+      t[3] = aes_sbox[tmp];
+      rcon = AES_XTIME(rcon);
+    }
+    else if(i % AES_KEY_LEN == AES_BLOCK_LEN)
+    {
+      t[0] = aes_sbox[t[0]];
+      t[1] = aes_sbox[t[1]];
+      t[2] = aes_sbox[t[2]];
+      t[3] = aes_sbox[t[3]];
+    }
+    w[i] = w[i - AES_KEY_LEN] ^ t[0];
+    w[i + 1] = w[i + 1 - AES_KEY_LEN] ^ t[1];
+    w[i + 2] = w[i + 2 - AES_KEY_LEN] ^ t[2];
+    w[i + 3] = w[i + 3 - AES_KEY_LEN] ^ t[3];
+  }
+}
+
+void aes_encrypt_sw(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out)
+{
+  const uint8_t * rk = ctx->round_keys;
+  uint8_t s[AES_BLOCK_LEN], t[AES_BLOCK_LEN], a0, a1, a2, a3, all;
+  uint32_t round, c, r;
+
+  for(c = 0; c < AES_BLOCK_LEN; c++) s[c] = in[c] ^ rk[c];
+
+  for(round = 1; round <= AES_ROUNDS; round++)
+  {
+    /* sub bytes and shift rows, the state is column by column */
+    for(c = 0; c < 4; c++)
+    {
+      for(r = 0; r < 4; r++) t[c * 4 + r] = aes_sbox[s[((c + r) % 4) * 4 + r]];
+    }
+
+    /* mix columns, all but the last round */
+    for(c = 0; c < 4; c++)
+    {
+      a0 = t[c * 4];
+      a1 = t[c * 4 + 1];
+      a2 = t[c * 4 + 2];
+      a3 = t[c * 4 + 3];
+      if(round < AES_ROUNDS)
+      {
+        all = a0 ^ a1 ^ a2 ^ a3;
+        t[c * 4] = a0 ^ all ^ AES_XTIME(a0 ^ a1);
+        t[c * 4 + 1] = a1 ^ all ^ AES_XTIME(a1 ^ a2);
+        t[c * 4 + 2] = a2 ^ all ^ AES_XTIME(a2 ^ a3);
+        t[c * 4 + 3] = a3 ^ all ^ AES_XTIME(a3 ^ a0);
+      }
+    }
+
+    for(c = 0; c < AES_BLOCK_LEN; c++) s[c] = t[c] ^ rk[round * AES_BLOCK_LEN + c];
+  }
+
+  memcpy(out, s, AES_BLOCK_LEN);
+}
+
+void aes_ofb_sw(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len)
+{
+  uint8_t stream[AES_BLOCK_LEN];
+  uint32_t i;
+
+  memcpy(stream, iv, AES_BLOCK_LEN);
+  for(i = 0; i < len; i++)
+  {
+    if(i % AES_BLOCK_LEN == 0) aes_encrypt_sw(ctx, stream, stream);
+    out[i] = in[i] ^ stream[i % AES_BLOCK_LEN];
+  }
+}
+
+#ifndef HOST_BUILD
+/* uDMA channel control word, see the technical reference manual */
+#define UDMA_DST_INC_16 (0x1u << 30)
+#define UDMA_DST_INC_NONE (0x3u << 30)
+#define UDMA_DST_SIZE_16 (0x1u << 28)
+#define UDMA_SRC_INC_16 (0x1u << 26)
+#define UDMA_SRC_INC_NONE (0x3u << 26)
+#define UDMA_SRC_SIZE_16 (0x1u << 24)
+#define UDMA_ARB_8 (0x3u << 14) /* a block of half words per trigger */
+#define UDMA_N_MINUS_1_OFS (4)
+#define UDMA_MODE_BASIC (0x1)
+#define UDMA_NUM_CHANNELS (8)
+
+#define AES_DMA_OUT (0) /* AES trigger 0, AESADOUT to memory */
+#define AES_DMA_IN (1) /* AES trigger 1, memory to AESAXIN */
+#define AES_DMA_SRC (7) /* CH_SRCCFG selecting the AES triggers on channels 0 to 2 */
+#define AES_HALF_WORDS (AES_BLOCK_LEN / 2)
+
+/*
+ * @brief uDMA channel control structure
+ */
+typedef struct
+{
+  volatile const void * src_end; /* last item, or the register */
+  volatile void * dst_end;
+  volatile uint32_t ctl;
+  uint32_t spare;
+} udma_ctl_t;
+
+/* primary then alternate structures, the table is aligned to its size */
+static udma_ctl_t aes_dma_table[2 * UDMA_NUM_CHANNELS] __attribute__((aligned(2 * UDMA_NUM_CHANNELS * 16)));
+
+/* resets the accelerator into a mode and loads the key */
+static void aes_hw_key(const aes_ctx_t * ctx, uint16_t mode)
+{
+  uint32_t i;
+
+  AES256->AESACTL0 = AES256_AESACTL0_SWRST;
+  AES256->AESACTL0 = mode | AES256_AESACTL0_KL__256BIT;
+  for(i = 0; i < AES_KEY_LEN; i += 2) AES256->AESAKEY = ctx->key[i] | (ctx->key[i + 1] << 8);
+  while(!(AES256->AESASTAT & AES256_AESASTAT_KEYWR));
+}
+
+void aes_encrypt_hw(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out)
+{
+  uint16_t word;
+  uint32_t i;
+
+  aes_hw_key(ctx, AES256_AESACTL0_OP_0);
+
+  /* the last half word in starts the block */
+  for(i = 0; i < AES_BLOCK_LEN; i += 2) AES256->AESADIN = in[i] | (in[i + 1] << 8);
+  while(AES256->AESASTAT & AES256_AESASTAT_BUSY);
+
+  for(i = 0; i < AES_BLOCK_LEN; i += 2)
+  {
+    word = AES256->AESADOUT;
+    out[i] = word;
+    out[i + 1] = word >> 8;
+  }
+}
+
+void aes_ofb_hw(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len)
+{
+  uint32_t blocks = AES_ROUND_UP(len) / AES_BLOCK_LEN, n = blocks * AES_HALF_WORDS, i;
+
+  if(!blocks) return;
+
+  DMA_Channel->CFG = DMA_CHANNEL_CFG_MASTEN;
+  DMA_Channel->CTLBASE = (uint32_t)aes_dma_table;
+  DMA_Control->CH_SRCCFG[AES_DMA_OUT] = AES_DMA_SRC;
+  DMA_Control->CH_SRCCFG[AES_DMA_IN] = AES_DMA_SRC;
+
+  /* one block of half words each time the accelerator asks */
+  aes_dma_table[AES_DMA_OUT].src_end = &AES256->AESADOUT;
+  aes_dma_table[AES_DMA_OUT].dst_end = (uint16_t *)out + n - 1;
+  aes_dma_table[AES_DMA_OUT].ctl = UDMA_DST_INC_16 | UDMA_DST_SIZE_16 | UDMA_SRC_INC_NONE | UDMA_SRC_SIZE_16 |
+                                   UDMA_ARB_8 | ((n - 1) << UDMA_N_MINUS_1_OFS) | UDMA_MODE_BASIC;
+  aes_dma_table[AES_DMA_IN].src_end = (const uint16_t *)in + n - 1;
+  aes_dma_table[AES_DMA_IN].dst_end = &AES256->AESAXIN;
+  aes_dma_table[AES_DMA_IN].ctl = UDMA_DST_INC_NONE | UDMA_DST_SIZE_16 | UDMA_SRC_INC_16 | UDMA_SRC_SIZE_16 |
+                                  UDMA_ARB_8 | ((n - 1) << UDMA_N_MINUS_1_OFS) | UDMA_MODE_BASIC;
+  DMA_Channel->ALTCLR = (1 << AES_DMA_OUT) | (1 << AES_DMA_IN);
+  DMA_Channel->ENASET = (1 << AES_DMA_OUT) | (1 << AES_DMA_IN);
+
+  /* cipher mode: the IV goes in first, then the block count starts the triggers */
+  aes_hw_key(ctx, AES256_AESACTL0_CMEN | AES256_AESACTL0_CM__OFB | AES256_AESACTL0_OP_0);
+  for(i = 0; i < AES_BLOCK_LEN; i += 2) AES256->AESAXIN = iv[i] | (iv[i + 1] << 8);
+  AES256->AESACTL1 = blocks;
+
+  /* the controller clears a channel's enable once its cycle is done */
+  while(DMA_Channel->ENASET & (1 << AES_DMA_OUT));
+  AES256->AESACTL0 &= ~AES256_AESACTL0_CMEN;
+}
+#endif /* HOST_BUILD */
+
+void aes_encrypt(const aes_ctx_t * ctx, const uint8_t * in, uint8_t * out)
+{
+#if defined HOST_BUILD || defined AES_SOFTWARE
+  aes_encrypt_sw(ctx, in, out);
+#else
+  aes_encrypt_hw(ctx, in, out);
+#endif
+}
+
+void aes_ofb(const aes_ctx_t * ctx, const uint8_t * iv, const uint8_t * in, uint8_t * out, uint32_t len)
+{
+#if defined HOST_BUILD || defined AES_SOFTWARE
+  aes_ofb_sw(ctx, iv, in, out, len);
+#else
+  aes_ofb_hw(ctx, iv, in, out, len);
+#endif
+}
@@ -0,0 +1,144 @@
+/**
+ * @file arena.c
+ * @brief Static memory arena with fixed size pools
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/04
+ */
+
+#include "helpers.h"
+#include "arena.h"
+#include "circbuf.h"
+#include "event_buf.h"
+#include "trace.h"
+#include "uart.h"
+
+/*
+ * @brief Pool descriptor
+ *
+ * Free blocks are chained through their first word
+ */
+typedef struct
+{
+  uint8_t * base;
+  uint32_t block_size;
+  uint16_t num_blocks;
+  uint16_t used;
+  uint16_t high_water;
+  void * free_list;
+} pool_t;
+
+/* pool storage */
+static eb_t arena_eb[1] ARENA_SECTION;
+static cb_t arena_cb[1] ARENA_SECTION;
+static uint32_t arena_rx[1][(UART_RX_BUF_LEN + 3) / 4] ARENA_SECTION;
+static ll_event_t arena_events[ARENA_EVENT_POOL_LEN] ARENA_SECTION;
+static uint32_t arena_payload[ARENA_PAYLOAD_POOL_LEN][ARENA_PAYLOAD_SIZE / 4] ARENA_SECTION;
+static uint32_t arena_tracking[1][ARENA_TRACKING_SIZE / 4] ARENA_SECTION;
+
+/* in arena_pool_e order */
+static pool_t pools[ARENA_NUM_POOLS] =
+{
+  { (uint8_t *)arena_eb, sizeof(arena_eb[0]), 1 },
+  { (uint8_t *)arena_cb, sizeof(arena_cb[0]), 1 },
+  { (uint8_t *)arena_rx, sizeof(arena_rx[0]), 1 },
+  { (uint8_t *)arena_events, sizeof(arena_events[0]), ARENA_EVENT_POOL_LEN },
+  { (uint8_t *)arena_payload, sizeof(arena_payload[0]), ARENA_PAYLOAD_POOL_LEN },
+  { (uint8_t *)arena_tracking, sizeof(arena_tracking[0]), 1 }
+};
+
+void arena_init()
+{
+  uint32_t i, j;
+  pool_t * pool;
+
+  for(i = 0; i < ARENA_NUM_POOLS; i++)
+  {
+    pool = &pools[i];
+    pool->used = 0;
+    pool->high_water = 0;
+    pool->free_list = NULL;
+
+    /* chain blocks so the lowest address is handed out first */
+    for(j = pool->num_blocks; j > 0; j--)
+    {
+      void ** block = (void **)(pool->base + (j - 1) * pool->block_size);
+      *block = pool->free_list;
+      pool->free_list = block;
+    }
+  }
+}
+
+void * arena_alloc(arena_pool_e pool_num)
+{
+  /* check inputs */
+  if(pool_num >= ARENA_NUM_POOLS) return NULL;
+
+  pool_t * pool = &pools[pool_num];
+  void ** block;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  block = (void **)pool->free_list;
+  if(block)
+  {
+    pool->free_list = *block;
+    if(++pool->used > pool->high_water)
+    {
+      pool->high_water = pool->used;
+      TRACE2(TRC_ARENA_HIGH_WATER, pool_num, pool->high_water);
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  return (void *)block;
+}
+
+ar_e arena_free(arena_pool_e pool_num, void * ptr)
+{
+  /* check inputs */
+  if(!ptr) return AR_NULL_PTR;
+  if(pool_num >= ARENA_NUM_POOLS) return AR_INVALID_PARAM;
+
+  pool_t * pool = &pools[pool_num];
+  uint32_t offset = (uint8_t *)ptr - pool->base;
+
+  /* must be the start of a block in this pool */
+  if((uint8_t *)ptr < pool->base ||
+     offset >= pool->num_blocks * pool->block_size ||
+     offset % pool->block_size) return AR_INVALID_PARAM;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  *(void **)ptr = pool->free_list;
+  pool->free_list = ptr;
+  pool->used--;
+
+  __set_PRIMASK(primask);
+
+  return AR_SUCCESS;
+}
+
+uint32_t arena_block_size(arena_pool_e pool_num)
+{
+  if(pool_num >= ARENA_NUM_POOLS) return 0;
+
+  return pools[pool_num].block_size;
+}
+
+ar_e arena_get_usage(arena_pool_e pool_num, uint16_t * used, uint16_t * high_water)
+{
+  /* check inputs */
+  if(!used || !high_water) return AR_NULL_PTR;
+  if(pool_num >= ARENA_NUM_POOLS) return AR_INVALID_PARAM;
+
+  *used = pools[pool_num].used;
+  *high_water = pools[pool_num].high_water;
+
+  return AR_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file baud.c
+ * @brief Bluetooth UART rate negotiation
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/08
+ */
+
+#include "helpers.h"
+#include "baud.h"
+#include "packets.h"
+#include "trace.h"
+#include "uart.h"
+
+/*
+ * @brief Negotiation state
+ */
+typedef enum
+{
+  BAUD_IDLE = 0,
+  BAUD_AT_WAIT, /* waiting for OK from the module */
+  BAUD_CONFIRM_WAIT, /* waiting for the app */
+  BAUD_REVERT_WAIT /* waiting for OK while going back */
+} baud_state_e;
+
+/* HC-06 commands, in baud_rate_e order */
+static const char * const at_cmds[BAUD_NUM_RATES] =
+{
+  "AT+BAUD4", /* 9600 */
+  "AT+BAUD5", /* 19200 */
+  "AT+BAUD6", /* 38400 */
+  "AT+BAUD7", /* 57600 */
+  "AT+BAUD8"  /* 115200 */
+};
+
+static volatile uint8_t state = BAUD_IDLE;
+static uint8_t old_rate;
+static uint8_t new_rate;
+static uint8_t confirmed;
+static uint32_t start;
+static uint8_t at_resp[BAUD_AT_RESP_LEN];
+static volatile uint8_t at_resp_len;
+
+static void baud_send_at(uint8_t rate)
+{
+  at_resp_len = 0;
+  bt_send_n((uint8_t *)at_cmds[rate], strlen(at_cmds[rate]));
+  start = CYCLE_COUNT();
+}
+
+static uint8_t baud_at_ok()
+{
+  return at_resp_len >= 2 && at_resp[0] == 'O' && at_resp[1] == 'K';
+}
+
+uint8_t baud_start(uint8_t rate)
+{
+  /* check inputs */
+  if(rate >= BAUD_NUM_RATES || state != BAUD_IDLE) return 0;
+
+  old_rate = uart_get_baud();
+  new_rate = rate;
+  confirmed = 0;
+
+  /* the module answers at the old rate */
+  state = BAUD_AT_WAIT;
+  baud_send_at(new_rate);
+
+  return 1;
+}
+
+uint8_t baud_confirm(uint8_t rate)
+{
+  if(state != BAUD_CONFIRM_WAIT || rate != new_rate) return 0;
+
+  confirmed = 1;
+  return 1;
+}
+
+uint8_t baud_confirming()
+{
+  return state == BAUD_CONFIRM_WAIT;
+}
+
+baud_e baud_poll()
+{
+  uint32_t elapsed = CYCLE_COUNT() - start;
+
+  switch(state)
+  {
+    case BAUD_AT_WAIT:
+      if(baud_at_ok())
+      {
+        uart_set_baud(UART_NUM_BT, new_rate);
+        start = CYCLE_COUNT();
+        state = BAUD_CONFIRM_WAIT;
+        return BAUD_SWITCHED;
+      }
+      if(elapsed > BAUD_AT_TIMEOUT)
+      {
+        state = BAUD_IDLE;
+        TRACE2(TRC_BAUD, new_rate, BAUD_FAILED);
+        return BAUD_FAILED;
+      }
+      break;
+
+    case BAUD_CONFIRM_WAIT:
+      if(confirmed)
+      {
+        state = BAUD_IDLE;
+        TRACE2(TRC_BAUD, new_rate, BAUD_CONFIRMED);
+        return BAUD_CONFIRMED;
+      }
+      if(elapsed > BAUD_CONFIRM_TIMEOUT)
+      {
+        /* the module is at the new rate, tell it to go back */
+        state = BAUD_REVERT_WAIT;
+        baud_send_at(old_rate);
+      }
+      break;
+
+    case BAUD_REVERT_WAIT:
+      if(baud_at_ok() || elapsed > BAUD_AT_TIMEOUT)
+      {
+        uart_set_baud(UART_NUM_BT, old_rate);
+        state = BAUD_IDLE;
+        TRACE2(TRC_BAUD, old_rate, BAUD_REVERTED);
+        return BAUD_REVERTED;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return BAUD_NONE;
+}
+
+RAMFUNC uint8_t baud_rx(uint8_t data)
+{
+  if(state != BAUD_AT_WAIT && state != BAUD_REVERT_WAIT) return 0;
+
+  if(at_resp_len < BAUD_AT_RESP_LEN) at_resp[at_resp_len++] = data;
+  return 1;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file bench.c
+ * @brief On-target micro benchmarks
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/05
+ */
+
+#include "helpers.h"
+#include "adxl345.h"
+#include "aes.h"
+#include "bench.h"
+#include "circbuf.h"
+#include "codec.h"
+#include "crc.h"
+#include "event_buf.h"
+#include "pack.h"
+#include "seal.h"
+#include "spi.h"
+#include "uart.h"
+
+/*
+ * @brief Benchmark entry
+ *
+ * fn runs the operation under test and returns the number of units it
+ * processed (operations or bytes)
+ */
+typedef struct
+{
+  uint8_t * name;
+  uint32_t (*fn)(uint32_t iterations);
+} bench_t;
+
+static uint8_t bench_data[BENCH_ITERATIONS] __attribute__((aligned(4)));
+static uint8_t bench_out[SEAL_BUF_LEN] __attribute__((aligned(4)));
+static aes_ctx_t bench_key;
+static volatile uint32_t bench_sink; /* keeps results from being optimised out */
+
+static uint32_t bench_cb(uint32_t iterations)
+{
+  uint8_t storage[16], data = 0;
+  cb_t buf;
+  buf.base = storage;
+  buf.head = storage;
+  buf.tail = storage;
+  buf.size = sizeof(storage);
+  buf.count = 0;
+  buf.item_size = sizeof(uint8_t);
+
+  uint32_t i;
+  for(i = 0; i < iterations; i++)
+  {
+    cb_add_item(&buf, &data);
+    cb_remove_item(&buf, &data);
+  }
+
+  return iterations;
+}
+
+static uint32_t bench_spi_read(uint32_t iterations)
+{
+  uint32_t i;
+  for(i = 0; i < iterations; i++)
+  {
+    spi_read(ADXL_DEVID);
+  }
+
+  return iterations;
+}
+
+static uint32_t bench_spi_burst(uint32_t iterations)
+{
+  uint8_t xyz[6];
+  uint32_t i;
+  for(i = 0; i < iterations; i++)
+  {
+    spi_read_burst(ADXL_DATAX0, xyz, sizeof(xyz));
+  }
+
+  return iterations;
+}
+
+static uint32_t bench_checksum(uint32_t iterations)
+{
+  uint32_t i;
+  uint8_t crc = 0;
+  for(i = 0; i < iterations; i++)
+  {
+    crc = my_checksum(crc, bench_data, sizeof(bench_data));
+  }
+
+  return iterations * sizeof(bench_data);
+}
+
+#ifndef HOST_BUILD
+static uint32_t bench_crc32_hw(uint32_t iterations)
+{
+  uint32_t i, crc = CRC32_INIT;
+  for(i = 0; i < iterations; i++)
+  {
+    crc = crc32_update_hw(crc, bench_data, sizeof(bench_data));
+  }
+
+  return iterations * sizeof(bench_data);
+}
+#endif /* HOST_BUILD */
+
+static uint32_t bench_crc32_sw(uint32_t iterations)
+{
+  uint32_t i, crc = CRC32_INIT;
+  for(i = 0; i < iterations; i++)
+  {
+    crc = crc32_update_sw(crc, bench_data, sizeof(bench_data));
+  }
+
+  return iterations * sizeof(bench_data);
+}
+
+#ifndef HOST_BUILD
+static uint32_t bench_aes_hw(uint32_t iterations)
+{
+  uint32_t i;
+  for(i = 0; i < iterations / BENCH_AES_FRAMES_PER; i++)
+  {
+    aes_ofb_hw(&bench_key, bench_data, bench_data, bench_out, sizeof(bench_data));
+  }
+
+  return i * sizeof(bench_data);
+}
+#endif /* HOST_BUILD */
+
+static uint32_t bench_aes_sw(uint32_t iterations)
+{
+  uint32_t i;
+  for(i = 0; i < iterations / BENCH_AES_FRAMES_PER; i++)
+  {
+    aes_ofb_sw(&bench_key, bench_data, bench_data, bench_out, sizeof(bench_data));
+  }
+
+  return i * sizeof(bench_data);
+}
+
+/* a full raw dump frame as send_events() hands it to the link, plain then sealed */
+static uint32_t bench_dump_frame(uint32_t iterations, uint8_t sealed)
+{
+  sg_seg_t segs[1 + BENCH_DUMP_EVENTS];
+  seal_t seal;
+  uint32_t i, j, len, crc = CRC32_INIT;
+
+  segs[0].ptr = bench_data;
+  segs[0].len = sizeof(res_dump_t);
+  for(i = 0; i < BENCH_DUMP_EVENTS; i++)
+  {
+    segs[1 + i].ptr = bench_data + sizeof(res_dump_t) + i * CODEC_EVENT_LEN;
+    segs[1 + i].len = CODEC_EVENT_LEN;
+  }
+  seal_derive(&seal, &bench_key, bench_data, bench_data + AES_BLOCK_LEN);
+
+  for(i = 0; i < iterations / BENCH_AES_FRAMES_PER; i++)
+  {
+    if(sealed)
+    {
+      seal_frame(&seal, PKT_RES_DUMP, segs, 1 + BENCH_DUMP_EVENTS, bench_out, &len);
+      crc = crc32_update(crc, bench_out, len);
+    }
+    else
+    {
+      /* the link takes the segments as they are, only the trailer is worked out */
+      for(j = 0; j < 1 + BENCH_DUMP_EVENTS; j++) crc = crc32_update(crc, segs[j].ptr, segs[j].len);
+    }
+  }
+
+  bench_sink = crc;
+
+  return i * (sizeof(res_dump_t) + BENCH_DUMP_EVENTS * CODEC_EVENT_LEN);
+}
+
+static uint32_t bench_dump_plain(uint32_t iterations)
+{
+  return bench_dump_frame(iterations, 0);
+}
+
+static uint32_t bench_dump_sealed(uint32_t iterations)
+{
+  return bench_dump_frame(iterations, 1);
+}
+
+static uint32_t bench_pack(uint32_t iterations)
+{
+  static ll_event_t events[BENCH_PACK_EVENTS];
+  uint8_t out[PKT_MAX_PAYLOAD];
+  eb_t buf;
+  eb_iter_t iter, sizing;
+  uint32_t i, n, done = 0;
+
+  /* a drop every few minutes with the odd flip, as on a parcel in transit */
+  for(i = 0; i < BENCH_PACK_EVENTS; i++)
+  {
+    memset(&events[i].event, 0, sizeof(event_t));
+    events[i].event.event_type = (i % 5 == 4) ? EVENT_FLIP : EVENT_DROP;
+    events[i].event.time.year = 2018;
+    events[i].event.time.month = 5;
+    events[i].event.time.day = 9;
+    events[i].event.time.dow = 3;
+    events[i].event.time.hour = 8 + i / 20;
+    events[i].event.time.minute = (i * 3) % 60;
+    events[i].event.time.second = (i * 17) % 60;
+    events[i].event.data = 300 + (i * 37) % 500;
+    events[i].crc = CRC32_FINAL(crc32_update(CRC32_INIT, (uint8_t *)&events[i].event, sizeof(event_t)));
+    events[i].prev = i ? &events[i - 1] : NULL;
+    events[i].next = (i + 1 < BENCH_PACK_EVENTS) ? &events[i + 1] : NULL;
+  }
+  buf.tail = &events[0];
+  buf.head = &events[BENCH_PACK_EVENTS - 1];
+  buf.count = BENCH_PACK_EVENTS;
+
+  for(i = 0; i < iterations / BENCH_PACK_EVENTS; i++)
+  {
+    eb_iter_begin(&buf, &iter);
+    while(iter.curr)
+    {
+      sizing = iter;
+      n = pack_count(&sizing, PACK_MAX_EVENTS, sizeof(out));
+      pack_events(&iter, n, out);
+      done += n;
+    }
+  }
+
+  return done;
+}
+
+static const bench_t benches[] =
+{
+  { (uint8_t *)"cb add+remove (op)", bench_cb },
+  { (uint8_t *)"spi_read (op)", bench_spi_read },
+  { (uint8_t *)"spi_read_burst 6B (op)", bench_spi_burst },
+  { (uint8_t *)"xor checksum (byte)", bench_checksum },
+#ifndef HOST_BUILD
+  { (uint8_t *)"crc32 hardware (byte)", bench_crc32_hw },
+#endif
+  { (uint8_t *)"crc32 software (byte)", bench_crc32_sw },
+#ifndef HOST_BUILD
+  { (uint8_t *)"aes256 ofb hardware+dma (byte)", bench_aes_hw },
+#endif
+  { (uint8_t *)"aes256 ofb software (byte)", bench_aes_sw },
+  { (uint8_t *)"dump frame plain (byte)", bench_dump_plain },
+  { (uint8_t *)"dump frame sealed (byte)", bench_dump_sealed },
+  { (uint8_t *)"pack dump (event)", bench_pack }
+};
+
+static void bench_print_num(uint32_t num)
+{
+  uint8_t conversion_buf[12];
+  my_itoa(num, conversion_buf, BASE_10);
+  log_send_str(conversion_buf);
+}
+
+void bench_run()
+{
+  uint32_t i, start, cycles, units;
+
+  for(i = 0; i < sizeof(bench_data); i++) bench_data[i] = i;
+  aes_init(&bench_key, bench_data);
+
+#ifdef RAM_HOT_PATH
+  log_send_str((uint8_t *)"bench: hot path in SRAM\r\n");
+#else
+  log_send_str((uint8_t *)"bench: hot path in flash\r\n");
+#endif
+
+  for(i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+  {
+    start = CYCLE_COUNT();
+    units = benches[i].fn(BENCH_ITERATIONS);
+    cycles = CYCLE_COUNT() - start;
+
+    log_send_str(benches[i].name);
+    log_send_str((uint8_t *)": ");
+    bench_print_num(cycles / units);
+    log_send_str((uint8_t *)".");
+    bench_print_num((cycles % units) * 10 / units);
+    log_send_str((uint8_t *)" cycles per unit\r\n");
+  }
+}
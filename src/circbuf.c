@@ -8,23 +8,29 @@
  * @date 2018/04/30
  */
 
-#include <stdlib.h>
 #include "helpers.h"
+#include "arena.h"
 #include "circbuf.h"
 
-cb_e cb_init(cb_t ** ptr_buf, size_t len, size_t item_size)
+cb_e cb_init(cb_t ** ptr_buf, uint32_t len, uint32_t item_size)
 {
   /* check inputs */
   if(!ptr_buf) return CB_NULL_PTR;
   if(len < 1) return CB_INVALID_PARAM;
   if(item_size < 1) return CB_INVALID_PARAM;
+  if(item_size * len > arena_block_size(ARENA_POOL_RX)) return CB_INVALID_PARAM;
 
   /* allocate memory */
-  *ptr_buf = (cb_t *)malloc(sizeof(cb_t));
-  if(!ptr_buf) return CB_MALLOC_FAILED;
+  *ptr_buf = (cb_t *)arena_alloc(ARENA_POOL_CB);
+  if(!(*ptr_buf)) return CB_ALLOC_FAILED;
 
-  (*ptr_buf)->base = (cb_t *)malloc(item_size * len);
-  if( !(*ptr_buf)->base ) return CB_MALLOC_FAILED;
+  (*ptr_buf)->base = arena_alloc(ARENA_POOL_RX);
+  if( !(*ptr_buf)->base )
+  {
+    arena_free(ARENA_POOL_CB, *ptr_buf);
+    *ptr_buf = NULL;
+    return CB_ALLOC_FAILED;
+  }
 
   /* initialize */
   (*ptr_buf)->count = 0;
@@ -41,14 +47,14 @@ cb_e cb_free(cb_t ** ptr_buf)
   /* check inputs */
   if(!ptr_buf || !(*ptr_buf)) return CB_NULL_PTR;
 
-  if( (*ptr_buf)->base ) free((*ptr_buf)->base);
-  free(*ptr_buf);
+  if( (*ptr_buf)->base ) arena_free(ARENA_POOL_RX, (*ptr_buf)->base);
+  arena_free(ARENA_POOL_CB, *ptr_buf);
   *ptr_buf = NULL;
 
   return CB_SUCCESS;
 }
 
-cb_e cb_add_item(cb_t * buf, void * ptr_data)
+RAMFUNC cb_e cb_add_item(cb_t * buf, void * ptr_data)
 {
   /* check inputs */
   if(!buf || !ptr_data) return CB_NULL_PTR;
@@ -61,7 +67,7 @@ cb_e cb_add_item(cb_t * buf, void * ptr_data)
   memcpy(buf->head, ptr_data, buf->item_size);
 
   /* move head */
-  if( (buf->head += buf->item_size) >= buf->head + buf->size * buf->item_size )
+  if( (buf->head += buf->item_size) >= buf->base + buf->size * buf->item_size )
   {
     buf->head = buf->base;
   }
@@ -72,7 +78,7 @@ cb_e cb_add_item(cb_t * buf, void * ptr_data)
   return CB_SUCCESS;
 }
 
-cb_e cb_remove_item(cb_t * buf, void * ptr_data)
+RAMFUNC cb_e cb_remove_item(cb_t * buf, void * ptr_data)
 {
   /* check inputs */
   if(!buf) return CB_NULL_PTR;
@@ -85,7 +91,7 @@ cb_e cb_remove_item(cb_t * buf, void * ptr_data)
   memcpy(ptr_data, buf->tail, buf->item_size);
 
   /* move tail */
-  if( (buf->tail += buf->item_size) >= buf->head + buf->size * buf->item_size )
+  if( (buf->tail += buf->item_size) >= buf->base + buf->size * buf->item_size )
   {
     buf->tail = buf->base;
   }
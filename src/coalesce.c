@@ -0,0 +1,127 @@
+/**
+ * @file coalesce.c
+ * @brief Merges bursts of triggers into single events
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/10
+ */
+
+#include "msp.h"
+#include "helpers.h"
+#include "coalesce.h"
+#include "event_buf.h"
+#include "rtc.h"
+
+#define CYCLES_PER_MS (MCLK_HZ / 1000)
+
+/*
+ * @brief Open record for one event type
+ */
+typedef struct
+{
+  event_t event;
+  uint32_t count;
+  uint32_t span; /* cycles from the first trigger to the last, saturates */
+  uint32_t last; /* cycle count at the last trigger */
+  uint8_t open;
+} burst_t;
+
+static eb_t * coalesce_buf;
+static uint32_t window;
+static burst_t bursts[COALESCE_NUM_TYPES];
+
+/* fill in the counters and store the record */
+static void coalesce_store(burst_t * burst)
+{
+  uint32_t ms = burst->span / CYCLES_PER_MS;
+  if(ms > 0xFFFF) ms = 0xFFFF;
+
+  burst->event.reserved[0] = (burst->count > 0xFF) ? 0xFF : burst->count;
+  burst->event.reserved[1] = ms;
+  burst->event.reserved[2] = ms >> 8;
+
+  eb_new_record(coalesce_buf, &burst->event);
+}
+
+void coalesce_init(eb_t * buf, uint16_t window_ms)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  coalesce_buf = buf;
+  window = (window_ms ? window_ms : COALESCE_DEFAULT_MS) * CYCLES_PER_MS;
+
+  __set_PRIMASK(primask);
+}
+
+void coalesce_trigger(event_type_e event_type, uint32_t magnitude)
+{
+  burst_t * burst;
+  burst_t done;
+  uint32_t now, gap;
+
+  /* types with no burst state are stored as they come */
+  if(event_type >= COALESCE_NUM_TYPES)
+  {
+    eb_new_event(coalesce_buf, event_type, magnitude);
+    return;
+  }
+  burst = &bursts[event_type];
+  done.open = 0;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  now = CYCLE_COUNT();
+  gap = now - burst->last;
+  if(burst->open && gap <= window)
+  {
+    /* join the open record */
+    burst->count++;
+    burst->span = (burst->span + gap < burst->span) ? 0xFFFFFFFF : burst->span + gap;
+    if(magnitude > burst->event.data) burst->event.data = magnitude;
+  }
+  else
+  {
+    /* close the open record, this trigger starts the next */
+    done = *burst;
+    burst->event.event_type = event_type;
+    burst->event.time = rtc_get_time();
+    burst->event.data = magnitude;
+    burst->count = 1;
+    burst->span = 0;
+    burst->open = 1;
+  }
+  burst->last = now;
+
+  __set_PRIMASK(primask);
+
+  /* the log takes its own critical section */
+  if(done.open) coalesce_store(&done);
+}
+
+void coalesce_poll()
+{
+  uint32_t i;
+  burst_t done;
+
+  for(i = 0; i < COALESCE_NUM_TYPES; i++)
+  {
+    done.open = 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if(bursts[i].open && CYCLE_COUNT() - bursts[i].last > window)
+    {
+      done = bursts[i];
+      bursts[i].open = 0;
+    }
+
+    __set_PRIMASK(primask);
+
+    if(done.open) coalesce_store(&done);
+  }
+}
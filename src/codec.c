@@ -0,0 +1,505 @@
+/**
+ * @file codec.c
+ * @brief Wire encoder and decoder for packets.h messages
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/07
+ */
+
+#include <string.h>
+#include "codec.h"
+#include "crc.h"
+#include "packets.h"
+
+#define F_U8(s, m, n) { FIELD_U8, (n), offsetof(s, m) }
+#define F_U16(s, m, n) { FIELD_U16, (n), offsetof(s, m) }
+#define F_U32(s, m, n) { FIELD_U32, (n), offsetof(s, m) }
+#define F_RTC(s, m) { FIELD_RTC, 1, offsetof(s, m) }
+#define F_PAD(n) { FIELD_PAD, (n), 0 }
+#define F_VAR(s, m, n) { FIELD_VAR, (n), offsetof(s, m) }
+#define MSG(t, f) { (t), sizeof(f) / sizeof(field_t), sizeof(f) / sizeof(field_t), (f) }
+#define MSG_OPT(t, f, r) { (t), sizeof(f) / sizeof(field_t), (r), (f) }
+
+/*
+ * The dump path, and the query path that shares its frames, sends
+ * stored records and these structs without going through the codec,
+ * so their in-memory layout must match the wire.
+ */
+_Static_assert(sizeof(rtc_t) == 8, "rtc_t wire size");
+_Static_assert(offsetof(rtc_t, month) == 2, "rtc_t.month offset");
+_Static_assert(offsetof(rtc_t, second) == 7, "rtc_t.second offset");
+_Static_assert(sizeof(event_t) == CODEC_EVENT_LEN, "event_t wire size");
+_Static_assert(offsetof(event_t, reserved) == 1, "event_t.reserved offset");
+_Static_assert(offsetof(event_t, time) == 4, "event_t.time offset");
+_Static_assert(offsetof(event_t, data) == 12, "event_t.data offset");
+_Static_assert(sizeof(res_dump_t) == 4, "res_dump_t wire size");
+_Static_assert(sizeof(res_sealed_t) == SEAL_HDR_LEN, "res_sealed_t wire size");
+_Static_assert(offsetof(res_dump_t, num_events) == 2, "res_dump_t.num_events offset");
+_Static_assert(offsetof(cmd_init_t, tracking_len) == CMD_INIT_FIXED_LEN - 1, "cmd_init_t.tracking_len offset");
+_Static_assert(offsetof(cmd_init_t, tracking) == CMD_INIT_FIXED_LEN, "cmd_init_t.tracking offset");
+_Static_assert(offsetof(res_caps_t, cmds) == CAPS_FIXED_LEN, "res_caps_t.cmds offset");
+_Static_assert(sizeof(res_stats_t) <= PKT_MAX_PAYLOAD, "res_stats_t fits a packet");
+_Static_assert(sizeof(res_summary_t) <= PKT_MAX_PAYLOAD, "res_summary_t fits a packet");
+_Static_assert(CAPS_FIXED_LEN + CAPS_MAX_CMDS * CAPS_CMD_LEN <= PKT_MAX_PAYLOAD, "res_caps_t fits a packet");
+
+static const field_t event_fields[] =
+{
+  F_U8(event_t, event_type, 1),
+  F_U8(event_t, reserved, 3),
+  F_RTC(event_t, time),
+  F_U32(event_t, data, 1)
+};
+
+static const field_t cmd_init_fields[] =
+{
+  F_U16(cmd_init_t, package_id, 1),
+  F_U16(cmd_init_t, coalesce_ms, 1),
+  F_RTC(cmd_init_t, time),
+  F_U8(cmd_init_t, carrier_access_code, 1),
+  F_U8(cmd_init_t, user_access_code, 1),
+  F_U8(cmd_init_t, flags, 1),
+  F_U8(cmd_init_t, tracking_len, 1),
+  F_VAR(cmd_init_t, tracking, CMD_INIT_TRACKING_MAX)
+};
+
+static const field_t cmd_dump_fields[] =
+{
+  F_U8(cmd_dump_t, access_code, 1),
+  F_U8(cmd_dump_t, encoding, 1)
+};
+
+static const field_t cmd_version_fields[] =
+{
+  F_U8(cmd_version_t, version, 1)
+};
+
+static const field_t cmd_baud_fields[] =
+{
+  F_U8(cmd_baud_t, rate, 1)
+};
+
+static const field_t cmd_summary_fields[] =
+{
+  F_U8(cmd_summary_t, access_code, 1)
+};
+
+static const field_t cmd_query_fields[] =
+{
+  F_U8(cmd_query_t, access_code, 1),
+  F_U8(cmd_query_t, encoding, 1),
+  F_U8(cmd_query_t, type_mask, 1),
+  F_PAD(1),
+  F_U32(cmd_query_t, start, 1),
+  F_U32(cmd_query_t, end, 1),
+  F_U32(cmd_query_t, min_data, 1)
+};
+
+static const field_t cmd_stream_fields[] =
+{
+  F_U8(cmd_stream_t, access_code, 1),
+  F_U8(cmd_stream_t, mode, 1),
+  F_U8(cmd_stream_t, rate, 1),
+  F_U8(cmd_stream_t, decimation, 1)
+};
+
+static const field_t cmd_key_fields[] =
+{
+  F_U8(cmd_key_t, key, SESSION_KEY_LEN)
+};
+
+static const field_t cmd_session_fields[] =
+{
+  F_U8(cmd_session_t, access_code, 1),
+  F_U8(cmd_session_t, nonce, SESSION_NONCE_LEN)
+};
+
+static const field_t res_status_fields[] =
+{
+  F_U16(res_status_t, package_id, 1),
+  F_U8(res_status_t, status_code, 1),
+  F_PAD(1),
+  F_U16(res_status_t, evicted, 1),
+  F_U8(res_status_t, policy, 1),
+  F_PAD(1)
+};
+
+static const field_t res_dump_fields[] =
+{
+  F_U16(res_dump_t, package_id, 1),
+  F_U8(res_dump_t, num_events, 1),
+  F_U8(res_dump_t, frames_left, 1)
+};
+
+static const field_t res_stats_fields[] =
+{
+  F_U32(res_stats_t, max_latency, 1),
+  F_U32(res_stats_t, latency_hist, STATS_HIST_BINS),
+  F_U32(res_stats_t, deadline_misses, STATS_NUM_TASKS),
+  F_U16(res_stats_t, arena_high_water, STATS_NUM_POOLS)
+};
+
+static const field_t res_summary_fields[] =
+{
+  F_U16(res_summary_t, package_id, 1),
+  F_U16(res_summary_t, lost, 1),
+  F_U16(res_summary_t, count, SUMMARY_NUM_TYPES),
+  F_U32(res_summary_t, max_severity, SUMMARY_NUM_TYPES),
+  F_U32(res_summary_t, mean_severity, SUMMARY_NUM_TYPES),
+  F_RTC(res_summary_t, first),
+  F_RTC(res_summary_t, last),
+  F_U16(res_summary_t, hour_hist, SUMMARY_HOURS)
+};
+
+static const field_t res_stream_fields[] =
+{
+  F_U16(res_stream_t, seq, 1),
+  F_U16(res_stream_t, dropped, 1),
+  F_U8(res_stream_t, mode, 1),
+  F_U8(res_stream_t, rate, 1),
+  F_U8(res_stream_t, decimation, 1),
+  F_U8(res_stream_t, flags, 1)
+};
+
+static const field_t res_session_fields[] =
+{
+  F_U8(res_session_t, nonce, SESSION_NONCE_LEN)
+};
+
+static const field_t res_sealed_fields[] =
+{
+  F_U16(res_sealed_t, seq, 1)
+};
+
+static const field_t res_caps_fields[] =
+{
+  F_U8(res_caps_t, proto_max, 1),
+  F_U8(res_caps_t, proto_version, 1),
+  F_U8(res_caps_t, max_payload, 1),
+  F_U8(res_caps_t, batch_max, 1),
+  F_U16(res_caps_t, max_frame, 1),
+  F_U16(res_caps_t, rx_buf_len, 1),
+  F_U16(res_caps_t, log_len, 1),
+  F_U8(res_caps_t, dump_encodings, 1),
+  F_U8(res_caps_t, stream_modes, 1),
+  F_U8(res_caps_t, baud_rates, 1),
+  F_U8(res_caps_t, features, 1),
+  F_U8(res_caps_t, cmds_len, 1),
+  F_VAR(res_caps_t, cmds, CAPS_MAX_CMDS * CAPS_CMD_LEN)
+};
+
+static const field_t res_version_fields[] =
+{
+  F_U8(res_version_t, version, 1)
+};
+
+static const field_t res_baud_fields[] =
+{
+  F_U8(res_baud_t, rate, 1)
+};
+
+static const msg_desc_t msgs[] =
+{
+  { PKT_CMD_STATUS, 0, 0, NULL },
+  MSG(PKT_CMD_INIT, cmd_init_fields),
+  MSG_OPT(PKT_CMD_DUMP, cmd_dump_fields, 1),
+  { PKT_CMD_STATS, 0, 0, NULL },
+  MSG(PKT_CMD_VERSION, cmd_version_fields),
+  MSG(PKT_CMD_BAUD, cmd_baud_fields),
+  MSG(PKT_CMD_SUMMARY, cmd_summary_fields),
+  MSG(PKT_CMD_QUERY, cmd_query_fields),
+  MSG(PKT_CMD_STREAM, cmd_stream_fields),
+  { PKT_CMD_BATCH, 0, 0, NULL }, /* see codec_batch_parse */
+  MSG(PKT_CMD_KEY, cmd_key_fields),
+  MSG_OPT(PKT_CMD_SESSION, cmd_session_fields, 1),
+  { PKT_CMD_CAPS, 0, 0, NULL },
+  { PKT_RES_ACK, 0, 0, NULL },
+  MSG(PKT_RES_STATUS, res_status_fields),
+  MSG(PKT_RES_DUMP, res_dump_fields),
+  MSG(PKT_RES_DUMP_PACKED, res_dump_fields),
+  MSG(PKT_RES_SUMMARY, res_summary_fields),
+  MSG(PKT_RES_STREAM, res_stream_fields),
+  MSG(PKT_RES_SESSION, res_session_fields),
+  MSG(PKT_RES_SEALED, res_sealed_fields),
+  MSG(PKT_RES_CAPS, res_caps_fields),
+  MSG(PKT_RES_STATS, res_stats_fields),
+  MSG(PKT_RES_VERSION, res_version_fields),
+  MSG(PKT_RES_BAUD, res_baud_fields),
+  { PKT_RES_NAK, 0, 0, NULL }
+};
+
+static const msg_desc_t * codec_find(uint8_t pkt_type)
+{
+  uint32_t i;
+  for(i = 0; i < sizeof(msgs) / sizeof(msgs[0]); i++)
+  {
+    if(msgs[i].pkt_type == pkt_type) return &msgs[i];
+  }
+
+  return NULL;
+}
+
+/* length of one element of a field on the wire */
+static uint32_t codec_elem_len(uint8_t type)
+{
+  switch(type)
+  {
+    case FIELD_U16: return 2;
+    case FIELD_U32: return 4;
+    case FIELD_RTC: return 8;
+    default: return 1;
+  }
+}
+
+static codec_e codec_encode_fields(const field_t * fields, uint8_t num_fields, const uint8_t * msg,
+                                   uint8_t * out, uint32_t cap, uint32_t * len)
+{
+  uint32_t pos = 0, i, j, n, val;
+  uint8_t var_len = 0;
+  const field_t * f;
+  const uint8_t * src;
+  const rtc_t * rtc;
+
+  for(i = 0; i < num_fields; i++)
+  {
+    f = &fields[i];
+    src = msg + f->offset;
+    n = (f->type == FIELD_VAR) ? var_len : f->count * codec_elem_len(f->type);
+    if(f->type == FIELD_VAR && var_len > f->count) return CODEC_OVERFLOW;
+    if(pos + n > cap) return CODEC_OVERFLOW;
+
+    switch(f->type)
+    {
+      case FIELD_U8:
+        memcpy(out + pos, src, f->count);
+        var_len = src[f->count - 1];
+        break;
+      case FIELD_U16:
+        for(j = 0; j < f->count; j++)
+        {
+          val = ((const uint16_t *)src)[j];
+          out[pos + 2 * j] = val;
+          out[pos + 2 * j + 1] = val >> 8;
+        }
+        break;
+      case FIELD_U32:
+        for(j = 0; j < f->count; j++)
+        {
+          val = ((const uint32_t *)src)[j];
+          out[pos + 4 * j] = val;
+          out[pos + 4 * j + 1] = val >> 8;
+          out[pos + 4 * j + 2] = val >> 16;
+          out[pos + 4 * j + 3] = val >> 24;
+        }
+        break;
+      case FIELD_RTC:
+        rtc = (const rtc_t *)src;
+        out[pos] = rtc->year;
+        out[pos + 1] = rtc->year >> 8;
+        out[pos + 2] = rtc->month;
+        out[pos + 3] = rtc->dow;
+        out[pos + 4] = rtc->day;
+        out[pos + 5] = rtc->hour;
+        out[pos + 6] = rtc->minute;
+        out[pos + 7] = rtc->second;
+        break;
+      case FIELD_PAD:
+        memset(out + pos, 0, f->count);
+        break;
+      case FIELD_VAR:
+        memcpy(out + pos, src, var_len);
+        break;
+    }
+    pos += n;
+  }
+
+  *len = pos;
+  return CODEC_SUCCESS;
+}
+
+static codec_e codec_decode_fields(const field_t * fields, uint8_t num_fields, uint8_t num_required,
+                                   const uint8_t * in, uint32_t len, uint8_t * msg)
+{
+  uint32_t pos = 0, i, j, n;
+  uint8_t var_len = 0;
+  const field_t * f;
+  uint8_t * dst;
+  rtc_t * rtc;
+
+  for(i = 0; i < num_fields; i++)
+  {
+    f = &fields[i];
+    dst = msg + f->offset;
+    n = (f->type == FIELD_VAR) ? var_len : f->count * codec_elem_len(f->type);
+    if(f->type == FIELD_VAR && var_len > f->count) return CODEC_OVERFLOW;
+    if(pos == len && i >= num_required) break;
+    if(pos + n > len) return CODEC_SHORT;
+
+    switch(f->type)
+    {
+      case FIELD_U8:
+        memcpy(dst, in + pos, f->count);
+        var_len = dst[f->count - 1];
+        break;
+      case FIELD_U16:
+        for(j = 0; j < f->count; j++)
+        {
+          ((uint16_t *)dst)[j] = in[pos + 2 * j] | (in[pos + 2 * j + 1] << 8);
+        }
+        break;
+      case FIELD_U32:
+        for(j = 0; j < f->count; j++)
+        {
+          ((uint32_t *)dst)[j] = (uint32_t)in[pos + 4 * j] |
+                                 ((uint32_t)in[pos + 4 * j + 1] << 8) |
+                                 ((uint32_t)in[pos + 4 * j + 2] << 16) |
+                                 ((uint32_t)in[pos + 4 * j + 3] << 24);
+        }
+        break;
+      case FIELD_RTC:
+        rtc = (rtc_t *)dst;
+        rtc->year = in[pos] | (in[pos + 1] << 8);
+        rtc->month = in[pos + 2];
+        rtc->dow = in[pos + 3];
+        rtc->day = in[pos + 4];
+        rtc->hour = in[pos + 5];
+        rtc->minute = in[pos + 6];
+        rtc->second = in[pos + 7];
+        break;
+      case FIELD_PAD:
+        break;
+      case FIELD_VAR:
+        memcpy(dst, in + pos, var_len);
+        break;
+    }
+    pos += n;
+  }
+
+  return CODEC_SUCCESS;
+}
+
+codec_e codec_encode(uint8_t pkt_type, const void * msg, uint8_t * out, uint32_t cap, uint32_t * len)
+{
+  /* check inputs */
+  if(!out || !len) return CODEC_NULL_PTR;
+
+  const msg_desc_t * desc = codec_find(pkt_type);
+  if(!desc) return CODEC_UNKNOWN_TYPE;
+  if(desc->num_fields && !msg) return CODEC_NULL_PTR;
+
+  return codec_encode_fields(desc->fields, desc->num_fields, (const uint8_t *)msg, out, cap, len);
+}
+
+codec_e codec_decode(uint8_t pkt_type, const uint8_t * in, uint32_t len, void * msg)
+{
+  const msg_desc_t * desc = codec_find(pkt_type);
+  if(!desc) return CODEC_UNKNOWN_TYPE;
+  if(!desc->num_fields) return CODEC_SUCCESS;
+
+  /* check inputs */
+  if(!msg || (len && !in)) return CODEC_NULL_PTR;
+
+  return codec_decode_fields(desc->fields, desc->num_fields, desc->num_required, in, len, (uint8_t *)msg);
+}
+
+codec_e codec_batch_parse(const uint8_t * in, uint32_t len, cmd_batch_t * batch)
+{
+  uint32_t pos = 0;
+  uint8_t num = 0;
+
+  /* check inputs */
+  if(!batch || (len && !in)) return CODEC_NULL_PTR;
+
+  while(pos < len)
+  {
+    if(pos + BATCH_ENTRY_HDR_LEN > len || pos + BATCH_ENTRY_HDR_LEN + in[pos + 1] > len) return CODEC_SHORT;
+    if(++num > BATCH_MAX_CMDS) return CODEC_OVERFLOW;
+    pos += BATCH_ENTRY_HDR_LEN + in[pos + 1];
+  }
+
+  batch->num_cmds = num;
+  batch->len = len;
+  batch->cmds = in;
+
+  return CODEC_SUCCESS;
+}
+
+uint8_t codec_batch_next(const cmd_batch_t * batch, uint32_t * pos, uint8_t * pkt_type, const uint8_t ** payload,
+                         uint8_t * len)
+{
+  if(*pos >= batch->len) return 0;
+
+  *pkt_type = batch->cmds[*pos];
+  *len = batch->cmds[*pos + 1];
+  *payload = batch->cmds + *pos + BATCH_ENTRY_HDR_LEN;
+  *pos += BATCH_ENTRY_HDR_LEN + *len;
+
+  return 1;
+}
+
+codec_e codec_batch_add(uint8_t pkt_type, const void * msg, uint8_t * out, uint32_t cap, uint32_t * len)
+{
+  uint32_t n;
+  codec_e status;
+
+  /* check inputs */
+  if(!out || !len) return CODEC_NULL_PTR;
+  if(*len + BATCH_ENTRY_HDR_LEN > cap) return CODEC_OVERFLOW;
+
+  status = codec_encode(pkt_type, msg, out + *len + BATCH_ENTRY_HDR_LEN, cap - *len - BATCH_ENTRY_HDR_LEN, &n);
+  if(status != CODEC_SUCCESS) return status;
+  if(n > 0xFF) return CODEC_OVERFLOW;
+
+  out[*len] = pkt_type;
+  out[*len + 1] = n;
+  *len += BATCH_ENTRY_HDR_LEN + n;
+
+  return CODEC_SUCCESS;
+}
+
+void codec_encode_event(const event_t * event, uint8_t * out)
+{
+  uint32_t len;
+  codec_encode_fields(event_fields, sizeof(event_fields) / sizeof(field_t), (const uint8_t *)event,
+                      out, CODEC_EVENT_LEN, &len);
+}
+
+void codec_decode_event(const uint8_t * in, event_t * event)
+{
+  codec_decode_fields(event_fields, sizeof(event_fields) / sizeof(field_t),
+                      sizeof(event_fields) / sizeof(field_t), in, CODEC_EVENT_LEN, (uint8_t *)event);
+}
+
+uint32_t codec_trailer_len(uint8_t version)
+{
+  return (version >= PROTO_VERSION_CRC32) ? 4 : 1;
+}
+
+uint32_t codec_frame(uint8_t version, uint8_t pkt_type, uint8_t * frame, uint32_t payload_len)
+{
+  uint32_t i, len, crc;
+  uint8_t checksum = 0;
+
+  if(payload_len > PKT_MAX_PAYLOAD) return 0;
+
+  frame[0] = pkt_type;
+  frame[1] = payload_len;
+  len = CODEC_HDR_LEN + payload_len;
+
+  if(version >= PROTO_VERSION_CRC32)
+  {
+    crc = CRC32_FINAL(crc32_update(CRC32_INIT, frame, len));
+    frame[len++] = crc;
+    frame[len++] = crc >> 8;
+    frame[len++] = crc >> 16;
+    frame[len++] = crc >> 24;
+  }
+  else
+  {
+    for(i = 0; i < len; i++) checksum ^= frame[i];
+    frame[len++] = checksum;
+  }
+
+  return len;
+}
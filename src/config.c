@@ -0,0 +1,99 @@
+/**
+ * @file config.c
+ * @brief Package configuration kept in flash across resets
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/11
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "config.h"
+#include "crc.h"
+#include "flash.h"
+
+/* programmed a word at a time */
+#define CONFIG_REC_WORDS ((sizeof(config_rec_t) + 3) / 4)
+
+_Static_assert(CONFIG_REC_WORDS * 4 <= FLASH_SECTOR_LEN, "config record fits a sector");
+
+static uint32_t config_crc(const config_rec_t * rec)
+{
+  const uint8_t * start = (const uint8_t *)&rec->version;
+  return CRC32_FINAL(crc32_update(CRC32_INIT, start, sizeof(config_rec_t) - offsetof(config_rec_t, version)));
+}
+
+/* the valid record in a slot, NULL if the slot has none */
+static const config_rec_t * config_slot(uint32_t slot)
+{
+  const config_rec_t * rec = (const config_rec_t *)flash_read(CONFIG_SLOT_ADDR(slot));
+
+  if(rec->magic != CONFIG_MAGIC) return NULL;
+  if(rec->version != CONFIG_VERSION || rec->len != sizeof(config_t)) return NULL;
+  if(rec->crc != config_crc(rec)) return NULL;
+
+  return rec;
+}
+
+/* slot holding the newest record, CONFIG_NUM_SLOTS if neither is valid */
+static uint32_t config_newest()
+{
+  const config_rec_t * rec;
+  uint32_t slot, newest = CONFIG_NUM_SLOTS, seq = 0;
+
+  for(slot = 0; slot < CONFIG_NUM_SLOTS; slot++)
+  {
+    rec = config_slot(slot);
+    if(!rec) continue;
+
+    /* sequence numbers are compared by difference so they may wrap */
+    if(newest == CONFIG_NUM_SLOTS || (int32_t)(rec->seq - seq) > 0)
+    {
+      newest = slot;
+      seq = rec->seq;
+    }
+  }
+
+  return newest;
+}
+
+config_e config_load(config_t * ptr_config)
+{
+  /* check inputs */
+  if(!ptr_config) return CONFIG_NULL_PTR;
+
+  uint32_t slot = config_newest();
+  if(slot == CONFIG_NUM_SLOTS) return CONFIG_EMPTY;
+
+  memcpy(ptr_config, &config_slot(slot)->config, sizeof(config_t));
+
+  return CONFIG_SUCCESS;
+}
+
+config_e config_save(const config_t * ptr_config)
+{
+  static uint32_t words[CONFIG_REC_WORDS];
+  config_rec_t * rec = (config_rec_t *)words;
+  uint32_t newest, slot;
+
+  /* check inputs */
+  if(!ptr_config) return CONFIG_NULL_PTR;
+
+  newest = config_newest();
+  slot = (newest == CONFIG_NUM_SLOTS) ? 0 : (newest + 1) % CONFIG_NUM_SLOTS;
+
+  memset(words, 0xFF, sizeof(words));
+  rec->magic = CONFIG_MAGIC;
+  rec->version = CONFIG_VERSION;
+  rec->len = sizeof(config_t);
+  rec->seq = (newest == CONFIG_NUM_SLOTS) ? 0 : config_slot(newest)->seq + 1;
+  memcpy(&rec->config, ptr_config, sizeof(config_t));
+  rec->crc = config_crc(rec);
+
+  if(flash_erase(CONFIG_SLOT_ADDR(slot)) != FLASH_SUCCESS) return CONFIG_WRITE_FAILED;
+  if(flash_program(CONFIG_SLOT_ADDR(slot), words, sizeof(words)) != FLASH_SUCCESS) return CONFIG_WRITE_FAILED;
+
+  return CONFIG_SUCCESS;
+}
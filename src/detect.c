@@ -0,0 +1,60 @@
+/**
+ * @file detect.c
+ * @brief Drop and flip detection
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include "helpers.h"
+#include "detect.h"
+
+void detect_init(detect_t * det)
+{
+  det->over_start = 0;
+  det->peak = 0;
+  det->flip_count = 0;
+  det->over = 0;
+}
+
+RAMFUNC uint8_t detect_tap(detect_t * det, uint32_t time_us, int16_t x, int16_t y, int16_t z, uint32_t * peak)
+{
+  uint32_t mag = (x < 0) ? -x : x;
+
+  if(((y < 0) ? -y : y) > mag) mag = (y < 0) ? -y : y;
+  if(((z < 0) ? -z : z) > mag) mag = (z < 0) ? -z : z;
+
+  if(mag > DETECT_TAP_LEVEL)
+  {
+    if(!det->over)
+    {
+      det->over = 1;
+      det->over_start = time_us;
+      det->peak = 0;
+    }
+    if(mag > det->peak) det->peak = mag;
+    return 0;
+  }
+
+  if(!det->over) return 0;
+  det->over = 0;
+
+  /* over for too long is a shove, not a tap */
+  if(time_us - det->over_start >= DETECT_TAP_DUR_US) return 0;
+
+  *peak = det->peak;
+  return 1;
+}
+
+RAMFUNC uint8_t detect_flip(detect_t * det, int16_t z)
+{
+  if(z <= 0)
+  {
+    det->flip_count = 0;
+    return 0;
+  }
+
+  return ++det->flip_count == DETECT_FLIP_COUNT;
+}
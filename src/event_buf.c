@@ -8,10 +8,249 @@
  * @date 2018/05/02
  */
 
-#include <stdlib.h>
 #include "helpers.h"
+#include "arena.h"
+#include "crc.h"
 #include "packets.h"
 #include "event_buf.h"
+#include "rtc.h"
+
+static eb_e eb_check_item(ll_event_t * ptr_event)
+{
+  uint32_t crc = CRC32_FINAL(crc32_update(CRC32_INIT, (uint8_t *)&ptr_event->event, sizeof(event_t)));
+
+  return (crc == ptr_event->crc) ? EB_SUCCESS : EB_CORRUPT;
+}
+
+static uint8_t eb_type_bit(uint8_t event_type)
+{
+  return (event_type < 8) ? (1 << event_type) : 0;
+}
+
+static uint8_t eb_block_match(const eb_block_t * block, const eb_filter_t * filter)
+{
+  return (block->type_mask & filter->type_mask) &&
+         block->max_time >= filter->start && block->min_time <= filter->end &&
+         block->max_data >= filter->min_data;
+}
+
+static uint8_t eb_event_match(const event_t * event, const eb_filter_t * filter)
+{
+  uint32_t secs;
+
+  if(!(eb_type_bit(event->event_type) & filter->type_mask)) return 0;
+  if(event->data < filter->min_data) return 0;
+
+  secs = rtc_to_seconds(&event->time);
+  return secs >= filter->start && secs <= filter->end;
+}
+
+/* true if the block has no events left, it then shares its first event with the next block */
+static uint8_t eb_block_empty(const eb_t * buf, uint32_t idx)
+{
+  return buf->blocks[idx].first == ((idx + 1 < buf->num_blocks) ? buf->blocks[idx + 1].first : NULL);
+}
+
+static void eb_block_drop(eb_t * buf, uint32_t idx)
+{
+  memmove(&buf->blocks[idx], &buf->blocks[idx + 1], (buf->num_blocks - idx - 1) * sizeof(eb_block_t));
+  buf->num_blocks--;
+}
+
+/* free an index slot, an empty block if there is one, else fold the two oldest together */
+static void eb_index_compact(eb_t * buf)
+{
+  eb_block_t * older = &buf->blocks[0];
+  const eb_block_t * newer = &buf->blocks[1];
+  uint32_t i;
+
+  for(i = 0; i + 1 < buf->num_blocks; i++)
+  {
+    if(eb_block_empty(buf, i))
+    {
+      eb_block_drop(buf, i);
+      return;
+    }
+  }
+
+  if(newer->min_time < older->min_time) older->min_time = newer->min_time;
+  if(newer->max_time > older->max_time) older->max_time = newer->max_time;
+  if(newer->max_data > older->max_data) older->max_data = newer->max_data;
+  older->type_mask |= newer->type_mask;
+  eb_block_drop(buf, 1);
+}
+
+/* must be called in a critical section */
+static void eb_index_add(eb_t * buf, ll_event_t * ptr_event)
+{
+  eb_block_t * block;
+  uint32_t i, secs = rtc_to_seconds(&ptr_event->event.time);
+
+  /* blocks emptied at the newest end have been waiting for this event */
+  for(i = 0; i < buf->num_blocks; i++)
+  {
+    if(!buf->blocks[i].first) buf->blocks[i].first = ptr_event;
+  }
+
+  block = buf->num_blocks ? &buf->blocks[buf->num_blocks - 1] : NULL;
+  if(!block || block->count >= EB_BLOCK_LEN)
+  {
+    /* iterators hold block numbers, so only compact when none can be running */
+    if(buf->num_blocks == EB_NUM_BLOCKS && !buf->pinned) eb_index_compact(buf);
+
+    if(buf->num_blocks < EB_NUM_BLOCKS)
+    {
+      block = &buf->blocks[buf->num_blocks++];
+      block->first = ptr_event;
+      block->min_time = secs;
+      block->max_time = secs;
+      block->max_data = 0;
+      block->type_mask = 0;
+      block->count = 0;
+    }
+  }
+
+  if(secs < block->min_time) block->min_time = secs;
+  if(secs > block->max_time) block->max_time = secs;
+  if(ptr_event->event.data > block->max_data) block->max_data = ptr_event->event.data;
+  block->type_mask |= eb_type_bit(ptr_event->event.event_type);
+  if(block->count < 0xFF) block->count++;
+}
+
+/* must be called in a critical section, after ptr_event is unlinked */
+static void eb_index_remove(eb_t * buf, ll_event_t * ptr_event)
+{
+  uint32_t i;
+
+  for(i = 0; i < buf->num_blocks; i++)
+  {
+    if(buf->blocks[i].first == ptr_event) buf->blocks[i].first = ptr_event->next;
+  }
+
+  while(buf->num_blocks && eb_block_empty(buf, 0)) eb_block_drop(buf, 0);
+}
+
+/* eviction lane of an event under the current policy */
+static uint32_t eb_lane(const eb_t * buf, const event_t * event)
+{
+  uint32_t lane;
+
+  switch(buf->policy)
+  {
+    case EB_KEEP_SEVERE:
+      /* one lane per power of two of the data */
+      lane = event->data ? 32 - __CLZ(event->data) : 0;
+      return (lane < EB_NUM_LANES) ? lane : EB_NUM_LANES - 1;
+    case EB_THIN_FLIPS:
+      return (event->event_type == EVENT_FLIP) ? EB_LANE_FLIPS : EB_LANE_OTHER;
+    default:
+      return 0;
+  }
+}
+
+/* must be called in a critical section */
+static void eb_lane_append(eb_t * buf, ll_event_t * ptr_event)
+{
+  uint32_t lane = eb_lane(buf, &ptr_event->event);
+
+  ptr_event->lane_next = NULL;
+  if(buf->lane_tail[lane]) buf->lane_tail[lane]->lane_next = ptr_event;
+  else buf->lane_head[lane] = ptr_event;
+  buf->lane_tail[lane] = ptr_event;
+  buf->lane_map |= (uint32_t)1 << lane;
+}
+
+/* must be called in a critical section, removes the event after prev, or the head if prev is NULL */
+static void eb_lane_remove(eb_t * buf, uint32_t lane, ll_event_t * prev)
+{
+  ll_event_t * rem = prev ? prev->lane_next : buf->lane_head[lane];
+
+  if(prev) prev->lane_next = rem->lane_next;
+  else buf->lane_head[lane] = rem->lane_next;
+
+  if(buf->lane_tail[lane] == rem) buf->lane_tail[lane] = prev;
+  if(!buf->lane_head[lane]) buf->lane_map &= ~((uint32_t)1 << lane);
+  if(buf->thin_prev == rem) buf->thin_prev = NULL;
+}
+
+/* must be called in a critical section */
+static void eb_unlink(eb_t * buf, ll_event_t * ptr_event)
+{
+  if(ptr_event->prev) ptr_event->prev->next = ptr_event->next;
+  else buf->tail = ptr_event->next;
+
+  if(ptr_event->next) ptr_event->next->prev = ptr_event->prev;
+  else buf->head = ptr_event->prev;
+
+  buf->count--;
+  eb_index_remove(buf, ptr_event);
+}
+
+/*
+ * Pick and unlink the event to make room for new_event, must be called
+ * in a critical section. Every choice takes the head of a lane, except
+ * thinning which keeps its place in the flip lane between calls.
+ */
+static ll_event_t * eb_evict(eb_t * buf, const event_t * new_event)
+{
+  ll_event_t * victim;
+  ll_event_t * prev = NULL;
+  uint32_t lane;
+
+  switch(buf->policy)
+  {
+    case EB_KEEP_SEVERE:
+      /* lowest lane in use, the new event goes instead if it is lower */
+      lane = 31 - __CLZ(buf->lane_map & -buf->lane_map);
+      if(eb_lane(buf, new_event) < lane) return NULL;
+      break;
+
+    case EB_THIN_FLIPS:
+      /* drop every other flip from the oldest on, starting over at the newest */
+      lane = EB_LANE_FLIPS;
+      if(!buf->lane_head[lane])
+      {
+        lane = EB_LANE_OTHER;
+        break;
+      }
+      prev = buf->thin_prev;
+      if(prev && !prev->lane_next) prev = NULL;
+      break;
+
+    default:
+      lane = 0;
+      break;
+  }
+
+  victim = prev ? prev->lane_next : buf->lane_head[lane];
+  eb_lane_remove(buf, lane, prev);
+  if(lane == EB_LANE_FLIPS && buf->policy == EB_THIN_FLIPS)
+  {
+    /* keep the next flip, the one after it goes next time */
+    buf->thin_prev = prev ? prev->lane_next : buf->lane_head[lane];
+  }
+
+  eb_unlink(buf, victim);
+
+  return victim;
+}
+
+/* set up the walk of block idx, skipping blocks that cannot match */
+static void eb_iter_enter(eb_iter_t * iter, uint32_t idx)
+{
+  eb_t * buf = iter->buf;
+
+  for(; idx < buf->num_blocks; idx++)
+  {
+    iter->block = idx;
+    iter->curr = buf->blocks[idx].first;
+    iter->block_end = (idx + 1 < buf->num_blocks) ? buf->blocks[idx + 1].first : NULL;
+    if(eb_block_match(&buf->blocks[idx], iter->filter)) return;
+  }
+
+  /* events added after this point go out next time */
+  iter->curr = NULL;
+}
 
 eb_e eb_init(eb_t ** ptr_buf)
 {
@@ -19,13 +258,21 @@ eb_e eb_init(eb_t ** ptr_buf)
   if(!ptr_buf) return EB_NULL_PTR;
 
   /* allocate memory */
-  *ptr_buf = (eb_t *)malloc(sizeof(eb_t));
-  if(!(*ptr_buf)) return EB_MALLOC_FAILED;
+  *ptr_buf = (eb_t *)arena_alloc(ARENA_POOL_EB);
+  if(!(*ptr_buf)) return EB_ALLOC_FAILED;
 
   /* initialize */
   (*ptr_buf)->head = NULL;
   (*ptr_buf)->tail = NULL;
   (*ptr_buf)->count = 0;
+  (*ptr_buf)->num_blocks = 0;
+  memset((*ptr_buf)->lane_head, 0, sizeof((*ptr_buf)->lane_head));
+  memset((*ptr_buf)->lane_tail, 0, sizeof((*ptr_buf)->lane_tail));
+  (*ptr_buf)->lane_map = 0;
+  (*ptr_buf)->thin_prev = NULL;
+  (*ptr_buf)->policy = EB_OVERWRITE_OLDEST;
+  (*ptr_buf)->pinned = 0;
+  (*ptr_buf)->evicted = 0;
 
   return EB_SUCCESS;
 }
@@ -33,13 +280,13 @@ eb_e eb_init(eb_t ** ptr_buf)
 eb_e eb_free(eb_t ** ptr_buf)
 {
   /* check inputs */
-  if(!ptr_buf) return EB_NULL_PTR;
+  if(!ptr_buf || !(*ptr_buf)) return EB_NULL_PTR;
 
   /* delete members */
   event_t temp;
   while((*ptr_buf)->tail) eb_remove_item(*ptr_buf, &temp);
 
-  free(*ptr_buf);
+  arena_free(ARENA_POOL_EB, *ptr_buf);
   *ptr_buf = NULL;
 
   return EB_SUCCESS;
@@ -48,25 +295,47 @@ eb_e eb_free(eb_t ** ptr_buf)
 eb_e eb_add_item(eb_t * buf, event_t * ptr_data)
 {
   /* check inputs */
-  if(!buf) return EB_NULL_PTR;
+  if(!buf || !ptr_data) return EB_NULL_PTR;
 
   /* create member */
-  ll_event_t * ptr_event = (ll_event_t *)malloc(sizeof(ll_event_t));
-  if(!ptr_event) return EB_MALLOC_FAILED;
+  uint32_t crc = CRC32_FINAL(crc32_update(CRC32_INIT, (uint8_t *)ptr_data, sizeof(event_t)));
+  ll_event_t * ptr_event = (ll_event_t *)arena_alloc(ARENA_POOL_EVENT);
+
+  BEGIN_CRITICAL_SECTION();
+
+  /* log full, the retention policy picks an event to give up its place */
+  if(!ptr_event)
+  {
+    if(buf->pinned || !buf->tail)
+    {
+      END_CRITICAL_SECTION();
+      return EB_ALLOC_FAILED;
+    }
+
+    buf->evicted++;
+    ptr_event = eb_evict(buf, ptr_data);
+    if(!ptr_event)
+    {
+      END_CRITICAL_SECTION();
+      return EB_EVICTED;
+    }
+    TRACE2(TRC_EVENT_EVICTED, ptr_event->event.event_type, buf->policy);
+  }
 
   memcpy(&ptr_event->event, ptr_data, sizeof(event_t));
+  ptr_event->crc = crc;
   ptr_event->next = NULL;
 
-  BEGIN_CRITICAL_SECTION();
-
   /* place new data at head */
   ptr_event->prev = buf->head;
-  buf->head->next = ptr_event;
+  if(buf->head) buf->head->next = ptr_event;
   buf->head = ptr_event;
 
   if(!buf->tail) buf->tail = ptr_event;
 
   buf->count++;
+  eb_lane_append(buf, ptr_event);
+  eb_index_add(buf, ptr_event);
 
   END_CRITICAL_SECTION();
 
@@ -76,7 +345,7 @@ eb_e eb_add_item(eb_t * buf, event_t * ptr_data)
 eb_e eb_remove_item(eb_t * buf, event_t * ptr_data)
 {
   /* check inputs */
-  if(!buf) return EB_NULL_PTR;
+  if(!buf || !ptr_data) return EB_NULL_PTR;
   /* check empty */
   if(!buf->tail) return EB_EMPTY;
 
@@ -84,21 +353,18 @@ eb_e eb_remove_item(eb_t * buf, event_t * ptr_data)
 
   /* copy from tail */
   memcpy(ptr_data, &buf->tail->event, sizeof(event_t));
+  eb_e status = eb_check_item(buf->tail);
 
-  /* remove member */
+  /* remove member, the oldest event is also the oldest in its lane */
   ll_event_t * rem = buf->tail;
-  buf->tail = rem->next;
-
-  if(rem->next) rem->next->prev = NULL;
-  else buf->head = NULL;
-
-  buf->count--;
+  eb_lane_remove(buf, eb_lane(buf, &rem->event), NULL);
+  eb_unlink(buf, rem);
 
   END_CRITICAL_SECTION();
 
-  free( (void *)rem );
+  arena_free(ARENA_POOL_EVENT, rem);
 
-  return EB_SUCCESS;
+  return status;
 }
 
 eb_e eb_seek_item(eb_t * buf, event_t * ptr_data, uint32_t idx)
@@ -114,11 +380,134 @@ eb_e eb_seek_item(eb_t * buf, event_t * ptr_data, uint32_t idx)
   ll_event_t * curr = buf->tail;
   for(i = 0; i < idx && curr->next; curr = curr->next, i++);
 
-  if(i != idx) return EB_EMPTY;
+  if(i != idx)
+  {
+    END_CRITICAL_SECTION();
+    return EB_EMPTY;
+  }
 
   memcpy(ptr_data, &curr->event, sizeof(event_t));
+  eb_e status = eb_check_item(curr);
+
+  END_CRITICAL_SECTION();
+
+  return status;
+}
+
+eb_e eb_set_policy(eb_t * buf, eb_policy_e policy)
+{
+  /* check inputs */
+  if(!buf) return EB_NULL_PTR;
+  if(policy >= EB_NUM_POLICIES) policy = EB_OVERWRITE_OLDEST;
+
+  BEGIN_CRITICAL_SECTION();
+
+  /* lanes depend on the policy, sort the log into the new ones */
+  buf->policy = policy;
+  memset(buf->lane_head, 0, sizeof(buf->lane_head));
+  memset(buf->lane_tail, 0, sizeof(buf->lane_tail));
+  buf->lane_map = 0;
+  buf->thin_prev = NULL;
+
+  ll_event_t * curr;
+  for(curr = buf->tail; curr; curr = curr->next) eb_lane_append(buf, curr);
+
+  END_CRITICAL_SECTION();
+
+  return EB_SUCCESS;
+}
+
+eb_e eb_pin(eb_t * buf, uint8_t pinned)
+{
+  /* check inputs */
+  if(!buf) return EB_NULL_PTR;
+
+  BEGIN_CRITICAL_SECTION();
+  buf->pinned = pinned;
+  END_CRITICAL_SECTION();
+
+  return EB_SUCCESS;
+}
+
+eb_e eb_iter_begin(eb_t * buf, eb_iter_t * iter)
+{
+  /* check inputs */
+  if(!buf || !iter) return EB_NULL_PTR;
+
+  iter->curr = buf->tail;
+  iter->buf = buf;
+  iter->filter = NULL;
 
+  return EB_SUCCESS;
+}
+
+eb_e eb_iter_filter(eb_t * buf, eb_iter_t * iter, const eb_filter_t * filter)
+{
+  /* check inputs */
+  if(!buf || !iter || !filter) return EB_NULL_PTR;
+
+  iter->buf = buf;
+  iter->filter = filter;
+  iter->curr = NULL;
+
+  BEGIN_CRITICAL_SECTION();
+  eb_iter_enter(iter, 0);
   END_CRITICAL_SECTION();
 
   return EB_SUCCESS;
 }
+
+uint32_t eb_iter_count(const eb_iter_t * iter)
+{
+  eb_iter_t next = *iter;
+  const event_t * ptr_event;
+  uint32_t n = 0;
+  eb_e status;
+
+  while((status = eb_iter_next(&next, &ptr_event)) == EB_SUCCESS || status == EB_CORRUPT) n++;
+
+  return n;
+}
+
+eb_e eb_iter_next(eb_iter_t * iter, const event_t ** ptr_event)
+{
+  /* check inputs */
+  if(!iter || !ptr_event) return EB_NULL_PTR;
+  /* check end */
+  if(!iter->curr) return EB_EMPTY;
+
+  if(!iter->filter)
+  {
+    BEGIN_CRITICAL_SECTION();
+
+    ll_event_t * curr = iter->curr;
+    iter->curr = curr->next;
+
+    END_CRITICAL_SECTION();
+
+    *ptr_event = &curr->event;
+
+    return eb_check_item(curr);
+  }
+
+  while(iter->curr)
+  {
+    BEGIN_CRITICAL_SECTION();
+
+    /* crossed into the next block, check it before walking it */
+    if(iter->curr == iter->block_end) eb_iter_enter(iter, iter->block + 1);
+
+    ll_event_t * curr = iter->curr;
+    if(curr) iter->curr = curr->next;
+
+    END_CRITICAL_SECTION();
+
+    if(curr && eb_check_item(curr) == EB_SUCCESS && eb_event_match(&curr->event, iter->filter))
+    {
+      *ptr_event = &curr->event;
+      return EB_SUCCESS;
+    }
+  }
+
+  return EB_EMPTY;
+}
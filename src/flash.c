@@ -0,0 +1,130 @@
+/**
+ * @file flash.c
+ * @brief Erase and program the main flash
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/11
+ */
+
+#include <string.h>
+#include "flash.h"
+
+static flash_e flash_check(uint32_t addr, uint32_t len)
+{
+  if(addr < FLASH_BANK1_BASE || (addr & 3) || (len & 3)) return FLASH_INVALID_PARAM;
+  if(addr + len > FLASH_SECTOR_ADDR(FLASH_NUM_SECTORS)) return FLASH_INVALID_PARAM;
+  if(len && addr / FLASH_SECTOR_LEN != (addr + len - 1) / FLASH_SECTOR_LEN) return FLASH_INVALID_PARAM;
+
+  return FLASH_SUCCESS;
+}
+
+#ifndef HOST_BUILD
+#include "msp.h"
+
+/* programming and erasing stall reads of the bank, but code runs from bank 0 */
+#define FLASH_SECTOR_BIT(addr) (1UL << (((addr) - FLASH_BANK1_BASE) / FLASH_SECTOR_LEN))
+
+flash_e flash_erase(uint32_t addr)
+{
+  flash_e status = flash_check(addr, FLASH_SECTOR_LEN);
+  if(status != FLASH_SUCCESS || (addr % FLASH_SECTOR_LEN)) return FLASH_INVALID_PARAM;
+
+  FLCTL->BANK1_MAIN_WEPROT &= ~FLASH_SECTOR_BIT(addr);
+
+  /* main memory, sector erase */
+  FLCTL->CLRIFG = FLCTL_CLRIFG_ERASE;
+  FLCTL->ERASE_CTLSTAT &= ~(FLCTL_ERASE_CTLSTAT_TYPE_MASK | FLCTL_ERASE_CTLSTAT_MODE);
+  FLCTL->ERASE_SECTADDR = addr;
+  FLCTL->ERASE_CTLSTAT |= FLCTL_ERASE_CTLSTAT_START;
+  while(!(FLCTL->IFG & FLCTL_IFG_ERASE));
+  FLCTL->ERASE_CTLSTAT |= FLCTL_ERASE_CTLSTAT_CLR_STAT;
+
+  FLCTL->BANK1_MAIN_WEPROT |= FLASH_SECTOR_BIT(addr);
+
+  /* erase verify */
+  const uint32_t * ptr = (const uint32_t *)addr;
+  uint32_t i;
+  for(i = 0; i < FLASH_SECTOR_LEN / 4; i++)
+  {
+    if(ptr[i] != 0xFFFFFFFF) return FLASH_ERASE_FAILED;
+  }
+
+  return FLASH_SUCCESS;
+}
+
+flash_e flash_program(uint32_t addr, const void * data, uint32_t len)
+{
+  const uint32_t * src = (const uint32_t *)data;
+  volatile uint32_t * dst = (volatile uint32_t *)addr;
+  uint32_t i;
+
+  flash_e status = flash_check(addr, len);
+  if(status != FLASH_SUCCESS || ((uint32_t)data & 3)) return FLASH_INVALID_PARAM;
+  if(!len) return FLASH_SUCCESS;
+
+  FLCTL->BANK1_MAIN_WEPROT &= ~FLASH_SECTOR_BIT(addr);
+
+  /* immediate word programming with pre and post verify */
+  FLCTL->PRG_CTLSTAT = (FLCTL->PRG_CTLSTAT & ~FLCTL_PRG_CTLSTAT_MODE) |
+                       FLCTL_PRG_CTLSTAT_VER_PRE | FLCTL_PRG_CTLSTAT_VER_PST | FLCTL_PRG_CTLSTAT_ENABLE;
+  for(i = 0; i < len / 4; i++)
+  {
+    FLCTL->CLRIFG = FLCTL_CLRIFG_PRG;
+    dst[i] = src[i];
+    while(!(FLCTL->IFG & FLCTL_IFG_PRG));
+  }
+  FLCTL->PRG_CTLSTAT &= ~FLCTL_PRG_CTLSTAT_ENABLE;
+
+  FLCTL->BANK1_MAIN_WEPROT |= FLASH_SECTOR_BIT(addr);
+
+  return memcmp((const void *)addr, data, len) ? FLASH_PROGRAM_FAILED : FLASH_SUCCESS;
+}
+
+const void * flash_read(uint32_t addr)
+{
+  return (const void *)addr;
+}
+#endif /* HOST_BUILD */
+
+#ifdef HOST_BUILD
+/* bank 1 only, flash_sim_image lets tests corrupt or inspect it */
+static uint8_t flash_image[FLASH_NUM_SECTORS * FLASH_SECTOR_LEN];
+
+uint8_t * flash_sim_image(uint32_t addr)
+{
+  return &flash_image[addr - FLASH_BANK1_BASE];
+}
+
+flash_e flash_erase(uint32_t addr)
+{
+  flash_e status = flash_check(addr, FLASH_SECTOR_LEN);
+  if(status != FLASH_SUCCESS || (addr % FLASH_SECTOR_LEN)) return FLASH_INVALID_PARAM;
+
+  memset(flash_sim_image(addr), 0xFF, FLASH_SECTOR_LEN);
+
+  return FLASH_SUCCESS;
+}
+
+flash_e flash_program(uint32_t addr, const void * data, uint32_t len)
+{
+  const uint8_t * src = (const uint8_t *)data;
+  uint8_t * dst;
+  uint32_t i;
+
+  flash_e status = flash_check(addr, len);
+  if(status != FLASH_SUCCESS) return status;
+
+  /* programming can only clear bits */
+  dst = flash_sim_image(addr);
+  for(i = 0; i < len; i++) dst[i] &= src[i];
+
+  return memcmp(dst, data, len) ? FLASH_PROGRAM_FAILED : FLASH_SUCCESS;
+}
+
+const void * flash_read(uint32_t addr)
+{
+  return flash_sim_image(addr);
+}
+#endif /* HOST_BUILD */
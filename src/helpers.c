@@ -28,6 +28,17 @@ uint8_t * my_reverse(uint8_t * src, uint32_t length)
   return src;
 }
 
+RAMFUNC uint8_t my_checksum(uint8_t seed, uint8_t * ptr, uint32_t length)
+{
+  uint32_t i;
+  for(i = 0; i < length; i++)
+  {
+    seed ^= *(ptr + i);
+  }
+
+  return seed;
+}
+
 uint8_t my_itoa(int32_t data, uint8_t * ptr, uint32_t base)
 {
   if (!ptr || base < 2 || base > 16) {
@@ -24,25 +24,38 @@
 
 #include "msp.h"
 #include <stddef.h>
-#include <stdlib.h>
 #include "adxl345.h"
+#include "aes.h"
+#include "arena.h"
+#include "baud.h"
+#include "bench.h"
 #include "circbuf.h"
+#include "coalesce.h"
+#include "codec.h"
+#include "config.h"
+#include "crc.h"
+#include "detect.h"
 #include "event_buf.h"
 #include "helpers.h"
+#include "monitor.h"
+#include "pack.h"
 #include "packets.h"
 #include "rtc.h"
+#include "seal.h"
 #include "spi.h"
+#include "stream.h"
+#include "summary.h"
+#include "trace.h"
 #include "uart.h"
 
-#define ACC_FLIP_THRESH (0x400)
-#define ACC_TAP_THRESH (0xFF)
-#define ACC_TAP_TIME (0x40)
-
 /* functionality switches */
 #undef CRC_CHECK
 #undef AUTH_CHECK
+#undef SEAL_REQUIRED
+#undef BAUD_SWITCH
 #undef TESTING
 #undef APP_TESTING
+#undef BENCHMARK
 #define DEMO
 
 typedef enum
@@ -52,6 +65,46 @@ typedef enum
   AUTH_CARRIER
 } auth_e;
 
+/* decoded command payload */
+typedef union
+{
+  cmd_init_t init;
+  cmd_dump_t dump;
+  cmd_version_t version;
+  cmd_baud_t baud;
+  cmd_summary_t summary;
+  cmd_query_t query;
+  cmd_stream_t stream;
+  cmd_key_t key;
+  cmd_session_t session;
+} cmd_msg_t;
+
+#define CMD_ALONE (1 << 0) /* never in a batch, it changes the link or nests */
+#define CMD_AUTH (1 << 1) /* starts with an access code */
+
+/*
+ * @brief Command handler, with its limits
+ */
+typedef struct
+{
+  uint8_t pkt_type;
+  uint8_t min_len; /* payload bytes */
+  uint8_t max_len;
+  uint8_t min_version; /* protocol version the link must be at */
+  uint8_t flags; /* CMD_* */
+  void (*run)(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth);
+} cmd_desc_t;
+
+/* traced as each part of startup finishes */
+typedef enum
+{
+  BOOT_MEMORY = 0, /* arena, event log and its stages */
+  BOOT_PERIPHERALS, /* UARTs, SPI and GPIO */
+  BOOT_SENSOR, /* ADXL345 setup */
+  BOOT_CONFIG, /* saved configuration restored, or none found */
+  BOOT_READY /* entering the main loop */
+} boot_phase_e;
+
 static eb_t * ptr_event_buf = NULL;
 static cb_t * ptr_uart_rx_buf = NULL;
 static dev_status_e dev_status = STATUS_UNINITIALIZED;
@@ -62,6 +115,15 @@ static uint8_t track_drops_f = 0;
 static uint8_t track_flips_f = 0;
 static uint8_t tracking_len;
 static uint8_t * tracking = NULL;
+static config_t config;
+static detect_t detect;
+static uint8_t tx_payloads[2][SEAL_BUF_LEN] __attribute__((aligned(4))); /* one is filled while the other goes out */
+static uint8_t tx_slot;
+static aes_ctx_t device_key;
+static uint8_t have_key = 0;
+static seal_t session;
+static uint8_t session_open_f = 0;
+static uint32_t sessions = 0;
 uint8_t pkts_received = 0;
 
 
@@ -97,8 +159,8 @@ void adxl_init()
   spi_write(ADXL_POWER_CTL, 0x08); /* enable measurements */
   spi_write(ADXL_INT_ENABLE, 0x00); /* disable interrupts */
   spi_write(ADXL_INT_MAP, 0x00); /* map all interrupts to INT1 */
-  spi_write(ADXL_THRESH_TAP, ACC_TAP_THRESH); /* set tap threshold */
-  spi_write(ADXL_DUR, ACC_TAP_TIME); /* set tap time */
+  spi_write(ADXL_THRESH_TAP, DETECT_TAP_THRESH); /* set tap threshold */
+  spi_write(ADXL_DUR, DETECT_TAP_DUR); /* set tap time */
   spi_write(ADXL_TAP_AXES, 0x07); /* enable tap detection for all axes */
   spi_write(ADXL_DATA_FORMAT, 0x00); /* set range to 2G */
   spi_write(ADXL_INT_ENABLE, 0x40); /* enable tap interrupts */
@@ -117,44 +179,294 @@ void begin_tracking()
   dev_status = STATUS_TRACKING;
 }
 
+void apply_key()
+{
+  static const uint8_t none[SESSION_KEY_LEN];
+
+  have_key = memcmp(config.key, none, SESSION_KEY_LEN) != 0;
+  if(have_key) aes_init(&device_key, config.key);
+}
+
+void apply_config()
+{
+  /* populate package parameters */
+  package_id = config.package_id;
+  carrier_access_code = config.carrier_access_code;
+  user_access_code = config.user_access_code;
+  track_drops_f = (config.flags & CMD_INIT_TRACK_DROPS) ? 1 : 0;
+  track_flips_f = (config.flags & CMD_INIT_TRACK_FLIPS) ? 1 : 0;
+  tracking_len = config.tracking_len;
+
+  if(!tracking) tracking = (uint8_t *)arena_alloc(ARENA_POOL_TRACKING);
+  memcpy(tracking, config.tracking, tracking_len);
+
+  apply_key();
+
+  coalesce_init(ptr_event_buf, config.coalesce_ms);
+  eb_set_policy(ptr_event_buf, (eb_policy_e)((config.flags & CMD_INIT_POLICY_MASK) >> CMD_INIT_POLICY_SHIFT));
+}
+
+void restore_config()
+{
+  rtc_t now;
+
+  if(config_load(&config) != CONFIG_SUCCESS) return;
+
+  /* the RTC keeps counting through a reset, but not a power loss */
+  now = rtc_get_time();
+  if(now.year < 2000) rtc_init(config.init_time);
+
+  apply_config();
+  begin_tracking();
+}
+
 
 /* Packet Sending Functions */
 
-void send_ack_pkt(ack_e ack)
+#define DUMP_EVENTS_PER_PKT ((PKT_MAX_PAYLOAD - sizeof(res_dump_t)) / CODEC_EVENT_LEN)
+
+_Static_assert(sizeof(res_dump_t) + DUMP_EVENTS_PER_PKT * CODEC_EVENT_LEN <= SEAL_MAX_PAYLOAD, "a full dump can be sealed");
+
+/*
+ * Responses are queued behind the frame going out rather than waited
+ * for, so each one is put together while the last is sent. Frames go
+ * out one at a time, so by the time a buffer comes round again the
+ * frame it held is done.
+ */
+uint8_t * next_tx_payload()
+{
+  tx_slot ^= 1;
+  return tx_payloads[tx_slot];
+}
+
+void send_msg_pkt(uint8_t pkt_type, const void * msg)
 {
-  pkt_t pkt;
-  pkt.type = (ack == ACK) ? PKT_RES_ACK : PKT_RES_NAK;
-  pkt.checksum = pkt.type;
-  pkt.pkt_len = 0;
-  pkt.checksum ^= pkt.pkt_len;
+  uint8_t * payload = next_tx_payload();
+  sg_seg_t seg;
+  uint32_t len;
 
-  bt_send_pkt(&pkt);
+  if(codec_encode(pkt_type, msg, payload, PKT_MAX_PAYLOAD, &len) != CODEC_SUCCESS) return;
+
+  seg.ptr = payload;
+  seg.len = len;
+  bt_send_sg_queue(pkt_type, &seg, 1);
 }
 
-void send_status_pkt()
+void send_ack_pkt(ack_e ack)
 {
-  pkt_t pkt;
-  pkt.type = PKT_RES_STATUS;
-  pkt.checksum = pkt.type;
-  pkt.pkt_len = sizeof(res_status_t);
-  pkt.checksum ^= pkt.pkt_len;
+  send_msg_pkt((ack == ACK) ? PKT_RES_ACK : PKT_RES_NAK, NULL);
+}
 
+void send_status_pkt()
+{
   res_status_t payload;
+  uint32_t evicted = 0;
   payload.package_id = package_id;
   payload.status_code = dev_status;
+  payload.reserved = 0;
+
+  eb_get_evicted(ptr_event_buf, &evicted);
+  payload.evicted = (evicted > 0xFFFF) ? 0xFFFF : evicted;
+  payload.policy = ptr_event_buf->policy;
+  payload.reserved_1 = 0;
+
+  send_msg_pkt(PKT_RES_STATUS, &payload);
+}
 
+void send_stats_pkt()
+{
+  res_stats_t payload;
+  uint16_t used;
   uint8_t i;
-  for(i = 0; i < pkt.pkt_len; i++)
+
+  mon_get_stats(&payload);
+  for(i = 0; i < STATS_NUM_POOLS; i++)
+  {
+    if(arena_get_usage((arena_pool_e)i, &used, &payload.arena_high_water[i]) != AR_SUCCESS)
+    {
+      payload.arena_high_water[i] = 0;
+    }
+  }
+
+  send_msg_pkt(PKT_RES_STATS, &payload);
+}
+
+/* queue a dump or query response, sealed while a session is open; segs may point into buf */
+void send_dump_frame(uint8_t pkt_type, uint8_t * buf, const sg_seg_t * segs, uint8_t num_segs)
+{
+  sg_seg_t seg;
+  uint32_t len;
+
+  /* the loop is held until the last frame is queued, each one is progress */
+  mon_kick();
+
+  if(!session_open_f)
+  {
+    bt_send_sg_queue(pkt_type, segs, num_segs);
+    return;
+  }
+
+  /* never in the clear, a frame that cannot be sealed is left out */
+  if(!seal_frame(&session, pkt_type, segs, num_segs, buf, &len)) return;
+  seg.ptr = buf;
+  seg.len = len;
+  bt_send_sg_queue(PKT_RES_SEALED, &seg, 1);
+}
+
+/* send count events from iter, packed, as PKT_RES_DUMP_PACKED frames */
+void send_packed_events(eb_iter_t * iter, uint32_t count)
+{
+  uint32_t remaining, frames = 0, n, len, pos, room;
+  eb_iter_t sizing;
+  res_dump_t payload;
+  uint8_t * buf;
+  sg_seg_t seg;
+
+  /* sealing takes a few bytes of every packet */
+  room = (session_open_f ? SEAL_MAX_PAYLOAD : PKT_MAX_PAYLOAD) - sizeof(res_dump_t);
+
+  /* size every packet first so each one can say how many follow */
+  sizing = *iter;
+  remaining = count;
+  do
+  {
+    n = pack_count(&sizing, remaining, room);
+    remaining -= n;
+    frames++;
+  } while(remaining && n);
+
+  payload.package_id = package_id;
+  remaining = count;
+  while(frames--)
+  {
+    sizing = *iter;
+    n = pack_count(&sizing, remaining, room);
+    remaining -= n;
+
+    /* encode header then events */
+    payload.num_events = n;
+    payload.frames_left = frames;
+    buf = next_tx_payload();
+    codec_encode(PKT_RES_DUMP_PACKED, &payload, buf, PKT_MAX_PAYLOAD, &pos);
+    len = pack_events(iter, n, buf + pos);
+
+    seg.ptr = buf;
+    seg.len = pos + len;
+    send_dump_frame(PKT_RES_DUMP_PACKED, buf, &seg, 1);
+  }
+}
+
+/* send count events from iter as PKT_RES_DUMP frames */
+void send_events(eb_iter_t * iter, uint32_t count)
+{
+  uint32_t frames, i, n, len;
+  const event_t * ptr_event;
+  res_dump_t payload;
+  uint8_t * buf, * spare;
+  sg_seg_t segs[1 + DUMP_EVENTS_PER_PKT];
+
+  frames = (count + DUMP_EVENTS_PER_PKT - 1) / DUMP_EVENTS_PER_PKT;
+  if(!frames) frames = 1;
+
+  payload.package_id = package_id;
+  while(frames--)
+  {
+    n = (count > DUMP_EVENTS_PER_PKT) ? DUMP_EVENTS_PER_PKT : count;
+    count -= n;
+
+    /* encode header, the rest of the buffer holds any corrupt copies */
+    buf = next_tx_payload();
+    payload.num_events = n;
+    payload.frames_left = frames;
+    codec_encode(PKT_RES_DUMP, &payload, buf, PKT_MAX_PAYLOAD, &len);
+    segs[0].ptr = buf;
+    segs[0].len = len;
+
+    /* point straight at the stored events, their layout matches the wire */
+    for(i = 0; i < n; i++)
+    {
+      spare = buf + len + i * CODEC_EVENT_LEN;
+      switch(eb_iter_next(iter, &ptr_event))
+      {
+        case EB_SUCCESS:
+          segs[1 + i].ptr = (const uint8_t *)ptr_event;
+          break;
+        case EB_CORRUPT:
+          memcpy(spare, ptr_event, CODEC_EVENT_LEN);
+          spare[0] = EVENT_CORRUPT;
+          segs[1 + i].ptr = spare;
+          break;
+        default:
+          /* buffer shrank, should not happen */
+          memset(spare, 0, CODEC_EVENT_LEN);
+          spare[0] = EVENT_CORRUPT;
+          segs[1 + i].ptr = spare;
+          break;
+      }
+      segs[1 + i].len = CODEC_EVENT_LEN;
+    }
+
+    send_dump_frame(PKT_RES_DUMP, buf, segs, 1 + n);
+  }
+}
+
+void send_dump_pkt(auth_e auth, uint8_t encoding)
+{
+  /* return a NAK if not authorized */
+  if(auth == AUTH_UNAUTH || encoding > DUMP_ENC_PACKED)
   {
-    pkt.checksum ^= *((uint8_t *)(&payload) + i);
+    send_ack_pkt(NAK);
+    return;
   }
 
-  pkt.ptr_pkt = (uint8_t *)&payload;
+  uint32_t count = 0;
+  eb_iter_t iter;
+
+  /* events added while dumping go out next time */
+  eb_pin(ptr_event_buf, 1);
+  eb_get_count(ptr_event_buf, &count);
+  eb_iter_begin(ptr_event_buf, &iter);
+
+  if(encoding == DUMP_ENC_PACKED) send_packed_events(&iter, count);
+  else send_events(&iter, count);
 
-  bt_send_pkt(&pkt);
+  /* the last frame may still be reading the log */
+  uart_tx_flush(UART_NUM_BT);
+  eb_pin(ptr_event_buf, 0);
 }
 
-void send_dump_pkt(auth_e auth)
+void send_query_pkt(auth_e auth, const cmd_query_t * query)
+{
+  /* return a NAK if not authorized */
+  if(auth == AUTH_UNAUTH || query->encoding > DUMP_ENC_PACKED)
+  {
+    send_ack_pkt(NAK);
+    return;
+  }
+
+  uint32_t count;
+  eb_iter_t iter;
+  eb_filter_t filter;
+
+  filter.start = query->start;
+  filter.end = query->end;
+  filter.min_data = query->min_data;
+  filter.type_mask = query->type_mask;
+
+  /* count the matches first so each packet can say how many follow */
+  eb_pin(ptr_event_buf, 1);
+  eb_iter_filter(ptr_event_buf, &iter, &filter);
+  count = eb_iter_count(&iter);
+
+  if(query->encoding == DUMP_ENC_PACKED) send_packed_events(&iter, count);
+  else send_events(&iter, count);
+
+  /* the last frame may still be reading the log */
+  uart_tx_flush(UART_NUM_BT);
+  eb_pin(ptr_event_buf, 0);
+}
+
+void send_summary_pkt(auth_e auth)
 {
   /* return a NAK if not authorized */
   if(auth == AUTH_UNAUTH)
@@ -163,42 +475,436 @@ void send_dump_pkt(auth_e auth)
     return;
   }
 
-  uint8_t crc, data, pkt_len;
-  uint32_t count, i, j;
-  event_t event;
-  res_dump_t payload;
+  res_summary_t payload;
+  summary_get(&payload);
+  payload.package_id = package_id;
 
-  /* send header */
-  bt_send(PKT_RES_DUMP);
-  crc = PKT_RES_DUMP;
+  send_msg_pkt(PKT_RES_SUMMARY, &payload);
+}
 
-  eb_get_count(ptr_event_buf, &count);
-  pkt_len = sizeof(res_dump_t) - sizeof(event_t *) + count * sizeof(event_t);
-  bt_send(pkt_len);
-  crc ^= pkt_len;
-
-  /* send payload */
-  bt_send(package_id);
-  crc ^= package_id;
-  bt_send(package_id >> 8);
-  crc ^= package_id >> 8;
-  bt_send(count);
-  crc ^= count;
-  bt_send(0x00);
-
-  /* send events */
-  for(i = 0; i < count; i++)
-  {
-    eb_seek_item(ptr_event_buf, &event, i);
-    for(j = 0; j < sizeof(event_t); j++)
+/* unique to each session, and under the device key so it cannot be guessed */
+void make_nonce(uint8_t * nonce)
+{
+  rtc_t now = rtc_get_time();
+  uint32_t words[AES_BLOCK_LEN / sizeof(uint32_t)];
+
+  words[0] = ++sessions;
+  words[1] = rtc_to_seconds(&now);
+  words[2] = CYCLE_COUNT();
+  words[3] = package_id;
+  aes_encrypt(&device_key, (const uint8_t *)words, nonce);
+}
+
+void send_session_pkt(auth_e auth, const cmd_session_t * cmd)
+{
+  static const uint8_t none[SESSION_NONCE_LEN];
+  res_session_t payload;
+
+  session_open_f = 0;
+
+  /* an all zero nonce just ends the session */
+  if(!memcmp(cmd->nonce, none, SESSION_NONCE_LEN))
+  {
+    send_ack_pkt(ACK);
+    return;
+  }
+
+  /* return a NAK if not authorized or there is no key */
+  if(auth == AUTH_UNAUTH || !have_key)
+  {
+    send_ack_pkt(NAK);
+    return;
+  }
+
+  make_nonce(payload.nonce);
+  seal_derive(&session, &device_key, cmd->nonce, payload.nonce);
+
+  /* the answer goes in the clear, everything after it sealed */
+  send_msg_pkt(PKT_RES_SESSION, &payload);
+  session_open_f = 1;
+}
+
+void send_version_pkt(uint8_t version)
+{
+  res_version_t payload;
+  payload.version = version;
+
+  send_msg_pkt(PKT_RES_VERSION, &payload);
+}
+
+void send_caps_pkt(const cmd_desc_t * cmds, uint32_t num_cmds)
+{
+  res_caps_t payload;
+  uint8_t version = uart_get_proto_version();
+  uint32_t frame, i;
+
+  /* a code byte every full block and a delimiter either side */
+  frame = CODEC_HDR_LEN + PKT_MAX_PAYLOAD + codec_trailer_len(version);
+  if(version >= PROTO_VERSION_COBS) frame += frame / CODEC_COBS_MAX_RUN + 1 + 2;
+
+  payload.proto_max = PROTO_VERSION_MAX;
+  payload.proto_version = version;
+  payload.max_payload = PKT_MAX_PAYLOAD;
+  payload.batch_max = BATCH_MAX_CMDS;
+  payload.max_frame = frame;
+  payload.rx_buf_len = UART_RX_BUF_LEN;
+  payload.log_len = ARENA_EVENT_POOL_LEN;
+  payload.dump_encodings = (1 << DUMP_ENC_RAW) | (1 << DUMP_ENC_PACKED);
+  payload.stream_modes = (1 << STREAM_OFF) | (1 << STREAM_XYZ) | (1 << STREAM_MAG);
+#ifdef BAUD_SWITCH
+  payload.baud_rates = (1 << BAUD_NUM_RATES) - 1;
+#else
+  payload.baud_rates = 1 << uart_get_baud();
+#endif /* BAUD_SWITCH */
+  payload.features = have_key ? CAPS_HAVE_KEY : 0;
+#ifdef AUTH_CHECK
+  payload.features |= CAPS_AUTH_CHECK;
+#endif /* AUTH_CHECK */
+#ifdef CRC_CHECK
+  payload.features |= CAPS_CRC_CHECK;
+#endif /* CRC_CHECK */
+#ifdef SEAL_REQUIRED
+  payload.features |= CAPS_SEAL_REQUIRED;
+#endif /* SEAL_REQUIRED */
+
+  for(i = 0; i < num_cmds; i++)
+  {
+    payload.cmds[i * CAPS_CMD_LEN] = cmds[i].pkt_type;
+    payload.cmds[i * CAPS_CMD_LEN + 1] = cmds[i].min_len;
+    payload.cmds[i * CAPS_CMD_LEN + 2] = cmds[i].max_len;
+    payload.cmds[i * CAPS_CMD_LEN + 3] = cmds[i].min_version;
+  }
+  payload.cmds_len = num_cmds * CAPS_CMD_LEN;
+
+  send_msg_pkt(PKT_RES_CAPS, &payload);
+}
+
+void send_baud_pkt(uint8_t rate)
+{
+  res_baud_t payload;
+  payload.rate = rate;
+
+  send_msg_pkt(PKT_RES_BAUD, &payload);
+}
+
+
+
+/* Packet Receiving Functions */
+
+/* v1 and v2, the type, length and trailer are at known offsets */
+uint8_t read_pkt(uint8_t * pkt_type, uint8_t * pkt_len, uint8_t * pkt, ack_e * ack)
+{
+  uint8_t pkt_crc, crc_check;
+  uint32_t pkt_crc32, crc32_check, i;
+
+  /* first byte is the packet type */
+  cb_remove_item(ptr_uart_rx_buf, pkt_type);
+  crc_check = *pkt_type;
+  crc32_check = crc32_update(CRC32_INIT, pkt_type, 1);
+
+  /* second byte is the payload len */
+  cb_remove_item(ptr_uart_rx_buf, pkt_len);
+  crc_check ^= *pkt_len;
+  crc32_check = crc32_update(crc32_check, pkt_len, 1);
+  TRACE2(TRC_PKT_RX, *pkt_type, *pkt_len);
+
+  /* get payload */
+  for(i = 0; i < *pkt_len; i++)
+  {
+    cb_remove_item(ptr_uart_rx_buf, &pkt[i]);
+  }
+  crc_check = my_checksum(crc_check, pkt, *pkt_len);
+
+  /* get and check crc */
+  if(uart_get_proto_version() >= PROTO_VERSION_CRC32)
+  {
+    pkt_crc32 = 0;
+    for(i = 0; i < sizeof(uint32_t); i++)
+    {
+      cb_remove_item(ptr_uart_rx_buf, &pkt_crc);
+      pkt_crc32 |= (uint32_t)pkt_crc << (8 * i);
+    }
+    crc32_check = CRC32_FINAL(crc32_update(crc32_check, pkt, *pkt_len));
+    *ack = (crc32_check == pkt_crc32) ? ACK : NAK;
+  }
+  else
+  {
+    cb_remove_item(ptr_uart_rx_buf, &pkt_crc);
+#ifdef CRC_CHECK
+    *ack = (crc_check == pkt_crc) ? ACK : NAK;
+#else
+    *ack = ACK;
+#endif /* CRC_CHECK */
+  }
+
+  if(*ack == NAK) TRACE2(TRC_PKT_BAD_CRC, *pkt_type, pkt_crc);
+
+  return 1;
+}
+
+/* v3, decode up to the next delimiter, returns 0 for an empty frame */
+uint8_t read_cobs_pkt(uint8_t * pkt_type, uint8_t * pkt_len, uint8_t * pkt, ack_e * ack)
+{
+  cobs_dec_t dec;
+  uint8_t hdr[CODEC_HDR_LEN] = { 0 };
+  uint8_t in, out;
+  uint32_t n = 0, pkt_crc32 = 0, crc32_check;
+
+  codec_cobs_init(&dec);
+  while(cb_remove_item(ptr_uart_rx_buf, &in) == CB_SUCCESS && in != CODEC_COBS_DELIM)
+  {
+    if(!codec_cobs_byte(&dec, in, &out)) continue;
+
+    if(n < CODEC_HDR_LEN) hdr[n] = out;
+    else if(n < CODEC_HDR_LEN + hdr[1]) pkt[n - CODEC_HDR_LEN] = out;
+    else if(n < CODEC_HDR_LEN + hdr[1] + sizeof(uint32_t))
     {
-      data = *((uint8_t *)&event + j);
-      bt_send(data);
-      crc ^= data;
+      pkt_crc32 |= (uint32_t)out << (8 * (n - CODEC_HDR_LEN - hdr[1]));
     }
+    n++;
+  }
+
+  /* nothing between two delimiters */
+  if(n == 0) return 0;
+
+  *pkt_type = hdr[0];
+  *pkt_len = hdr[1];
+  TRACE2(TRC_PKT_RX, *pkt_type, *pkt_len);
+
+  /* a frame cut short or run into the next one fails here */
+  crc32_check = CRC32_FINAL(crc32_update(crc32_update(CRC32_INIT, hdr, CODEC_HDR_LEN), pkt, *pkt_len));
+  *ack = (codec_cobs_done(&dec) && n == CODEC_HDR_LEN + *pkt_len + sizeof(uint32_t) &&
+          crc32_check == pkt_crc32) ? ACK : NAK;
+
+  if(*ack == NAK) TRACE2(TRC_PKT_BAD_CRC, *pkt_type, pkt_crc32);
+
+  return 1;
+}
+
+
+/* Command Handling */
+
+void run_batch(const uint8_t * pkt, uint8_t pkt_len);
+
+auth_e cmd_auth(uint8_t access_code)
+{
+#ifdef AUTH_CHECK
+  return ( access_code == carrier_access_code ) ? AUTH_CARRIER :
+         ( access_code == user_access_code ) ? AUTH_USER : AUTH_UNAUTH;
+#else
+  return AUTH_CARRIER;
+#endif /* AUTH_CHECK */
+}
+
+void handle_status(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  send_status_pkt();
+}
+
+void handle_init(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  ack_e ack = ACK;
+
+  /* the key was set before the init, and stays */
+  memset(&config, 0, offsetof(config_t, key));
+  config.package_id = cmd->init.package_id;
+  config.coalesce_ms = cmd->init.coalesce_ms;
+  config.carrier_access_code = cmd->init.carrier_access_code;
+  config.user_access_code = cmd->init.user_access_code;
+  config.flags = cmd->init.flags;
+  config.tracking_len = cmd->init.tracking_len;
+  memcpy(config.tracking, cmd->init.tracking, cmd->init.tracking_len);
+  config.init_time = cmd->init.time;
+
+  rtc_init(cmd->init.time);
+  apply_config();
+
+  /* resume from here after a reset */
+  if(config_save(&config) != CONFIG_SUCCESS) ack = NAK;
+
+  /* a new shipment, the last trip's aggregates do not carry over */
+  summary_init();
+  begin_tracking();
+  send_ack_pkt(ack);
+}
+
+void handle_dump(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+#ifdef SEAL_REQUIRED
+  /* the log only leaves the board encrypted */
+  if(!session_open_f) auth = AUTH_UNAUTH;
+#endif /* SEAL_REQUIRED */
+  send_dump_pkt(auth, cmd->dump.encoding);
+}
+
+void handle_stats(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  send_stats_pkt();
+}
+
+void handle_version(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  uint8_t version = cmd->version.version;
+
+  if(version > PROTO_VERSION_MAX) version = PROTO_VERSION_MAX;
+  if(version < PROTO_VERSION_XOR) version = PROTO_VERSION_XOR;
+
+  /* answer with the old framing, then switch */
+  send_version_pkt(version);
+  uart_set_proto_version(version);
+}
+
+void handle_baud(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+#ifdef BAUD_SWITCH
+  if(baud_confirming())
+  {
+    send_ack_pkt(baud_confirm(cmd->baud.rate) ? ACK : NAK);
+  }
+  else if(stream_active() || !baud_start(cmd->baud.rate))
+  {
+    send_ack_pkt(NAK);
+  }
+#else
+  /* the HC-06 ignores AT commands while the phone is connected */
+  send_ack_pkt(NAK);
+#endif /* BAUD_SWITCH */
+}
+
+void handle_summary(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  send_summary_pkt(auth);
+}
+
+void handle_query(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+#ifdef SEAL_REQUIRED
+  if(!session_open_f) auth = AUTH_UNAUTH;
+#endif /* SEAL_REQUIRED */
+  send_query_pkt(auth, &cmd->query);
+}
+
+void handle_stream(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  ack_e ack = ACK;
+
+  if(auth == AUTH_UNAUTH) ack = NAK;
+  else if(!stream_start(cmd->stream.mode, cmd->stream.rate, cmd->stream.decimation)) ack = NAK;
+  send_ack_pkt(ack);
+}
+
+void handle_batch(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  run_batch(pkt, pkt_len);
+}
+
+void handle_key(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  /* set at the depot, never once tracking */
+  if(dev_status == STATUS_TRACKING)
+  {
+    send_ack_pkt(NAK);
+    return;
   }
+  memcpy(config.key, cmd->key.key, SESSION_KEY_LEN);
+  apply_key();
+  session_open_f = 0;
+  send_ack_pkt(ACK);
+}
+
+void handle_session(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  send_session_pkt(auth, &cmd->session);
+}
+
+void handle_caps(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth);
+
+/*
+ * Every command the board runs, listed as they are in PKT_RES_CAPS.
+ * Lengths are payload bytes on the wire. A key is only taken over a
+ * link with a CRC32 trailer, a corrupted one would be saved.
+ */
+static const cmd_desc_t cmd_table[] =
+{
+  { PKT_CMD_STATUS, 0, 0, PROTO_VERSION_XOR, 0, handle_status },
+  { PKT_CMD_INIT, CMD_INIT_FIXED_LEN, PKT_MAX_PAYLOAD, PROTO_VERSION_XOR, 0, handle_init },
+  { PKT_CMD_DUMP, 1, 2, PROTO_VERSION_XOR, CMD_AUTH, handle_dump },
+  { PKT_CMD_STATS, 0, 0, PROTO_VERSION_XOR, 0, handle_stats },
+  { PKT_CMD_VERSION, 1, 1, PROTO_VERSION_XOR, CMD_ALONE, handle_version },
+  { PKT_CMD_BAUD, 1, 1, PROTO_VERSION_XOR, CMD_ALONE, handle_baud },
+  { PKT_CMD_SUMMARY, 1, 1, PROTO_VERSION_XOR, CMD_AUTH, handle_summary },
+  { PKT_CMD_QUERY, 16, 16, PROTO_VERSION_XOR, CMD_AUTH, handle_query },
+  { PKT_CMD_STREAM, 4, 4, PROTO_VERSION_XOR, CMD_AUTH, handle_stream },
+  { PKT_CMD_BATCH, 0, PKT_MAX_PAYLOAD, PROTO_VERSION_XOR, CMD_ALONE, handle_batch },
+  { PKT_CMD_KEY, SESSION_KEY_LEN, SESSION_KEY_LEN, PROTO_VERSION_CRC32, 0, handle_key },
+  { PKT_CMD_SESSION, 1, 1 + SESSION_NONCE_LEN, PROTO_VERSION_XOR, CMD_AUTH, handle_session },
+  { PKT_CMD_CAPS, 0, 0, PROTO_VERSION_XOR, 0, handle_caps }
+};
+
+#define NUM_CMDS (sizeof(cmd_table) / sizeof(cmd_table[0]))
+
+_Static_assert(NUM_CMDS <= CAPS_MAX_CMDS, "every command fits PKT_RES_CAPS");
+
+void handle_caps(const cmd_msg_t * cmd, const uint8_t * pkt, uint8_t pkt_len, auth_e auth)
+{
+  send_caps_pkt(cmd_table, NUM_CMDS);
+}
 
-  bt_send(crc);
+const cmd_desc_t * find_cmd(uint8_t pkt_type)
+{
+  uint32_t i;
+  for(i = 0; i < NUM_CMDS; i++)
+  {
+    if(cmd_table[i].pkt_type == pkt_type) return &cmd_table[i];
+  }
+
+  return NULL;
+}
+
+/* decode and carry out one command, in_batch if it came in a batch */
+void run_cmd(uint8_t pkt_type, const uint8_t * pkt, uint8_t pkt_len, uint8_t in_batch)
+{
+  static cmd_msg_t cmd;
+  const cmd_desc_t * desc = find_cmd(pkt_type);
+
+  /* unknown, outside its limits, ahead of the link, or changes the link in a batch */
+  if(!desc || pkt_len < desc->min_len || pkt_len > desc->max_len ||
+     uart_get_proto_version() < desc->min_version || (in_batch && (desc->flags & CMD_ALONE)))
+  {
+    send_ack_pkt(NAK);
+    return;
+  }
+
+  /* decode payload */
+  memset(&cmd, 0, sizeof(cmd));
+  if(codec_decode(pkt_type, pkt, pkt_len, &cmd) != CODEC_SUCCESS)
+  {
+    send_ack_pkt(NAK);
+    return;
+  }
+
+  /* the access code comes first in every command that has one */
+  desc->run(&cmd, pkt, pkt_len, (desc->flags & CMD_AUTH) ? cmd_auth(pkt[0]) : AUTH_UNAUTH);
+}
+
+/* run every command in a batch, in order, or NAK the lot if it is malformed */
+void run_batch(const uint8_t * pkt, uint8_t pkt_len)
+{
+  cmd_batch_t batch;
+  const uint8_t * payload;
+  uint8_t pkt_type, len;
+  uint32_t pos = 0;
+
+  if(codec_batch_parse(pkt, pkt_len, &batch) != CODEC_SUCCESS)
+  {
+    send_ack_pkt(NAK);
+    return;
+  }
+
+  if(!batch.num_cmds) send_ack_pkt(ACK);
+
+  /* each response is queued behind the last, so they go out back to back */
+  while(codec_batch_next(&batch, &pos, &pkt_type, &payload, &len)) run_cmd(pkt_type, payload, len, 1);
 }
 
 
@@ -262,8 +968,7 @@ void PORT1_IRQHandler()
     track_flips_f = 1;
     tracking_len = 18;
 
-    if(tracking) free( (void *)tracking );
-    tracking = (uint8_t *)malloc(tracking_len);
+    if(!tracking) tracking = (uint8_t *)arena_alloc(ARENA_POOL_TRACKING);
     memcpy(tracking, "1ZA807T70336134832", tracking_len);
 
     rtc_t rtc;
@@ -308,7 +1013,7 @@ void PORT1_IRQHandler()
 }
 #endif /* TESTING */
 
-void PORT4_IRQHandler()
+RAMFUNC void PORT4_IRQHandler()
 {
   if(P4->IFG & BIT0)
   {
@@ -322,7 +1027,7 @@ void PORT4_IRQHandler()
     spi_read(ADXL_INT_SOURCE);
     P4->IFG &= ~(BIT4);
 
-    if(track_drops_f) eb_new_event(ptr_event_buf, EVENT_DROP, 0);
+    if(track_drops_f) coalesce_trigger(EVENT_DROP, adxl_get_peak());
   }
   if(P4->IFG & BIT5)
   {
@@ -330,8 +1035,15 @@ void PORT4_IRQHandler()
   }
 }
 
-void EUSCIA2_IRQHandler()
+RAMFUNC void EUSCIA2_IRQHandler()
 {
+  /* transmit engine */
+  if((EUSCI_A2->IE & EUSCI_A_IE_TXIE) && (EUSCI_A2->IFG & EUSCI_A_IFG_TXIFG))
+  {
+    uart_tx_isr(UART_NUM_BT);
+  }
+  if(!(EUSCI_A2->IFG & EUSCI_A_IFG_RXIFG)) return;
+
   /* clear interrupt */
   EUSCI_A2->IFG &= ~EUSCI_A_IFG_RXIFG;
 
@@ -340,9 +1052,31 @@ void EUSCIA2_IRQHandler()
 
   bt_send(data);
 #else
-  static uint8_t mid_pkt = 0, byte_count, payload_len;
+  static uint8_t mid_pkt = 0, payload_len;
+  static uint16_t byte_count; /* a full CRC32 frame is past 255 */
 
+  /* reading RXBUF clears the error flags */
+  uint8_t rx_err = EUSCI_A2->STATW & EUSCI_A_STATW_RXERR;
   uint8_t data = EUSCI_A2->RXBUF;
+
+  /* drop bytes garbled by a rate change, and module replies */
+  if(rx_err || baud_rx(data)) return;
+
+  /* v3 frames end at a delimiter, so any lost byte costs one frame */
+  if(uart_get_proto_version() >= PROTO_VERSION_COBS)
+  {
+    if(cb_add_item(ptr_uart_rx_buf, &data) != CB_SUCCESS)
+    {
+      /* frame longer than the ring, drop it and start again at the next delimiter */
+      if(!pkts_received) cb_clear(ptr_uart_rx_buf);
+    }
+    else if(data == CODEC_COBS_DELIM)
+    {
+      pkts_received++;
+    }
+    return;
+  }
+
   cb_add_item(ptr_uart_rx_buf, &data);
 
   /* do a bit of processing to simplify main */
@@ -356,7 +1090,7 @@ void EUSCIA2_IRQHandler()
     payload_len = data;
     byte_count++;
   }
-  else if(byte_count == 2 + payload_len)
+  else if(byte_count == 1 + payload_len + uart_trailer_len())
   {
     mid_pkt = 0;
     pkts_received++;
@@ -373,18 +1107,32 @@ void EUSCIA2_IRQHandler()
 
 void main(void)
 {
-  WDT_A->CTL = WDT_A_CTL_PW | WDT_A_CTL_HOLD; /* stop watchdog timer */
+  WDT_A->CTL = WDT_A_CTL_PW | WDT_A_CTL_HOLD; /* stop watchdog timer until setup is done */
 
+  arena_init();
+  trace_init();
+  TRACE0(TRC_BOOT);
   eb_init(&ptr_event_buf);
+  summary_init();
+  coalesce_init(ptr_event_buf, 0);
+  TRACE1(TRC_BOOT_PHASE, BOOT_MEMORY);
   uart_init(&ptr_uart_rx_buf);
   spi_init();
   gpio_init();
+  TRACE1(TRC_BOOT_PHASE, BOOT_PERIPHERALS);
   adxl_init();
+  TRACE1(TRC_BOOT_PHASE, BOOT_SENSOR);
+  restore_config();
+  TRACE1(TRC_BOOT_PHASE, BOOT_CONFIG);
 
 #if defined TESTING || defined DEMO
   add_mock_events();
 #endif
 
+#ifdef BENCHMARK
+  bench_run();
+#endif
+
 #ifdef APP_TESTING
   while(1)
   {
@@ -396,110 +1144,70 @@ void main(void)
 
   /* main control loop */
   ack_e ack;
-  auth_e auth;
-  uint8_t pkt_type, pkt_len, pkt_crc, crc_check;
+  uint8_t pkt_type, pkt_len, have_pkt;
   uint8_t * pkt = NULL;
   int16_t acc_z;
-  uint32_t flip_count = 0, i;
-  cmd_init_t * ptr_init_pkt = NULL;
+
+  detect_init(&detect);
+  mon_init();
+  TRACE1(TRC_BOOT_PHASE, BOOT_READY);
 
   while(1)
   {
-    /* sense flips */
+    mon_loop();
+    mon_feed();
+
+    /* send pending trace records */
+    trace_drain();
+
+    /* step baud rate negotiation */
+    switch(baud_poll())
+    {
+      case BAUD_SWITCHED:
+        send_baud_pkt(uart_get_baud());
+        break;
+      case BAUD_FAILED:
+        send_ack_pkt(NAK);
+        break;
+      default:
+        break;
+    }
+
+    /* stream samples, and send them if the link is free */
+    stream_poll();
+
+    /* sense flips, the stream owns the FIFO while it runs */
     if(track_flips_f)
     {
-      acc_z = adxl_get_z();
-      if(acc_z > 0)
-      {
-        flip_count++;
-        if(flip_count == ACC_FLIP_THRESH)
-        {
-          eb_new_event(ptr_event_buf, EVENT_FLIP, 0);
-        }
-      }
-      else
-      {
-        flip_count = 0;
-      }
+      if(!stream_get_z(&acc_z)) acc_z = adxl_get_z();
+      if(detect_flip(&detect, acc_z)) coalesce_trigger(EVENT_FLIP, acc_z);
     } /* if(track_flips_f) */
+    coalesce_poll();
+    mon_task_serviced(MON_TASK_SENSE);
 
     /* handle received packets */
+    mon_task_serviced(MON_TASK_RX);
     if(pkts_received)
     {
-      pkts_received--;
-
-      /* first byte is the packet type */
-      cb_remove_item(ptr_uart_rx_buf, &pkt_type);
-      crc_check = pkt_type;
+      pkt = (uint8_t *)arena_alloc(ARENA_POOL_PAYLOAD);
+      if(uart_get_proto_version() >= PROTO_VERSION_COBS) have_pkt = read_cobs_pkt(&pkt_type, &pkt_len, pkt, &ack);
+      else have_pkt = read_pkt(&pkt_type, &pkt_len, pkt, &ack);
 
-      /* second byte is the payload len */
-      cb_remove_item(ptr_uart_rx_buf, &pkt_len);
-      crc_check ^= pkt_len;
+      BEGIN_CRITICAL_SECTION();
+      pkts_received--;
+      END_CRITICAL_SECTION();
 
-      /* get payload */
-      pkt = (uint8_t *)malloc(pkt_len);
-      for(i = 0; i < pkt_len; i++)
+      if(!have_pkt)
       {
-        cb_remove_item(ptr_uart_rx_buf, &pkt[i]);
-        crc_check ^= pkt[i];
+        arena_free(ARENA_POOL_PAYLOAD, pkt);
+        continue;
       }
 
-      /* get and check crc */
-      cb_remove_item(ptr_uart_rx_buf, &pkt_crc);
-#ifdef CRC_CHECK
-      ack = (crc_check == pkt_crc) ? ACK : NAK;
-#else
-      ack = ACK;
-#endif /* CRC_CHECK */
-      
       /* handle packets */
-      if(ack == ACK)
-      {
-        switch(pkt_type)
-        {
-          case PKT_CMD_STATUS:
-            send_status_pkt();
-            break;
-          case PKT_CMD_INIT:
-            ptr_init_pkt = (cmd_init_t *)pkt;
-
-            /* populate package parameters */
-            package_id = ptr_init_pkt->package_id;
-            carrier_access_code = ptr_init_pkt->carrier_access_code;
-            user_access_code = ptr_init_pkt->user_access_code;
-            track_drops_f = ptr_init_pkt->track_drops;
-            track_flips_f = ptr_init_pkt->track_flips;
-            tracking_len = ptr_init_pkt->tracking_len;
-
-            if(tracking) free( (void *)tracking );
-            tracking = (uint8_t *)malloc(tracking_len);
-            memcpy(tracking, &ptr_init_pkt->tracking, tracking_len);
-
-            rtc_init(ptr_init_pkt->time);
-
-            begin_tracking();
-            send_ack_pkt(ack);
-            break;
-          case PKT_CMD_DUMP:
-#ifdef AUTH_CHECK
-            auth = ( ((cmd_dump_t *)pkt)->access_code == carrier_access_code ) ? AUTH_CARRIER :
-                   ( ((cmd_dump_t *)pkt)->access_code == user_access_code ) ? AUTH_USER : AUTH_UNAUTH;
-#else
-            auth = AUTH_CARRIER;
-#endif /* AUTH_CHECK */
-            send_dump_pkt(auth);
-            break;
-          default:
-            send_ack_pkt(NAK);
-            break;
-        } /* switch(pkt_type) */
-      }
-      else
-      {
-        send_ack_pkt(ack);
-      } /* if(ack == ACK) */
+      if(ack == ACK) run_cmd(pkt_type, pkt, pkt_len, 0);
+      else send_ack_pkt(ack);
 
-      free( (void *)pkt );
+      arena_free(ARENA_POOL_PAYLOAD, pkt);
 
     } /* if(pkt_received_f) */
   }
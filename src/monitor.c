@@ -0,0 +1,94 @@
+/**
+ * @file monitor.c
+ * @brief Main loop latency monitor and deadline watchdog
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/05
+ */
+
+#include "msp.h"
+#include "helpers.h"
+#include "packets.h"
+#include "monitor.h"
+
+static const uint32_t deadlines[MON_NUM_TASKS] =
+{
+  MON_SENSE_DEADLINE,
+  MON_RX_DEADLINE
+};
+
+static uint32_t loop_start;
+static uint32_t max_latency;
+static uint32_t latency_hist[MON_HIST_BINS];
+static uint32_t last_serviced[MON_NUM_TASKS];
+static uint32_t deadline_misses[MON_NUM_TASKS];
+
+void mon_init()
+{
+  uint32_t i;
+
+  loop_start = CYCLE_COUNT();
+  max_latency = 0;
+  for(i = 0; i < MON_HIST_BINS; i++) latency_hist[i] = 0;
+  for(i = 0; i < MON_NUM_TASKS; i++)
+  {
+    last_serviced[i] = loop_start;
+    deadline_misses[i] = 0;
+  }
+
+  /* start watchdog */
+  WDT_A->CTL = MON_WDT_CONFIG | WDT_A_CTL_CNTCL;
+}
+
+void mon_loop()
+{
+  uint32_t now = CYCLE_COUNT();
+  uint32_t latency = now - loop_start;
+  int32_t bin;
+
+  loop_start = now;
+  if(latency > max_latency) max_latency = latency;
+
+  /* log2 bin, clamped to the ends of the histogram */
+  bin = (32 - __CLZ(latency)) - MON_HIST_SHIFT;
+  if(bin < 0) bin = 0;
+  if(bin >= MON_HIST_BINS) bin = MON_HIST_BINS - 1;
+  latency_hist[bin]++;
+}
+
+void mon_task_serviced(mon_task_e task)
+{
+  uint32_t now = CYCLE_COUNT();
+
+  if(now - last_serviced[task] > deadlines[task]) deadline_misses[task]++;
+  last_serviced[task] = now;
+}
+
+void mon_feed()
+{
+  uint32_t now = CYCLE_COUNT();
+  uint32_t i;
+
+  for(i = 0; i < MON_NUM_TASKS; i++)
+  {
+    if(now - last_serviced[i] > deadlines[i]) return;
+  }
+
+  WDT_A->CTL = MON_WDT_CONFIG | WDT_A_CTL_CNTCL;
+}
+
+void mon_kick()
+{
+  WDT_A->CTL = MON_WDT_CONFIG | WDT_A_CTL_CNTCL;
+}
+
+void mon_get_stats(res_stats_t * ptr_stats)
+{
+  uint32_t i;
+
+  ptr_stats->max_latency = max_latency;
+  for(i = 0; i < MON_HIST_BINS; i++) ptr_stats->latency_hist[i] = latency_hist[i];
+  for(i = 0; i < MON_NUM_TASKS; i++) ptr_stats->deadline_misses[i] = deadline_misses[i];
+}
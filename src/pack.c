@@ -0,0 +1,180 @@
+/**
+ * @file pack.c
+ * @brief Packed event encoding for dumps
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/09
+ */
+
+#include "helpers.h"
+#include "event_buf.h"
+#include "pack.h"
+#include "packets.h"
+#include "rtc.h"
+
+/* stands in for an event that went missing between passes */
+static const event_t pack_missing;
+
+static uint8_t pack_next(eb_iter_t * iter, const event_t ** ptr_event, uint8_t * type)
+{
+  eb_e status = eb_iter_next(iter, ptr_event);
+
+  if(status == EB_SUCCESS)
+  {
+    switch((*ptr_event)->event_type)
+    {
+      case EVENT_DROP: *type = PACK_TYPE_DROP; break;
+      case EVENT_FLIP: *type = PACK_TYPE_FLIP; break;
+      case EVENT_CORRUPT: *type = PACK_TYPE_CORRUPT; break;
+      default: *type = PACK_TYPE_OTHER; break;
+    }
+    return 1;
+  }
+
+  *type = PACK_TYPE_CORRUPT;
+  if(status == EB_CORRUPT) return 1;
+
+  *ptr_event = &pack_missing;
+  return 0;
+}
+
+static uint32_t pack_reserved(const event_t * event)
+{
+  return event->reserved[0] | (event->reserved[1] << 8) | (event->reserved[2] << 16);
+}
+
+static uint32_t pack_zigzag(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static uint32_t pack_varint_len(uint32_t value)
+{
+  uint32_t len = 1;
+  while(value >= 0x80)
+  {
+    value >>= 7;
+    len++;
+  }
+
+  return len;
+}
+
+static uint32_t pack_varint(uint8_t * out, uint32_t value)
+{
+  uint32_t len = 0;
+  while(value >= 0x80)
+  {
+    out[len++] = value | 0x80;
+    value >>= 7;
+  }
+  out[len++] = value;
+
+  return len;
+}
+
+uint32_t pack_count(eb_iter_t * iter, uint32_t max_events, uint32_t cap)
+{
+  eb_iter_t next = *iter;
+  const event_t * event;
+  uint8_t type;
+  uint32_t n = 0, varints = 0, cost, secs, prev = 0, reserved;
+
+  if(max_events > PACK_MAX_EVENTS) max_events = PACK_MAX_EVENTS;
+
+  while(n < max_events && pack_next(&next, &event, &type))
+  {
+    secs = rtc_to_seconds(&event->time);
+    reserved = pack_reserved(event);
+
+    cost = pack_varint_len(event->data);
+    if(type == PACK_TYPE_OTHER) cost++;
+    if(reserved) cost += pack_varint_len(reserved);
+    if(n) cost += pack_varint_len(pack_zigzag(secs - prev));
+
+    /* bitmaps grow with every event */
+    if(PACK_BASE_LEN + (2 * (n + 1) + 7) / 8 + (n + 1 + 7) / 8 + varints + cost > cap) break;
+
+    varints += cost;
+    prev = secs;
+    n++;
+    *iter = next;
+  }
+
+  return n;
+}
+
+uint32_t pack_events(eb_iter_t * iter, uint32_t num_events, uint8_t * out)
+{
+  eb_iter_t pass;
+  const event_t * event;
+  uint8_t type;
+  uint32_t i, pos, secs, prev = 0, reserved;
+  uint32_t types_len = (2 * num_events + 7) / 8;
+  uint32_t flags_len = (num_events + 7) / 8;
+
+  if(!num_events) return 0;
+
+  /* base */
+  pass = *iter;
+  pack_next(&pass, &event, &type);
+  secs = rtc_to_seconds(&event->time);
+  out[0] = secs;
+  out[1] = secs >> 8;
+  out[2] = secs >> 16;
+  out[3] = secs >> 24;
+  out[4] = event->time.dow;
+  pos = PACK_BASE_LEN;
+
+  /* types and reserved flags */
+  memset(out + pos, 0, types_len + flags_len);
+  pass = *iter;
+  for(i = 0; i < num_events; i++)
+  {
+    pack_next(&pass, &event, &type);
+    out[pos + i / 4] |= type << (2 * (i % 4));
+    if(pack_reserved(event)) out[pos + types_len + i / 8] |= 1 << (i % 8);
+  }
+  pos += types_len + flags_len;
+
+  /* other types */
+  pass = *iter;
+  for(i = 0; i < num_events; i++)
+  {
+    pack_next(&pass, &event, &type);
+    if(type == PACK_TYPE_OTHER) out[pos++] = event->event_type;
+  }
+
+  /* reserved */
+  pass = *iter;
+  for(i = 0; i < num_events; i++)
+  {
+    pack_next(&pass, &event, &type);
+    reserved = pack_reserved(event);
+    if(reserved) pos += pack_varint(out + pos, reserved);
+  }
+
+  /* time deltas */
+  pass = *iter;
+  for(i = 0; i < num_events; i++)
+  {
+    pack_next(&pass, &event, &type);
+    secs = rtc_to_seconds(&event->time);
+    if(i) pos += pack_varint(out + pos, pack_zigzag(secs - prev));
+    prev = secs;
+  }
+
+  /* data */
+  pass = *iter;
+  for(i = 0; i < num_events; i++)
+  {
+    pack_next(&pass, &event, &type);
+    pos += pack_varint(out + pos, event->data);
+  }
+
+  *iter = pass;
+
+  return pos;
+}
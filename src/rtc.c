@@ -35,3 +35,18 @@ rtc_t rtc_get_time()
   ret.second = (RTC_C->TIM0 & RTC_C_TIM0_SEC_MASK) >> RTC_C_TIM0_SEC_OFS;
   return ret;
 }
+
+uint32_t rtc_to_seconds(const rtc_t * time)
+{
+  if(time->year < 2000) return 0;
+
+  /* days since 0000/03/01, counting years from March puts the leap day last */
+  uint32_t y = time->year - (time->month <= 2);
+  uint32_t m = (time->month + 9) % 12;
+  uint32_t days = 365 * y + y / 4 - y / 100 + y / 400 + (153 * m + 2) / 5 + time->day - 1;
+
+  /* days from 0000/03/01 to 2000/01/01 */
+  days -= 730425;
+
+  return ((days * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file seal.c
+ * @brief Encrypted sessions and sealed frames
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include <string.h>
+#include "aes.h"
+#include "seal.h"
+
+_Static_assert(SESSION_KEY_LEN == AES_KEY_LEN, "session key is an AES-256 key");
+_Static_assert(SESSION_NONCE_LEN == AES_BLOCK_LEN, "nonces are one block");
+
+/* the gathered response, type first */
+static uint8_t seal_plain[AES_ROUND_UP(1 + SEAL_MAX_PAYLOAD)] __attribute__((aligned(4)));
+
+/* seq little endian, then zeros */
+static void seal_iv(uint32_t seq, uint8_t * iv)
+{
+  memset(iv, 0, AES_BLOCK_LEN);
+  iv[0] = seq;
+  iv[1] = seq >> 8;
+}
+
+void seal_derive(seal_t * seal, const aes_ctx_t * device, const uint8_t * app_nonce, const uint8_t * dev_nonce)
+{
+  uint8_t key[AES_KEY_LEN];
+
+  aes_encrypt(device, app_nonce, key);
+  aes_encrypt(device, dev_nonce, key + AES_BLOCK_LEN);
+  aes_init(&seal->aes, key);
+  seal->seq = 0;
+
+  memset(key, 0, sizeof(key));
+}
+
+uint8_t seal_frame(seal_t * seal, uint8_t pkt_type, const sg_seg_t * segs, uint8_t num_segs, uint8_t * out,
+                   uint32_t * len)
+{
+  uint8_t iv[AES_BLOCK_LEN];
+  uint32_t i, pos = 1;
+
+  if(seal->seq >= SEAL_MAX_SEQ) return 0;
+  for(i = 0; i < num_segs; i++) pos += segs[i].len;
+  if(pos > 1 + SEAL_MAX_PAYLOAD) return 0;
+
+  /* gather first, the segments may be in out */
+  seal_plain[0] = pkt_type;
+  for(i = 0, pos = 1; i < num_segs; i++)
+  {
+    memcpy(seal_plain + pos, segs[i].ptr, segs[i].len);
+    pos += segs[i].len;
+  }
+
+  out[0] = seal->seq;
+  out[1] = seal->seq >> 8;
+  seal_iv(seal->seq++, iv);
+  aes_ofb(&seal->aes, iv, seal_plain, out + SEAL_HDR_LEN, pos);
+  *len = SEAL_HDR_LEN + pos;
+
+  return 1;
+}
+
+uint8_t seal_open(const seal_t * seal, const uint8_t * in, uint32_t len, uint8_t * pkt_type, uint8_t * out,
+                  uint32_t * out_len)
+{
+  uint8_t iv[AES_BLOCK_LEN], plain[AES_ROUND_UP(1 + SEAL_MAX_PAYLOAD)] __attribute__((aligned(4)));
+
+  if(len < SEAL_OVERHEAD || len > PKT_MAX_PAYLOAD) return 0;
+
+  seal_iv(in[0] | (in[1] << 8), iv);
+  aes_ofb(&seal->aes, iv, in + SEAL_HDR_LEN, plain, len - SEAL_HDR_LEN);
+  *pkt_type = plain[0];
+  *out_len = len - SEAL_OVERHEAD;
+  memcpy(out, plain + 1, *out_len);
+
+  return 1;
+}
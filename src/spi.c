@@ -11,6 +11,7 @@
  */
 
 #include "msp.h"
+#include "helpers.h"
 #include "spi.h"
 
 void spi_init()
@@ -34,7 +35,7 @@ void spi_init()
   EUSCI_B0->CTLW0 &= ~(EUSCI_B_CTLW0_SWRST); /* enable */
 }
 
-void spi_write(uint8_t addr, uint8_t data)
+RAMFUNC void spi_write(uint8_t addr, uint8_t data)
 {
   /* wait for idle */
   while(EUSCI_B0->STATW & EUSCI_B_STATW_SPI_BUSY);
@@ -54,7 +55,7 @@ void spi_write(uint8_t addr, uint8_t data)
   P3->OUT |= BIT0;
 }
 
-uint8_t spi_read(uint8_t addr)
+RAMFUNC uint8_t spi_read(uint8_t addr)
 {
   uint8_t ret;
 
@@ -81,3 +82,42 @@ uint8_t spi_read(uint8_t addr)
 
   return ret;
 }
+
+RAMFUNC void spi_read_burst(uint8_t addr, uint8_t * ptr_data, uint8_t len)
+{
+  uint8_t i;
+
+  /* wait for idle */
+  while(EUSCI_B0->STATW & EUSCI_B_STATW_SPI_BUSY);
+
+  /* select chip */
+  P3->OUT &= ~(BIT0);
+
+  /* send address with read and multi-byte bits */
+  while(!(EUSCI_B0->IFG & EUSCI_B_IFG_TXIFG));
+  EUSCI_B0->TXBUF = BIT7 | BIT6 | addr;
+
+  /* discard the byte clocked in with the address */
+  while(!(EUSCI_B0->IFG & EUSCI_B_IFG_RXIFG));
+  ptr_data[0] = EUSCI_B0->RXBUF;
+
+  /* clock in each register */
+  for(i = 0; i < len; i++)
+  {
+    EUSCI_B0->TXBUF = 0;
+    while(!(EUSCI_B0->IFG & EUSCI_B_IFG_RXIFG));
+    ptr_data[i] = EUSCI_B0->RXBUF;
+  }
+
+  /* deselect chip */
+  while(EUSCI_B0->STATW & EUSCI_B_STATW_SPI_BUSY);
+  P3->OUT |= BIT0;
+}
+
+uint16_t spi_read_double(uint8_t addr)
+{
+  uint8_t data[2];
+  spi_read_burst(addr, data, 2);
+
+  return (data[1] << 8) | data[0];
+}
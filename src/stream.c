@@ -0,0 +1,248 @@
+/**
+ * @file stream.c
+ * @brief Live accelerometer stream over Bluetooth
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/12
+ */
+
+#include "msp.h"
+#include "helpers.h"
+#include "adxl345.h"
+#include "codec.h"
+#include "spi.h"
+#include "stream.h"
+#include "trace.h"
+#include "uart.h"
+
+static uint8_t mode = STREAM_OFF;
+static uint8_t rate;
+static uint8_t old_bw_rate; /* BW_RATE before the stream started */
+static uint8_t want_decimation; /* asked for */
+static uint8_t decimation; /* in use, raised while the link is behind */
+static uint8_t frames[2][STREAM_FRAME_LEN];
+static res_stream_t hdrs[2];
+static uint8_t fill; /* frame being filled, the other may be going out */
+static uint32_t fill_len; /* sample bytes in it */
+static uint8_t held; /* the fill frame is full and waiting for the link */
+static uint8_t waited; /* the held frame could not go straight away */
+static uint8_t skip; /* samples to pass over before the next one sent */
+static uint32_t dropped; /* sensor samples thrown away since the last frame began */
+static uint8_t flags; /* for the next frame */
+static uint16_t seq;
+static uint8_t clean; /* frames in a row sent without waiting */
+static int16_t last_z;
+static uint8_t have_z;
+
+/* integer square root of x^2 + y^2 + z^2, at most 56755 */
+static uint16_t stream_magnitude(const uint8_t * raw)
+{
+  int32_t x = (int16_t)(raw[0] | (raw[1] << 8));
+  int32_t y = (int16_t)(raw[2] | (raw[3] << 8));
+  int32_t z = (int16_t)(raw[4] | (raw[5] << 8));
+  uint32_t sq = (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z), root = 0, bit = 1u << 30;
+
+  while(bit > sq) bit >>= 2;
+  while(bit)
+  {
+    if(sq >= root + bit)
+    {
+      sq -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+static void stream_set_decimation(uint8_t n)
+{
+  if(n == decimation) return;
+
+  decimation = n;
+  TRACE2(TRC_STREAM, mode, decimation);
+}
+
+static void stream_begin_frame()
+{
+  res_stream_t * hdr = &hdrs[fill];
+
+  hdr->dropped = (dropped > 0xFFFF) ? 0xFFFF : dropped;
+  hdr->mode = mode;
+  hdr->rate = rate;
+  hdr->decimation = decimation;
+  hdr->flags = flags;
+  dropped = 0;
+  flags = 0;
+  fill_len = 0;
+  skip = 0;
+}
+
+/* sends the held frame if the link is free */
+static void stream_send()
+{
+  sg_seg_t seg;
+  uint32_t len;
+
+  if(!held) return;
+
+  if(uart_tx_busy(UART_NUM_BT))
+  {
+    /* behind, send fewer samples from the next frame on */
+    if(!waited)
+    {
+      waited = 1;
+      clean = 0;
+      stream_set_decimation((decimation > STREAM_MAX_DECIMATION / 2) ? STREAM_MAX_DECIMATION : decimation * 2);
+    }
+    return;
+  }
+
+  hdrs[fill].seq = seq;
+  codec_encode(PKT_RES_STREAM, &hdrs[fill], frames[fill], STREAM_HDR_LEN, &len);
+  seg.ptr = frames[fill];
+  seg.len = len + STREAM_SAMPLES_LEN;
+  if(!uart_send_sg_start(UART_NUM_BT, PKT_RES_STREAM, &seg, 1)) return;
+  seq++;
+
+  /* caught up, try a lower decimation */
+  if(!waited && decimation > want_decimation && ++clean >= STREAM_RECOVER_FRAMES)
+  {
+    clean = 0;
+    stream_set_decimation((decimation / 2 < want_decimation) ? want_decimation : decimation / 2);
+  }
+
+  held = 0;
+  waited = 0;
+  fill ^= 1;
+  stream_begin_frame();
+}
+
+uint8_t stream_start(uint8_t new_mode, uint8_t new_rate, uint8_t new_decimation)
+{
+  if(new_mode == STREAM_OFF)
+  {
+    stream_stop();
+    return 1;
+  }
+
+  /* check inputs */
+  if(new_mode >= STREAM_NUM_MODES || new_rate < STREAM_RATE_MIN || new_rate > STREAM_RATE_MAX) return 0;
+
+  /* going through bypass empties the FIFO */
+  if(mode == STREAM_OFF) old_bw_rate = spi_read(ADXL_BW_RATE);
+  spi_write(ADXL_FIFO_CTL, ADXL_FIFO_CTL_BYPASS);
+  spi_write(ADXL_BW_RATE, (old_bw_rate & ~ADXL_BW_RATE_MASK) | new_rate);
+  spi_write(ADXL_FIFO_CTL, ADXL_FIFO_CTL_STREAM);
+
+  mode = new_mode;
+  rate = new_rate;
+  want_decimation = new_decimation ? new_decimation : 1;
+  decimation = want_decimation;
+  held = 0;
+  waited = 0;
+  dropped = 0;
+  flags = 0;
+  seq = 0;
+  clean = 0;
+  have_z = 0;
+  stream_begin_frame();
+  TRACE2(TRC_STREAM, mode, decimation);
+
+  return 1;
+}
+
+void stream_stop()
+{
+  if(mode == STREAM_OFF) return;
+
+  /* a frame going out finishes from its own buffer */
+  spi_write(ADXL_FIFO_CTL, ADXL_FIFO_CTL_BYPASS);
+  spi_write(ADXL_BW_RATE, old_bw_rate);
+  mode = STREAM_OFF;
+  held = 0;
+  have_z = 0;
+  TRACE2(TRC_STREAM, STREAM_OFF, 0);
+}
+
+uint8_t stream_active()
+{
+  return mode != STREAM_OFF;
+}
+
+void stream_poll()
+{
+  uint8_t entries, scratch[ADXL_SAMPLE_LEN], * raw;
+  uint16_t mag;
+
+  if(mode == STREAM_OFF) return;
+
+  stream_send();
+
+  /* take what the FIFO holds now, anything newer waits for the next loop */
+  entries = spi_read(ADXL_FIFO_STATUS) & ADXL_FIFO_STATUS_ENTRIES;
+  if(entries >= ADXL_FIFO_DEPTH)
+  {
+    /* samples may have been pushed out while the loop was busy */
+    if(held) flags |= STREAM_FLAG_FIFO_FULL;
+    else hdrs[fill].flags |= STREAM_FLAG_FIFO_FULL;
+  }
+
+  for(; entries; entries--)
+  {
+    /* x, y and z go straight into the frame when sent as they are */
+    raw = (!held && !skip && mode == STREAM_XYZ) ? &frames[fill][STREAM_HDR_LEN + fill_len] : scratch;
+
+    /* one burst pops one FIFO entry, keep the tap interrupt out of it */
+    BEGIN_CRITICAL_SECTION();
+    spi_read_burst(ADXL_DATAX0, raw, ADXL_SAMPLE_LEN);
+    END_CRITICAL_SECTION();
+    last_z = (int16_t)(raw[4] | (raw[5] << 8));
+    have_z = 1;
+
+    if(held)
+    {
+      dropped++;
+      continue;
+    }
+    if(skip)
+    {
+      skip--;
+      continue;
+    }
+    skip = decimation - 1;
+
+    if(mode == STREAM_MAG)
+    {
+      mag = stream_magnitude(raw);
+      frames[fill][STREAM_HDR_LEN + fill_len] = mag;
+      frames[fill][STREAM_HDR_LEN + fill_len + 1] = mag >> 8;
+      fill_len += sizeof(uint16_t);
+    }
+    else
+    {
+      fill_len += ADXL_SAMPLE_LEN;
+    }
+
+    if(fill_len == STREAM_SAMPLES_LEN)
+    {
+      held = 1;
+      stream_send();
+    }
+  }
+}
+
+uint8_t stream_get_z(int16_t * z)
+{
+  if(mode == STREAM_OFF || !have_z) return 0;
+
+  *z = last_z;
+  return 1;
+}
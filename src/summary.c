@@ -0,0 +1,90 @@
+/**
+ * @file summary.c
+ * @brief Running aggregates of recorded events
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/10
+ */
+
+#include "helpers.h"
+#include "packets.h"
+#include "summary.h"
+
+static uint16_t lost;
+static uint32_t count[SUMMARY_NUM_TYPES];
+static uint32_t records[SUMMARY_NUM_TYPES];
+static uint32_t max_severity[SUMMARY_NUM_TYPES];
+static uint64_t sum_severity[SUMMARY_NUM_TYPES];
+static rtc_t first;
+static rtc_t last;
+static uint16_t hour_hist[SUMMARY_HOURS];
+
+void summary_init()
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  lost = 0;
+  memset(count, 0, sizeof(count));
+  memset(records, 0, sizeof(records));
+  memset(max_severity, 0, sizeof(max_severity));
+  memset(sum_severity, 0, sizeof(sum_severity));
+  memset(&first, 0, sizeof(first));
+  memset(&last, 0, sizeof(last));
+  memset(hour_hist, 0, sizeof(hour_hist));
+
+  __set_PRIMASK(primask);
+}
+
+void summary_add(const event_t * event, uint8_t stored)
+{
+  uint8_t type = event->event_type;
+  uint8_t hour = event->time.hour;
+  /* a coalesced record stands for every trigger merged into it */
+  uint32_t triggers = event->reserved[0] ? event->reserved[0] : 1;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if(!stored) lost = (lost + triggers > 0xFFFF) ? 0xFFFF : lost + triggers;
+
+  if(type < SUMMARY_NUM_TYPES)
+  {
+    count[type] += triggers;
+    records[type]++;
+    if(event->data > max_severity[type]) max_severity[type] = event->data;
+    sum_severity[type] += event->data;
+  }
+
+  if(!first.year) first = event->time;
+  last = event->time;
+  if(hour < SUMMARY_HOURS)
+  {
+    hour_hist[hour] = (hour_hist[hour] + triggers > 0xFFFF) ? 0xFFFF : hour_hist[hour] + triggers;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+void summary_get(res_summary_t * ptr_summary)
+{
+  uint32_t i;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  ptr_summary->lost = lost;
+  for(i = 0; i < SUMMARY_NUM_TYPES; i++)
+  {
+    ptr_summary->count[i] = (count[i] > 0xFFFF) ? 0xFFFF : count[i];
+    ptr_summary->max_severity[i] = max_severity[i];
+    ptr_summary->mean_severity[i] = records[i] ? sum_severity[i] / records[i] : 0;
+  }
+  ptr_summary->first = first;
+  ptr_summary->last = last;
+  memcpy(ptr_summary->hour_hist, hour_hist, sizeof(hour_hist));
+
+  __set_PRIMASK(primask);
+}
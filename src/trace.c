@@ -0,0 +1,48 @@
+/**
+ * @file trace.c
+ * @brief Binary trace ring for the on-board UART
+ *
+ * For CSCI 4830-019 Wireless X final project
+ *
+ * @author Christopher Morroni
+ * @date 2018/05/04
+ */
+
+#include "helpers.h"
+#include "trace.h"
+#include "uart.h"
+
+trace_t trace;
+
+void trace_init()
+{
+  cycle_counter_init();
+
+  trace.head = 0;
+  trace.tail = 0;
+  trace.drain_off = 0;
+  trace.dropped = 0;
+  trace.seq = 0;
+}
+
+void trace_drain()
+{
+  trace_rec_t * rec;
+  uint32_t len;
+
+  while(trace.tail != trace.head)
+  {
+    rec = &trace.recs[trace.tail & (TRACE_BUF_LEN - 1)];
+
+    /* only send the arguments the record uses */
+    len = sizeof(trace_rec_t) - (TRACE_MAX_ARGS - rec->nargs) * sizeof(uint32_t);
+
+    if(!uart_send_nonblocking(UART_NUM_LOG, *((uint8_t *)rec + trace.drain_off))) return;
+
+    if(++trace.drain_off == len)
+    {
+      trace.drain_off = 0;
+      trace.tail++;
+    }
+  }
+}
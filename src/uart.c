@@ -13,10 +13,105 @@
 
 #include "msp.h"
 #include "circbuf.h"
+#include "codec.h"
+#include "crc.h"
+#include "hal.h"
 #include "helpers.h"
 #include "packets.h"
 #include "uart.h"
 
+/*
+ * @brief COBS encoder state, v3 and up
+ */
+typedef enum
+{
+  COBS_OFF = 0, /* not encoding, or frame finished */
+  COBS_LEAD, /* leading delimiter */
+  COBS_CODE, /* code byte of the next block */
+  COBS_DATA, /* bytes of the block */
+  COBS_DELIM /* closing delimiter */
+} cobs_tx_e;
+
+/*
+ * @brief transmit engine state
+ */
+typedef struct
+{
+  sg_seg_t segs[UART_SG_MAX_SEGS + 2]; /* header, payload, trailer */
+  uint8_t hdr[2];
+  uint8_t trailer[4];
+  uint8_t num_segs;
+  uint8_t seg; /* segment being sent */
+  uint32_t off; /* offset in the segment */
+  uint8_t version;
+  uint8_t checksum; /* v1 running XOR */
+  uint32_t crc; /* v2 and up running CRC32 */
+  uint8_t cobs; /* cobs_tx_e */
+  uint8_t run; /* bytes left in the COBS block */
+  uint8_t run_full; /* COBS block has no implied zero */
+  volatile uint8_t busy;
+} tx_engine_t;
+
+/*
+ * @brief EUSCI_A divider settings, with oversampling
+ */
+typedef struct
+{
+  uint16_t brw; /* UCBRx */
+  uint8_t brf; /* UCBRFx */
+  uint8_t brs; /* UCBRSx */
+} uart_div_t;
+
+/* in baud_rate_e order, from the eUSCI baud rate calculation in the
+   MSP432P4xx technical reference manual */
+#if SMCLK_HZ == 3000000
+static const uart_div_t div_table[BAUD_NUM_RATES] =
+{
+  { 0x14, 0x4, 0x22 }, /* 9600, setting the board has always used */
+  { 0x09, 0xC, 0x22 }, /* 19200 */
+  { 0x04, 0xE, 0x08 }, /* 38400 */
+  { 0x03, 0x4, 0x02 }, /* 57600 */
+  { 0x01, 0xA, 0x00 }  /* 115200 */
+};
+#elif SMCLK_HZ == 12000000
+static const uart_div_t div_table[BAUD_NUM_RATES] =
+{
+  { 0x4E, 0x2, 0x00 }, /* 9600 */
+  { 0x27, 0x1, 0x00 }, /* 19200 */
+  { 0x13, 0x8, 0x55 }, /* 38400 */
+  { 0x0D, 0x0, 0x25 }, /* 57600 */
+  { 0x06, 0x8, 0x20 }  /* 115200 */
+};
+#elif SMCLK_HZ == 24000000
+static const uart_div_t div_table[BAUD_NUM_RATES] =
+{
+  { 0x9C, 0x4, 0x00 }, /* 9600 */
+  { 0x4E, 0x2, 0x00 }, /* 19200 */
+  { 0x27, 0x1, 0x00 }, /* 38400 */
+  { 0x1A, 0x0, 0xB6 }, /* 57600 */
+  { 0x0D, 0x0, 0x25 }  /* 115200 */
+};
+#else
+#error "no UART divider table for this SMCLK_HZ"
+#endif
+
+static uint8_t proto_version = PROTO_VERSION_XOR;
+static uint8_t bt_rate = BAUD_9600;
+static tx_engine_t tx_engines[2];
+
+/* wait for the frame in progress to finish */
+static void uart_tx_wait(uint8_t uart_num)
+{
+  /* the on-board UART has no interrupt, and inside an interrupt the
+     Bluetooth one may not run, so drive those by polling */
+  uint8_t poll = (uart_num == 0) || __get_IPSR();
+
+  while(tx_engines[uart_num].busy)
+  {
+    if(poll) uart_tx_isr(uart_num);
+  }
+}
+
 void uart_init(cb_t ** ptr_uart_rx_buf)
 {
   /* initialize RX buffer */
@@ -25,52 +120,80 @@ void uart_init(cb_t ** ptr_uart_rx_buf)
   /* UART0 for logging */
   P1->SEL0 |= BIT3 | BIT2; /* UART mode */
   P1->SEL1 &= ~(BIT3 | BIT2);
-  EUSCI_A0->CTLW0 |= EUSCI_A_CTLW0_SWRST; /* disable */
-  EUSCI_A0->CTLW0 = EUSCI_A_CTLW0_SSEL__SMCLK | /* SMCLK as source */
-                    EUSCI_A_CTLW0_SWRST; /* keep disabled */
-  EUSCI_A0->BRW = 0x14; /* 9600 BAUD */
-  EUSCI_A0->MCTLW = 0x22 << EUSCI_A_MCTLW_BRS_OFS |
-                    0x4 << EUSCI_A_MCTLW_BRF_OFS |
-                    EUSCI_A_MCTLW_OS16; /* enable oversampling */
-  EUSCI_A0->CTLW0 &= ~(EUSCI_A_CTLW0_SWRST); /* enable */
+  uart_set_baud(UART_NUM_LOG, BAUD_9600);
 
   /* UART1 for Bluetooth */
   P3->SEL0 |= BIT3 | BIT2; /* UART mode */
   P3->SEL1 &= ~(BIT3 | BIT2);
-  EUSCI_A2->CTLW0 |= EUSCI_A_CTLW0_SWRST; /* disable */
-  EUSCI_A2->CTLW0 = EUSCI_A_CTLW0_SSEL__SMCLK | /* SMCLK as source */
-                    EUSCI_A_CTLW0_SWRST; /* stay disabled */
-  EUSCI_A2->BRW = 0x14; /* 9600 BAUD */
-  EUSCI_A2->MCTLW = 0x22 << EUSCI_A_MCTLW_BRS_OFS |
-                    0x4 << EUSCI_A_MCTLW_BRF_OFS |
-                    EUSCI_A_MCTLW_OS16; /* enable oversampling */
-  EUSCI_A2->CTLW0 &= ~(EUSCI_A_CTLW0_SWRST); /* enable */
-  EUSCI_A2->IE = EUSCI_A_IE_RXIE; /* enable interrupts */
+  uart_set_baud(UART_NUM_BT, BAUD_9600);
   NVIC_EnableIRQ(EUSCIA2_IRQn);
   __enable_interrupts();
 }
 
-void uart_send_blocking(uint8_t uart_num, uint8_t data)
+uint8_t uart_set_baud(uint8_t uart_num, uint8_t rate)
 {
-  if(uart_num == 0)
-  {
-    /* wait for UART to be idle */
-    while(!(EUSCI_A0->IFG & EUSCI_A_IFG_TXIFG));
+  /* check inputs */
+  if(uart_num > 1 || rate >= BAUD_NUM_RATES) return 0;
 
-    EUSCI_A0->TXBUF = data;
-  }
-  else if(uart_num == 1)
-  {
-    /* wait for UART to be idle */
-    while(!(EUSCI_A2->IFG & EUSCI_A_IFG_TXIFG));
+  const uart_div_t * div = &div_table[rate];
+  EUSCI_A_Type * uart = (uart_num == 0) ? EUSCI_A0 : EUSCI_A2;
+
+  /* let the last byte leave the shift register */
+  uart_tx_wait(uart_num);
+  while(hal_uart_busy(uart_num));
+
+  uart->CTLW0 |= EUSCI_A_CTLW0_SWRST; /* disable */
+  uart->CTLW0 = EUSCI_A_CTLW0_SSEL__SMCLK | /* SMCLK as source */
+                EUSCI_A_CTLW0_SWRST; /* stay disabled */
+  uart->BRW = div->brw;
+  uart->MCTLW = div->brs << EUSCI_A_MCTLW_BRS_OFS |
+                div->brf << EUSCI_A_MCTLW_BRF_OFS |
+                EUSCI_A_MCTLW_OS16; /* enable oversampling */
+  uart->CTLW0 &= ~(EUSCI_A_CTLW0_SWRST); /* enable */
 
-    EUSCI_A2->TXBUF = data;
+  /* reset clears the interrupt enables */
+  if(uart_num == 1)
+  {
+    EUSCI_A2->IE = EUSCI_A_IE_RXIE;
+    bt_rate = rate;
   }
+
+  return 1;
 }
 
-void uart_send_n_blocking(uint8_t uart_num, uint8_t * ptr_data, uint8_t len)
+uint8_t uart_get_baud()
 {
-  uint8_t i;
+  return bt_rate;
+}
+
+void uart_send_blocking(uint8_t uart_num, uint8_t data)
+{
+  /* check inputs */
+  if(uart_num > 1) return;
+
+  /* don't interleave with a frame in progress */
+  uart_tx_wait(uart_num);
+
+  /* wait for UART to be idle */
+  while(!hal_uart_tx_ready(uart_num));
+
+  hal_uart_tx(uart_num, data);
+}
+
+uint8_t uart_send_nonblocking(uint8_t uart_num, uint8_t data)
+{
+  if(uart_num > 1 || uart_tx_busy(uart_num)) return 0;
+
+  if(!hal_uart_tx_ready(uart_num)) return 0;
+
+  hal_uart_tx(uart_num, data);
+
+  return 1;
+}
+
+void uart_send_n_blocking(uint8_t uart_num, uint8_t * ptr_data, uint32_t len)
+{
+  uint32_t i;
   for(i = 0; i < len; i++)
   {
     uart_send_blocking(uart_num, ptr_data[i]);
@@ -80,25 +203,14 @@ void uart_send_n_blocking(uint8_t uart_num, uint8_t * ptr_data, uint8_t len)
 void uart_send_str_blocking(uint8_t uart_num, uint8_t * data)
 {
   uint32_t i;
-  if(uart_num == 0)
-  {
-    for(i = 0; *(data + i); i++)
-    {
-      /* wait for UART to be idle */
-      while(!(EUSCI_A0->IFG & EUSCI_A_IFG_TXIFG));
+  if(uart_num > 1) return;
 
-      EUSCI_A0->TXBUF = *(data + i);
-    }
-  }
-  else if(uart_num == 1)
+  for(i = 0; *(data + i); i++)
   {
-    for(i = 0; *(data + i); i++)
-    {
-      /* wait for UART to be idle */
-      while(!(EUSCI_A2->IFG & EUSCI_A_IFG_TXIFG));
+    /* wait for UART to be idle */
+    while(!hal_uart_tx_ready(uart_num));
 
-      EUSCI_A2->TXBUF = *(data + i);
-    }
+    hal_uart_tx(uart_num, *(data + i));
   }
 }
 
@@ -111,14 +223,262 @@ void uart_send_int_blocking(uint8_t uart_num, int32_t data)
 
 void uart_send_pkt(uint8_t uart_num, pkt_t * ptr_pkt)
 {
-  uart_send_blocking(uart_num, ptr_pkt->type);
-  uart_send_blocking(uart_num, ptr_pkt->pkt_len);
+  sg_seg_t seg;
+  seg.ptr = ptr_pkt->ptr_pkt;
+  seg.len = ptr_pkt->pkt_len;
+
+  uart_send_sg(uart_num, ptr_pkt->type, &seg, 1);
+}
+
+/* fold a segment into the checksum, or fill in the trailer */
+static RAMFUNC void uart_tx_fold(tx_engine_t * tx, uint8_t i)
+{
+  sg_seg_t * seg = &tx->segs[i];
+  uint32_t crc;
+
+  if(i == tx->num_segs - 1)
+  {
+    /* trailer */
+    if(tx->version >= PROTO_VERSION_CRC32)
+    {
+      crc = CRC32_FINAL(tx->crc);
+      tx->trailer[0] = crc;
+      tx->trailer[1] = crc >> 8;
+      tx->trailer[2] = crc >> 16;
+      tx->trailer[3] = crc >> 24;
+    }
+    else
+    {
+      tx->trailer[0] = tx->checksum;
+    }
+  }
+  else if(tx->version >= PROTO_VERSION_CRC32)
+  {
+    tx->crc = crc32_update(tx->crc, seg->ptr, seg->len);
+  }
+  else
+  {
+    tx->checksum = my_checksum(tx->checksum, (uint8_t *)seg->ptr, seg->len);
+  }
+}
+
+/* move to the next non-empty segment */
+static RAMFUNC void uart_tx_enter_seg(tx_engine_t * tx)
+{
+  while(tx->seg < tx->num_segs && tx->segs[tx->seg].len == 0) tx->seg++;
+
+  /* COBS frames are folded up front */
+  if(tx->seg < tx->num_segs && tx->cobs == COBS_OFF) uart_tx_fold(tx, tx->seg);
+}
+
+/* take the next byte of the unencoded frame */
+static RAMFUNC uint8_t uart_tx_next(tx_engine_t * tx)
+{
+  sg_seg_t * seg = &tx->segs[tx->seg];
+  uint8_t data = seg->ptr[tx->off];
+
+  if(++tx->off == seg->len)
+  {
+    tx->off = 0;
+    tx->seg++;
+    uart_tx_enter_seg(tx);
+  }
+
+  return data;
+}
+
+/* count the non-zero bytes ahead, up to one COBS block */
+static RAMFUNC uint8_t uart_tx_run(tx_engine_t * tx)
+{
+  uint8_t seg = tx->seg, run = 0;
+  uint32_t off = tx->off;
+
+  while(seg < tx->num_segs && run < CODEC_COBS_MAX_RUN)
+  {
+    if(off == tx->segs[seg].len)
+    {
+      seg++;
+      off = 0;
+    }
+    else if(tx->segs[seg].ptr[off] == 0)
+    {
+      break;
+    }
+    else
+    {
+      run++;
+      off++;
+    }
+  }
+
+  return run;
+}
+
+/* next byte of a COBS frame, see codec.h */
+static RAMFUNC uint8_t uart_tx_cobs(tx_engine_t * tx)
+{
+  uint8_t data;
+
+  switch(tx->cobs)
+  {
+    case COBS_LEAD:
+      /* flush whatever the receiver has half decoded */
+      tx->cobs = COBS_CODE;
+      return CODEC_COBS_DELIM;
+    case COBS_CODE:
+      tx->run = uart_tx_run(tx);
+      tx->run_full = (tx->run == CODEC_COBS_MAX_RUN);
+      data = tx->run + 1;
+      break;
+    case COBS_DATA:
+      data = uart_tx_next(tx);
+      tx->run--;
+      break;
+    default:
+      tx->cobs = COBS_OFF;
+      return CODEC_COBS_DELIM;
+  }
+
+  if(tx->run)
+  {
+    tx->cobs = COBS_DATA;
+  }
+  else if(tx->seg == tx->num_segs)
+  {
+    tx->cobs = COBS_DELIM;
+  }
+  else
+  {
+    /* the zero that ended the block is implied by the code byte */
+    if(!tx->run_full) uart_tx_next(tx);
+    tx->cobs = COBS_CODE;
+  }
+
+  return data;
+}
+
+static RAMFUNC void uart_tx_step(uint8_t uart_num)
+{
+  tx_engine_t * tx = &tx_engines[uart_num];
+  if(!tx->busy) return;
+
+  uint8_t data = (tx->cobs == COBS_OFF) ? uart_tx_next(tx) : uart_tx_cobs(tx);
+
+  hal_uart_tx(uart_num, data);
+
+  if(tx->seg == tx->num_segs && tx->cobs == COBS_OFF)
+  {
+    /* frame done */
+    if(uart_num == 1) EUSCI_A2->IE &= ~EUSCI_A_IE_TXIE;
+    tx->busy = 0;
+  }
+}
+
+uint8_t uart_send_sg_start(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs)
+{
+  /* check inputs */
+  if(uart_num > 1 || num_segs > UART_SG_MAX_SEGS || (num_segs && !segs)) return 0;
 
+  tx_engine_t * tx = &tx_engines[uart_num];
+  uint32_t len = 0;
   uint8_t i;
-  for(i = 0; i < ptr_pkt->pkt_len; i++)
+
+  if(tx->busy) return 0;
+
+  for(i = 0; i < num_segs; i++)
+  {
+    len += segs[i].len;
+    tx->segs[i + 1] = segs[i];
+  }
+  if(len > PKT_MAX_PAYLOAD) return 0;
+
+  /* header and trailer segments */
+  tx->hdr[0] = type;
+  tx->hdr[1] = len;
+  tx->segs[0].ptr = tx->hdr;
+  tx->segs[0].len = sizeof(tx->hdr);
+  tx->segs[num_segs + 1].ptr = tx->trailer;
+  tx->segs[num_segs + 1].len = codec_trailer_len(proto_version);
+
+  tx->num_segs = num_segs + 2;
+  tx->seg = 0;
+  tx->off = 0;
+  tx->version = proto_version;
+  tx->checksum = 0;
+  tx->crc = CRC32_INIT;
+  tx->cobs = COBS_OFF;
+
+  if(tx->version >= PROTO_VERSION_COBS)
   {
-    uart_send_blocking(uart_num, ptr_pkt->ptr_pkt[i]);
+    /* the encoder looks ahead into the trailer, so it must be ready */
+    for(i = 0; i < tx->num_segs; i++) uart_tx_fold(tx, i);
+    tx->cobs = COBS_LEAD;
   }
+  uart_tx_enter_seg(tx);
+  tx->busy = 1;
+
+  /* TXIFG is already set, so the interrupt fires straight away */
+  if(uart_num == 1) EUSCI_A2->IE |= EUSCI_A_IE_TXIE;
+
+  return 1;
+}
 
-  uart_send_blocking(uart_num, ptr_pkt->checksum);
+void uart_send_sg(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs)
+{
+  /* check inputs */
+  if(uart_num > 1) return;
+
+  uart_tx_wait(uart_num);
+  if(uart_send_sg_start(uart_num, type, segs, num_segs)) uart_tx_wait(uart_num);
+}
+
+void uart_send_sg_queue(uint8_t uart_num, uint8_t type, const sg_seg_t * segs, uint8_t num_segs)
+{
+  /* check inputs */
+  if(uart_num > 1) return;
+
+  uart_tx_wait(uart_num);
+  uart_send_sg_start(uart_num, type, segs, num_segs);
+
+  /* nothing drives the on-board UART once this returns */
+  if(uart_num == 0) uart_tx_wait(uart_num);
+}
+
+void uart_tx_flush(uint8_t uart_num)
+{
+  if(uart_num > 1) return;
+
+  uart_tx_wait(uart_num);
+}
+
+uint8_t uart_tx_busy(uint8_t uart_num)
+{
+  if(uart_num > 1) return 0;
+
+  return tx_engines[uart_num].busy;
+}
+
+RAMFUNC void uart_tx_isr(uint8_t uart_num)
+{
+  if(!hal_uart_tx_ready(uart_num)) return;
+
+  uart_tx_step(uart_num);
+}
+
+void uart_set_proto_version(uint8_t version)
+{
+  if(version < PROTO_VERSION_XOR) version = PROTO_VERSION_XOR;
+  if(version > PROTO_VERSION_MAX) version = PROTO_VERSION_MAX;
+
+  proto_version = version;
+}
+
+uint8_t uart_get_proto_version()
+{
+  return proto_version;
+}
+
+uint8_t uart_trailer_len()
+{
+  return codec_trailer_len(proto_version);
 }